@@ -0,0 +1,7 @@
+# PlatformIO extra script for [env:fuzz]: libFuzzer needs clang, and the
+# sanitizers have to be linked as well as compiled in.
+Import("env")
+
+sanitizers = "-fsanitize=fuzzer,address,undefined"
+env.Replace(CC="clang", CXX="clang++", LINK="clang++")
+env.Append(CCFLAGS=[sanitizers, "-fno-sanitize-recover=undefined"], LINKFLAGS=[sanitizers])
@@ -0,0 +1,1012 @@
+/*
+   Sterilizer host tools - fleet load generator
+
+   Emulates a fleet of Sterilizer props against a real broker to see how it
+   copes with every prop in the building at once, and with all of them
+   reconnecting together after a power blip. Virtual prop <n> is named
+   <name>-<n> and behaves as the sketch does on the wire (src/main.cpp,
+   src/commands.cpp, src/telemetry.cpp):
+
+     - connects with a clean session and its name as client ID, subscribes
+       to ToDevice/<name>-<n> and retries 5 s after a failed connect
+     - sends PINGREQ every keep-alive period
+     - publishes a burst of stats lines on ToHost/<name>-<n>/stats every
+       stats interval
+     - answers "ping <token>" with a pong and any other command with
+       "ack <id> <command> ok" on ToHost/<name>-<n>
+
+   Each thread runs one epoll loop for its share of the props and a prober
+   client that subscribes to their ToHost topics and sends pings and
+   commands at --rate, timing each to its pong or ack: host -> broker ->
+   prop -> broker -> host, as tools/rtt_probe.py does for real props.
+
+   For each fleet size the fleet grows to that size at --ramp connects a
+   second, is probed for --duration seconds and then, unless --no-storm,
+   every prop drops its connection at once and comes back within
+   --storm-jitter ms. Reported per size: CONNACK and SUBACK times, probe
+   round trips, PINGRESP and (with --qos 1) PUBACK times, and how long the
+   storm took to settle with the CONNACK times under it.
+
+   Usage: fleet_load [options]
+     --broker <host>       broker address (default 10.1.10.55)
+     --port <port>         broker port (default 1883)
+     --sizes <n,n,...>     fleet sizes, run smallest first (default 50,100,200,400)
+     --threads <n>         event loops, each pinned to a core (default: one per core)
+     --name <name>         virtual props are <name>-<n> (default Sterilizer)
+     --ramp <n>            connects a second while the fleet grows (default 200)
+     --duration <s>        seconds of probing at each size (default 30)
+     --rate <n>            probes a second across the fleet (default 100)
+     --commands <f>        share of the probes that are commands (default 0.2)
+     --keepalive <s>       the props' keep-alive (default 15, as PubSubClient)
+     --stats-interval <s>  seconds between a prop's stats bursts (default 60)
+     --stats-lines <n>     lines in a burst (default 21)
+     --qos <0|1>           the props' publishes: 0 as PubSubClient, 1 as esp-mqtt (default 0)
+     --storm-jitter <ms>   spread of the props' return after a storm (default 2000)
+     --no-storm            no reconnect storms
+
+   Linux only. Built by [env:fleet]:
+     pio run -e fleet && .pio/build/fleet/program --sizes 100,200,400,800
+   Each prop is a socket, so large fleets need a matching open file limit
+   (ulimit -n) here and on the broker.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mqtt_codec.h"
+#include "prop_protocol.h"
+
+// Give up on a connect that has not reached SUBACK in this long
+#define CONNECT_TIMEOUT_MS 10000
+// As mqttSetup()'s wait between attempts
+#define RETRY_MS 5000
+// Timer resolution of the event loops
+#define TICK_MS 2
+// Replies later than this after probing stops count as lost
+#define LATE_REPLY_MS 2000
+// Longest a fleet is given to grow or to settle after a storm
+#define SETTLE_TIMEOUT_MS 120000
+
+struct Options {
+  std::string broker;
+  uint16_t port;
+  std::vector<int> sizes;
+  int threads;
+  std::string name;
+  double ramp;
+  double duration;
+  double rate;
+  double commands;
+  int keepalive;
+  double statsInterval;
+  int statsLines;
+  int qos;
+  int stormJitter;
+  bool storm;
+};
+
+static Options options;
+
+// What the main thread tells the event loops
+static std::atomic<int> fleetSize(0);
+static std::atomic<bool> probing(false);
+static std::atomic<unsigned> stormGeneration(0);
+static std::atomic<bool> stopping(false);
+
+static int64_t nowNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// A prop's micros(), for its pongs
+static unsigned long propMicros() {
+  return (uint32_t)(nowNs() / 1000);
+}
+
+// Lines of the sort telemetry.cpp publishes, cycled through for a burst
+static const char* const statsTemplate[] = {
+  "cmd rx=5 run=5 full=0 rate=0 evict=0 unacked=0 late=0 hw=1 ping=0",
+  "lat solve net n=5 max=1 b1=5",
+  "lat solve queue n=5 max=5 b3=5",
+  "link profile=game auto=1 switches=0 game=67 attract=0 overnight=0",
+  "sleep sleeps=0 checks=0 auto=0 last=none slept=0 ready=0",
+  "web assets=0 bytes=0 missing=0 clients=0 sockets=0 commands=0 dropped=0 pushes=0 lost=0",
+  "transport name=pubsub rx=5 tx=19 fail=0 acked=0 dropped=0 connects=3",
+  "idle passes=241 idle=59% timer=228 gpio=0 net=6 wifi=1 event=4 serial=0",
+  "evt posted=6 delivered=6 dropped=0 hw=1",
+};
+
+
+// Measurements
+enum SampleKind {
+  SAMPLE_CONNECT,      // TCP connect to CONNACK
+  SAMPLE_SUBSCRIBE,    // SUBSCRIBE to SUBACK
+  SAMPLE_KEEPALIVE,    // PINGREQ to PINGRESP
+  SAMPLE_PUBACK,       // a QoS 1 publish to its PUBACK
+  SAMPLE_PING,         // probe ping to pong
+  SAMPLE_COMMAND,      // probe command to ack
+  SAMPLE_KINDS
+};
+
+static const char* const sampleNames[SAMPLE_KINDS] = {
+  "connect", "subscribe", "keepalive", "puback", "ping rtt", "command"
+};
+
+struct Samples {
+  std::vector<double> ms[SAMPLE_KINDS];
+  unsigned long pings;
+  unsigned long commands;
+  unsigned long failures;   // connects refused or timed out
+  unsigned long drops;      // connections lost other than by a storm
+  unsigned long statsLines;
+
+  Samples() : pings(0), commands(0), failures(0), drops(0), statsLines(0) {}
+
+  void add(const Samples& other) {
+    for (int kind = 0; kind < SAMPLE_KINDS; kind++) {
+      ms[kind].insert(ms[kind].end(), other.ms[kind].begin(), other.ms[kind].end());
+    }
+    pings += other.pings;
+    commands += other.commands;
+    failures += other.failures;
+    drops += other.drops;
+    statsLines += other.statsLines;
+  }
+};
+
+// Of values already sorted
+static double percentile(const std::vector<double>& values, double fraction) {
+  return values[std::min(values.size() - 1, (size_t)(fraction * values.size()))];
+}
+
+
+// Clients
+enum ClientState {
+  CLIENT_IDLE,         // not yet part of the fleet
+  CLIENT_WAITING,      // to connect at retryAtNs
+  CLIENT_CONNECTING,   // TCP connect under way
+  CLIENT_CONNACK,
+  CLIENT_SUBACK,
+  CLIENT_UP
+};
+
+struct Client {
+  bool prober;
+  int index;
+  std::string name;
+  std::string deviceTopic;
+  std::string hostTopic;
+  std::string statsTopic;
+  std::vector<std::string> filters;
+  MqttLink link;
+  ClientState state;
+  uint32_t watching;         // epoll events registered
+  int64_t stepNs;            // when the connect or subscribe started
+  int64_t retryAtNs;
+  int64_t keepaliveAtNs;
+  int64_t pingreqNs;         // 0 unless a PINGRESP is due
+  int64_t statsAtNs;
+  size_t subacks;
+  uint16_t nextPacketId;
+  std::map<uint16_t, int64_t> unacked;
+
+  Client() : prober(false), index(0), state(CLIENT_IDLE), watching(0), stepNs(0), retryAtNs(0), keepaliveAtNs(0),
+             pingreqNs(0), statsAtNs(0), subacks(0), nextPacketId(1) {}
+};
+
+class Worker {
+public:
+  explicit Worker(int index);
+  ~Worker();
+
+  void run();
+  // The samples since the last call
+  Samples collect();
+
+  std::atomic<int> up;                 // props connected and subscribed
+  std::atomic<bool> proberUp;
+  std::atomic<unsigned> stormSeen;
+  std::atomic<int64_t> lastUpNs;       // when a prop last came up
+
+private:
+  void start(Client& client, int64_t now);
+  void fail(Client& client, int64_t now, bool dropped);
+  void watch(Client& client);
+  void service(Client& client, uint32_t events, int64_t now);
+  void packet(Client& client, const MqttPacket& packet, int64_t now);
+  void propMessage(Client& client, const MqttPacket& packet);
+  void proberMessage(const MqttPacket& packet, int64_t now);
+  void publish(Client& client, const std::string& topic, const std::string& payload, int64_t now);
+  void tick(int64_t now);
+  void tickClient(Client& client, int64_t now);
+  void probe(int64_t now, double elapsedS);
+  void record(SampleKind kind, int64_t fromNs, int64_t now);
+
+  int index;
+  int epoll;
+  std::vector<Client*> props;
+  Client proberClient;
+  std::mt19937 random;
+  double rampCredit;
+  double probeCredit;
+  int64_t lastTickNs;
+  size_t probeNext;
+  std::string message;
+
+  std::mutex lock;
+  Samples samples;
+};
+
+Worker::Worker(int index) : up(0), proberUp(false), stormSeen(0), lastUpNs(0), index(index), epoll(-1),
+                            random(index + 1), rampCredit(0), probeCredit(0), lastTickNs(0), probeNext(0) {
+  int largest = options.sizes.back();
+  for (int n = index; n < largest; n += options.threads) {
+    Client* prop = new Client();
+    prop->index = n;
+    prop->name = options.name + "-" + std::to_string(n + 1);
+    prop->deviceTopic = propDeviceTopic(prop->name);
+    prop->hostTopic = propHostTopic(prop->name);
+    prop->statsTopic = propStatsTopic(prop->name);
+    prop->filters.push_back(prop->deviceTopic);
+    props.push_back(prop);
+    proberClient.filters.push_back(prop->hostTopic);
+  }
+  proberClient.prober = true;
+  proberClient.name = options.name + "-probe-" + std::to_string(index + 1);
+}
+
+Worker::~Worker() {
+  for (size_t i = 0; i < props.size(); i++) {
+    delete props[i];
+  }
+}
+
+Samples Worker::collect() {
+  std::lock_guard<std::mutex> guard(lock);
+  Samples taken;
+  std::swap(taken, samples);
+  return taken;
+}
+
+void Worker::record(SampleKind kind, int64_t fromNs, int64_t now) {
+  std::lock_guard<std::mutex> guard(lock);
+  samples.ms[kind].push_back((now - fromNs) / 1e6);
+}
+
+void Worker::run() {
+  // One loop per core
+  cpu_set_t cores;
+  CPU_ZERO(&cores);
+  CPU_SET(index % std::thread::hardware_concurrency(), &cores);
+  pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+
+  epoll = epoll_create1(EPOLL_CLOEXEC);
+  lastTickNs = nowNs();
+  start(proberClient, lastTickNs);
+
+  struct epoll_event events[256];
+  while (!stopping.load()) {
+    int count = epoll_wait(epoll, events, 256, TICK_MS);
+    int64_t now = nowNs();
+    for (int i = 0; i < count; i++) {
+      Client& client = *(Client*)events[i].data.ptr;
+      service(client, events[i].events, now);
+    }
+    tick(now);
+  }
+
+  // Leave politely, so that the broker is not left holding sessions
+  for (size_t i = 0; i <= props.size(); i++) {
+    Client& client = i < props.size() ? *props[i] : proberClient;
+    if (client.state == CLIENT_UP) {
+      mqttDisconnect(client.link.out);
+      linkFlush(client.link);
+    }
+    linkClose(client.link);
+  }
+  close(epoll);
+}
+
+void Worker::start(Client& client, int64_t now) {
+  client.stepNs = now;
+  client.watching = 0;
+  client.unacked.clear();
+  client.pingreqNs = 0;
+  if (!linkOpen(client.link, options.broker.c_str(), options.port)) {
+    fail(client, now, false);
+    return;
+  }
+  client.state = CLIENT_CONNECTING;
+  watch(client);
+}
+
+void Worker::fail(Client& client, int64_t now, bool dropped) {
+  if (client.state == CLIENT_UP) {
+    if (client.prober) {
+      proberUp = false;
+    }
+    else {
+      up--;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (dropped && client.state == CLIENT_UP) {
+      samples.drops++;
+    }
+    else {
+      samples.failures++;
+    }
+  }
+  // Closing the socket also takes it out of the epoll set
+  linkClose(client.link);
+  client.watching = 0;
+  client.state = CLIENT_WAITING;
+  client.retryAtNs = now + (int64_t)RETRY_MS * 1000000;
+}
+
+void Worker::watch(Client& client) {
+  if (client.link.fd < 0) {
+    return;
+  }
+  uint32_t wanted = EPOLLIN;
+  if (client.state == CLIENT_CONNECTING || !client.link.out.empty()) {
+    wanted |= EPOLLOUT;
+  }
+  if (wanted == client.watching) {
+    return;
+  }
+  struct epoll_event event;
+  event.events = wanted;
+  event.data.ptr = &client;
+  epoll_ctl(epoll, client.watching == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, client.link.fd, &event);
+  client.watching = wanted;
+}
+
+void Worker::service(Client& client, uint32_t events, int64_t now) {
+  if (client.link.fd < 0) {
+    return;
+  }
+  if (client.state == CLIENT_CONNECTING) {
+    if (!linkConnected(client.link)) {
+      fail(client, now, false);
+      return;
+    }
+    mqttConnect(client.link.out, client.name.c_str(), options.keepalive);
+    client.state = CLIENT_CONNACK;
+  }
+  if (events & EPOLLIN) {
+    bool open = linkRead(client.link);
+    MqttPacket received;
+    int result = 0;
+    while (client.link.fd >= 0 && (result = linkNext(client.link, received)) > 0) {
+      packet(client, received, now);
+    }
+    if (client.link.fd < 0) {
+      return;
+    }
+    if (!open || result < 0) {
+      fail(client, now, true);
+      return;
+    }
+  }
+  else if (events & (EPOLLERR | EPOLLHUP)) {
+    fail(client, now, true);
+    return;
+  }
+  if (!linkFlush(client.link)) {
+    fail(client, now, true);
+    return;
+  }
+  watch(client);
+}
+
+void Worker::packet(Client& client, const MqttPacket& packet, int64_t now) {
+  switch (packet.type) {
+    case MQTT_CONNACK:
+      if (client.state != CLIENT_CONNACK || packet.returnCode != 0) {
+        fail(client, now, false);
+        return;
+      }
+      if (!client.prober) {
+        record(SAMPLE_CONNECT, client.stepNs, now);
+      }
+      for (size_t i = 0; i < client.filters.size(); i++) {
+        mqttSubscribe(client.link.out, (uint16_t)(i + 1), client.filters[i].c_str(), options.qos);
+      }
+      client.state = CLIENT_SUBACK;
+      client.stepNs = now;
+      client.subacks = 0;
+      break;
+    case MQTT_SUBACK:
+      if (client.state != CLIENT_SUBACK || packet.returnCode == 0x80) {
+        fail(client, now, false);
+        return;
+      }
+      if (++client.subacks < client.filters.size()) {
+        break;
+      }
+      client.state = CLIENT_UP;
+      client.keepaliveAtNs = now + (int64_t)options.keepalive * 1000000000;
+      client.statsAtNs = now + (int64_t)(options.statsInterval * 1e9);
+      if (client.prober) {
+        proberUp = true;
+      }
+      else {
+        record(SAMPLE_SUBSCRIBE, client.stepNs, now);
+        up++;
+        lastUpNs = now;
+      }
+      break;
+    case MQTT_PINGRESP:
+      if (client.pingreqNs != 0) {
+        record(SAMPLE_KEEPALIVE, client.pingreqNs, now);
+        client.pingreqNs = 0;
+      }
+      break;
+    case MQTT_PUBACK: {
+      std::map<uint16_t, int64_t>::iterator sent = client.unacked.find(packet.packetId);
+      if (sent != client.unacked.end()) {
+        record(SAMPLE_PUBACK, sent->second, now);
+        client.unacked.erase(sent);
+      }
+      break;
+    }
+    case MQTT_PUBLISH:
+      if ((packet.flags & 0x06) != 0) {
+        mqttPuback(client.link.out, packet.packetId);
+      }
+      if (client.state != CLIENT_UP) {
+        break;
+      }
+      if (client.prober) {
+        proberMessage(packet, now);
+      }
+      else {
+        propMessage(client, packet);
+      }
+      break;
+  }
+}
+
+// As handlePing() and handleCommand(), with every command accepted
+void Worker::propMessage(Client& client, const MqttPacket& packet) {
+  unsigned long receivedUs = propMicros();
+  MqttView kind;
+  if (!packet.topic.equals(client.deviceTopic.c_str()) || !messageWord(packet.payload, 0, kind)) {
+    return;
+  }
+  if (kind.equals("ping")) {
+    MqttView token = { "", 0 };
+    messageWord(packet.payload, 1, token);
+    formatPong(message, token, receivedUs, propMicros(), propMicros(), "game", "fleet");
+  }
+  else {
+    MqttView requestId = { "", 0 };
+    messageField(packet.payload, "id", requestId);
+    formatAck(message, requestId, kind, "ok");
+  }
+  publish(client, client.hostTopic, message, nowNs());
+}
+
+void Worker::proberMessage(const MqttPacket& packet, int64_t now) {
+  MqttView prop;
+  MqttView subtopic;
+  MqttView kind;
+  MqttView token;
+  unsigned long long sentNs;
+  if (!propFromHostTopic(packet.topic, prop, subtopic) || subtopic.length > 0 || !messageWord(packet.payload, 0, kind) ||
+      !messageWord(packet.payload, 1, token) || !viewToULong(token, sentNs)) {
+    return;
+  }
+  if (kind.equals("pong")) {
+    record(SAMPLE_PING, (int64_t)sentNs, now);
+  }
+  else if (kind.equals("ack")) {
+    record(SAMPLE_COMMAND, (int64_t)sentNs, now);
+  }
+}
+
+void Worker::publish(Client& client, const std::string& topic, const std::string& payload, int64_t now) {
+  // The prober's publishes stand for the game's, at QoS 0
+  int qos = client.prober ? 0 : options.qos;
+  uint16_t packetId = 0;
+  if (qos > 0) {
+    packetId = client.nextPacketId++;
+    if (client.nextPacketId == 0) {
+      client.nextPacketId = 1;
+    }
+    client.unacked[packetId] = now;
+  }
+  mqttPublish(client.link.out, topic.c_str(), payload.data(), payload.size(), qos, packetId);
+}
+
+
+// Timers
+void Worker::tick(int64_t now) {
+  double elapsedS = (now - lastTickNs) / 1e9;
+  lastTickNs = now;
+
+  // A storm: every prop in the fleet drops its connection and comes back within the jitter
+  unsigned generation = stormGeneration.load();
+  if (generation != stormSeen.load()) {
+    std::uniform_int_distribution<int> jitter(0, std::max(options.stormJitter, 0));
+    for (size_t i = 0; i < props.size(); i++) {
+      Client& prop = *props[i];
+      if (prop.state == CLIENT_IDLE) {
+        continue;
+      }
+      if (prop.state == CLIENT_UP) {
+        up--;
+      }
+      linkClose(prop.link);
+      prop.watching = 0;
+      prop.state = CLIENT_WAITING;
+      prop.retryAtNs = now + (int64_t)jitter(random) * 1000000;
+    }
+    stormSeen = generation;
+  }
+
+  // Growing: this loop's share of the ramp
+  int size = fleetSize.load();
+  bool growing = false;
+  rampCredit += elapsedS * options.ramp / options.threads;
+  for (size_t i = 0; i < props.size() && props[i]->index < size; i++) {
+    if (props[i]->state != CLIENT_IDLE) {
+      continue;
+    }
+    growing = true;
+    if (rampCredit < 1) {
+      break;
+    }
+    start(*props[i], now);
+    rampCredit -= 1;
+  }
+  if (!growing) {
+    rampCredit = 0;
+  }
+
+  tickClient(proberClient, now);
+  for (size_t i = 0; i < props.size(); i++) {
+    tickClient(*props[i], now);
+  }
+  if (probing.load() && proberUp.load()) {
+    probe(now, elapsedS);
+  }
+  else {
+    probeCredit = 0;
+  }
+  if (proberClient.link.fd >= 0) {
+    if (linkFlush(proberClient.link)) {
+      watch(proberClient);
+    }
+    else {
+      fail(proberClient, now, true);
+    }
+  }
+}
+
+void Worker::tickClient(Client& client, int64_t now) {
+  switch (client.state) {
+    case CLIENT_IDLE:
+      return;
+    case CLIENT_WAITING:
+      if (now >= client.retryAtNs) {
+        start(client, now);
+      }
+      return;
+    case CLIENT_CONNECTING:
+    case CLIENT_CONNACK:
+    case CLIENT_SUBACK:
+      if (now - client.stepNs > (int64_t)CONNECT_TIMEOUT_MS * 1000000) {
+        fail(client, now, false);
+      }
+      return;
+    case CLIENT_UP:
+      break;
+  }
+  bool wrote = false;
+  if (now >= client.keepaliveAtNs) {
+    // No answer to the last one: PubSubClient gives up on the connection
+    if (client.pingreqNs != 0) {
+      fail(client, now, true);
+      return;
+    }
+    mqttPingreq(client.link.out);
+    client.pingreqNs = now;
+    client.keepaliveAtNs += (int64_t)options.keepalive * 1000000000;
+    wrote = true;
+  }
+  if (!client.prober && now >= client.statsAtNs) {
+    size_t templates = sizeof(statsTemplate) / sizeof(statsTemplate[0]);
+    for (int line = 0; line < options.statsLines; line++) {
+      message = statsTemplate[line % templates];
+      publish(client, client.statsTopic, message, now);
+    }
+    client.statsAtNs += (int64_t)(options.statsInterval * 1e9);
+    wrote = true;
+    std::lock_guard<std::mutex> guard(lock);
+    samples.statsLines += options.statsLines;
+  }
+  if (wrote && !client.prober) {
+    if (!linkFlush(client.link)) {
+      fail(client, now, true);
+      return;
+    }
+    watch(client);
+  }
+}
+
+// This loop's share of --rate, spread over its props that are up
+void Worker::probe(int64_t now, double elapsedS) {
+  std::uniform_real_distribution<double> share(0, 1);
+  probeCredit += elapsedS * options.rate / options.threads;
+  while (probeCredit >= 1) {
+    // The next prop that is up, if any is
+    Client* prop = NULL;
+    for (size_t tries = 0; tries < props.size() && prop == NULL; tries++) {
+      Client* candidate = props[probeNext++ % props.size()];
+      if (candidate->state == CLIENT_UP) {
+        prop = candidate;
+      }
+    }
+    if (prop == NULL) {
+      probeCredit = 0;
+      return;
+    }
+    probeCredit -= 1;
+    // The time sent is the token, so the reply says how long it took
+    char probe[48];
+    bool command = share(random) < options.commands;
+    snprintf(probe, sizeof(probe), command ? "reset id=%lld" : "ping %lld", (long long)now);
+    message = probe;
+    publish(proberClient, prop->deviceTopic, message, now);
+    std::lock_guard<std::mutex> guard(lock);
+    if (command) {
+      samples.commands++;
+    }
+    else {
+      samples.pings++;
+    }
+  }
+}
+
+
+// Reporting
+static void printSamples(const char* name, std::vector<double>& values, long lost) {
+  if (values.empty() && lost <= 0) {
+    return;
+  }
+  printf("  %-10s n=%-6zu", name, values.size());
+  if (lost >= 0) {
+    printf(" lost=%-4ld", lost);
+  }
+  if (!values.empty()) {
+    std::sort(values.begin(), values.end());
+    printf(" p50 %7.2f  p90 %7.2f  p99 %7.2f  p99.9 %7.2f  max %7.2f ms", percentile(values, 0.5),
+           percentile(values, 0.9), percentile(values, 0.99), percentile(values, 0.999), values.back());
+  }
+  printf("\n");
+}
+
+struct SizeResult {
+  int size;
+  double connectP99;
+  double pingP50;
+  double pingP99;
+  double commandP99;
+  double stormS;          // -1 if it did not settle, 0 with no storm
+  double stormConnectP99;
+  unsigned long failures;
+};
+
+static double p99(std::vector<double>& values) {
+  std::sort(values.begin(), values.end());
+  return values.empty() ? 0 : percentile(values, 0.99);
+}
+
+
+// Running the fleet
+static std::vector<Worker*> workers;
+
+static int fleetUp() {
+  int total = 0;
+  for (size_t i = 0; i < workers.size(); i++) {
+    total += workers[i]->up.load();
+  }
+  return total;
+}
+
+static Samples collectAll() {
+  Samples all;
+  for (size_t i = 0; i < workers.size(); i++) {
+    all.add(workers[i]->collect());
+  }
+  return all;
+}
+
+static void sleepMs(int64_t ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// Waits for the whole fleet to be up; false on timing out
+static bool settle(int size, unsigned generation) {
+  int64_t deadline = nowNs() + (int64_t)SETTLE_TIMEOUT_MS * 1000000;
+  while (nowNs() < deadline) {
+    bool seen = true;
+    for (size_t i = 0; i < workers.size(); i++) {
+      seen = seen && workers[i]->stormSeen.load() == generation;
+    }
+    if (seen && fleetUp() >= size) {
+      return true;
+    }
+    sleepMs(10);
+  }
+  return false;
+}
+
+static SizeResult runSize(int size) {
+  SizeResult result;
+  memset(&result, 0, sizeof(result));
+  result.size = size;
+  printf("fleet of %d props, %d threads, qos %d\n", size, options.threads, options.qos);
+
+  int64_t started = nowNs();
+  int before = fleetUp();
+  fleetSize = size;
+  if (!settle(size, stormGeneration.load())) {
+    printf("  only %d of %d props came up\n", fleetUp(), size);
+  }
+  else {
+    double seconds = (nowNs() - started) / 1e9;
+    printf("  grew by %d in %.2f s\n", size - before, seconds);
+  }
+  Samples growing = collectAll();
+  printSamples(sampleNames[SAMPLE_CONNECT], growing.ms[SAMPLE_CONNECT], -1);
+  printSamples(sampleNames[SAMPLE_SUBSCRIBE], growing.ms[SAMPLE_SUBSCRIBE], -1);
+  result.connectP99 = p99(growing.ms[SAMPLE_CONNECT]);
+  result.failures = growing.failures;
+
+  probing = true;
+  sleepMs((int64_t)(options.duration * 1000));
+  probing = false;
+  sleepMs(LATE_REPLY_MS);
+  Samples steady = collectAll();
+  printf("  probed for %.0f s at %.0f a second, %lu stats lines, %lu dropped connections\n", options.duration,
+         options.rate, steady.statsLines, steady.drops);
+  printSamples(sampleNames[SAMPLE_PING], steady.ms[SAMPLE_PING], (long)steady.pings - (long)steady.ms[SAMPLE_PING].size());
+  printSamples(sampleNames[SAMPLE_COMMAND], steady.ms[SAMPLE_COMMAND],
+               (long)steady.commands - (long)steady.ms[SAMPLE_COMMAND].size());
+  printSamples(sampleNames[SAMPLE_KEEPALIVE], steady.ms[SAMPLE_KEEPALIVE], -1);
+  printSamples(sampleNames[SAMPLE_PUBACK], steady.ms[SAMPLE_PUBACK], -1);
+  result.pingP99 = p99(steady.ms[SAMPLE_PING]);
+  result.pingP50 = steady.ms[SAMPLE_PING].empty() ? 0 : percentile(steady.ms[SAMPLE_PING], 0.5);
+  result.commandP99 = p99(steady.ms[SAMPLE_COMMAND]);
+  result.failures += steady.failures;
+
+  if (options.storm) {
+    int64_t stormNs = nowNs();
+    unsigned generation = ++stormGeneration;
+    bool settled = settle(size, generation);
+    Samples storm = collectAll();
+    int64_t lastUp = 0;
+    for (size_t i = 0; i < workers.size(); i++) {
+      lastUp = std::max(lastUp, workers[i]->lastUpNs.load());
+    }
+    result.stormS = settled ? (lastUp - stormNs) / 1e9 : -1;
+    if (settled) {
+      printf("  storm: all %d props back in %.2f s, %lu failed connects\n", size, result.stormS, storm.failures);
+    }
+    else {
+      printf("  storm: only %d of %d props back after %d s, %lu failed connects\n", fleetUp(), size,
+             SETTLE_TIMEOUT_MS / 1000, storm.failures);
+    }
+    printSamples(sampleNames[SAMPLE_CONNECT], storm.ms[SAMPLE_CONNECT], -1);
+    printSamples(sampleNames[SAMPLE_SUBSCRIBE], storm.ms[SAMPLE_SUBSCRIBE], -1);
+    result.stormConnectP99 = p99(storm.ms[SAMPLE_CONNECT]);
+    result.failures += storm.failures;
+  }
+  printf("\n");
+  fflush(stdout);
+  return result;
+}
+
+static void printSummary(const std::vector<SizeResult>& results) {
+  printf("props  connect p99  ping p50  ping p99  command p99  storm s  storm connect p99  failures\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const SizeResult& result = results[i];
+    char storm[16];
+    if (!options.storm) {
+      snprintf(storm, sizeof(storm), "-");
+    }
+    else if (result.stormS < 0) {
+      snprintf(storm, sizeof(storm), "timeout");
+    }
+    else {
+      snprintf(storm, sizeof(storm), "%.2f", result.stormS);
+    }
+    printf("%5d  %11.2f  %8.2f  %8.2f  %11.2f  %7s  %17.2f  %8lu\n", result.size, result.connectP99,
+           result.pingP50, result.pingP99, result.commandP99, storm, result.stormConnectP99, result.failures);
+  }
+}
+
+
+// Options
+static void usage() {
+  fprintf(stderr,
+          "usage: fleet_load [--broker <host>] [--port <port>] [--sizes <n,n,...>] [--threads <n>]\n"
+          "                  [--name <name>] [--ramp <n>] [--duration <s>] [--rate <n>] [--commands <f>]\n"
+          "                  [--keepalive <s>] [--stats-interval <s>] [--stats-lines <n>] [--qos <0|1>]\n"
+          "                  [--storm-jitter <ms>] [--no-storm]\n");
+  exit(2);
+}
+
+static std::vector<int> parseSizes(const char* text) {
+  std::vector<int> sizes;
+  const char* at = text;
+  while (*at != '\0') {
+    char* end;
+    long size = strtol(at, &end, 10);
+    if (end == at || size <= 0 || (*end != ',' && *end != '\0')) {
+      usage();
+    }
+    sizes.push_back((int)size);
+    at = *end == ',' ? end + 1 : end;
+  }
+  if (sizes.empty()) {
+    usage();
+  }
+  std::sort(sizes.begin(), sizes.end());
+  return sizes;
+}
+
+static void parseOptions(int argc, char** argv) {
+  options.broker = "10.1.10.55";
+  options.port = 1883;
+  options.sizes = parseSizes("50,100,200,400");
+  options.threads = std::max(1u, std::thread::hardware_concurrency());
+  options.name = "Sterilizer";
+  options.ramp = 200;
+  options.duration = 30;
+  options.rate = 100;
+  options.commands = 0.2;
+  options.keepalive = 15;
+  options.statsInterval = 60;
+  options.statsLines = 21;
+  options.qos = 0;
+  options.stormJitter = 2000;
+  options.storm = true;
+
+  for (int i = 1; i < argc; i++) {
+    const char* option = argv[i];
+    if (strcmp(option, "--no-storm") == 0) {
+      options.storm = false;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage();
+    }
+    const char* value = argv[++i];
+    if (strcmp(option, "--broker") == 0) {
+      options.broker = value;
+    }
+    else if (strcmp(option, "--port") == 0) {
+      options.port = (uint16_t)atoi(value);
+    }
+    else if (strcmp(option, "--sizes") == 0) {
+      options.sizes = parseSizes(value);
+    }
+    else if (strcmp(option, "--threads") == 0) {
+      options.threads = atoi(value);
+    }
+    else if (strcmp(option, "--name") == 0) {
+      options.name = value;
+    }
+    else if (strcmp(option, "--ramp") == 0) {
+      options.ramp = atof(value);
+    }
+    else if (strcmp(option, "--duration") == 0) {
+      options.duration = atof(value);
+    }
+    else if (strcmp(option, "--rate") == 0) {
+      options.rate = atof(value);
+    }
+    else if (strcmp(option, "--commands") == 0) {
+      options.commands = atof(value);
+    }
+    else if (strcmp(option, "--keepalive") == 0) {
+      options.keepalive = atoi(value);
+    }
+    else if (strcmp(option, "--stats-interval") == 0) {
+      options.statsInterval = atof(value);
+    }
+    else if (strcmp(option, "--stats-lines") == 0) {
+      options.statsLines = atoi(value);
+    }
+    else if (strcmp(option, "--qos") == 0) {
+      options.qos = atoi(value);
+    }
+    else if (strcmp(option, "--storm-jitter") == 0) {
+      options.stormJitter = atoi(value);
+    }
+    else {
+      usage();
+    }
+  }
+  if (options.threads < 1 || options.ramp <= 0 || options.keepalive < 1 || options.statsInterval <= 0 ||
+      options.statsLines < 0 || options.qos < 0 || options.qos > 1 || options.port == 0) {
+    usage();
+  }
+}
+
+
+int main(int argc, char** argv) {
+  parseOptions(argc, argv);
+  signal(SIGPIPE, SIG_IGN);
+
+  // A socket per prop, and one prober per thread
+  struct rlimit files;
+  if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+    files.rlim_cur = files.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files);
+    if (files.rlim_cur < (rlim_t)options.sizes.back() + options.threads + 16) {
+      fprintf(stderr, "open file limit %lu is too low for %d props\n", (unsigned long)files.rlim_cur,
+              options.sizes.back());
+      return 1;
+    }
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.threads; i++) {
+    workers.push_back(new Worker(i));
+  }
+  for (int i = 0; i < options.threads; i++) {
+    threads.push_back(std::thread(&Worker::run, workers[i]));
+  }
+
+  // The probers first: without them nothing can be timed
+  int64_t deadline = nowNs() + (int64_t)CONNECT_TIMEOUT_MS * 1000000;
+  bool probersUp = false;
+  while (!probersUp && nowNs() < deadline) {
+    probersUp = true;
+    for (size_t i = 0; i < workers.size(); i++) {
+      probersUp = probersUp && workers[i]->proberUp.load();
+    }
+    sleepMs(10);
+  }
+
+  std::vector<SizeResult> results;
+  if (!probersUp) {
+    fprintf(stderr, "cannot reach the broker at %s:%u\n", options.broker.c_str(), options.port);
+  }
+  else {
+    for (size_t i = 0; i < options.sizes.size(); i++) {
+      results.push_back(runSize(options.sizes[i]));
+    }
+    printSummary(results);
+  }
+
+  stopping = true;
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+    delete workers[i];
+  }
+  return probersUp ? 0 : 1;
+}
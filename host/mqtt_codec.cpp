@@ -0,0 +1,266 @@
+/*
+   Sterilizer host tools - MQTT 3.1.1 codec
+*/
+
+#include "mqtt_codec.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool MqttView::equals(const char* text) const {
+  size_t textLength = strlen(text);
+  return textLength == length && memcmp(data, text, length) == 0;
+}
+
+bool MqttView::startsWith(const char* text) const {
+  size_t textLength = strlen(text);
+  return textLength <= length && memcmp(data, text, textLength) == 0;
+}
+
+
+// Encoding
+static void putLength(std::string& out, size_t length) {
+  do {
+    uint8_t digit = length % 128;
+    length /= 128;
+    out += (char)(length > 0 ? digit | 0x80 : digit);
+  } while (length > 0);
+}
+
+static void putShort(std::string& out, uint16_t value) {
+  out += (char)(value >> 8);
+  out += (char)(value & 0xff);
+}
+
+static void putString(std::string& out, const char* text, size_t length) {
+  putShort(out, (uint16_t)length);
+  out.append(text, length);
+}
+
+void mqttConnect(std::string& out, const char* clientId, uint16_t keepAliveS) {
+  size_t idLength = strlen(clientId);
+  out += (char)(MQTT_CONNECT << 4);
+  putLength(out, 10 + 2 + idLength);
+  putString(out, "MQTT", 4);
+  out += (char)4;      // protocol level 3.1.1
+  out += (char)0x02;   // clean session
+  putShort(out, keepAliveS);
+  putString(out, clientId, idLength);
+}
+
+void mqttSubscribe(std::string& out, uint16_t packetId, const char* filter, uint8_t qos) {
+  size_t filterLength = strlen(filter);
+  out += (char)(MQTT_SUBSCRIBE << 4 | 0x02);
+  putLength(out, 2 + 2 + filterLength + 1);
+  putShort(out, packetId);
+  putString(out, filter, filterLength);
+  out += (char)qos;
+}
+
+void mqttPublish(std::string& out, const char* topic, const char* payload, size_t length, uint8_t qos,
+                 uint16_t packetId, bool retain) {
+  size_t topicLength = strlen(topic);
+  out += (char)(MQTT_PUBLISH << 4 | qos << 1 | (retain ? 1 : 0));
+  putLength(out, 2 + topicLength + (qos > 0 ? 2 : 0) + length);
+  putString(out, topic, topicLength);
+  if (qos > 0) {
+    putShort(out, packetId);
+  }
+  out.append(payload, length);
+}
+
+void mqttPuback(std::string& out, uint16_t packetId) {
+  out += (char)(MQTT_PUBACK << 4);
+  out += (char)2;
+  putShort(out, packetId);
+}
+
+void mqttPingreq(std::string& out) {
+  out += (char)(MQTT_PINGREQ << 4);
+  out += (char)0;
+}
+
+void mqttDisconnect(std::string& out) {
+  out += (char)(MQTT_DISCONNECT << 4);
+  out += (char)0;
+}
+
+
+// Parsing
+static uint16_t getShort(const uint8_t* at) {
+  return (uint16_t)(at[0] << 8 | at[1]);
+}
+
+int mqttParse(const char* data, size_t length, MqttPacket& packet) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  if (length < 2) {
+    return 0;
+  }
+  // The remaining length: up to four bytes of seven bits each
+  size_t remaining = 0;
+  size_t header = 1;
+  int shift = 0;
+  while (true) {
+    if (header >= length) {
+      return 0;
+    }
+    uint8_t digit = bytes[header++];
+    remaining |= (size_t)(digit & 0x7f) << shift;
+    if ((digit & 0x80) == 0) {
+      break;
+    }
+    shift += 7;
+    if (shift > 21) {
+      return -1;
+    }
+  }
+  if (remaining > MQTT_MAX_PACKET) {
+    return -1;
+  }
+  if (length < header + remaining) {
+    return 0;
+  }
+
+  const uint8_t* body = bytes + header;
+  memset(&packet, 0, sizeof(packet));
+  packet.type = bytes[0] >> 4;
+  packet.flags = bytes[0] & 0x0f;
+  packet.size = header + remaining;
+  switch (packet.type) {
+    case MQTT_CONNACK:
+      if (remaining != 2) {
+        return -1;
+      }
+      packet.returnCode = body[1];
+      break;
+    case MQTT_PUBLISH: {
+      uint8_t qos = (packet.flags >> 1) & 0x03;
+      if (remaining < 2) {
+        return -1;
+      }
+      size_t topicLength = getShort(body);
+      size_t at = 2 + topicLength;
+      if (qos > 2 || at + (qos > 0 ? 2 : 0) > remaining) {
+        return -1;
+      }
+      packet.topic.data = (const char*)body + 2;
+      packet.topic.length = topicLength;
+      if (qos > 0) {
+        packet.packetId = getShort(body + at);
+        at += 2;
+      }
+      packet.payload.data = (const char*)body + at;
+      packet.payload.length = remaining - at;
+      break;
+    }
+    case MQTT_PUBACK:
+      if (remaining != 2) {
+        return -1;
+      }
+      packet.packetId = getShort(body);
+      break;
+    case MQTT_SUBACK:
+      if (remaining < 3) {
+        return -1;
+      }
+      packet.packetId = getShort(body);
+      packet.returnCode = body[2];
+      break;
+    case MQTT_PINGRESP:
+      break;
+    default:
+      // Nothing else is sent to a client
+      return -1;
+  }
+  return 1;
+}
+
+
+// Connections
+bool linkOpen(MqttLink& link, const char* host, uint16_t port) {
+  linkClose(link);
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* address = NULL;
+  if (getaddrinfo(host, service, &hints, &address) != 0) {
+    return false;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    freeaddrinfo(address);
+    return false;
+  }
+  // Small messages, each waited for at the other end
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  int result = connect(fd, address->ai_addr, address->ai_addrlen);
+  freeaddrinfo(address);
+  if (result < 0 && errno != EINPROGRESS) {
+    close(fd);
+    return false;
+  }
+  link.fd = fd;
+  return true;
+}
+
+bool linkConnected(MqttLink& link) {
+  int error = 0;
+  socklen_t length = sizeof(error);
+  return getsockopt(link.fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0;
+}
+
+void linkClose(MqttLink& link) {
+  if (link.fd >= 0) {
+    close(link.fd);
+  }
+  link.fd = -1;
+  link.in.clear();
+  link.consumed = 0;
+  link.out.clear();
+}
+
+bool linkFlush(MqttLink& link) {
+  while (!link.out.empty()) {
+    ssize_t sent = send(link.fd, link.out.data(), link.out.size(), MSG_NOSIGNAL);
+    if (sent < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    link.out.erase(0, sent);
+  }
+  return true;
+}
+
+bool linkRead(MqttLink& link) {
+  link.in.erase(0, link.consumed);
+  link.consumed = 0;
+  char buffer[16384];
+  while (true) {
+    ssize_t received = recv(link.fd, buffer, sizeof(buffer), 0);
+    if (received > 0) {
+      link.in.append(buffer, received);
+      continue;
+    }
+    if (received == 0) {
+      return false;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+}
+
+int linkNext(MqttLink& link, MqttPacket& packet) {
+  int result = mqttParse(link.in.data() + link.consumed, link.in.size() - link.consumed, packet);
+  if (result > 0) {
+    link.consumed += packet.size;
+  }
+  return result;
+}
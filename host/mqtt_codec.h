@@ -0,0 +1,95 @@
+/*
+   Sterilizer host tools - MQTT 3.1.1 codec
+
+   The packets the host tools send and receive, encoded into and parsed
+   out of plain byte buffers so that the tools can run hundreds of
+   connections from one event loop without a client library: CONNECT,
+   SUBSCRIBE, PUBLISH at QoS 0 or 1, PUBACK, PINGREQ and DISCONNECT out;
+   CONNACK, SUBACK, PUBLISH, PUBACK and PINGRESP in.
+
+   Encoders append to a std::string, the connection's output buffer.
+   mqttParse() reads one packet from the front of an input buffer without
+   copying: a received PUBLISH's topic and payload are MqttViews into the
+   buffer, valid until it is next changed.
+
+   MqttLink is one non-blocking broker connection with its buffers, for
+   an epoll loop: linkOpen() starts the TCP connect, linkConnected()
+   says how it went once the socket is writable, linkFlush() writes
+   what it can when the socket is writable and linkRead() appends what has
+   arrived.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+enum MqttPacketType {
+  MQTT_CONNECT = 1,
+  MQTT_CONNACK = 2,
+  MQTT_PUBLISH = 3,
+  MQTT_PUBACK = 4,
+  MQTT_SUBSCRIBE = 8,
+  MQTT_SUBACK = 9,
+  MQTT_PINGREQ = 12,
+  MQTT_PINGRESP = 13,
+  MQTT_DISCONNECT = 14
+};
+
+// Largest packet mqttParse() accepts; a broker sending more is treated as broken
+#define MQTT_MAX_PACKET 65536
+
+// Bytes of someone else's buffer
+struct MqttView {
+  const char* data;
+  size_t length;
+
+  bool equals(const char* text) const;
+  bool startsWith(const char* text) const;
+  std::string str() const {
+    return std::string(data, length);
+  }
+};
+
+struct MqttPacket {
+  uint8_t type;          // MqttPacketType
+  uint8_t flags;         // the low nibble of the fixed header
+  size_t size;           // bytes taken from the buffer
+  uint16_t packetId;     // PUBLISH at QoS 1, PUBACK, SUBACK
+  uint8_t returnCode;    // CONNACK, or the first of a SUBACK
+  MqttView topic;        // PUBLISH
+  MqttView payload;      // PUBLISH
+};
+
+void mqttConnect(std::string& out, const char* clientId, uint16_t keepAliveS);
+void mqttSubscribe(std::string& out, uint16_t packetId, const char* filter, uint8_t qos);
+void mqttPublish(std::string& out, const char* topic, const char* payload, size_t length, uint8_t qos = 0,
+                 uint16_t packetId = 0, bool retain = false);
+void mqttPuback(std::string& out, uint16_t packetId);
+void mqttPingreq(std::string& out);
+void mqttDisconnect(std::string& out);
+
+// 1 with a packet, 0 if the buffer holds only part of one, -1 if it is not MQTT
+int mqttParse(const char* data, size_t length, MqttPacket& packet);
+
+struct MqttLink {
+  int fd;
+  std::string in;
+  size_t consumed;       // parsed bytes at the front of in
+  std::string out;
+
+  MqttLink() : fd(-1), consumed(0) {}
+};
+
+// Starts connecting; false if the socket could not even be created
+bool linkOpen(MqttLink& link, const char* host, uint16_t port);
+// Once the socket is first writable: false if the connect failed
+bool linkConnected(MqttLink& link);
+void linkClose(MqttLink& link);
+// Writes what the socket takes; false if the connection failed
+bool linkFlush(MqttLink& link);
+// Reads what has arrived; false if the connection closed or failed
+bool linkRead(MqttLink& link);
+// The next whole packet, as mqttParse(); consumed packets are dropped on the next read
+int linkNext(MqttLink& link, MqttPacket& packet);
@@ -0,0 +1,688 @@
+/*
+   Sterilizer host tools - room orchestrator
+*/
+
+#include "orchestrator.h"
+#include <errno.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+
+// epoll data for the two descriptors
+#define WATCH_BROKER 0
+#define WATCH_WAKE 1
+
+static int64_t nowNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// The wall clock, in Unix microseconds, at a CLOCK_MONOTONIC reading
+static uint64_t unixUs(int64_t monotonicNs) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  int64_t realNs = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+  return (uint64_t)((realNs - (nowNs() - monotonicNs)) / 1000);
+}
+
+
+// Latency windows
+void LatencyWindow::add(double us) {
+  if (samples.size() < LATENCY_WINDOW) {
+    samples.push_back(us);
+  }
+  else {
+    samples[next] = us;
+  }
+  next = (next + 1) % LATENCY_WINDOW;
+  count++;
+}
+
+double LatencyWindow::percentile(double fraction) const {
+  if (samples.empty()) {
+    return 0;
+  }
+  std::vector<double> sorted(samples);
+  size_t at = std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()));
+  std::nth_element(sorted.begin(), sorted.begin() + at, sorted.end());
+  return sorted[at];
+}
+
+
+// Setting up
+Orchestrator::Orchestrator()
+    : host("10.1.10.55"), port(1883), clientId("RoomOrchestrator"), logFile(NULL), eventHook(NULL),
+      eventContext(NULL), timerHook(NULL), timerContext(NULL), timerMs(0), epoll(-1), wakeFd(-1),
+      linkConnecting(false), linkUp(false), watching(0), retryAtNs(0), connectStartNs(0), keepaliveAtNs(0),
+      pingreqNs(0), timerAtNs(0), stopping(false), reportWanted(false), nextId(0) {
+  std::random_device seed;
+  char prefix[8];
+  snprintf(prefix, sizeof(prefix), "%04x-", (unsigned)(seed() & 0xffff));
+  runPrefix = prefix;
+}
+
+Orchestrator::~Orchestrator() {
+  linkClose(link);
+}
+
+void Orchestrator::setBroker(const char* host, uint16_t port, const char* clientId) {
+  this->host = host;
+  this->port = port;
+  this->clientId = clientId;
+}
+
+void Orchestrator::setLog(FILE* log) {
+  logFile = log;
+}
+
+void Orchestrator::setEventHook(EventHook hook, void* context) {
+  eventHook = hook;
+  eventContext = context;
+}
+
+void Orchestrator::setTimerHook(unsigned long intervalMs, TimerHook hook, void* context) {
+  timerMs = intervalMs;
+  timerHook = hook;
+  timerContext = context;
+}
+
+void Orchestrator::log(const char* format, ...) {
+  if (logFile == NULL) {
+    return;
+  }
+  // Wall clock, to line up with the props' own logs
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  struct tm local;
+  localtime_r(&now.tv_sec, &local);
+  fprintf(logFile, "%02d:%02d:%02d.%03ld ", local.tm_hour, local.tm_min, local.tm_sec, now.tv_nsec / 1000000);
+  va_list args;
+  va_start(args, format);
+  vfprintf(logFile, format, args);
+  va_end(args);
+  fputc('\n', logFile);
+  fflush(logFile);
+}
+
+
+// Rules
+static PropAnnouncement eventByName(const std::string& name) {
+  static const PropAnnouncement events[] = { ANNOUNCE_SOLVED, ANNOUNCE_RESET, ANNOUNCE_SLEEPING, ANNOUNCE_AWAKE };
+  for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); i++) {
+    if (name == announcementName(events[i])) {
+      return events[i];
+    }
+  }
+  return ANNOUNCE_NONE;
+}
+
+bool Orchestrator::addRule(const std::string& line, std::string& error) {
+  std::vector<std::string> words;
+  size_t at = 0;
+  while (true) {
+    at = line.find_first_not_of(" \t\r\n", at);
+    if (at == std::string::npos) {
+      break;
+    }
+    size_t end = line.find_first_of(" \t\r\n", at);
+    words.push_back(line.substr(at, end == std::string::npos ? std::string::npos : end - at));
+    at = end;
+  }
+
+  Rule rule;
+  size_t word = 0;
+  if (words.size() < 5 || words[word++] != "when") {
+    error = "expected \"when <prop> <event> send <prop> <command>\"";
+    return false;
+  }
+  rule.prop = words[word++];
+  rule.event = eventByName(words[word]);
+  if (words[word] == "says") {
+    if (++word >= words.size()) {
+      error = "says needs a word";
+      return false;
+    }
+    rule.word = words[word];
+  }
+  else if (rule.event == ANNOUNCE_NONE) {
+    error = "unknown event \"" + words[word] + "\" (solved, reset, sleeping, awake or says <word>)";
+    return false;
+  }
+  word++;
+  if (word >= words.size() || words[word] != "send") {
+    error = "expected send after the event";
+    return false;
+  }
+  word++;
+  if (word + 1 >= words.size()) {
+    error = "send needs a prop and a command";
+    return false;
+  }
+  rule.target = words[word++];
+  for (; word < words.size(); word++) {
+    rule.command += (rule.command.empty() ? "" : " ") + words[word];
+  }
+  rule.targetTopic = propDeviceTopic(rule.target);
+  rule.fired = 0;
+  ruleList.push_back(rule);
+  return true;
+}
+
+bool Orchestrator::loadRules(const char* path, std::string& error) {
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    error = std::string(path) + ": " + strerror(errno);
+    return false;
+  }
+  char line[512];
+  int number = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), file) != NULL) {
+    number++;
+    const char* text = line + strspn(line, " \t");
+    if (*text == '#' || *text == '\n' || *text == '\r' || *text == '\0') {
+      continue;
+    }
+    std::string reason;
+    if (!addRule(text, reason)) {
+      error = std::string(path) + ":" + std::to_string(number) + ": " + reason;
+      ok = false;
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+
+// The loop
+bool Orchestrator::run() {
+  epoll = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epoll < 0 || wakeFd < 0) {
+    return false;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.u32 = WATCH_WAKE;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, wakeFd, &event);
+
+  int64_t now = nowNs();
+  timerAtNs = now + (int64_t)timerMs * 1000000;
+  connectBroker(now);
+
+  struct epoll_event events[8];
+  while (!stopping.load()) {
+    // Sleep until the next timer: retry, keep-alive or report
+    int64_t next = now + 1000000000;
+    if (link.fd < 0) {
+      next = std::min(next, retryAtNs);
+    }
+    if (linkUp) {
+      next = std::min(next, keepaliveAtNs);
+    }
+    if (timerHook != NULL && timerMs > 0) {
+      next = std::min(next, timerAtNs);
+    }
+    int timeoutMs = (int)std::max((int64_t)0, (next - now + 999999) / 1000000);
+    int count = epoll_wait(epoll, events, 8, timeoutMs);
+    now = nowNs();
+    for (int i = 0; i < count; i++) {
+      if (events[i].data.u32 == WATCH_WAKE) {
+        uint64_t ignored;
+        ssize_t ignoredLength = read(wakeFd, &ignored, sizeof(ignored));
+        (void)ignoredLength;
+      }
+      else {
+        service(events[i].events, now);
+      }
+    }
+    timers(now);
+    pump(now);
+  }
+
+  // Leave politely
+  if (linkUp) {
+    mqttDisconnect(link.out);
+    linkFlush(link);
+  }
+  linkClose(link);
+  linkUp = false;
+  close(wakeFd);
+  close(epoll);
+  wakeFd = -1;
+  epoll = -1;
+  return true;
+}
+
+void Orchestrator::stop() {
+  stopping = true;
+  if (wakeFd >= 0) {
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+  }
+}
+
+void Orchestrator::report() {
+  reportWanted = true;
+  if (wakeFd >= 0) {
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+  }
+}
+
+void Orchestrator::timers(int64_t now) {
+  if (link.fd < 0 && now >= retryAtNs) {
+    connectBroker(now);
+  }
+  else if (link.fd >= 0 && !linkUp && now - connectStartNs > (int64_t)ORCHESTRATOR_CONNECT_TIMEOUT_MS * 1000000) {
+    log("broker %s:%u did not answer", host.c_str(), port);
+    dropBroker(now);
+  }
+  if (linkUp && now >= keepaliveAtNs) {
+    // No answer to the last one
+    if (pingreqNs != 0) {
+      log("broker stopped answering");
+      dropBroker(now);
+    }
+    else {
+      mqttPingreq(link.out);
+      pingreqNs = now;
+      keepaliveAtNs = now + (int64_t)ORCHESTRATOR_KEEPALIVE_S * 1000000000;
+    }
+  }
+  bool due = timerMs > 0 && now >= timerAtNs;
+  if (timerHook != NULL && (due || reportWanted.load())) {
+    reportWanted = false;
+    if (due) {
+      timerAtNs = now + (int64_t)timerMs * 1000000;
+    }
+    timerHook(*this, timerContext);
+  }
+}
+
+
+// The broker connection
+void Orchestrator::connectBroker(int64_t now) {
+  connectStartNs = now;
+  if (!linkOpen(link, host.c_str(), port)) {
+    log("cannot connect to %s:%u", host.c_str(), port);
+    retryAtNs = now + (int64_t)ORCHESTRATOR_RETRY_MS * 1000000;
+    return;
+  }
+  linkConnecting = true;
+  watching = 0;
+  watch();
+}
+
+void Orchestrator::dropBroker(int64_t now) {
+  if (linkUp) {
+    log("lost the broker");
+  }
+  if (!unsent.empty()) {
+    log("%zu commands not sent", unsent.size());
+    unsent.clear();
+  }
+  // Closing the socket also takes it out of the epoll set
+  linkClose(link);
+  linkConnecting = false;
+  linkUp = false;
+  watching = 0;
+  pingreqNs = 0;
+  retryAtNs = now + (int64_t)ORCHESTRATOR_RETRY_MS * 1000000;
+}
+
+void Orchestrator::watch() {
+  if (link.fd < 0) {
+    return;
+  }
+  uint32_t wanted = EPOLLIN;
+  if (linkConnecting || !link.out.empty()) {
+    wanted |= EPOLLOUT;
+  }
+  if (wanted == watching) {
+    return;
+  }
+  struct epoll_event event;
+  event.events = wanted;
+  event.data.u32 = WATCH_BROKER;
+  epoll_ctl(epoll, watching == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, link.fd, &event);
+  watching = wanted;
+}
+
+void Orchestrator::service(uint32_t events, int64_t now) {
+  if (link.fd < 0) {
+    return;
+  }
+  if (linkConnecting) {
+    if (!linkConnected(link)) {
+      log("cannot connect to %s:%u", host.c_str(), port);
+      dropBroker(now);
+      return;
+    }
+    linkConnecting = false;
+    mqttConnect(link.out, clientId.c_str(), ORCHESTRATOR_KEEPALIVE_S);
+  }
+  if (events & EPOLLIN) {
+    bool open = linkRead(link);
+    MqttPacket received;
+    int result = 0;
+    while (link.fd >= 0 && (result = linkNext(link, received)) > 0) {
+      packet(received, now);
+    }
+    if (link.fd >= 0 && (!open || result < 0)) {
+      dropBroker(now);
+    }
+  }
+  else if (events & (EPOLLERR | EPOLLHUP)) {
+    dropBroker(now);
+  }
+}
+
+// Writes what is queued; commands are counted as sent once all of it is out
+void Orchestrator::pump(int64_t now) {
+  if (link.fd < 0 || linkConnecting) {
+    return;
+  }
+  if (!linkFlush(link)) {
+    dropBroker(now);
+    return;
+  }
+  if (link.out.empty() && !unsent.empty()) {
+    int64_t sentNs = nowNs();
+    for (size_t i = 0; i < unsent.size(); i++) {
+      const Unsent& command = unsent[i];
+      if (command.rule >= 0) {
+        ruleList[command.rule].sent.add((sentNs - command.receivedNs) / 1e3);
+      }
+      PendingAck pending = { command.rule, sentNs };
+      pendingAcks[command.id] = pending;
+    }
+    unsent.clear();
+    // The oldest are the likeliest never to be answered
+    while (pendingAcks.size() > MAX_PENDING_ACKS) {
+      pendingAcks.erase(pendingAcks.begin());
+    }
+  }
+  watch();
+}
+
+void Orchestrator::packet(const MqttPacket& packet, int64_t now) {
+  switch (packet.type) {
+    case MQTT_CONNACK:
+      if (packet.returnCode != 0) {
+        log("broker refused the connection, code %u", packet.returnCode);
+        dropBroker(now);
+        return;
+      }
+      mqttSubscribe(link.out, 1, HOST_TOPIC_PREFIX "#", 0);
+      break;
+    case MQTT_SUBACK:
+      if (packet.returnCode == 0x80) {
+        log("broker refused the subscription");
+        dropBroker(now);
+        return;
+      }
+      linkUp = true;
+      keepaliveAtNs = now + (int64_t)ORCHESTRATOR_KEEPALIVE_S * 1000000000;
+      log("connected to %s:%u as %s", host.c_str(), port, clientId.c_str());
+      break;
+    case MQTT_PINGRESP:
+      pingreqNs = 0;
+      break;
+    case MQTT_PUBLISH:
+      if ((packet.flags & 0x06) != 0) {
+        mqttPuback(link.out, packet.packetId);
+      }
+      message(packet.topic, packet.payload, now);
+      break;
+  }
+}
+
+
+// The table
+PropState& Orchestrator::prop(const MqttView& name, int64_t now) {
+  lookup.assign(name.data, name.length);
+  std::unordered_map<std::string, size_t>::iterator found = tableIndex.find(lookup);
+  if (found != tableIndex.end()) {
+    return table[found->second];
+  }
+  PropState state;
+  state.name = lookup;
+  state.state = ANNOUNCE_NONE;
+  state.seenNs = now;
+  state.changedNs = now;
+  state.messages = 0;
+  state.statsLines = 0;
+  state.acks = 0;
+  state.refused = 0;
+  state.clockSynced = false;
+  state.clockMs = 0;
+  tableIndex[lookup] = table.size();
+  table.push_back(state);
+  log("new prop %s", lookup.c_str());
+  return table.back();
+}
+
+// Only assigned when it differs, so that an unchanged value costs no copy
+static void keepField(std::string& kept, const MqttView& value) {
+  if (value.length > 0 && !value.equals(kept.c_str())) {
+    kept.assign(value.data, value.length);
+  }
+}
+
+void Orchestrator::message(const MqttView& topic, const MqttView& payload, int64_t now) {
+  MqttView name;
+  MqttView subtopic;
+  if (!propFromHostTopic(topic, name, subtopic)) {
+    return;
+  }
+  PropState& state = prop(name, now);
+  state.seenNs = now;
+  state.messages++;
+
+  PropEvent event;
+  event.prop = &state;
+  event.subtopic = subtopic;
+  event.message = payload;
+  event.announcement = ANNOUNCE_NONE;
+  event.changed = false;
+  event.receivedNs = now;
+  MqttView kind = { "", 0 };
+  MqttView value;
+  if (subtopic.length == 0) {
+    messageWord(payload, 0, kind);
+    event.announcement = propAnnouncement(payload);
+    if (event.announcement != ANNOUNCE_NONE && event.announcement != state.state) {
+      event.changed = true;
+      state.state = event.announcement;
+      state.changedNs = now;
+    }
+    if (kind.equals("ack")) {
+      acknowledged(state, payload, now);
+    }
+    else if (kind.equals("pong")) {
+      if (messageField(payload, "link", value)) {
+        keepField(state.link, value);
+      }
+      if (messageField(payload, "mqtt", value)) {
+        keepField(state.mqtt, value);
+      }
+    }
+  }
+  else if (subtopic.equals(TIME_SUBTOPIC)) {
+    answerTime(state, payload, now);
+  }
+  else if (subtopic.equals(STATS_SUBTOPIC)) {
+    state.statsLines++;
+    if (payload.startsWith("link ") && messageField(payload, "profile", value)) {
+      keepField(state.link, value);
+    }
+    else if (payload.startsWith("transport ") && messageField(payload, "name", value)) {
+      keepField(state.mqtt, value);
+    }
+  }
+
+  for (size_t i = 0; i < ruleList.size(); i++) {
+    const Rule& rule = ruleList[i];
+    if (rule.prop != "*" && !name.equals(rule.prop.c_str())) {
+      continue;
+    }
+    bool matches = rule.event != ANNOUNCE_NONE ? event.changed && event.announcement == rule.event
+                                               : kind.equals(rule.word.c_str());
+    if (matches) {
+      fire((int)i, event);
+    }
+  }
+  // The commands go out before anything is logged, so that the log does not hold them up
+  if (!firedNow.empty()) {
+    pump(nowNs());
+  }
+  if (event.changed) {
+    log("%s %s", state.name.c_str(), announcementName(state.state));
+  }
+  for (size_t i = 0; i < firedNow.size(); i++) {
+    const Rule& rule = ruleList[firedNow[i].rule];
+    if (firedNow[i].id == 0) {
+      log("rule %d: not connected, %s %s not sent", firedNow[i].rule + 1, rule.target.c_str(), rule.command.c_str());
+    }
+    else {
+      log("rule %d: %s %s -> %s %s id=%s%lu", firedNow[i].rule + 1, state.name.c_str(),
+          rule.event != ANNOUNCE_NONE ? announcementName(rule.event) : rule.word.c_str(), rule.target.c_str(),
+          rule.command.c_str(), runPrefix.c_str(), firedNow[i].id);
+    }
+  }
+  firedNow.clear();
+  if (eventHook != NULL) {
+    eventHook(*this, event, eventContext);
+  }
+}
+
+// Answered at once, as t2 to t3 is counted as time the prop was not waiting on the network
+void Orchestrator::answerTime(PropState& state, const MqttView& payload, int64_t now) {
+  uint64_t received = unixUs(now);
+  MqttView seq;
+  MqttView t1;
+  MqttView sync;
+  unsigned long long synced;
+  if (!messageWord(payload, 1, seq) || !messageField(payload, "t1", t1)) {
+    return;
+  }
+  if (messageField(payload, "sync", sync) && viewToULong(sync, synced)) {
+    state.clockSynced = true;
+    state.clockMs = (int64_t)(synced - received) / 1e3;
+  }
+  if (!linkUp) {
+    return;
+  }
+  replyTopic = DEVICE_TOPIC_PREFIX;
+  replyTopic += state.name;
+  formatTimeReply(command, seq, t1, received, unixUs(nowNs()));
+  mqttPublish(link.out, replyTopic.c_str(), command.data(), command.size());
+  pump(nowNs());
+}
+
+void Orchestrator::acknowledged(PropState& state, const MqttView& payload, int64_t now) {
+  state.acks++;
+  MqttView id;
+  MqttView command;
+  MqttView outcome;
+  if (!messageWord(payload, 1, id) || !messageWord(payload, 2, command) || !messageWord(payload, 3, outcome)) {
+    return;
+  }
+  if (!outcome.equals("ok") && !outcome.equals("noop")) {
+    state.refused++;
+    log("%s answered %.*s with %.*s", state.name.c_str(), (int)command.length, command.data, (int)outcome.length,
+        outcome.data);
+  }
+  // Ours are "<run>-<n>"
+  if (!id.startsWith(runPrefix.c_str())) {
+    return;
+  }
+  MqttView number = { id.data + runPrefix.size(), id.length - runPrefix.size() };
+  unsigned long long n;
+  if (!viewToULong(number, n)) {
+    return;
+  }
+  std::map<unsigned long, PendingAck>::iterator pending = pendingAcks.find((unsigned long)n);
+  if (pending == pendingAcks.end()) {
+    return;
+  }
+  if (pending->second.rule >= 0) {
+    ruleList[pending->second.rule].ack.add((now - pending->second.sentNs) / 1e3);
+  }
+  pendingAcks.erase(pending);
+}
+
+
+// Commands
+void Orchestrator::fire(int index, const PropEvent& event) {
+  Rule& rule = ruleList[index];
+  Fired fired = { index, queue(rule.targetTopic, rule.command, index, event.receivedNs) };
+  if (fired.id != 0) {
+    rule.fired++;
+    rule.decide.add((nowNs() - event.receivedNs) / 1e3);
+  }
+  firedNow.push_back(fired);
+}
+
+unsigned long Orchestrator::send(const std::string& prop, const std::string& text) {
+  return queue(propDeviceTopic(prop), text, -1, nowNs());
+}
+
+unsigned long Orchestrator::queue(const std::string& topic, const std::string& text, int rule, int64_t receivedNs) {
+  if (!linkUp) {
+    return 0;
+  }
+  unsigned long id = ++nextId;
+  command = text;
+  command += " id=";
+  command += runPrefix;
+  command += std::to_string(id);
+  mqttPublish(link.out, topic.c_str(), command.data(), command.size());
+  Unsent queued = { rule, receivedNs, id };
+  unsent.push_back(queued);
+  return id;
+}
+
+
+// Reports
+void Orchestrator::printTable(FILE* out) const {
+  int64_t now = nowNs();
+  fprintf(out, "%-20s %-9s %8s %9s %7s %7s %5s %7s %8s %-9s %s\n", "prop", "state", "seen s", "changed s", "msgs",
+          "stats", "acks", "refused", "clock ms", "link", "mqtt");
+  for (size_t i = 0; i < table.size(); i++) {
+    const PropState& prop = table[i];
+    char clock[16] = "-";
+    if (prop.clockSynced) {
+      snprintf(clock, sizeof(clock), "%+.1f", prop.clockMs);
+    }
+    fprintf(out, "%-20s %-9s %8.1f %9.1f %7lu %7lu %5lu %7lu %8s %-9s %s\n", prop.name.c_str(),
+            prop.state == ANNOUNCE_NONE ? "-" : announcementName(prop.state), (now - prop.seenNs) / 1e9,
+            (now - prop.changedNs) / 1e9, prop.messages, prop.statsLines, prop.acks, prop.refused, clock,
+            prop.link.empty() ? "-" : prop.link.c_str(), prop.mqtt.empty() ? "-" : prop.mqtt.c_str());
+  }
+}
+
+void Orchestrator::printRules(FILE* out) const {
+  for (size_t i = 0; i < ruleList.size(); i++) {
+    const Rule& rule = ruleList[i];
+    std::string event = rule.event != ANNOUNCE_NONE ? announcementName(rule.event) : "says " + rule.word;
+    fprintf(out, "rule %zu: when %s %s send %s %s, fired %lu\n", i + 1, rule.prop.c_str(), event.c_str(),
+            rule.target.c_str(), rule.command.c_str(), rule.fired);
+    if (rule.fired == 0) {
+      continue;
+    }
+    fprintf(out, "  decide p50 %.0f p99 %.0f us, sent p50 %.0f p99 %.0f us, ack p50 %.1f p99 %.1f ms (%lu acks)\n",
+            rule.decide.percentile(0.5), rule.decide.percentile(0.99), rule.sent.percentile(0.5),
+            rule.sent.percentile(0.99), rule.ack.percentile(0.5) / 1e3, rule.ack.percentile(0.99) / 1e3,
+            rule.ack.total());
+  }
+}
@@ -0,0 +1,233 @@
+/*
+   Sterilizer host tools - room orchestrator
+
+   The game master's side of the props' topics, as a library. One
+   Orchestrator holds one broker connection subscribed to ToHost/#, keeps
+   a table of every prop heard from and runs game-flow rules against what
+   the props announce, all from a single-threaded epoll loop (run()).
+
+   Messages are parsed where they were received: topics and payloads are
+   MqttViews into the connection's input buffer (mqtt_codec.h), and
+   nothing is copied or allocated for a message unless it changes the
+   table (a prop heard from for the first time, a new link profile).
+
+   The table has a PropState per prop: what it last announced (solved,
+   reset, sleeping, awake; see prop_protocol.h), when it was last heard
+   from, how many messages, stats lines and acknowledgments it sent, the
+   acknowledgments that were not ok or noop, and the link profile and MQTT
+   transport its pongs and stats report.
+
+   The orchestrator is the props' time server: it answers their time
+   requests (src/clocksync.h) from the system clock, which NTP should keep
+   right, and notes how far each synchronized prop's clock is from its own
+   when a request arrives, the one-way delay included.
+
+   A rule is a line
+
+     when <prop> <event> send <prop> <command ...>
+
+   where the first prop may be * for any prop and the event is solved,
+   reset, sleeping or awake, which fire when a prop's state changes to it,
+   or "says <word>", which fires on every message from the prop starting
+   with that word. For example
+
+     when Sterilizer solved send Cabinet unlock
+     when * says crashed send Lights scene alarm
+
+   Commands go to ToDevice/<prop> as "<command> id=<run>-<n>", <run> four
+   hex digits picked at start so that IDs from an earlier run are not
+   taken for duplicates (src/commands.h). Each rule's latency from event
+   to command is kept in three stages, over its last LATENCY_WINDOW firings:
+
+     decide  the announcement read off the socket to the command queued
+     sent    the announcement read off the socket to the command handed
+             to the kernel, which is what the rule costs the room
+     ack     the command handed to the kernel to the target's ack arriving
+
+   An event hook sees every message after the table is updated, with the
+   prop's state, and may send() commands of its own; a timer hook is called
+   at a set interval, for reports. stop() and report() may be called from a
+   signal handler.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "mqtt_codec.h"
+#include "prop_protocol.h"
+
+// Firings of a rule kept for its latency percentiles
+#define LATENCY_WINDOW 1024
+// Commands remembered while waiting for their ack
+#define MAX_PENDING_ACKS 1024
+#define ORCHESTRATOR_KEEPALIVE_S 15
+#define ORCHESTRATOR_RETRY_MS 5000
+// Longest from TCP connect to SUBACK
+#define ORCHESTRATOR_CONNECT_TIMEOUT_MS 10000
+
+struct PropState {
+  std::string name;
+  PropAnnouncement state;    // ANNOUNCE_NONE until the prop announces something
+  int64_t seenNs;
+  int64_t changedNs;
+  unsigned long messages;
+  unsigned long statsLines;
+  unsigned long acks;
+  unsigned long refused;     // acks other than ok and noop
+  std::string link;
+  std::string mqtt;
+  bool clockSynced;
+  double clockMs;            // the prop's synchronized clock less ours, at its last time request
+};
+
+struct PropEvent {
+  const PropState* prop;
+  MqttView subtopic;         // "" for the prop's own topic, else stats, trace, ...
+  MqttView message;
+  PropAnnouncement announcement;
+  bool changed;              // the announcement changed the prop's state
+  int64_t receivedNs;
+};
+
+// The latest durations, in microseconds
+class LatencyWindow {
+public:
+  LatencyWindow() : next(0), count(0) {}
+  void add(double us);
+  unsigned long total() const {
+    return count;
+  }
+  // Over the window; 0 when empty
+  double percentile(double fraction) const;
+
+private:
+  std::vector<double> samples;
+  size_t next;
+  unsigned long count;
+};
+
+struct Rule {
+  std::string prop;          // or "*"
+  PropAnnouncement event;    // ANNOUNCE_NONE for "says"
+  std::string word;
+  std::string target;
+  std::string command;
+  std::string targetTopic;
+  unsigned long fired;
+  LatencyWindow decide;
+  LatencyWindow sent;
+  LatencyWindow ack;
+};
+
+class Orchestrator {
+public:
+  typedef void (*EventHook)(Orchestrator& orchestrator, const PropEvent& event, void* context);
+  typedef void (*TimerHook)(Orchestrator& orchestrator, void* context);
+
+  Orchestrator();
+  ~Orchestrator();
+
+  void setBroker(const char* host, uint16_t port, const char* clientId);
+  // State changes, rules fired and refused commands are written here; NULL for none
+  void setLog(FILE* log);
+  void setEventHook(EventHook hook, void* context);
+  void setTimerHook(unsigned long intervalMs, TimerHook hook, void* context);
+
+  // false with the reason if the line is not a rule
+  bool addRule(const std::string& line, std::string& error);
+  // Rules one per line, with blank lines and # comments; false with the line and reason
+  bool loadRules(const char* path, std::string& error);
+
+  // Runs the loop until stop(); false if it could not start
+  bool run();
+  void stop();
+  // Calls the timer hook now
+  void report();
+
+  // Queues "<command> id=<id>" for ToDevice/<prop>; returns the ID's number
+  unsigned long send(const std::string& prop, const std::string& command);
+
+  const std::vector<PropState>& props() const {
+    return table;
+  }
+  const std::vector<Rule>& rules() const {
+    return ruleList;
+  }
+  bool connected() const {
+    return linkUp;
+  }
+  void printTable(FILE* out) const;
+  void printRules(FILE* out) const;
+
+private:
+  struct PendingAck {
+    int rule;                // -1 for a command sent by a hook
+    int64_t sentNs;
+  };
+  struct Fired {
+    int rule;
+    unsigned long id;        // 0 if not sent
+  };
+  struct Unsent {
+    int rule;
+    int64_t receivedNs;
+    unsigned long id;
+  };
+
+  void connectBroker(int64_t now);
+  void dropBroker(int64_t now);
+  void watch();
+  void service(uint32_t events, int64_t now);
+  void packet(const MqttPacket& packet, int64_t now);
+  void message(const MqttView& topic, const MqttView& payload, int64_t now);
+  PropState& prop(const MqttView& name, int64_t now);
+  void acknowledged(PropState& state, const MqttView& payload, int64_t now);
+  void answerTime(PropState& state, const MqttView& payload, int64_t now);
+  void fire(int rule, const PropEvent& event);
+  unsigned long queue(const std::string& topic, const std::string& command, int rule, int64_t receivedNs);
+  void pump(int64_t now);
+  void timers(int64_t now);
+  void log(const char* format, ...);
+
+  std::string host;
+  uint16_t port;
+  std::string clientId;
+  FILE* logFile;
+  EventHook eventHook;
+  void* eventContext;
+  TimerHook timerHook;
+  void* timerContext;
+  unsigned long timerMs;
+
+  int epoll;
+  int wakeFd;                // eventfd for stop() and report()
+  MqttLink link;
+  bool linkConnecting;
+  bool linkUp;
+  uint32_t watching;
+  int64_t retryAtNs;
+  int64_t connectStartNs;    // until SUBACK
+  int64_t keepaliveAtNs;
+  int64_t pingreqNs;
+  int64_t timerAtNs;
+  std::atomic<bool> stopping;
+  std::atomic<bool> reportWanted;
+
+  std::vector<PropState> table;
+  std::unordered_map<std::string, size_t> tableIndex;
+  std::string lookup;        // reused for lookups, so that they do not allocate
+  std::vector<Rule> ruleList;
+  std::string runPrefix;      // "<run>-"
+  unsigned long nextId;
+  std::map<unsigned long, PendingAck> pendingAcks;
+  std::vector<Unsent> unsent;
+  std::vector<Fired> firedNow;
+  std::string command;
+  std::string replyTopic;
+};
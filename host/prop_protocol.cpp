@@ -0,0 +1,153 @@
+/*
+   Sterilizer host tools - the props' topics and messages
+*/
+
+#include "prop_protocol.h"
+#include <stdio.h>
+#include <string.h>
+
+std::string propDeviceTopic(const std::string& prop) {
+  return DEVICE_TOPIC_PREFIX + prop;
+}
+
+std::string propHostTopic(const std::string& prop) {
+  return HOST_TOPIC_PREFIX + prop;
+}
+
+std::string propStatsTopic(const std::string& prop) {
+  return HOST_TOPIC_PREFIX + prop + "/" STATS_SUBTOPIC;
+}
+
+bool propFromHostTopic(const MqttView& topic, MqttView& prop, MqttView& subtopic) {
+  if (!topic.startsWith(HOST_TOPIC_PREFIX)) {
+    return false;
+  }
+  prop.data = topic.data + strlen(HOST_TOPIC_PREFIX);
+  prop.length = topic.length - strlen(HOST_TOPIC_PREFIX);
+  subtopic.data = prop.data + prop.length;
+  subtopic.length = 0;
+  const char* slash = (const char*)memchr(prop.data, '/', prop.length);
+  if (slash != NULL) {
+    subtopic.data = slash + 1;
+    subtopic.length = prop.length - (size_t)(slash + 1 - prop.data);
+    prop.length = slash - prop.data;
+    if (subtopic.length == 0 || memchr(subtopic.data, '/', subtopic.length) != NULL) {
+      return false;
+    }
+  }
+  return prop.length > 0;
+}
+
+bool messageWord(const MqttView& message, int index, MqttView& word) {
+  size_t at = 0;
+  for (int i = 0; ; i++) {
+    while (at < message.length && message.data[at] == ' ') {
+      at++;
+    }
+    if (at == message.length) {
+      return false;
+    }
+    size_t start = at;
+    while (at < message.length && message.data[at] != ' ') {
+      at++;
+    }
+    if (i == index) {
+      word.data = message.data + start;
+      word.length = at - start;
+      return true;
+    }
+  }
+}
+
+bool messageField(const MqttView& message, const char* key, MqttView& value) {
+  size_t keyLength = strlen(key);
+  MqttView word;
+  for (int i = 1; messageWord(message, i, word); i++) {
+    if (word.length > keyLength && word.data[keyLength] == '=' && memcmp(word.data, key, keyLength) == 0) {
+      value.data = word.data + keyLength + 1;
+      value.length = word.length - keyLength - 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool viewToULong(const MqttView& view, unsigned long long& value) {
+  if (view.length == 0 || view.length > 20) {
+    return false;
+  }
+  value = 0;
+  for (size_t i = 0; i < view.length; i++) {
+    if (view.data[i] < '0' || view.data[i] > '9') {
+      return false;
+    }
+    value = value * 10 + (view.data[i] - '0');
+  }
+  return true;
+}
+
+static bool endsWith(const MqttView& message, const char* text) {
+  size_t textLength = strlen(text);
+  return message.length >= textLength && memcmp(message.data + message.length - textLength, text, textLength) == 0;
+}
+
+// As networkOnPuzzle() in src/main.cpp and sleep.cpp word them, after the prop's name
+PropAnnouncement propAnnouncement(const MqttView& message) {
+  MqttView word;
+  if (!messageWord(message, 1, word)) {
+    return ANNOUNCE_NONE;
+  }
+  if (word.equals("sleeping")) {
+    return ANNOUNCE_SLEEPING;
+  }
+  if (word.equals("awake")) {
+    return ANNOUNCE_AWAKE;
+  }
+  if (endsWith(message, " has been solved!")) {
+    return ANNOUNCE_SOLVED;
+  }
+  if (endsWith(message, " has been reset!")) {
+    return ANNOUNCE_RESET;
+  }
+  return ANNOUNCE_NONE;
+}
+
+const char* announcementName(PropAnnouncement announcement) {
+  switch (announcement) {
+    case ANNOUNCE_NONE:     return "none";
+    case ANNOUNCE_SOLVED:   return "solved";
+    case ANNOUNCE_RESET:    return "reset";
+    case ANNOUNCE_SLEEPING: return "sleeping";
+    case ANNOUNCE_AWAKE:    return "awake";
+  }
+  return "?";
+}
+
+void formatPong(std::string& out, const MqttView& token, unsigned long rxUs, unsigned long dispatchUs,
+                unsigned long txUs, const char* link, const char* mqtt) {
+  char fields[96];
+  snprintf(fields, sizeof(fields), " rx=%lu dispatch=%lu tx=%lu link=%s mqtt=%s", rxUs, dispatchUs, txUs, link, mqtt);
+  out = "pong ";
+  out.append(token.length > 0 ? token.data : "-", token.length > 0 ? token.length : 1);
+  out += fields;
+}
+
+void formatAck(std::string& out, const MqttView& requestId, const MqttView& command, const char* outcome) {
+  out = "ack ";
+  out.append(requestId.length > 0 ? requestId.data : "-", requestId.length > 0 ? requestId.length : 1);
+  out += ' ';
+  out.append(command.length > 0 ? command.data : "-", command.length > 0 ? command.length : 1);
+  out += ' ';
+  out += outcome;
+}
+
+void formatTimeReply(std::string& out, const MqttView& seq, const MqttView& t1, unsigned long long t2Us,
+                     unsigned long long t3Us) {
+  char fields[48];
+  snprintf(fields, sizeof(fields), " t2=%llu t3=%llu", t2Us, t3Us);
+  out = "time ";
+  out.append(seq.data, seq.length);
+  out += " t1=";
+  out.append(t1.data, t1.length);
+  out += fields;
+}
@@ -0,0 +1,72 @@
+/*
+   Sterilizer host tools - the props' topics and messages
+
+   A prop named <name> listens on ToDevice/<name> and talks on
+   ToHost/<name>, with its stats lines on ToHost/<name>/stats; for the
+   Sterilizer these are DeviceTopic and hostTopic in src/main.cpp and
+   statsTopic in src/telemetry.cpp. Messages are words separated by
+   spaces, the first the message's kind, the rest often key=value fields:
+
+     to the prop    "<command> [args] [id=<request id>]", "ping <token>",
+                    "time <seq> t1= t2= t3="               (src/clocksync.h)
+     from the prop  "ack <id> <command> <outcome> [dup]"   (src/commands.h)
+                    "pong <token> rx= dispatch= tx= link= mqtt="
+                    "Sterilizer puzzle has been solved!", "Sterilizer has
+                    been reset!"                             (src/main.cpp)
+                    "Sterilizer sleeping ...", "Sterilizer awake ..."
+                                                             (src/sleep.h)
+
+   Traces, profiles and crash dumps go to their own ToHost/<name>/<what>
+   topics (src/trace.h, src/profiler.h, src/crashdump.h) and are binary.
+   The prop asks for the host's time on ToHost/<name>/time with
+   "time <seq> t1=<us> [sync=<us>]", answered on ToDevice/<name>.
+
+   The helpers here read these without copying, as MqttViews into the
+   received packet, for the room orchestrator (orchestrator.h), and write
+   the prop's side of them for the fleet load generator's virtual props.
+*/
+
+#pragma once
+
+#include <string>
+#include "mqtt_codec.h"
+
+#define DEVICE_TOPIC_PREFIX "ToDevice/"
+#define HOST_TOPIC_PREFIX "ToHost/"
+#define STATS_SUBTOPIC "stats"
+#define TIME_SUBTOPIC "time"
+
+// The announcements that change what a prop is doing
+enum PropAnnouncement {
+  ANNOUNCE_NONE,
+  ANNOUNCE_SOLVED,
+  ANNOUNCE_RESET,
+  ANNOUNCE_SLEEPING,
+  ANNOUNCE_AWAKE
+};
+
+std::string propDeviceTopic(const std::string& prop);
+std::string propHostTopic(const std::string& prop);
+std::string propStatsTopic(const std::string& prop);
+
+// The prop a ToHost/ topic is from and what follows it: "" for its own topic,
+// "stats", "time", "trace", "profile" or "crash"; false for any other topic
+bool propFromHostTopic(const MqttView& topic, MqttView& prop, MqttView& subtopic);
+
+// The index'th word (from 0) of a message
+bool messageWord(const MqttView& message, int index, MqttView& word);
+// The value of a key=value word
+bool messageField(const MqttView& message, const char* key, MqttView& value);
+bool viewToULong(const MqttView& view, unsigned long long& value);
+PropAnnouncement propAnnouncement(const MqttView& message);
+const char* announcementName(PropAnnouncement announcement);
+
+// The prop's side
+void formatPong(std::string& out, const MqttView& token, unsigned long rxUs, unsigned long dispatchUs,
+                unsigned long txUs, const char* link, const char* mqtt);
+void formatAck(std::string& out, const MqttView& requestId, const MqttView& command, const char* outcome);
+
+// The host's side: the answer to a time request, with the host's clock in
+// Unix microseconds when the request was read (t2) and the answer sent (t3)
+void formatTimeReply(std::string& out, const MqttView& seq, const MqttView& t1, unsigned long long t2Us,
+                     unsigned long long t3Us);
@@ -0,0 +1,113 @@
+/*
+   Sterilizer host tools - room orchestrator daemon
+
+   Runs an Orchestrator (orchestrator.h) with the rules in a file, logging
+   state changes, rules fired and refused commands on stdout, and printing
+   the prop table and each rule's event-to-command latency every --report
+   seconds, on SIGUSR1 and on the way out (SIGINT, SIGTERM).
+
+   Usage: room_orchestrator [options] <rules file>
+     --broker <host>   broker address (default 10.1.10.55)
+     --port <port>     broker port (default 1883)
+     --id <client id>  MQTT client ID (default RoomOrchestrator)
+     --report <s>      seconds between reports, 0 for none (default 300)
+
+   Linux only. Built by [env:orchestrator]:
+     pio run -e orchestrator && .pio/build/orchestrator/program host/room.rules
+*/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "orchestrator.h"
+
+static Orchestrator orchestrator;
+
+static void onSignal(int number) {
+  if (number == SIGUSR1) {
+    orchestrator.report();
+  }
+  else {
+    orchestrator.stop();
+  }
+}
+
+static void printReport(Orchestrator& orchestrator, void* context) {
+  (void)context;
+  printf("\n");
+  orchestrator.printTable(stdout);
+  orchestrator.printRules(stdout);
+  printf("\n");
+  fflush(stdout);
+}
+
+static void usage() {
+  fprintf(stderr, "usage: room_orchestrator [--broker <host>] [--port <port>] [--id <client id>] [--report <s>]"
+                  " <rules file>\n");
+  exit(2);
+}
+
+int main(int argc, char** argv) {
+  const char* broker = "10.1.10.55";
+  int port = 1883;
+  const char* clientId = "RoomOrchestrator";
+  double reportS = 300;
+  const char* rules = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (argv[i][0] != '-') {
+      if (rules != NULL) {
+        usage();
+      }
+      rules = argv[i];
+      continue;
+    }
+    if (i + 1 >= argc) {
+      usage();
+    }
+    const char* value = argv[++i];
+    if (strcmp(argv[i - 1], "--broker") == 0) {
+      broker = value;
+    }
+    else if (strcmp(argv[i - 1], "--port") == 0) {
+      port = atoi(value);
+    }
+    else if (strcmp(argv[i - 1], "--id") == 0) {
+      clientId = value;
+    }
+    else if (strcmp(argv[i - 1], "--report") == 0) {
+      reportS = atof(value);
+    }
+    else {
+      usage();
+    }
+  }
+  if (rules == NULL || port <= 0 || port > 65535 || reportS < 0) {
+    usage();
+  }
+
+  std::string error;
+  if (!orchestrator.loadRules(rules, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 2;
+  }
+  orchestrator.setBroker(broker, (uint16_t)port, clientId);
+  orchestrator.setLog(stdout);
+  orchestrator.setTimerHook((unsigned long)(reportS * 1000), printReport, NULL);
+  orchestrator.printRules(stdout);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = onSignal;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  sigaction(SIGUSR1, &action, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  if (!orchestrator.run()) {
+    fprintf(stderr, "cannot start the event loop\n");
+    return 1;
+  }
+  printReport(orchestrator, NULL);
+  return 0;
+}
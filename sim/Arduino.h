@@ -0,0 +1,97 @@
+/*
+   Sterilizer simulator - Arduino core stand-in
+
+   The subset of the Arduino API the sketch uses, backed by the simulator's
+   virtual clock and pins.
+*/
+
+#pragma once
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x01
+#define OUTPUT       0x03
+#define INPUT_PULLUP 0x05
+
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+
+#define F(string) (string)
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+
+#define digitalPinToInterrupt(pin) (pin)
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+// The handler runs when the scenario changes the input, as an ISR would
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+void detachInterrupt(uint8_t pin);
+
+class IPAddress {
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) {
+    octets[0] = a;
+    octets[1] = b;
+    octets[2] = c;
+    octets[3] = d;
+  }
+  uint8_t operator[](int index) const {
+    return octets[index];
+  }
+  uint8_t octets[4];
+};
+
+// Serial output goes to stderr so it never mixes with the event log. Input
+// comes from the scenario's "serial" lines through simSerialInput().
+class HardwareSerial {
+public:
+  void begin(unsigned long baud) {}
+  operator bool() { return true; }
+  int available();
+  int read();
+  // Output is never held up
+  int availableForWrite() {
+    return 128;
+  }
+  void flush() {}
+  // The callback runs when input arrives, as the UART's event task would
+  void onReceive(void (*callback)());
+  size_t write(uint8_t c);
+  size_t write(const uint8_t* buffer, size_t size);
+  size_t print(const char* text);
+  size_t print(char c);
+  size_t print(int value);
+  size_t print(unsigned int value);
+  size_t print(long value);
+  size_t print(unsigned long value);
+  size_t print(const IPAddress& address);
+  template <typename T> size_t println(T value) {
+    size_t n = print(value);
+    return n + println();
+  }
+  size_t println() {
+    return print("\n");
+  }
+  int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,61 @@
+/*
+   Sterilizer simulator - FastLED stand-in
+
+   Holds on to the sketch's LED array and logs what the strip would show on
+   every FastLED.show().
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+struct CRGB {
+  enum HTMLColorCode {
+    Black  = 0x000000,
+    Blue   = 0x0000FF,
+    Green  = 0x008000,
+    Purple = 0x800080,
+    Red    = 0xFF0000,
+    White  = 0xFFFFFF
+  };
+
+  uint8_t r, g, b;
+
+  CRGB() : r(0), g(0), b(0) {}
+  CRGB(HTMLColorCode colour) : r((colour >> 16) & 0xFF), g((colour >> 8) & 0xFF), b(colour & 0xFF) {}
+  CRGB(uint8_t red, uint8_t green, uint8_t blue) : r(red), g(green), b(blue) {}
+
+  bool operator==(const CRGB& other) const {
+    return r == other.r && g == other.g && b == other.b;
+  }
+  bool operator!=(const CRGB& other) const {
+    return !(*this == other);
+  }
+};
+
+enum EOrder { RGB, GRB };
+enum ESPIChipsets { WS2812B };
+
+class CFastLED {
+public:
+  template <ESPIChipsets CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+  CFastLED& addLeds(CRGB* data, int count) {
+    leds = data;
+    ledCount = count;
+    return *this;
+  }
+  void setBrightness(uint8_t scale) {
+    brightness = scale;
+  }
+  uint8_t getBrightness() {
+    return brightness;
+  }
+  void show();
+
+private:
+  CRGB* leds = NULL;
+  int ledCount = 0;
+  uint8_t brightness = 255;
+};
+
+extern CFastLED FastLED;
@@ -0,0 +1,59 @@
+/*
+   Sterilizer simulator - LittleFS stand-in
+
+   Files live in a scratch directory, never in the project's data/: that
+   is what "pio run -t uploadfs" flashes to the prop, and neither an
+   upload in a scenario nor the fuzzer may leave files in it. By default
+   the scratch directory is a new temporary one, filled with a copy of the
+   files in data/ (the panel built by web/gzip_assets.py), as the prop's
+   partition is after an uploadfs, and removed at exit. sim_main's
+   --fs-root names a directory to use instead, as it is and kept.
+   Files are read or written whole, from the start; there is no seeking.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <memory>
+
+class File {
+public:
+  File() : length(0) {}
+  File(FILE* file, size_t length) : file(file, fclose), length(length) {}
+
+  explicit operator bool() const {
+    return file.get() != NULL;
+  }
+  size_t size() const {
+    return length;
+  }
+  size_t read(uint8_t* buffer, size_t size) {
+    return file ? fread(buffer, 1, size, file.get()) : 0;
+  }
+  size_t write(const uint8_t* buffer, size_t size) {
+    return file ? fwrite(buffer, 1, size, file.get()) : 0;
+  }
+  void close() {
+    file.reset();
+  }
+
+private:
+  // Shared like the core's File, and closed when the last copy goes
+  std::shared_ptr<FILE> file;
+  size_t length;
+};
+
+class LittleFSFS {
+public:
+  bool begin(bool formatOnFail = false);
+  bool exists(const char* path);
+  File open(const char* path, const char* mode = "r");
+  bool remove(const char* path);
+  bool rename(const char* from, const char* to);
+};
+
+extern LittleFSFS LittleFS;
+
+// Roots the file system in dir instead of a temporary copy of data/; call before setup()
+void simSetFsRoot(const char* dir);
@@ -0,0 +1,33 @@
+/*
+   Sterilizer simulator - Preferences stand-in
+
+   Namespaces are kept in memory for the length of a run, so a setting
+   saved from the console is there after a simulated restart but not in
+   the next run. Opening a namespace read-only fails until something has
+   been saved in it, as NVS does.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <string>
+
+class Preferences {
+public:
+  Preferences() : open(false), readOnly(true) {}
+
+  bool begin(const char* name, bool readOnly = false);
+  void end();
+
+  bool isKey(const char* key);
+  bool remove(const char* key);
+  size_t getString(const char* key, char* value, size_t maxLen);
+  size_t putString(const char* key, const char* value);
+  long getLong(const char* key, long defaultValue = 0);
+  size_t putLong(const char* key, long value);
+
+private:
+  bool open;
+  bool readOnly;
+  std::string space;
+};
@@ -0,0 +1,66 @@
+/*
+   Sterilizer simulator - PubSubClient stand-in
+
+   The PubSubClient API the sketch uses, talking to FakeBroker instead of a
+   socket. Like the real library it delivers at most one message per
+   loop(), drops messages larger than its buffer, and blocks in connect()
+   for as long as the broker takes to answer.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <functional>
+#include <string>
+
+#define MQTT_MAX_PACKET_SIZE 256
+
+#define MQTT_CONNECTION_TIMEOUT     -4
+#define MQTT_CONNECTION_LOST        -3
+#define MQTT_CONNECT_FAILED         -2
+#define MQTT_DISCONNECTED           -1
+#define MQTT_CONNECTED               0
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient {
+public:
+  PubSubClient(WiFiClient& client) {}
+
+  PubSubClient& setServer(const char* domain, uint16_t port) {
+    return *this;
+  }
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE) {
+    this->callback = callback;
+    return *this;
+  }
+  bool setBufferSize(uint16_t size) {
+    bufferSize = size;
+    return true;
+  }
+  uint16_t getBufferSize() {
+    return bufferSize;
+  }
+
+  bool connect(const char* id);
+  void disconnect();
+  bool connected();
+  bool subscribe(const char* topic);
+  bool unsubscribe(const char* topic);
+  bool publish(const char* topic, const char* payload);
+  bool publish(const char* topic, const char* payload, bool retained);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+  bool loop();
+  int state() {
+    return connectionState;
+  }
+
+private:
+  std::function<void(char*, uint8_t*, unsigned int)> callback;
+  std::string clientId;
+  int connection = -1;
+  int connectionState = MQTT_DISCONNECTED;
+  uint16_t bufferSize = MQTT_MAX_PACKET_SIZE;
+};
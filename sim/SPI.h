@@ -0,0 +1,7 @@
+/*
+   Sterilizer simulator - SPI stand-in (nothing is used)
+*/
+
+#pragma once
+
+#include <Arduino.h>
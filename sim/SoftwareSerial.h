@@ -0,0 +1,7 @@
+/*
+   Sterilizer simulator - SoftwareSerial stand-in (nothing is used)
+*/
+
+#pragma once
+
+#include <Arduino.h>
@@ -0,0 +1,62 @@
+/*
+   Sterilizer simulator - WebServer stand-in
+
+   The part of the ESP32 core's WebServer the sketch uses. There is no
+   socket: the scenario's "http <path>" lines queue GET requests with
+   simHttpGet(), and handleClient() answers the oldest one. Each response
+   is written to the event log as "http <code> <path> <bytes>", and its
+   body goes with the sketch's Serial output unless that is hidden. A file
+   from LittleFS is counted but not shown, as the panel's are gzipped.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <string>
+
+class WebServer {
+public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  WebServer(int port) {}
+
+  void begin() {}
+  void on(const char* uri, THandlerFunction handler) {
+    handlers[uri] = handler;
+  }
+  void onNotFound(THandlerFunction handler) {
+    notFound = handler;
+  }
+  void handleClient();
+
+  void send(int code, const char* contentType, const char* content);
+  void send_P(int code, const char* contentType, const char* content, size_t contentLength);
+  std::string uri() const {
+    return path;
+  }
+
+  // Reads the file a buffer at a time, as WiFiClient::write(Stream&) does
+  template <typename FILE_TYPE>
+  size_t streamFile(FILE_TYPE& file, const char* contentType, int code = 200) {
+    uint8_t buffer[1436];
+    size_t sent = 0;
+    size_t length;
+    while ((length = file.read(buffer, sizeof(buffer))) > 0) {
+      sent += length;
+    }
+    logResponse(code, sent);
+    return sent;
+  }
+
+private:
+  void logResponse(int code, size_t length);
+
+  std::map<std::string, THandlerFunction> handlers;
+  THandlerFunction notFound;
+  std::string path;
+};
+
+// Queues a request for the next handleClient() and wakes the sketch's loop
+void simHttpGet(const std::string& path);
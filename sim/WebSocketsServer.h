@@ -0,0 +1,46 @@
+/*
+   Sterilizer simulator - WebSocketsServer stand-in
+
+   The part of the arduinoWebSockets server the sketch uses, with one
+   client: the scenario's "ws" lines open and close it and send it text,
+   and loop() delivers them to the sketch's event handler. Each frame the
+   sketch sends is written to the event log as "ws <text>".
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <string>
+
+enum WStype_t {
+  WStype_ERROR,
+  WStype_DISCONNECTED,
+  WStype_CONNECTED,
+  WStype_TEXT,
+  WStype_BIN,
+};
+
+class WebSocketsServer {
+public:
+  typedef std::function<void(uint8_t num, WStype_t type, uint8_t* payload, size_t length)> WebSocketServerEvent;
+
+  WebSocketsServer(uint16_t port) {}
+
+  void begin() {}
+  void loop();
+  void onEvent(WebSocketServerEvent handler) {
+    this->handler = handler;
+  }
+  bool sendTXT(uint8_t num, const char* payload, size_t length = 0);
+  bool broadcastTXT(const char* payload, size_t length = 0);
+  int connectedClients(bool ping = false);
+
+private:
+  WebSocketServerEvent handler;
+};
+
+// What the scenario's client does at the next loop(); each wakes the sketch's loop
+void simWebSocketOpen();
+void simWebSocketClose();
+void simWebSocketSend(const std::string& text);
@@ -0,0 +1,61 @@
+/*
+   Sterilizer simulator - WiFi stand-in
+
+   WiFi and WiFiClient as the sketch uses them, backed by FakeWiFi.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "fake_wifi.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiClass {
+public:
+  // Joining on a channel skips the scan, and fails once the access point has moved
+  wl_status_t begin(const char* ssid, const char* passphrase, int32_t channel = 0, const uint8_t* bssid = NULL, bool connect = true) {
+    simWiFi().begin(channel);
+    return status();
+  }
+  bool disconnect(bool wifioff = false, bool eraseap = false) {
+    simWiFi().leave();
+    return true;
+  }
+  bool reconnect() {
+    simWiFi().reconnect();
+    return true;
+  }
+  wl_status_t status() {
+    return simWiFi().connected() ? WL_CONNECTED : WL_DISCONNECTED;
+  }
+  IPAddress localIP() {
+    return simWiFi().connected() ? IPAddress(10, 1, 10, 80) : IPAddress();
+  }
+  int8_t RSSI() {
+    return simWiFi().rssi();
+  }
+  int32_t channel() {
+    return simWiFi().channel();
+  }
+  uint8_t* BSSID() {
+    static uint8_t bssid[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+    return bssid;
+  }
+};
+
+// The fake broker connection lives in PubSubClient; the client only carries it
+class WiFiClient {
+public:
+  int available() {
+    return 0;
+  }
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,161 @@
+/*
+   Sterilizer simulator - fake MQTT broker
+*/
+
+#include "fake_broker.h"
+#include "sim.h"
+#include <algorithm>
+
+FakeBroker& simBroker() {
+  static FakeBroker broker;
+  return broker;
+}
+
+// The device's socket becomes readable when a message reaches it
+static void scheduleArrival(uint64_t at) {
+  simSchedule(at, [] { simRaiseWake(SIM_WAKE_NETWORK); });
+}
+
+void FakeBroker::setUp(bool up) {
+  if (brokerUp && !up) {
+    outageCount++;
+    for (size_t i = 0; i < sessions.size(); i++) {
+      sessions[i].open = false;
+    }
+    // A closed connection makes the socket readable too
+    simRaiseWake(SIM_WAKE_NETWORK);
+  }
+  brokerUp = up;
+}
+
+bool FakeBroker::topicMatches(const std::string& filter, const std::string& topic) {
+  size_t f = 0;
+  size_t t = 0;
+  while (f < filter.size()) {
+    if (filter[f] == '#') {
+      return true;
+    }
+    if (filter[f] == '+') {
+      // One whole level
+      while (t < topic.size() && topic[t] != '/') {
+        t++;
+      }
+      f++;
+      continue;
+    }
+    if (t >= topic.size() || filter[f] != topic[t]) {
+      // "a/#" also matches "a"
+      return t == topic.size() && filter.compare(f, std::string::npos, "/#") == 0;
+    }
+    f++;
+    t++;
+  }
+  return t == topic.size();
+}
+
+void FakeBroker::route(const std::string& topic, const std::string& payload, bool retain, uint64_t sentAt) {
+  if (retain) {
+    if (payload.empty()) {
+      retained.erase(topic);
+    }
+    else {
+      retained[topic] = payload;
+    }
+  }
+  for (size_t i = 0; i < sessions.size(); i++) {
+    Session& session = sessions[i];
+    if (!session.open) {
+      continue;
+    }
+    for (size_t j = 0; j < session.filters.size(); j++) {
+      if (topicMatches(session.filters[j], topic)) {
+        Message message = { topic, payload, false, sentAt + latency };
+        session.inbox.push_back(message);
+        scheduleArrival(message.deliverAt);
+        break;
+      }
+    }
+  }
+}
+
+void FakeBroker::hostPublish(const std::string& topic, const std::string& payload, bool retain) {
+  if (brokerUp) {
+    // The host sits next to the broker; only the hop to the device is slow
+    route(topic, payload, retain, simNow());
+  }
+}
+
+int FakeBroker::connect(const std::string& clientId) {
+  if (!brokerUp) {
+    return -1;
+  }
+  // A new connection with the same client ID takes over, as in MQTT
+  for (size_t i = 0; i < sessions.size(); i++) {
+    if (sessions[i].clientId == clientId) {
+      sessions[i].open = false;
+    }
+  }
+  Session session;
+  session.clientId = clientId;
+  session.open = true;
+  sessions.push_back(session);
+  connectCount++;
+  return sessions.size() - 1;
+}
+
+bool FakeBroker::connected(int connection) const {
+  return connection >= 0 && connection < (int)sessions.size() && sessions[connection].open;
+}
+
+void FakeBroker::disconnect(int connection) {
+  if (connected(connection)) {
+    sessions[connection].open = false;
+  }
+}
+
+void FakeBroker::subscribe(int connection, const std::string& filter) {
+  if (!connected(connection)) {
+    return;
+  }
+  Session& session = sessions[connection];
+  session.filters.push_back(filter);
+  for (std::map<std::string, std::string>::iterator i = retained.begin(); i != retained.end(); ++i) {
+    if (topicMatches(filter, i->first)) {
+      Message message = { i->first, i->second, true, simNow() + latency };
+      session.inbox.push_back(message);
+      scheduleArrival(message.deliverAt);
+    }
+  }
+}
+
+void FakeBroker::unsubscribe(int connection, const std::string& filter) {
+  if (!connected(connection)) {
+    return;
+  }
+  std::vector<std::string>& filters = sessions[connection].filters;
+  filters.erase(std::remove(filters.begin(), filters.end(), filter), filters.end());
+}
+
+void FakeBroker::publish(int connection, const std::string& topic, const std::string& payload, bool retain) {
+  if (!connected(connection)) {
+    return;
+  }
+  Message message = { topic, payload, retain, simNow() + latency };
+  if (onDevicePublish) {
+    onDevicePublish(sessions[connection].clientId, message);
+  }
+  route(topic, payload, retain, simNow() + latency);
+}
+
+bool FakeBroker::nextDelivery(int connection, uint64_t now, Message& message) {
+  if (!connected(connection)) {
+    return false;
+  }
+  std::deque<Message>& inbox = sessions[connection].inbox;
+  if (inbox.empty() || inbox.front().deliverAt > now) {
+    return false;
+  }
+  message = inbox.front();
+  inbox.pop_front();
+  return true;
+}
@@ -0,0 +1,78 @@
+/*
+   Sterilizer simulator - fake MQTT broker
+
+   The part of MQTT 3.1.1 that PubSubClient uses: clean-session connects,
+   subscriptions with + and # wildcards, QoS 0 publishes and retained
+   messages. Delivery is delayed by a scripted one-way latency, connects by
+   a scripted CONNACK delay, and an outage drops every connection and
+   refuses new ones until the broker is brought back.
+
+   The host side of a scenario publishes with hostPublish() and sees every
+   message published by a device through onDevicePublish.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+class FakeBroker {
+public:
+  struct Message {
+    std::string topic;
+    std::string payload;
+    bool retain;
+    uint64_t deliverAt;
+  };
+
+  // Scripted behaviour
+  void setUp(bool up);
+  bool isUp() const { return brokerUp; }
+  void setLatency(uint64_t us) { latency = us; }
+  void setConnackDelay(uint64_t us) { connackDelay = us; }
+  uint64_t connectTime() const { return latency * 2 + connackDelay; }
+
+  // Host side
+  void hostPublish(const std::string& topic, const std::string& payload, bool retain = false);
+  std::function<void(const std::string& clientId, const Message& message)> onDevicePublish;
+
+  // Device side, used by the PubSubClient stand-in. Connections are
+  // numbered; a number stays dead once its connection has dropped.
+  int connect(const std::string& clientId);
+  bool connected(int connection) const;
+  void disconnect(int connection);
+  void subscribe(int connection, const std::string& filter);
+  void unsubscribe(int connection, const std::string& filter);
+  void publish(int connection, const std::string& topic, const std::string& payload, bool retain);
+  // Takes the next message due for a connection by now, if any
+  bool nextDelivery(int connection, uint64_t now, Message& message);
+
+  static bool topicMatches(const std::string& filter, const std::string& topic);
+
+  unsigned long connects() const { return connectCount; }
+  unsigned long outages() const { return outageCount; }
+
+private:
+  struct Session {
+    std::string clientId;
+    bool open;
+    std::vector<std::string> filters;
+    std::deque<Message> inbox;
+  };
+
+  void route(const std::string& topic, const std::string& payload, bool retain, uint64_t sentAt);
+
+  bool brokerUp = true;
+  uint64_t latency = 1000;
+  uint64_t connackDelay = 0;
+  std::vector<Session> sessions;
+  std::map<std::string, std::string> retained;
+  unsigned long connectCount = 0;
+  unsigned long outageCount = 0;
+};
+
+FakeBroker& simBroker();
@@ -0,0 +1,45 @@
+/*
+   Sterilizer simulator - fake WiFi
+*/
+
+#include "fake_wifi.h"
+#include "sim.h"
+
+FakeWiFi& simWiFi() {
+  static FakeWiFi wifi;
+  return wifi;
+}
+
+void FakeWiFi::setAvailable(bool available) {
+  apAvailable = available;
+  if (!available) {
+    drop();
+  }
+}
+
+void FakeWiFi::drop() {
+  if (joining) {
+    dropCount++;
+    simRaiseWake(SIM_WAKE_WIFI);
+  }
+  joining = false;
+}
+
+void FakeWiFi::setChannel(int32_t channel) {
+  apChannel = channel;
+  drop();
+}
+
+void FakeWiFi::begin(int32_t channel) {
+  if (joining) {
+    return;
+  }
+  joining = true;
+  joinChannel = channel;
+  connectAt = simNow() + connectDelay;
+  simSchedule(connectAt, [] { simRaiseWake(SIM_WAKE_WIFI); });
+}
+
+bool FakeWiFi::connected() const {
+  return apAvailable && joining && simNow() >= connectAt && (joinChannel == 0 || joinChannel == apChannel);
+}
@@ -0,0 +1,44 @@
+/*
+   Sterilizer simulator - fake WiFi
+
+   Stands in for the access point. Scenarios take the link down and up and
+   set how long association takes; WiFi.h reports the result to the sketch.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+class FakeWiFi {
+public:
+  // Whether the access point is reachable at all
+  void setAvailable(bool available);
+  bool available() const { return apAvailable; }
+  // Time from WiFi.begin()/reconnect() to being connected
+  void setConnectDelay(uint64_t us) { connectDelay = us; }
+  // Drops the association, as when the access point reboots
+  void drop();
+  // Moves the access point; a join to another channel never completes
+  void setChannel(int32_t channel);
+  int32_t channel() const { return apChannel; }
+
+  // Used by the WiFi.h stand-in; channel 0 scans
+  void begin(int32_t channel = 0);
+  void reconnect() { begin(joinChannel); }
+  // The device leaving on its own, which is not counted as a drop
+  void leave() { joining = false; }
+  bool connected() const;
+  int rssi() const { return -55; }
+  unsigned long drops() const { return dropCount; }
+
+private:
+  bool apAvailable = true;
+  bool joining = false;
+  int32_t apChannel = 6;
+  int32_t joinChannel = 0;
+  uint64_t connectDelay = 50000;
+  uint64_t connectAt = 0;
+  unsigned long dropCount = 0;
+};
+
+FakeWiFi& simWiFi();
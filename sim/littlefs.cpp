@@ -0,0 +1,120 @@
+/*
+   Sterilizer simulator - LittleFS stand-in
+*/
+
+#include "LittleFS.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// What "pio run -t uploadfs" flashes; copied, never written
+#define SIM_DATA_DIR "data"
+
+LittleFSFS LittleFS;
+
+static std::string root;
+
+void simSetFsRoot(const char* dir) {
+  root = dir;
+}
+
+static bool isFile(const std::string& path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+static void copyFile(const std::string& from, const std::string& to) {
+  FILE* in = fopen(from.c_str(), "rb");
+  FILE* out = in != NULL ? fopen(to.c_str(), "wb") : NULL;
+  char buffer[4096];
+  size_t length;
+  while (out != NULL && (length = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+    fwrite(buffer, 1, length, out);
+  }
+  if (out != NULL) {
+    fclose(out);
+  }
+  if (in != NULL) {
+    fclose(in);
+  }
+}
+
+// Copies each file in from into to, or removes them when to is empty
+static void eachFile(const std::string& from, const std::string& to) {
+  DIR* dir = opendir(from.c_str());
+  if (dir == NULL) {
+    return;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string path = from + "/" + entry->d_name;
+    if (!isFile(path)) {
+      continue;
+    }
+    if (to.empty()) {
+      ::remove(path.c_str());
+    }
+    else {
+      copyFile(path, to + "/" + entry->d_name);
+    }
+  }
+  closedir(dir);
+}
+
+static void removeScratch() {
+  eachFile(root, "");
+  rmdir(root.c_str());
+}
+
+static const std::string& fsRoot() {
+  if (root.empty()) {
+    const char* tmp = getenv("TMPDIR");
+    std::string pattern = std::string(tmp != NULL && tmp[0] != '\0' ? tmp : "/tmp") + "/sterilizer-fs-XXXXXX";
+    if (mkdtemp(&pattern[0]) != NULL) {
+      root = pattern;
+      eachFile(SIM_DATA_DIR, root);
+      atexit(removeScratch);
+    }
+  }
+  return root;
+}
+
+static std::string hostPath(const char* path) {
+  return fsRoot() + path;
+}
+
+bool LittleFSFS::begin(bool formatOnFail) {
+  struct stat info;
+  const std::string& dir = fsRoot();
+  return !dir.empty() && stat(dir.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+bool LittleFSFS::exists(const char* path) {
+  struct stat info;
+  return stat(hostPath(path).c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+File LittleFSFS::open(const char* path, const char* mode) {
+  std::string name = hostPath(path);
+  if (mode[0] == 'w') {
+    FILE* file = fopen(name.c_str(), "wb");
+    return file != NULL ? File(file, 0) : File();
+  }
+  struct stat info;
+  if (stat(name.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+    return File();
+  }
+  FILE* file = fopen(name.c_str(), "rb");
+  return file != NULL ? File(file, info.st_size) : File();
+}
+
+bool LittleFSFS::remove(const char* path) {
+  return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool LittleFSFS::rename(const char* from, const char* to) {
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
@@ -0,0 +1,29 @@
+/*
+   Sterilizer simulator - mbedtls base64 stand-in
+*/
+
+#include "mbedtls/base64.h"
+#include <stdint.h>
+
+static const char base64Chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen) {
+  size_t needed = (slen + 2) / 3 * 4;
+  if (dlen < needed + 1) {
+    *olen = needed + 1;
+    return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+  }
+  size_t used = 0;
+  for (size_t i = 0; i < slen; i += 3) {
+    uint32_t group = (uint32_t)src[i] << 16;
+    if (i + 1 < slen) group |= (uint32_t)src[i + 1] << 8;
+    if (i + 2 < slen) group |= src[i + 2];
+    dst[used++] = base64Chars[(group >> 18) & 0x3F];
+    dst[used++] = base64Chars[(group >> 12) & 0x3F];
+    dst[used++] = i + 1 < slen ? base64Chars[(group >> 6) & 0x3F] : '=';
+    dst[used++] = i + 2 < slen ? base64Chars[group & 0x3F] : '=';
+  }
+  dst[used] = '\0';
+  *olen = used;
+  return 0;
+}
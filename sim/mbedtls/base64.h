@@ -0,0 +1,13 @@
+/*
+   Sterilizer simulator - mbedtls base64 stand-in (encoding only)
+*/
+
+#pragma once
+
+#include <stddef.h>
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+
+// As mbedtls: writes a terminated string to dst, its length to *olen, or
+// fails with the size needed in *olen if dlen has no room for it
+int mbedtls_base64_encode(unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src, size_t slen);
@@ -0,0 +1,67 @@
+/*
+   Sterilizer simulator - Preferences stand-in
+*/
+
+#include "Preferences.h"
+#include <map>
+#include <string.h>
+#include <stdlib.h>
+
+// Values by namespace and key; numbers are kept as their text
+static std::map<std::string, std::map<std::string, std::string> > spaces;
+
+bool Preferences::begin(const char* name, bool readOnly) {
+  if (readOnly && spaces.find(name) == spaces.end()) {
+    return false;
+  }
+  space = name;
+  spaces[space];
+  open = true;
+  this->readOnly = readOnly;
+  return true;
+}
+
+void Preferences::end() {
+  open = false;
+}
+
+bool Preferences::isKey(const char* key) {
+  return open && spaces[space].count(key) > 0;
+}
+
+bool Preferences::remove(const char* key) {
+  return open && !readOnly && spaces[space].erase(key) > 0;
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLen) {
+  if (!isKey(key)) {
+    return 0;
+  }
+  const std::string& saved = spaces[space][key];
+  // Like NVS, a value that does not fit is not read at all
+  if (saved.size() + 1 > maxLen) {
+    return 0;
+  }
+  memcpy(value, saved.c_str(), saved.size() + 1);
+  return saved.size() + 1;
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+  if (!open || readOnly) {
+    return 0;
+  }
+  spaces[space][key] = value;
+  return strlen(value);
+}
+
+long Preferences::getLong(const char* key, long defaultValue) {
+  return isKey(key) ? strtol(spaces[space][key].c_str(), NULL, 10) : defaultValue;
+}
+
+size_t Preferences::putLong(const char* key, long value) {
+  if (!open || readOnly) {
+    return 0;
+  }
+  spaces[space][key] = std::to_string(value);
+  return sizeof(value);
+}
@@ -0,0 +1,108 @@
+/*
+   Sterilizer simulator - PubSubClient stand-in
+*/
+
+#include <PubSubClient.h>
+#include "fake_broker.h"
+#include "sim.h"
+#include <vector>
+
+// How long a connect attempt blocks when nothing answers
+#define SIM_CONNECT_TIMEOUT_US 3000000
+
+bool PubSubClient::connect(const char* id) {
+  clientId = id;
+  if (!simWiFi().connected() || !simBroker().isUp()) {
+    simAdvance(SIM_CONNECT_TIMEOUT_US);
+    connectionState = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  simAdvance(simBroker().connectTime());
+  // The broker may have gone away while the CONNACK was on its way
+  connection = simBroker().connect(clientId);
+  if (connection < 0) {
+    connectionState = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  connectionState = MQTT_CONNECTED;
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  simBroker().disconnect(connection);
+  connection = -1;
+  connectionState = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::connected() {
+  if (connection < 0) {
+    return false;
+  }
+  if (!simWiFi().connected() || !simBroker().connected(connection)) {
+    simBroker().disconnect(connection);
+    connection = -1;
+    connectionState = MQTT_CONNECTION_LOST;
+    return false;
+  }
+  return true;
+}
+
+bool PubSubClient::subscribe(const char* topic) {
+  if (!connected()) {
+    return false;
+  }
+  simBroker().subscribe(connection, topic);
+  return true;
+}
+
+bool PubSubClient::unsubscribe(const char* topic) {
+  if (!connected()) {
+    return false;
+  }
+  simBroker().unsubscribe(connection, topic);
+  return true;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+  return publish(topic, (const uint8_t*)payload, strlen(payload), false);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+  return publish(topic, (const uint8_t*)payload, strlen(payload), retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+  return publish(topic, payload, length, false);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+  if (!connected()) {
+    return false;
+  }
+  // Fixed header, topic length and topic must fit in the buffer along with the payload
+  if (5 + 2 + strlen(topic) + length > bufferSize) {
+    return false;
+  }
+  simBroker().publish(connection, topic, std::string((const char*)payload, length), retained);
+  return true;
+}
+
+bool PubSubClient::loop() {
+  if (!connected()) {
+    return false;
+  }
+  FakeBroker::Message message;
+  if (!simBroker().nextDelivery(connection, simNow(), message)) {
+    return true;
+  }
+  // Messages that do not fit the buffer are read and thrown away
+  if (5 + 2 + message.topic.size() + message.payload.size() > bufferSize || !callback) {
+    return true;
+  }
+  std::vector<char> topic(message.topic.begin(), message.topic.end());
+  topic.push_back('\0');
+  std::vector<uint8_t> payload(message.payload.begin(), message.payload.end());
+  payload.push_back(0);
+  callback(&topic[0], &payload[0], message.payload.size());
+  return true;
+}
@@ -0,0 +1,356 @@
+/*
+   Sterilizer simulator - scenario scripts
+*/
+
+#include "scenario.h"
+#include "fake_broker.h"
+#include "fake_wifi.h"
+#include "sim.h"
+#include "WebServer.h"
+#include "WebSocketsServer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sstream>
+#include <vector>
+
+static uint64_t endTime = 0;
+static double scale = 1.0;
+
+// The host's clock for "timeserver": Unix time, from TIMESERVER_EPOCH_US at the start
+#define TIMESERVER_EPOCH_US 1790000000000000ULL
+// Time the host takes to answer a request
+#define TIMESERVER_TURNAROUND_US 100
+static bool timeServing = false;
+static double hostClockBase = TIMESERVER_EPOCH_US;   // host clock at hostClockFrom
+static uint64_t hostClockFrom = 0;
+static double hostDriftPpm = 0;
+
+// "expect" and "never" checks on the event log
+struct Expectation {
+  bool wanted;           // expect: must be seen; never: must not be
+  uint64_t from;
+  uint64_t until;
+  std::string event;     // pattern for the start of the event, without its time
+  std::string source;    // file:line, for the report
+  bool seen;
+};
+static std::vector<Expectation> expectations;
+
+// Whether event starts with something pattern matches: * is any run of characters, ? any one
+static bool eventMatches(const char* pattern, const char* event) {
+  if (*pattern == '\0') {
+    return true;
+  }
+  if (*pattern == '*') {
+    for (const char* rest = event;; rest++) {
+      if (eventMatches(pattern + 1, rest)) {
+        return true;
+      }
+      if (*rest == '\0') {
+        return false;
+      }
+    }
+  }
+  if (*event == '\0' || (*pattern != '?' && *pattern != *event)) {
+    return false;
+  }
+  return eventMatches(pattern + 1, event + 1);
+}
+
+static void checkEvent(const std::string& event) {
+  uint64_t now = simNow();
+  for (size_t i = 0; i < expectations.size(); i++) {
+    Expectation& expectation = expectations[i];
+    if (!expectation.seen && now >= expectation.from && now <= expectation.until &&
+        eventMatches(expectation.event.c_str(), event.c_str())) {
+      expectation.seen = true;
+    }
+  }
+}
+
+uint64_t scenarioEnd() {
+  return endTime;
+}
+
+static uint64_t toMicros(const std::string& ms) {
+  return (uint64_t)(strtod(ms.c_str(), NULL) * 1000);
+}
+
+// Scenario times are scaled; durations such as latencies are not
+static uint64_t scaledMicros(const std::string& ms) {
+  return (uint64_t)(strtod(ms.c_str(), NULL) * 1000 * scale);
+}
+
+static void hostPublish(const std::string& topic, const std::string& payload, bool retain) {
+  simLog("host %s %s", topic.c_str(), payload.c_str());
+  simBroker().hostPublish(topic, payload, retain);
+}
+
+static uint64_t hostClock(uint64_t now) {
+  return (uint64_t)(hostClockBase + (now - hostClockFrom) * (1 + hostDriftPpm / 1e6));
+}
+
+// Steps the host's clock by stepMs and runs it driftPpm fast from now on
+static void setHostClock(double stepMs, double driftPpm) {
+  uint64_t now = simNow();
+  hostClockBase = hostClock(now) + stepMs * 1000;
+  hostClockFrom = now;
+  hostDriftPpm = driftPpm;
+  timeServing = true;
+}
+
+void scenarioDevicePublished(const std::string& topic, const std::string& payload, uint64_t arrivesUs) {
+  const std::string prefix = "ToHost/";
+  const std::string suffix = "/time";
+  if (!timeServing || topic.size() <= prefix.size() + suffix.size() || topic.compare(0, prefix.size(), prefix) != 0 ||
+      topic.compare(topic.size() - suffix.size(), suffix.size(), suffix) != 0) {
+    return;
+  }
+  std::istringstream words(payload);
+  std::string kind, seq, t1, sync;
+  words >> kind >> seq >> t1 >> sync;
+  if (kind != "time" || t1.compare(0, 3, "t1=") != 0) {
+    return;
+  }
+  // The prop's synchronized clock against the host's, both when the request was sent
+  if (sync.compare(0, 5, "sync=") == 0) {
+    simLog("clock error=%lld", (long long)(strtoull(sync.c_str() + 5, NULL, 10) - hostClock(simNow())));
+  }
+  std::string prop = topic.substr(prefix.size(), topic.size() - prefix.size() - suffix.size());
+  char reply[96];
+  snprintf(reply, sizeof(reply), "time %s %s t2=%llu t3=%llu", seq.c_str(), t1.c_str(),
+           (unsigned long long)hostClock(arrivesUs),
+           (unsigned long long)hostClock(arrivesUs + TIMESERVER_TURNAROUND_US));
+  std::string deviceTopic = "ToDevice/" + prop;
+  std::string message = reply;
+  simSchedule(arrivesUs + TIMESERVER_TURNAROUND_US, [deviceTopic, message]() { hostPublish(deviceTopic, message, false); });
+}
+
+// Everything after the first n words of a line, with the separating space removed
+static std::string restOfLine(const std::string& line, int words) {
+  size_t position = 0;
+  for (int i = 0; i < words; i++) {
+    position = line.find_first_not_of(" \t", position);
+    position = line.find_first_of(" \t", position);
+    if (position == std::string::npos) {
+      return "";
+    }
+  }
+  position = line.find_first_not_of(" \t", position);
+  return position == std::string::npos ? "" : line.substr(position);
+}
+
+static std::string numbered(std::string payload, int n) {
+  size_t marker;
+  char number[16];
+  snprintf(number, sizeof(number), "%d", n);
+  while ((marker = payload.find("{n}")) != std::string::npos) {
+    payload.replace(marker, 3, number);
+  }
+  return payload;
+}
+
+static bool scheduleLine(const std::string& line, const std::string& source) {
+  std::istringstream words(line);
+  std::string when;
+  std::string action;
+  std::string target;
+  words >> when >> action;
+  uint64_t at = scaledMicros(when);
+
+  if (action == "publish" || action == "retain") {
+    words >> target;
+    std::string payload = restOfLine(line, 3);
+    bool retain = action == "retain";
+    simSchedule(at, [target, payload, retain]() { hostPublish(target, payload, retain); });
+  }
+  else if (action == "burst") {
+    int count;
+    std::string every;
+    words >> count >> every >> target;
+    std::string payload = restOfLine(line, 5);
+    for (int n = 0; n < count; n++) {
+      std::string message = numbered(payload, n);
+      simSchedule(at + n * scaledMicros(every), [target, message]() { hostPublish(target, message, false); });
+    }
+  }
+  else if (action == "broker") {
+    std::string value;
+    words >> target >> value;
+    if (target == "down" || target == "up") {
+      bool up = target == "up";
+      simSchedule(at, [up]() { simBroker().setUp(up); });
+    }
+    else if (target == "latency") {
+      uint64_t us = toMicros(value);
+      simSchedule(at, [us]() { simBroker().setLatency(us); });
+    }
+    else if (target == "connack") {
+      uint64_t us = toMicros(value);
+      simSchedule(at, [us]() { simBroker().setConnackDelay(us); });
+    }
+    else {
+      return false;
+    }
+  }
+  else if (action == "wifi") {
+    std::string value;
+    words >> target >> value;
+    if (target == "down" || target == "up") {
+      bool up = target == "up";
+      simSchedule(at, [up]() { simWiFi().setAvailable(up); });
+    }
+    else if (target == "drop") {
+      simSchedule(at, []() { simWiFi().drop(); });
+    }
+    else if (target == "connect") {
+      uint64_t us = toMicros(value);
+      simSchedule(at, [us]() { simWiFi().setConnectDelay(us); });
+    }
+    else if (target == "channel") {
+      int32_t channel = atoi(value.c_str());
+      simSchedule(at, [channel]() { simWiFi().setChannel(channel); });
+    }
+    else {
+      return false;
+    }
+  }
+  else if (action == "input") {
+    int pin;
+    int level;
+    if (!(words >> pin >> level)) {
+      return false;
+    }
+    simSchedule(at, [pin, level]() {
+      simLog("input %d %d", pin, level);
+      simSetInput(pin, level);
+    });
+  }
+  else if (action == "http") {
+    if (!(words >> target)) {
+      return false;
+    }
+    simSchedule(at, [target]() {
+      simLog("host http GET %s", target.c_str());
+      simHttpGet(target);
+    });
+  }
+  else if (action == "ws") {
+    if (!(words >> target)) {
+      return false;
+    }
+    if (target == "open") {
+      simSchedule(at, []() {
+        simLog("host ws open");
+        simWebSocketOpen();
+      });
+    }
+    else if (target == "close") {
+      simSchedule(at, []() {
+        simLog("host ws close");
+        simWebSocketClose();
+      });
+    }
+    else if (target == "send") {
+      std::string text = restOfLine(line, 3);
+      simSchedule(at, [text]() {
+        simLog("host ws %s", text.c_str());
+        simWebSocketSend(text);
+      });
+    }
+    else {
+      return false;
+    }
+  }
+  else if (action == "serial") {
+    std::string text = restOfLine(line, 2);
+    simSchedule(at, [text]() {
+      simLog("host serial %s", text.c_str());
+      simSerialInput(text + "\n");
+    });
+  }
+  else if (action == "timeserver") {
+    std::string step;
+    double drift = 0;
+    words >> step;
+    if (step == "off") {
+      simSchedule(at, []() { timeServing = false; });
+    }
+    else if (!step.empty()) {
+      words >> drift;
+      double stepMs = strtod(step.c_str(), NULL);
+      simSchedule(at, [stepMs, drift]() { setHostClock(stepMs, drift); });
+    }
+    else {
+      return false;
+    }
+  }
+  else if (action == "expect" || action == "never") {
+    std::string within;
+    words >> within;
+    std::string event = restOfLine(line, 3);
+    if (within.empty() || event.empty()) {
+      return false;
+    }
+    Expectation expectation = { action == "expect", at, at + scaledMicros(within), event, source, false };
+    expectations.push_back(expectation);
+  }
+  else if (action == "mark") {
+    std::string text = restOfLine(line, 2);
+    simSchedule(at, [text]() { simLog("mark %s", text.c_str()); });
+  }
+  else if (action == "end") {
+    endTime = at;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+bool loadScenario(const char* path, double timeScale) {
+  scale = timeScale;
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    fprintf(stderr, "cannot open scenario %s\n", path);
+    return false;
+  }
+  char buffer[1024];
+  int lineNumber = 0;
+  bool ok = true;
+  while (fgets(buffer, sizeof(buffer), file) != NULL) {
+    lineNumber++;
+    std::string line(buffer);
+    while (!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r')) {
+      line.erase(line.size() - 1);
+    }
+    size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos || line[start] == '#') {
+      continue;
+    }
+    char source[512];
+    snprintf(source, sizeof(source), "%s:%d", path, lineNumber);
+    if (!scheduleLine(line.substr(start), source)) {
+      fprintf(stderr, "%s:%d: cannot understand \"%s\"\n", path, lineNumber, line.c_str());
+      ok = false;
+    }
+  }
+  fclose(file);
+  simSetLogListener(checkEvent);
+  return ok;
+}
+
+int scenarioFailures() {
+  int failures = 0;
+  for (size_t i = 0; i < expectations.size(); i++) {
+    const Expectation& expectation = expectations[i];
+    if (expectation.seen != expectation.wanted) {
+      fprintf(stderr, "%s: %s \"%s\" between %.3f and %.3f ms\n", expectation.source.c_str(),
+              expectation.wanted ? "did not see" : "saw", expectation.event.c_str(),
+              expectation.from / 1000.0, expectation.until / 1000.0);
+      failures++;
+    }
+  }
+  return failures;
+}
@@ -0,0 +1,69 @@
+/*
+   Sterilizer simulator - scenario scripts
+
+   A scenario is a text file of timed actions, one per line, applied to the
+   fake broker, the fake WiFi and the input pins as the virtual clock
+   passes them. Times are milliseconds since the simulator started; blank
+   lines and lines starting with # are ignored.
+
+     <ms> publish <topic> <payload...>      host publishes a message
+     <ms> retain <topic> <payload...>       host publishes a retained message
+     <ms> burst <count> <every ms> <topic> <payload...>
+                                            host publishes count messages; {n}
+                                            in the payload becomes 0, 1, ...
+     <ms> broker down | up                  outage, or the end of one
+     <ms> broker latency <ms>               one-way delay to and from the device
+     <ms> broker connack <ms>               extra delay before a CONNACK
+     <ms> wifi down | up                    access point gone, or back
+     <ms> wifi drop                         association lost, access point stays up
+     <ms> wifi connect <ms>                 time taken to associate
+     <ms> wifi channel <n>                  access point moves to channel n
+                                            (6 at the start)
+     <ms> input <pin> <0|1>                 drive an input pin
+     <ms> http <path>                       GET a page from the sketch's web server
+     <ms> ws open | close                   web panel connects, or goes away
+     <ms> ws send <text...>                 web panel sends a command
+     <ms> serial <text...>                  line typed on the serial console
+     <ms> timeserver <step ms> [<ppm>]      host answers the props' time requests
+                                            (src/clocksync.h), its clock stepped
+                                            by step and running ppm fast from here
+     <ms> timeserver off                    host stops answering
+     <ms> mark <text...>                    write a marker into the event log
+     <ms> expect <within ms> <event...>     an event starting with these words
+                                            must be logged within the time given
+     <ms> never <for ms> <event...>         no such event may be logged for the
+                                            time given
+     <ms> end                               stop the simulation
+
+   Host publishes are written to the event log as "host <topic> <payload>"
+   when they reach the broker, web requests as "host http GET <path>",
+   the panel's frames as "host ws <text>", "host ws open" or
+   "host ws close", console lines as "host serial <text>", and input
+   changes as "input <pin> <level>", so a log shows what each output
+   followed. While the time server runs, a request carrying the prop's
+   synchronized time logs "clock error=<us>", that time less the host's.
+   tools/mqtt_capture.py records live traffic in this format, which makes
+   a capture from a real game a scenario that can be replayed.
+
+   Events for "expect" and "never" are written as in the log, without the
+   time, e.g. "pub ToHost/Sterilizer ack r1 reset ok" or "gpio 33 0", and
+   match any event that starts that way; * stands for any run of
+   characters and ? for any one, so "clock error=-????" is an error of a
+   millisecond or more behind. A scenario with checks is a test: the
+   simulator reports each one that fails and exits with status 1.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// Schedules every action in the file, with its times multiplied by timeScale.
+// Returns false, after printing why, if the file cannot be read.
+bool loadScenario(const char* path, double timeScale = 1.0);
+// Time of the "end" action, or 0 if there is none
+uint64_t scenarioEnd();
+// Reports, on stderr, each "expect" or "never" that failed, and returns how many did
+int scenarioFailures();
+// Called with every message the sketch publishes, when it is published
+void scenarioDevicePublished(const std::string& topic, const std::string& payload, uint64_t arrivesUs);
@@ -0,0 +1,294 @@
+/*
+   Sterilizer simulator - virtual clock, pins, event log and the Arduino
+   core, Serial and FastLED stand-ins
+*/
+
+#include "sim.h"
+#include <Arduino.h>
+#include <FastLED.h>
+#include <WiFi.h>
+#include <stdarg.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+CFastLED FastLED;
+
+// Each call to millis() or micros() costs this much virtual time, so
+// busy-wait loops in the sketch still make progress
+#define CLOCK_READ_COST_US 1
+
+static uint64_t now = 0;
+static std::multimap<uint64_t, std::function<void()> > scheduled;
+static std::map<int, int> pinLevels;
+static std::vector<CRGB> shownFrame;
+static bool quiet = false;
+static bool eventLog = true;
+static std::map<int, void (*)()> interruptHandlers;
+static std::function<void(int)> wakeHandler;
+static bool woken = false;
+static std::function<void(const std::string&)> logListener;
+
+
+// Clock
+uint64_t simNow() {
+  return now;
+}
+
+// Runs the next scheduled action due by target; false if there is none
+static bool runNextAction(uint64_t target) {
+  if (scheduled.empty() || scheduled.begin()->first > target) {
+    return false;
+  }
+  std::multimap<uint64_t, std::function<void()> >::iterator next = scheduled.begin();
+  if (next->first > now) {
+    now = next->first;
+  }
+  std::function<void()> action = next->second;
+  scheduled.erase(next);
+  action();
+  return true;
+}
+
+void simAdvance(uint64_t us) {
+  uint64_t target = now + us;
+  while (runNextAction(target)) {
+  }
+  now = target;
+}
+
+void simSleep(uint64_t us) {
+  uint64_t target = now + us;
+  woken = false;
+  while (!woken && runNextAction(target)) {
+  }
+  if (!woken) {
+    now = target;
+  }
+}
+
+void simWake() {
+  woken = true;
+}
+
+void simSetWakeHandler(std::function<void(int source)> handler) {
+  wakeHandler = handler;
+}
+
+void simRaiseWake(int source) {
+  if (wakeHandler) {
+    wakeHandler(source);
+  }
+}
+
+void simSchedule(uint64_t at, std::function<void()> action) {
+  scheduled.insert(std::make_pair(at, action));
+}
+
+unsigned long millis() {
+  simAdvance(CLOCK_READ_COST_US);
+  // The ESP32's counters are 32 bits wide; wrap the same way
+  return (uint32_t)(now / 1000);
+}
+
+unsigned long micros() {
+  simAdvance(CLOCK_READ_COST_US);
+  return (uint32_t)now;
+}
+
+void delay(unsigned long ms) {
+  simAdvance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  simAdvance(us);
+}
+
+void yield() {
+}
+
+
+// Pins
+int simPinLevel(int pin) {
+  std::map<int, int>::iterator level = pinLevels.find(pin);
+  return level == pinLevels.end() ? LOW : level->second;
+}
+
+void simSetInput(int pin, int level) {
+  bool changed = simPinLevel(pin) != level;
+  pinLevels[pin] = level;
+  std::map<int, void (*)()>::iterator handler = interruptHandlers.find(pin);
+  if (changed && handler != interruptHandlers.end()) {
+    handler->second();
+  }
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode) {
+  // Every change is reported; the sketch only asks for CHANGE
+  interruptHandlers[pin] = handler;
+}
+
+void detachInterrupt(uint8_t pin) {
+  interruptHandlers.erase(pin);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (mode == INPUT_PULLUP && pinLevels.find(pin) == pinLevels.end()) {
+    pinLevels[pin] = HIGH;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  // Only changes are logged; the sketch rewrites the relays every loop() once solved
+  std::map<int, int>::iterator current = pinLevels.find(pin);
+  if (current != pinLevels.end() && current->second == level) {
+    return;
+  }
+  pinLevels[pin] = level;
+  simLog("gpio %u %u", pin, level);
+}
+
+int digitalRead(uint8_t pin) {
+  return simPinLevel(pin);
+}
+
+
+// Event Log
+void simLog(const char* format, ...) {
+  if (!eventLog) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  std::string event(length > 0 ? length : 0, '\0');
+  va_start(args, format);
+  vsnprintf(&event[0], event.size() + 1, format, args);
+  va_end(args);
+  printf("%llu.%03llu %s\n", (unsigned long long)(now / 1000), (unsigned long long)(now % 1000), event.c_str());
+  if (logListener) {
+    logListener(event);
+  }
+}
+
+void simSetLogListener(std::function<void(const std::string& event)> listener) {
+  logListener = listener;
+}
+
+void simSetQuiet(bool on) {
+  quiet = on;
+}
+
+bool simQuiet() {
+  return quiet;
+}
+
+void simSetEventLog(bool enabled) {
+  eventLog = enabled;
+}
+
+
+// Serial
+static std::deque<uint8_t> serialInput;
+static void (*serialReceived)() = NULL;
+
+void simSerialInput(const std::string& text) {
+  serialInput.insert(serialInput.end(), text.begin(), text.end());
+  if (serialReceived != NULL) {
+    serialReceived();
+  }
+}
+
+void HardwareSerial::onReceive(void (*callback)()) {
+  serialReceived = callback;
+}
+
+int HardwareSerial::available() {
+  return serialInput.size();
+}
+
+int HardwareSerial::read() {
+  if (serialInput.empty()) {
+    return -1;
+  }
+  uint8_t c = serialInput.front();
+  serialInput.pop_front();
+  return c;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (!quiet) {
+    fputc(c, stderr);
+  }
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (!quiet) {
+    fwrite(buffer, 1, size, stderr);
+  }
+  return size;
+}
+
+size_t HardwareSerial::print(const char* text) {
+  return write((const uint8_t*)text, strlen(text));
+}
+
+size_t HardwareSerial::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t HardwareSerial::print(int value) {
+  return printf("%d", value);
+}
+
+size_t HardwareSerial::print(unsigned int value) {
+  return printf("%u", value);
+}
+
+size_t HardwareSerial::print(long value) {
+  return printf("%ld", value);
+}
+
+size_t HardwareSerial::print(unsigned long value) {
+  return printf("%lu", value);
+}
+
+size_t HardwareSerial::print(const IPAddress& address) {
+  return printf("%u.%u.%u.%u", address.octets[0], address.octets[1], address.octets[2], address.octets[3]);
+}
+
+int HardwareSerial::printf(const char* format, ...) {
+  char text[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  print(text);
+  return length;
+}
+
+
+// FastLED
+void CFastLED::show() {
+  std::vector<CRGB> frame(leds, leds + ledCount);
+  if (frame == shownFrame) {
+    return;
+  }
+  shownFrame = frame;
+
+  int lit = 0;
+  CRGB first;
+  for (int i = 0; i < ledCount; i++) {
+    if (leds[i] != CRGB(CRGB::Black)) {
+      if (lit == 0) {
+        first = leds[i];
+      }
+      lit++;
+    }
+  }
+  simLog("led %d %02x%02x%02x", lit, first.r, first.g, first.b);
+}
@@ -0,0 +1,60 @@
+/*
+   Sterilizer simulator - virtual clock, pins and event log
+
+   The native build runs the unmodified sketch against stand-ins for the
+   Arduino core, WiFi, PubSubClient, FastLED, the web server and LittleFS.
+   Time is virtual: delay() and friends advance the clock instantly, so a
+   scenario covering minutes of play runs in milliseconds and always the
+   same way.
+
+   Everything the sketch does that a player or the host could see is
+   written to the event log (stdout), one line per event:
+
+     <time ms> gpio <pin> <level>
+     <time ms> led <lit pixels> <first lit colour as rrggbb>
+     <time ms> pub <topic> <payload>
+     <time ms> http <code> <path> <bytes>
+     <time ms> ws <text>
+
+   Scenario actions add their own lines (see scenario.h).
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <string>
+
+// Virtual time in microseconds since the simulator started
+uint64_t simNow();
+// Moves the clock forward, running any scheduled actions that fall due on the way
+void simAdvance(uint64_t us);
+// Runs action once the clock reaches at
+void simSchedule(uint64_t at, std::function<void()> action);
+
+// Pins driven by the sketch or by the scenario
+int simPinLevel(int pin);
+void simSetInput(int pin, int level);
+
+// Wake sources for the sketch's tickless loop: the fakes raise one when a
+// message reaches the device's socket or the WiFi link changes
+enum SimWakeSource {
+  SIM_WAKE_NETWORK = 1,
+  SIM_WAKE_WIFI = 2,
+};
+void simSetWakeHandler(std::function<void(int source)> handler);
+void simRaiseWake(int source);
+// Moves the clock forward like simAdvance(), stopping early at the first simWake()
+void simSleep(uint64_t us);
+void simWake();
+
+// Bytes typed on the serial port, for Serial.read()
+void simSerialInput(const std::string& text);
+
+// Event log
+void simLog(const char* format, ...) __attribute__((format(printf, 1, 2)));
+void simSetQuiet(bool quiet);  // hides the sketch's Serial output
+bool simQuiet();
+void simSetEventLog(bool enabled);  // turns the event log off, e.g. while fuzzing
+// Called with each event as it is logged, without its time, e.g. for a scenario's checks
+void simSetLogListener(std::function<void(const std::string& event)> listener);
@@ -0,0 +1,125 @@
+/*
+   Sterilizer simulator - entry point
+
+   Runs setup() and then loop() against the fakes until the scenario ends,
+   writing the event log to stdout and the sketch's Serial output to stderr.
+   Exits with status 1 if any of the scenario's checks failed.
+
+   Usage: sterilizer-sim [options] [scenario]
+     --until <ms>       stop at this virtual time (default: the scenario's end,
+                        or 60000)
+     --loop-us <us>     virtual time one pass of loop() costs (default 50)
+     --time-scale <f>   multiply the scenario's times by f, e.g. 0.5 to replay
+                        a capture at double speed
+     --trace <file>     write the event trace (trace.h format) on exit
+     --fs-root <dir>    keep the LittleFS files in dir (default: a temporary
+                        copy of data/, removed on exit)
+     --quiet            hide the sketch's Serial output
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fake_broker.h"
+#include "fake_wifi.h"
+#include "LittleFS.h"
+#include "scenario.h"
+#include "sim.h"
+#include "trace.h"
+
+void setup();
+void loop();
+
+static bool writeTrace(const char* path) {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  uint8_t chunk[256];
+  size_t offset = 0;
+  size_t length;
+  while ((length = traceDumpRead(offset, chunk, sizeof(chunk))) > 0) {
+    fwrite(chunk, 1, length, file);
+    offset += length;
+  }
+  return fclose(file) == 0;
+}
+
+int main(int argc, char** argv) {
+  uint64_t until = 0;
+  uint64_t loopCost = 50;
+  const char* tracePath = NULL;
+  const char* scenarioPath = NULL;
+  double timeScale = 1.0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--until") == 0 && i + 1 < argc) {
+      until = (uint64_t)(atof(argv[++i]) * 1000);
+    }
+    else if (strcmp(argv[i], "--loop-us") == 0 && i + 1 < argc) {
+      loopCost = strtoull(argv[++i], NULL, 10);
+    }
+    else if (strcmp(argv[i], "--time-scale") == 0 && i + 1 < argc) {
+      timeScale = atof(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      tracePath = argv[++i];
+    }
+    else if (strcmp(argv[i], "--fs-root") == 0 && i + 1 < argc) {
+      simSetFsRoot(argv[++i]);
+    }
+    else if (strcmp(argv[i], "--quiet") == 0) {
+      simSetQuiet(true);
+    }
+    else if (argv[i][0] != '-' && scenarioPath == NULL) {
+      scenarioPath = argv[i];
+    }
+    else {
+      fprintf(stderr, "usage: %s [--until ms] [--loop-us us] [--time-scale f] [--trace file] [--fs-root dir] [--quiet] [scenario]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  if (timeScale <= 0) {
+    fprintf(stderr, "--time-scale must be positive\n");
+    return 2;
+  }
+  if (scenarioPath != NULL && !loadScenario(scenarioPath, timeScale)) {
+    return 2;
+  }
+  if (until == 0) {
+    until = scenarioEnd() != 0 ? scenarioEnd() : 60000000ULL;
+  }
+
+  simBroker().onDevicePublish = [](const std::string& clientId, const FakeBroker::Message& message) {
+    simLog("pub %s %s", message.topic.c_str(), message.payload.c_str());
+    scenarioDevicePublished(message.topic, message.payload, message.deliverAt);
+  };
+
+  clock_t started = clock();
+  unsigned long passes = 0;
+  setup();
+  while (simNow() < until) {
+    loop();
+    simAdvance(loopCost);
+    passes++;
+  }
+  double seconds = (double)(clock() - started) / CLOCKS_PER_SEC;
+
+  fprintf(stderr, "\nsimulated %.3f s in %.3f s: %lu loop passes, %lu broker connects, "
+          "%lu broker outages, %lu WiFi drops\n",
+          simNow() / 1e6, seconds, passes, simBroker().connects(), simBroker().outages(), simWiFi().drops());
+
+  if (tracePath != NULL && !writeTrace(tracePath)) {
+    fprintf(stderr, "cannot write trace %s\n", tracePath);
+    return 1;
+  }
+  int failures = scenarioFailures();
+  if (failures > 0) {
+    fprintf(stderr, "%d scenario check%s failed\n", failures, failures == 1 ? "" : "s");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+/*
+   Sterilizer simulator - WebServer stand-in
+*/
+
+#include "WebServer.h"
+#include "sim.h"
+#include <deque>
+#include <stdio.h>
+#include <string.h>
+
+static std::deque<std::string> requests;
+
+void simHttpGet(const std::string& path) {
+  requests.push_back(path);
+  simRaiseWake(SIM_WAKE_NETWORK);
+}
+
+void WebServer::handleClient() {
+  if (requests.empty()) {
+    return;
+  }
+  path = requests.front();
+  requests.pop_front();
+  std::map<std::string, THandlerFunction>::iterator handler = handlers.find(path);
+  if (handler != handlers.end()) {
+    handler->second();
+  }
+  else if (notFound) {
+    notFound();
+  }
+  else {
+    send(404, "text/plain", "");
+  }
+}
+
+void WebServer::send(int code, const char* contentType, const char* content) {
+  send_P(code, contentType, content, strlen(content));
+}
+
+void WebServer::logResponse(int code, size_t length) {
+  simLog("http %d %s %lu", code, path.c_str(), (unsigned long)length);
+}
+
+void WebServer::send_P(int code, const char* contentType, const char* content, size_t contentLength) {
+  logResponse(code, contentLength);
+  if (!simQuiet()) {
+    fwrite(content, 1, contentLength, stderr);
+  }
+}
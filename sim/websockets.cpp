@@ -0,0 +1,77 @@
+/*
+   Sterilizer simulator - WebSocketsServer stand-in
+*/
+
+#include "WebSocketsServer.h"
+#include "sim.h"
+#include <deque>
+#include <string.h>
+
+struct SimFrame {
+  WStype_t type;
+  std::string text;
+};
+
+static std::deque<SimFrame> frames;
+static bool clientOpen = false;
+
+static void queueFrame(WStype_t type, const std::string& text) {
+  SimFrame frame = { type, text };
+  frames.push_back(frame);
+  simRaiseWake(SIM_WAKE_NETWORK);
+}
+
+void simWebSocketOpen() {
+  queueFrame(WStype_CONNECTED, "");
+}
+
+void simWebSocketClose() {
+  queueFrame(WStype_DISCONNECTED, "");
+}
+
+void simWebSocketSend(const std::string& text) {
+  queueFrame(WStype_TEXT, text);
+}
+
+void WebSocketsServer::loop() {
+  while (!frames.empty()) {
+    SimFrame frame = frames.front();
+    frames.pop_front();
+    // Text sent before the client opens, or after it closes, goes nowhere
+    if (frame.type == WStype_TEXT && !clientOpen) {
+      continue;
+    }
+    if (frame.type == WStype_CONNECTED) {
+      clientOpen = true;
+    }
+    else if (frame.type == WStype_DISCONNECTED) {
+      clientOpen = false;
+    }
+    if (handler) {
+      handler(0, frame.type, (uint8_t*)&frame.text[0], frame.text.size());
+    }
+  }
+}
+
+bool WebSocketsServer::sendTXT(uint8_t num, const char* payload, size_t length) {
+  if (!clientOpen || num != 0) {
+    return false;
+  }
+  if (length == 0) {
+    length = strlen(payload);
+  }
+  // The state JSON ends in a newline, which would split the log line
+  while (length > 0 && payload[length - 1] == '\n') {
+    length--;
+  }
+  simLog("ws %.*s", (int)length, payload);
+  return true;
+}
+
+bool WebSocketsServer::broadcastTXT(const char* payload, size_t length) {
+  return sendTXT(0, payload, length);
+}
+
+int WebSocketsServer::connectedClients(bool ping) {
+  return clientOpen ? 1 : 0;
+}
@@ -0,0 +1,328 @@
+/*
+   Sterilizer puzzle - clock synchronization
+
+   The prop's clock is micros() carried to 64 bits, so that offsets and
+   drift can be worked in whole microseconds without floating point. A
+   reply is read in mqttCallback(), like a ping, so that t4 is the time it
+   came off the socket and not when the loop got to it.
+*/
+
+#include "clocksync.h"
+#include "sterilizer.h"
+#include "telemetry.h"
+#include "tickless.h"
+#include <stdlib.h>
+
+// Longest "time" reply
+#define CLOCK_REPLY_LENGTH 96
+
+const char timeTopic[] = "ToHost/Sterilizer/time";
+
+ClockStats clockStats;
+
+// The prop's clock
+static uint64_t localHigh = 0;          // micros() wraps, in the top 32 bits
+static unsigned long lastMicros = 0;
+
+// The host's clock is the prop's plus offsetAt()
+static bool synced = false;
+static uint64_t baseLocal = 0;          // when the last round was applied
+static int64_t baseOffset = 0;
+static int64_t slewTotal = 0;           // error being slewed away from baseLocal on
+static long driftPpb = 0;
+static bool driftKnown = false;
+// Offset measured at the start of the current drift estimate
+static bool anchored = false;
+static uint64_t anchorLocal = 0;
+static int64_t anchorOffset = 0;
+
+// The round under way
+static unsigned long nextSeq = 1;
+static unsigned long roundSeq = 0;      // sequence number of its first request
+static int roundSent = 0;               // 0 when no round is under way
+static int roundReplies = 0;
+static uint64_t sentLocal[CLOCK_BURST]; // t1 of each request, 0 once answered
+static unsigned long lastSendMs = 0;
+static bool haveBest = false;
+static uint64_t bestLocal = 0;          // prop's clock halfway between t1 and t4
+static int64_t bestOffset = 0;
+static int64_t bestDelay = 0;
+
+static unsigned long nextRoundMs = 0;
+static unsigned long retryMs = CLOCK_RETRY_MS;
+
+
+// The Prop's Clock
+
+static uint64_t localNow() {
+  unsigned long now = micros();
+  if (now < lastMicros) {
+    localHigh += 1ULL << 32;
+  }
+  lastMicros = now;
+  return localHigh | now;
+}
+
+// A micros() reading from the last 71 minutes, on the prop's clock
+static uint64_t localAt(unsigned long us) {
+  uint64_t now = localNow();
+  return now - (unsigned long)(lastMicros - us);
+}
+
+static int64_t offsetAt(uint64_t local) {
+  int64_t elapsed = (int64_t)(local - baseLocal);
+  int64_t slewed = elapsed > 0 ? elapsed * CLOCK_SLEW_PPM / 1000000 : 0;
+  int64_t slew = slewTotal;
+  if (slew > slewed) {
+    slew = slewed;
+  }
+  else if (slew < -slewed) {
+    slew = -slewed;
+  }
+  return baseOffset + elapsed * driftPpb / 1000000000 + slew;
+}
+
+
+// Rounds
+
+static void sendRequest(unsigned long nowMs) {
+  char line[80];
+  uint64_t t1 = localNow();
+  int used = snprintf(line, sizeof(line), "time %lu t1=%llu", nextSeq, (unsigned long long)t1);
+  if (synced) {
+    snprintf(line + used, sizeof(line) - used, " sync=%llu", (unsigned long long)(t1 + offsetAt(t1)));
+  }
+  sentLocal[roundSent++] = t1;
+  nextSeq++;
+  lastSendMs = nowMs;
+  MQTTclient.publish(timeTopic, line);
+}
+
+static void updateDrift() {
+  if (!anchored) {
+    anchored = true;
+    anchorLocal = bestLocal;
+    anchorOffset = bestOffset;
+    return;
+  }
+  int64_t span = (int64_t)(bestLocal - anchorLocal);
+  if (span < (int64_t)CLOCK_DRIFT_MIN_MS * 1000) {
+    return;
+  }
+  int64_t measured = (bestOffset - anchorOffset) * 1000000000 / span;
+  const int64_t limit = (int64_t)CLOCK_MAX_DRIFT_PPM * 1000;
+  if (measured > limit) {
+    measured = limit;
+  }
+  else if (measured < -limit) {
+    measured = -limit;
+  }
+  driftPpb = driftKnown ? driftPpb + (long)((measured - driftPpb) / 4) : (long)measured;
+  driftKnown = true;
+  anchorLocal = bestLocal;
+  anchorOffset = bestOffset;
+}
+
+static void endRound(unsigned long nowMs) {
+  roundSent = 0;
+  if (!haveBest) {
+    clockStats.lost++;
+    if (synced) {
+      nextRoundMs = nowMs + CLOCK_ROUND_MS;
+    }
+    else {
+      nextRoundMs = nowMs + retryMs;
+      retryMs = retryMs * 2 < CLOCK_ROUND_MS ? retryMs * 2 : CLOCK_ROUND_MS;
+    }
+    return;
+  }
+  clockStats.rounds++;
+  clockStats.delayUs = (long)bestDelay;
+  retryMs = CLOCK_RETRY_MS;
+  nextRoundMs = nowMs + CLOCK_ROUND_MS;
+
+  // Rebase at now, so that the clock carries on from where it is
+  uint64_t now = localNow();
+  if (!synced) {
+    synced = true;
+    baseLocal = now;
+    baseOffset = bestOffset;
+    slewTotal = 0;
+    clockStats.steps++;
+    clockStats.errorUs = 0;
+    updateDrift();
+    return;
+  }
+  int64_t error = bestOffset - offsetAt(bestLocal);
+  int64_t current = offsetAt(now);
+  baseLocal = now;
+  clockStats.errorUs = (long)error;
+  if (error > CLOCK_STEP_US || error < -CLOCK_STEP_US) {
+    // Offsets from before a step say nothing about the drift
+    baseOffset = current + error;
+    slewTotal = 0;
+    clockStats.steps++;
+    anchored = false;
+  }
+  else {
+    baseOffset = current;
+    slewTotal = error;
+    // More than a known drift explains: the host's clock was set
+    if (driftKnown && (error > CLOCK_JUMP_US || error < -CLOCK_JUMP_US)) {
+      anchored = false;
+    }
+  }
+  updateDrift();
+}
+
+void clockSetup() {
+  localNow();
+  nextRoundMs = millis();
+}
+
+void clockLoop() {
+  localNow();
+  unsigned long now = millis();
+  if (roundSent == 0) {
+    if ((long)(now - nextRoundMs) < 0) {
+      wakeWithin(nextRoundMs - now);
+      return;
+    }
+    // Reconnecting wakes the loop
+    if (!MQTTclient.connected()) {
+      return;
+    }
+    roundSeq = nextSeq;
+    roundReplies = 0;
+    haveBest = false;
+    sendRequest(now);
+    wakeWithin(CLOCK_BURST_GAP_MS);
+    return;
+  }
+  if (roundSent < CLOCK_BURST) {
+    if (now - lastSendMs < CLOCK_BURST_GAP_MS) {
+      wakeWithin(CLOCK_BURST_GAP_MS - (now - lastSendMs));
+    }
+    else if (MQTTclient.connected()) {
+      sendRequest(now);
+      wakeWithin(CLOCK_BURST_GAP_MS);
+    }
+    else {
+      endRound(now);
+    }
+    return;
+  }
+  if (roundReplies < roundSent && now - lastSendMs < CLOCK_REPLY_WAIT_MS) {
+    wakeWithin(CLOCK_REPLY_WAIT_MS - (now - lastSendMs));
+    return;
+  }
+  endRound(now);
+}
+
+// "t<n>=<digits>" at text, or false
+static bool readStamp(const char*& text, char name, uint64_t& value) {
+  if (text[0] != ' ' || text[1] != 't' || text[2] != name || text[3] != '=' || text[4] < '0' || text[4] > '9') {
+    return false;
+  }
+  char* end;
+  value = strtoull(text + 4, &end, 10);
+  text = end;
+  return true;
+}
+
+bool clockMessage(const byte* message, unsigned int length, unsigned long receivedUs) {
+  if (length < 4 || strncmp((const char*)message, "time", 4) != 0 || (length > 4 && message[4] != ' ')) {
+    return false;
+  }
+  uint64_t t4 = localAt(receivedUs);
+  clockStats.replies++;
+  if (length > CLOCK_REPLY_LENGTH) {
+    clockStats.rejected++;
+    return true;
+  }
+  char line[CLOCK_REPLY_LENGTH + 1];
+  memcpy(line, message, length);
+  line[length] = '\0';
+
+  char* end;
+  unsigned long seq = strtoul(line + 4, &end, 10);
+  const char* at = end;
+  uint64_t t1, t2, t3;
+  if (end == line + 4 || !readStamp(at, '1', t1) || !readStamp(at, '2', t2) || !readStamp(at, '3', t3) ||
+      *at != '\0') {
+    clockStats.rejected++;
+    return true;
+  }
+  // Only the round under way, each request once
+  unsigned long index = seq - roundSeq;
+  if (roundSent == 0 || index >= (unsigned long)roundSent || sentLocal[index] != t1 || t1 == 0) {
+    clockStats.rejected++;
+    return true;
+  }
+  sentLocal[index] = 0;
+  roundReplies++;
+
+  int64_t delay = (int64_t)(t4 - t1) - (int64_t)(t3 - t2);
+  if (t3 < t2 || delay > CLOCK_MAX_DELAY_US) {
+    clockStats.rejected++;
+    return true;
+  }
+  if (delay < 0) {
+    delay = 0;
+  }
+  if (!haveBest || delay < bestDelay) {
+    haveBest = true;
+    bestDelay = delay;
+    bestOffset = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2;
+    bestLocal = t1 + (t4 - t1) / 2;
+  }
+  return true;
+}
+
+
+// The Synchronized Clock
+
+bool clockSynced() {
+  return synced;
+}
+
+uint64_t clockSyncedUs(unsigned long localUs) {
+  if (!synced) {
+    return 0;
+  }
+  uint64_t local = localAt(localUs);
+  return local + offsetAt(local);
+}
+
+uint64_t clockNowMs() {
+  return clockSyncedUs(micros()) / 1000;
+}
+
+void clockStamp(char* line, size_t size) {
+  if (!synced) {
+    return;
+  }
+  char stamp[24];
+  int length = snprintf(stamp, sizeof(stamp), " at=%llu", (unsigned long long)clockNowMs());
+  size_t used = strlen(line);
+  if (used + length < size) {
+    memcpy(line + used, stamp, length + 1);
+  }
+}
+
+long clockDriftPpb() {
+  return driftPpb;
+}
+
+
+// Reporting
+
+void publishClockStats() {
+  char line[160];
+  long long offset = synced ? (long long)offsetAt(localNow()) : 0;
+  snprintf(line, sizeof(line),
+           "clock synced=%d offset=%lld drift=%ld delay=%ld error=%ld rounds=%lu lost=%lu rejected=%lu steps=%lu",
+           synced ? 1 : 0, offset, driftPpb, clockStats.delayUs, clockStats.errorUs, clockStats.rounds,
+           clockStats.lost, clockStats.rejected, clockStats.steps);
+  publishStatsLine(line);
+}
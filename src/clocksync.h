@@ -0,0 +1,100 @@
+/*
+   Sterilizer puzzle - clock synchronization
+
+   Every prop times things with its own micros(), which starts at boot and
+   runs a few tens of ppm fast or slow, so traces, acks and stats from two
+   props cannot be lined up. This module keeps an estimate of the host's
+   clock (Unix time in microseconds) from a two-way exchange over MQTT:
+
+     to the host    ToHost/Sterilizer/time  "time <seq> t1=<us> [sync=<us>]"
+     from the host  ToDevice/Sterilizer     "time <seq> t1=<us> t2=<us> t3=<us>"
+
+   t1 is the prop's clock when it sent the request (micros() carried to 64
+   bits), echoed back; t2 and t3 are the host's clock when it read the
+   request and when it sent the reply; t4, the prop's clock when the reply
+   came off the socket, is taken where pings are (mqttCallback). As NTP:
+
+     offset = ((t2 - t1) + (t3 - t4)) / 2    host clock - prop clock
+     delay  = (t4 - t1) - (t3 - t2)          time on the wire, both ways
+
+   The offset is off by at most delay / 2, so a round sends CLOCK_BURST
+   requests CLOCK_BURST_GAP_MS apart and keeps the reply with the shortest
+   delay; replies slower than CLOCK_MAX_DELAY_US are not used. sync= is
+   the prop's synchronized time when it sent the request, once it has one,
+   for the host to check it against its own.
+
+   The synchronized clock is
+
+     prop clock + offset + drift * (time since the last round) + slew
+
+   The first round sets the offset. After that a round's error against the
+   prediction is slewed away at CLOCK_SLEW_PPM, so the clock never jumps
+   and never runs backwards, unless it is off by more than CLOCK_STEP_US
+   (the host's clock was set, or the prop slept through its drift), when
+   it is stepped. The drift, in ppb, is smoothed from the offsets of rounds
+   at least CLOCK_DRIFT_MIN_MS apart and carries the clock between rounds;
+   an error it cannot explain (CLOCK_JUMP_US) starts the estimate afresh.
+
+   Rounds run every CLOCK_ROUND_MS once synced. Until the first answer
+   they start CLOCK_RETRY_MS apart, doubling up to CLOCK_ROUND_MS while
+   nobody answers. The room orchestrator answers (host/orchestrator.h);
+   in the simulator the "timeserver" scenario action does.
+
+   Once synced, stats lines and acks end with " at=<Unix time in ms>" and
+   a trace dump carries the clock at the time of the dump (trace.h), so
+   tools/trace2chrome.py can put several props on one timeline.
+
+   The stats line is
+   "clock synced= offset=<us> drift=<ppb> delay=<us> error=<us> rounds= lost= rejected=
+   steps=" where error= is the last round's measured offset against the
+   prediction and rejected= counts replies too slow, late or malformed.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#define CLOCK_BURST 4
+#define CLOCK_BURST_GAP_MS 250
+// How long a round waits for its last reply
+#define CLOCK_REPLY_WAIT_MS 1000
+#define CLOCK_ROUND_MS 60000
+#define CLOCK_RETRY_MS 5000
+#define CLOCK_MAX_DELAY_US 100000
+#define CLOCK_STEP_US 50000
+// Errors beyond this, once the drift is known, are changes to the host's
+// clock rather than drift, and start a new drift estimate
+#define CLOCK_JUMP_US 2000
+#define CLOCK_SLEW_PPM 5000
+#define CLOCK_MAX_DRIFT_PPM 500
+#define CLOCK_DRIFT_MIN_MS 50000
+
+struct ClockStats {
+  unsigned long rounds;      // rounds with a usable reply
+  unsigned long lost;        // rounds without one
+  unsigned long replies;
+  unsigned long rejected;    // replies too slow, out of date or malformed
+  unsigned long steps;
+  long delayUs;              // of the last round's best reply
+  long errorUs;              // of the last round against the prediction
+};
+
+extern const char timeTopic[];
+extern ClockStats clockStats;
+
+void clockSetup();
+void clockLoop();
+// Handles a "time" reply; false for any other message. receivedUs is when it came off the socket.
+bool clockMessage(const byte* message, unsigned int length, unsigned long receivedUs);
+
+bool clockSynced();
+// The synchronized time, in Unix microseconds, of a micros() reading no
+// more than 71 minutes old; 0 until synced
+uint64_t clockSyncedUs(unsigned long localUs);
+// The same, now, in milliseconds
+uint64_t clockNowMs();
+// Appends " at=<Unix ms>" to a line if synced and there is room
+void clockStamp(char* line, size_t size);
+// The drift in force, for a trace dump
+long clockDriftPpb();
+void publishClockStats();
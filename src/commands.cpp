@@ -0,0 +1,714 @@
+/*
+   Sterilizer puzzle - command handling
+
+   Parses the messages received on ToDevice/Sterilizer, filters out retries
+   of commands that have already been handled and acknowledges every command
+   to the host.
+*/
+
+#include "commands.h"
+#include "sterilizer.h"
+#include "telemetry.h"
+#include "taskstats.h"
+#include "profiler.h"
+#include "crashdump.h"
+#include "trace.h"
+#include "gpio.h"
+#include "script.h"
+#include "tickless.h"
+#include "link.h"
+#include "sleep.h"
+#include "events.h"
+#include "web.h"
+#include "console.h"
+#include "upload.h"
+#include "clocksync.h"
+#include <FastLED.h>
+
+// Function Declarations
+static CommandOutcome cmdSolve(const char* args);
+static CommandOutcome cmdReset(const char* args);
+static CommandOutcome cmdBrightness(const char* args);
+static CommandOutcome cmdStats(const char* args);
+static CommandOutcome cmdProfile(const char* args);
+static CommandOutcome cmdCoreDump(const char* args);
+static CommandOutcome cmdTrace(const char* args);
+static CommandOutcome cmdBench(const char* args);
+static CommandOutcome cmdLink(const char* args);
+static CommandOutcome cmdSleep(const char* args);
+static CommandOutcome cmdTest(const char* args);
+static void sendAck(const char* requestId, const char* command, CommandOutcome outcome, bool duplicate);
+
+struct Command {
+  const char* name;
+  CommandPriority priority;
+  CommandOutcome (*handler)(const char* args);
+};
+
+// Command table, searched in order
+static const Command commands[] = {
+  { "reset",      PRIO_SAFETY,   cmdReset },
+  { "solve",      PRIO_CONTROL,  cmdSolve },
+  { "brightness", PRIO_COSMETIC, cmdBrightness },
+  { "stats",      PRIO_COSMETIC, cmdStats },
+  { "profile",    PRIO_COSMETIC, cmdProfile },
+  { "coredump",   PRIO_TRANSFER, cmdCoreDump },
+  { "trace",      PRIO_TRANSFER, cmdTrace },
+  { "bench",      PRIO_COSMETIC, cmdBench },
+  { "link",       PRIO_COSMETIC, cmdLink },
+  { "sleep",      PRIO_CONTROL,  cmdSleep },
+  { "test",       PRIO_CONTROL,  cmdTest },
+};
+static const int NUM_COMMANDS = sizeof(commands) / sizeof(commands[0]);
+
+// Recently handled request IDs, oldest overwritten first
+struct RecentRequest {
+  char id[MAX_REQUEST_ID + 1];
+  CommandOutcome outcome;
+};
+static RecentRequest recentRequests[RECENT_ID_SLOTS];
+static int nextRecentSlot = 0;
+
+// Commands waiting for loop(); a slot is free when its length is zero
+struct QueuedCommand {
+  char line[MAX_COMMAND_LENGTH + 1];
+  unsigned int length;
+  CommandPriority priority;
+  unsigned long sequence;  // arrival order, oldest run first within a priority
+  unsigned long readUs;    // micros() when the message was read off the socket
+  unsigned long dispatchUs;  // micros() when mqttCallback() queued it
+};
+static QueuedCommand commandQueue[COMMAND_QUEUE_SIZE];
+static unsigned long nextSequence = 0;
+
+// Token bucket per subscribed topic, applied to cosmetic commands only
+struct TopicLimit {
+  const char* topic;
+  float burst;      // most commands accepted back to back
+  float perSecond;  // sustained commands per second
+  float tokens;
+  unsigned long lastRefill;
+};
+static TopicLimit topicLimits[] = {
+  { DeviceTopic, 10, 5, 10, 0 },
+  { WEB_SOURCE,  10, 5, 10, 0 },
+};
+static const int NUM_TOPIC_LIMITS = sizeof(topicLimits) / sizeof(topicLimits[0]);
+// Bounds the "busy" acks a flood of dropped commands gets back
+static TopicLimit busyLimit = { "busy", 10, 5, 10, 0 };
+
+CommandStats commandStats;
+
+// Latency of each command in the table, by stage
+static LatencyHistogram latencyHistograms[NUM_COMMANDS][LATENCY_STAGES];
+
+// The command being run by processCommands(), for noteActuation()
+static int activeCommand = -1;
+static bool actuated = false;
+static unsigned long activeReadUs = 0;
+static unsigned long activeStartUs = 0;
+
+
+// Command Handlers
+static CommandOutcome cmdSolve(const char* args) {
+  // Re-running the solve sequence would fire the flames and pump again
+  if (puzzle == Solved || puzzle == Solving) {
+    return CMD_NOOP;
+  }
+  onSolve();
+  return CMD_OK;
+}
+
+static CommandOutcome cmdReset(const char* args) {
+  // A relay or LED test only runs while armed; a reset stops it where it is
+  if (puzzle == Running && onTestStop()) {
+    return CMD_OK;
+  }
+  // The puzzle is already armed with the relays off and the lock engaged
+  if (puzzle == Running || puzzle == Resetting) {
+    return CMD_NOOP;
+  }
+  onReset();
+  return CMD_OK;
+}
+
+static CommandOutcome cmdBrightness(const char* args) {
+  char* end;
+  long value = strtol(args, &end, 10);
+  if (end == args || *end != '\0' || value < 0 || value > 255) {
+    return CMD_INVALID;
+  }
+  if (value == LedBright) {
+    return CMD_NOOP;
+  }
+  LedBright = value;
+  FastLED.setBrightness(LedBright);
+  showLEDs();
+  return CMD_OK;
+}
+
+static CommandOutcome cmdStats(const char* args) {
+  publishStats();
+  publishTaskStats();
+  return CMD_OK;
+}
+
+static CommandOutcome cmdProfile(const char* args) {
+  if (strncmp(args, "start", 5) == 0 && (args[5] == '\0' || args[5] == ' ')) {
+    unsigned long hz = PROFILE_DEFAULT_HZ;
+    if (args[5] == ' ') {
+      char* end;
+      hz = strtoul(args + 6, &end, 10);
+      if (*end != '\0') {
+        return CMD_INVALID;
+      }
+    }
+    return profilerStart(hz) ? CMD_OK : CMD_INVALID;
+  }
+  if (strcmp(args, "stop") == 0) {
+    profilerStop();
+    return CMD_OK;
+  }
+  if (strcmp(args, "dump") == 0) {
+    // A dump already being published is not restarted
+    return profilerDump() ? CMD_OK : CMD_NOOP;
+  }
+  return CMD_INVALID;
+}
+
+static CommandOutcome cmdCoreDump(const char* args) {
+  if (strcmp(args, "info") == 0) {
+    return publishCrashSummary() ? CMD_OK : CMD_INVALID;
+  }
+  if (strncmp(args, "read ", 5) == 0) {
+    char* end;
+    unsigned long offset = strtoul(args + 5, &end, 10);
+    if (end == args + 5 || *end != '\0') {
+      return CMD_INVALID;
+    }
+    // Fails past the end of the dump, or when there is none
+    return publishCoreDumpChunk(offset) ? CMD_OK : CMD_NOOP;
+  }
+  if (strcmp(args, "erase") == 0) {
+    return eraseCoreDump() ? CMD_OK : CMD_INVALID;
+  }
+  return CMD_INVALID;
+}
+
+static CommandOutcome cmdTrace(const char* args) {
+  if (strcmp(args, "on") == 0) {
+    traceEnable(true);
+    return CMD_OK;
+  }
+  if (strcmp(args, "off") == 0) {
+    traceEnable(false);
+    return CMD_OK;
+  }
+  if (strcmp(args, "clear") == 0) {
+    traceClear();
+    return CMD_OK;
+  }
+  if (strcmp(args, "dump") == 0) {
+    return traceDump() ? CMD_OK : CMD_NOOP;
+  }
+  return CMD_INVALID;
+}
+
+static CommandOutcome cmdBench(const char* args) {
+  if (strcmp(args, "gpio") == 0) {
+    publishGpioBenchmark();
+    return CMD_OK;
+  }
+  return CMD_INVALID;
+}
+
+static CommandOutcome cmdLink(const char* args) {
+  if (strcmp(args, "auto") == 0) {
+    linkOverride(LINK_GAME, true);
+    return CMD_OK;
+  }
+  for (int profile = 0; profile < LINK_PROFILES; profile++) {
+    if (strcmp(args, linkProfileName((LinkProfile)profile)) == 0) {
+      linkOverride((LinkProfile)profile, false);
+      return CMD_OK;
+    }
+  }
+  return CMD_INVALID;
+}
+
+static CommandOutcome cmdSleep(const char* args) {
+  if (strncmp(args, "auto ", 5) == 0) {
+    if (strcmp(args + 5, "off") == 0) {
+      sleepAutoAfter(0);
+      return CMD_OK;
+    }
+    char* end;
+    unsigned long minutes = strtoul(args + 5, &end, 10);
+    if (end == args + 5 || *end != '\0' || minutes == 0 || minutes > SLEEP_MAX_MINUTES) {
+      return CMD_INVALID;
+    }
+    sleepAutoAfter(minutes);
+    return CMD_OK;
+  }
+
+  SleepMode mode = SLEEP_DEEP;
+  unsigned long minutes = SLEEP_DEFAULT_MINUTES;
+  unsigned long checkMinutes = SLEEP_CHECK_MINUTES;
+  char words[MAX_COMMAND_LENGTH + 1];
+  strncpy(words, args, MAX_COMMAND_LENGTH);
+  words[MAX_COMMAND_LENGTH] = '\0';
+  for (char* word = strtok(words, " "); word != NULL; word = strtok(NULL, " ")) {
+    char* end;
+    if (strcmp(word, "light") == 0) {
+      mode = SLEEP_LIGHT;
+    }
+    else if (strcmp(word, "deep") == 0) {
+      mode = SLEEP_DEEP;
+    }
+    else if (strncmp(word, "for=", 4) == 0) {
+      minutes = strtoul(word + 4, &end, 10);
+      if (end == word + 4 || *end != '\0') {
+        return CMD_INVALID;
+      }
+    }
+    else if (strncmp(word, "check=", 6) == 0) {
+      checkMinutes = strtoul(word + 6, &end, 10);
+      if (end == word + 6 || *end != '\0') {
+        return CMD_INVALID;
+      }
+    }
+    else {
+      return CMD_INVALID;
+    }
+  }
+  // Never in the middle of a solve or reset sequence
+  if (puzzle == Solving || puzzle == Resetting) {
+    return CMD_NOOP;
+  }
+  return sleepRequest(mode, minutes, checkMinutes) ? CMD_OK : CMD_INVALID;
+}
+
+static CommandOutcome cmdTest(const char* args) {
+  bool relays = strcmp(args, "relays") == 0;
+  if (!relays && strcmp(args, "leds") != 0) {
+    return CMD_INVALID;
+  }
+  // Only while armed; loop() holds the relays and LEDs of the solved state on every pass
+  if (puzzle != Running) {
+    return CMD_NOOP;
+  }
+  bool started = relays ? onRelayTest() : onLedTest();
+  return started ? CMD_OK : CMD_NOOP;
+}
+
+
+// Request ID Cache
+static RecentRequest* findRecentRequest(const char* requestId) {
+  for (int i = 0; i < RECENT_ID_SLOTS; i++) {
+    if (recentRequests[i].id[0] != '\0' && strcmp(recentRequests[i].id, requestId) == 0) {
+      return &recentRequests[i];
+    }
+  }
+  return NULL;
+}
+
+static void rememberRequest(const char* requestId, CommandOutcome outcome) {
+  RecentRequest& slot = recentRequests[nextRecentSlot];
+  strncpy(slot.id, requestId, MAX_REQUEST_ID);
+  slot.id[MAX_REQUEST_ID] = '\0';
+  slot.outcome = outcome;
+  nextRecentSlot = (nextRecentSlot + 1) % RECENT_ID_SLOTS;
+}
+
+
+// Command Queue
+
+// Look up the command named by the first word of a message
+static const Command* findCommand(const char* line, unsigned int length) {
+  unsigned int start = 0;
+  // Payload bytes above 0x7F must not reach the ctype functions as negative chars
+  while (start < length && isspace((unsigned char)line[start])) {
+    start++;
+  }
+  unsigned int end = start;
+  while (end < length && !isspace((unsigned char)line[end])) {
+    end++;
+  }
+  for (int i = 0; i < NUM_COMMANDS; i++) {
+    if (strlen(commands[i].name) == end - start && strncasecmp(line + start, commands[i].name, end - start) == 0) {
+      return &commands[i];
+    }
+  }
+  return NULL;
+}
+
+static bool takeToken(TopicLimit& limit) {
+  unsigned long now = millis();
+  limit.tokens += (now - limit.lastRefill) * limit.perSecond / 1000.0f;
+  if (limit.tokens > limit.burst) {
+    limit.tokens = limit.burst;
+  }
+  limit.lastRefill = now;
+  if (limit.tokens < 1.0f) {
+    return false;
+  }
+  limit.tokens -= 1.0f;
+  return true;
+}
+
+static bool takeRateToken(const char* topic) {
+  for (int i = 0; i < NUM_TOPIC_LIMITS; i++) {
+    if (strcmp(topic, topicLimits[i].topic) == 0) {
+      return takeToken(topicLimits[i]);
+    }
+  }
+  return true;
+}
+
+// Answers a command that will not be run, so that a host can tell it from one lost on the way
+static void ackBusy(const char* message, unsigned int length) {
+  if (!takeToken(busyLimit)) {
+    commandStats.unacked++;
+    return;
+  }
+  char line[MAX_COMMAND_LENGTH + 1];
+  unsigned int copied = length > MAX_COMMAND_LENGTH ? MAX_COMMAND_LENGTH : length;
+  memcpy(line, message, copied);
+  line[copied] = '\0';
+
+  char* command = strtok(line, " \t\r\n");
+  const char* requestId = "";
+  if (command != NULL) {
+    for (char* c = command; *c != '\0'; c++) {
+      *c = tolower((unsigned char)*c);
+    }
+    for (char* word = strtok(NULL, " \t\r\n"); word != NULL; word = strtok(NULL, " \t\r\n")) {
+      if (strncmp(word, "id=", 3) == 0 && strlen(word + 3) <= MAX_REQUEST_ID) {
+        requestId = word + 3;
+      }
+    }
+  }
+  sendAck(requestId, command != NULL ? command : "", CMD_BUSY, false);
+}
+
+// Answer a ping without queueing it. Returns false for anything else.
+static bool handlePing(const byte* message, unsigned int length, unsigned long receivedUs) {
+  if (length < 4 || strncasecmp((const char*)message, "ping", 4) != 0 ||
+      (length > 4 && message[4] != ' ')) {
+    return false;
+  }
+  unsigned long dispatchUs = micros();
+
+  // Echo the host's token (normally its send time) unchanged
+  unsigned int start = 4;
+  while (start < length && message[start] == ' ') {
+    start++;
+  }
+  unsigned int tokenLength = length - start;
+  if (tokenLength > MAX_PING_TOKEN) {
+    tokenLength = MAX_PING_TOKEN;
+  }
+  char token[MAX_PING_TOKEN + 1];
+  memcpy(token, message + start, tokenLength);
+  token[tokenLength] = '\0';
+
+  char pong[64 + MAX_PING_TOKEN];
+  snprintf(pong, sizeof(pong), "pong %s rx=%lu dispatch=%lu tx=%lu link=%s mqtt=%s",
+           tokenLength > 0 ? token : "-", receivedUs, dispatchUs, micros(), linkProfileName(linkProfile()),
+           MQTTclient.name());
+  MQTTclient.publish(hostTopic, pong);
+  commandStats.pings++;
+  return true;
+}
+
+void enqueueCommand(const char* topic, const byte* message, unsigned int length, unsigned long receivedUs) {
+  commandStats.received++;
+
+  if (handlePing(message, length, receivedUs)) {
+    return;
+  }
+  // Upload chunks carry more than a command line holds and are written from PubSubClient's buffer
+  if (strcmp(topic, DeviceTopic) == 0 && uploadMessage(message, length)) {
+    return;
+  }
+  // Time replies are timed from the socket, as pings are
+  if (strcmp(topic, DeviceTopic) == 0 && clockMessage(message, length, receivedUs)) {
+    return;
+  }
+
+  // An empty message cannot be queued, as a zero length marks a free slot; answer it now
+  if (length == 0) {
+    sendAck("", "", CMD_INVALID, false);
+    return;
+  }
+
+  // Over-long messages are still queued (truncated) so that they get an "invalid" ack
+  const Command* command = findCommand((const char*)message, length);
+  CommandPriority priority = command != NULL ? command->priority : PRIO_COSMETIC;
+
+  if (priority == PRIO_COSMETIC && !takeRateToken(topic)) {
+    commandStats.droppedRate++;
+    ackBusy((const char*)message, length);
+    return;
+  }
+
+  int slot = -1;
+  int used = 0;
+  char evictedLine[MAX_COMMAND_LENGTH];
+  unsigned int evictedLength = 0;
+  for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    if (commandQueue[i].length == 0) {
+      if (slot < 0) {
+        slot = i;
+      }
+    }
+    else {
+      used++;
+    }
+  }
+
+  // Queue full: push out the newest command of the lowest priority, if it ranks below this one
+  if (slot < 0) {
+    for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+      QueuedCommand& queued = commandQueue[i];
+      if (queued.priority <= priority) {
+        continue;
+      }
+      if (slot < 0 || queued.priority > commandQueue[slot].priority ||
+          (queued.priority == commandQueue[slot].priority && queued.sequence > commandQueue[slot].sequence)) {
+        slot = i;
+      }
+    }
+    if (slot < 0) {
+      commandStats.droppedFull++;
+      ackBusy((const char*)message, length);
+      return;
+    }
+    commandStats.evicted++;
+    evictedLength = commandQueue[slot].length > MAX_COMMAND_LENGTH ? MAX_COMMAND_LENGTH : commandQueue[slot].length;
+    memcpy(evictedLine, commandQueue[slot].line, evictedLength);
+    used--;
+  }
+
+  QueuedCommand& queued = commandQueue[slot];
+  // One byte past the limit is kept so that handleCommand() can tell it was too long
+  queued.length = length > MAX_COMMAND_LENGTH ? MAX_COMMAND_LENGTH + 1 : length;
+  memcpy(queued.line, message, length > MAX_COMMAND_LENGTH ? MAX_COMMAND_LENGTH : length);
+  queued.priority = priority;
+  queued.sequence = nextSequence++;
+  queued.readUs = receivedUs;
+  queued.dispatchUs = micros();
+
+  if (used + 1 > commandStats.highWater) {
+    commandStats.highWater = used + 1;
+  }
+  // Only now: publishing from PubSubClient's callback reuses the buffer that message points into
+  if (evictedLength > 0) {
+    ackBusy(evictedLine, evictedLength);
+  }
+}
+
+// Commands from the web panel's task, handed over by the event bus
+void commandsOnCommand(const Event& event) {
+  enqueueCommand(event.command.source, (const byte*)event.command.line, event.command.length,
+                 event.command.receivedUs);
+  // processCommands() has already had its turn in this pass of loop()
+  wakeWithin(0);
+}
+
+// Remove and return the oldest command of the highest priority, or -1 if the queue is empty
+static int nextQueuedCommand() {
+  int best = -1;
+  for (int i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+    QueuedCommand& queued = commandQueue[i];
+    if (queued.length == 0) {
+      continue;
+    }
+    if (best < 0 || queued.priority < commandQueue[best].priority ||
+        (queued.priority == commandQueue[best].priority && queued.sequence < commandQueue[best].sequence)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+void processCommands() {
+  unsigned long start = micros();
+  int slot;
+  while ((slot = nextQueuedCommand()) >= 0) {
+    if (micros() - start >= COMMAND_TICK_BUDGET_US) {
+      commandStats.overBudget++;
+      // Carry on with the rest on the next pass straight away
+      wakeWithin(0);
+      return;
+    }
+    // Copy out first so that a command which publishes can queue new ones safely
+    char line[MAX_COMMAND_LENGTH + 1];
+    unsigned int length = commandQueue[slot].length;
+    memcpy(line, commandQueue[slot].line, length > MAX_COMMAND_LENGTH ? MAX_COMMAND_LENGTH : length);
+    commandQueue[slot].length = 0;
+
+    const Command* command = findCommand(line, length);
+    if (command != NULL) {
+      activeCommand = command - commands;
+      actuated = false;
+      activeReadUs = commandQueue[slot].readUs;
+      activeStartUs = micros();
+      recordLatency(latencyHistograms[activeCommand][LAT_NETWORK], commandQueue[slot].dispatchUs - activeReadUs);
+      recordLatency(latencyHistograms[activeCommand][LAT_QUEUE], activeStartUs - commandQueue[slot].dispatchUs);
+    }
+
+    commandStats.processed++;
+    // Someone is running the game; keep the link responsive. Stats polling and fetches do not count.
+    if (command != NULL && command->priority <= PRIO_CONTROL) {
+      noteLinkActivity();
+    }
+    int traced = activeCommand;
+    if (traced >= 0) {
+      traceBegin(TRACE_COMMAND, traced);
+    }
+    handleCommand((const byte*)line, length);
+    if (traced >= 0) {
+      traceEnd(TRACE_COMMAND, traced);
+    }
+    activeCommand = -1;
+  }
+}
+
+// Called on every relay write; times the first one made by the running command
+void noteActuation() {
+  if (activeCommand < 0 || actuated) {
+    return;
+  }
+  unsigned long now = micros();
+  actuated = true;
+  recordLatency(latencyHistograms[activeCommand][LAT_ACTUATION], now - activeStartUs);
+  recordLatency(latencyHistograms[activeCommand][LAT_TOTAL], now - activeReadUs);
+}
+
+int commandCount() {
+  return NUM_COMMANDS;
+}
+
+const char* commandName(int command) {
+  return commands[command].name;
+}
+
+const LatencyHistogram& commandLatency(int command, LatencyStage stage) {
+  return latencyHistograms[command][stage];
+}
+
+const char* latencyStageName(LatencyStage stage) {
+  switch (stage) {
+    case LAT_NETWORK:   return "net";
+    case LAT_QUEUE:     return "queue";
+    case LAT_ACTUATION: return "act";
+    case LAT_TOTAL:     return "total";
+    default:            return "?";
+  }
+}
+
+
+const char* outcomeName(CommandOutcome outcome) {
+  switch (outcome) {
+    case CMD_OK:      return "ok";
+    case CMD_NOOP:    return "noop";
+    case CMD_UNKNOWN: return "unknown";
+    case CMD_INVALID: return "invalid";
+    case CMD_BUSY:    return "busy";
+  }
+  return "?";
+}
+
+static void sendAck(const char* requestId, const char* command, CommandOutcome outcome, bool duplicate) {
+  char ack[48 + MAX_REQUEST_ID + MAX_COMMAND_LENGTH];
+  snprintf(ack, sizeof(ack), "ack %s %s %s%s",
+           requestId[0] != '\0' ? requestId : "-",
+           command[0] != '\0' ? command : "-",
+           outcomeName(outcome),
+           duplicate ? " dup" : "");
+  clockStamp(ack, sizeof(ack));
+  MQTTclient.publish(hostTopic, ack);
+  webPushAck(ack);
+  consoleAck(ack);
+}
+
+void handleCommand(const byte* message, unsigned int length) {
+  // Copy into a fixed buffer rather than one sized by the sender
+  char line[MAX_COMMAND_LENGTH + 1];
+  if (length > MAX_COMMAND_LENGTH) {
+    Serial.print("Command too long: ");
+    Serial.println(length);
+    sendAck("", "", CMD_INVALID, false);
+    return;
+  }
+  memcpy(line, message, length);
+  line[length] = '\0';
+
+#ifdef DEBUG
+  Serial.print("Command: ");
+  Serial.println(line);
+#endif
+
+  // Split off the command name; command names are case insensitive
+  char* command = strtok(line, " \t\r\n");
+  if (command == NULL) {
+    sendAck("", "", CMD_INVALID, false);
+    return;
+  }
+  for (char* c = command; *c != '\0'; c++) {
+    *c = tolower((unsigned char)*c);
+  }
+
+  // Pull the request ID out of the remaining words, keeping the rest as arguments
+  char args[MAX_COMMAND_LENGTH + 1] = "";
+  char requestId[MAX_REQUEST_ID + 1] = "";
+  for (char* word = strtok(NULL, " \t\r\n"); word != NULL; word = strtok(NULL, " \t\r\n")) {
+    if (strncmp(word, "id=", 3) == 0) {
+      if (strlen(word + 3) > MAX_REQUEST_ID) {
+        sendAck("", command, CMD_INVALID, false);
+        return;
+      }
+      strcpy(requestId, word + 3);
+    }
+    else {
+      if (args[0] != '\0') {
+        strcat(args, " ");
+      }
+      strcat(args, word);
+    }
+  }
+
+  // A retry of a request we have already handled only gets its acknowledgment again
+  if (requestId[0] != '\0') {
+    RecentRequest* recent = findRecentRequest(requestId);
+    if (recent != NULL) {
+      Serial.print("Duplicate request ");
+      Serial.println(requestId);
+      sendAck(requestId, command, recent->outcome, true);
+      return;
+    }
+  }
+
+  CommandOutcome outcome = CMD_UNKNOWN;
+  for (int i = 0; i < NUM_COMMANDS; i++) {
+    if (strcmp(command, commands[i].name) == 0) {
+      outcome = commands[i].handler(args);
+      break;
+    }
+  }
+  if (outcome == CMD_OK) {
+    // Lets a script wait for the host to send this command
+    scriptPost(command);
+  }
+  if (outcome == CMD_UNKNOWN) {
+    Serial.print("Message Received: ");
+    Serial.println(command);
+    Serial.println();
+  }
+
+  if (requestId[0] != '\0') {
+    rememberRequest(requestId, outcome);
+  }
+  sendAck(requestId, command, outcome, false);
+}
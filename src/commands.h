@@ -0,0 +1,110 @@
+/*
+   Sterilizer puzzle - command handling
+
+   Commands arrive on ToDevice/Sterilizer as "<command> [id=<request id>]",
+   for example "solve id=42". Every command is answered on ToHost/Sterilizer
+   with "ack <request id> <command> <outcome>" ("-" when no ID was given),
+   followed by " at=<Unix ms>" once the clock is synchronized (clocksync.h).
+   A host that retries with the same request ID gets the original outcome
+   back with a "dup" suffix instead of running the command a second time.
+   A command dropped without running, by the rate limit or a full queue,
+   is answered "busy" and not remembered, so a retry can still run it;
+   these answers have a rate limit of their own, and any they hold back
+   are counted as unacked=.
+
+   mqttCallback() only queues commands. They are run from loop() by
+   processCommands(), highest priority first, so a flood of cosmetic
+   commands cannot hold back a reset. Only cosmetic commands are rate
+   limited per topic; a core dump or trace is fetched a page at a time,
+   each request waiting for the last, and is not. Commands typed into the web panel
+   (web.h) join the same queue through the event bus, and lines typed on
+   the serial console (console.h) straight from loop(). Every
+   acknowledgment goes to the panel and the console as well as to
+   ToHost/Sterilizer.
+
+   "test relays" switches each relay on for TEST_RELAY_MS in turn, and
+   "test leds" shows each colour on the strip; both only while the puzzle
+   is armed. A reset stops a test where it is, with the relays made safe,
+   and is acknowledged "ok"; a solve takes over from it.
+
+   "ping <token>" is the exception: it is answered straight from
+   mqttCallback() with "pong <token> rx=<us> dispatch=<us> tx=<us>", the
+   device's micros() when the message was received, recognised and
+   published, so a host can measure the round trip through the broker;
+   link= and mqtt= name the WiFi profile and the MQTT transport in use.
+   Upload messages ("upload ..." and "chunk ...", see upload.h) are not
+   queued either; they are handled in mqttCallback() as they arrive, and so
+   are the host's "time" replies (clocksync.h).
+
+   Each command is timed from the moment its bytes are read off the socket
+   to the first relay it switches, split into the stages below, and the
+   durations are kept in one histogram per command and stage.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "latency.h"
+
+// Longest command (including arguments and request ID) that will be parsed
+#define MAX_COMMAND_LENGTH 64
+// Longest request ID that will be remembered
+#define MAX_REQUEST_ID 16
+// Number of recent request IDs remembered for de-duplication
+#define RECENT_ID_SLOTS 8
+// Number of commands that can wait in the queue
+#define COMMAND_QUEUE_SIZE 8
+// Time processCommands() may spend starting new commands in one pass of loop()
+#define COMMAND_TICK_BUDGET_US 2000
+// Longest ping token echoed back to the host
+#define MAX_PING_TOKEN 32
+
+enum CommandOutcome {
+  CMD_OK,       // the command ran
+  CMD_NOOP,     // the puzzle was already in the requested state
+  CMD_UNKNOWN,  // no such command
+  CMD_INVALID,  // the message could not be parsed
+  CMD_BUSY      // not run: rate limited or pushed out of a full queue; a retry may run it
+};
+
+// Lower values are run first and may evict higher values from a full queue
+enum CommandPriority {
+  PRIO_SAFETY,   // puts the props into a safe state (reset)
+  PRIO_CONTROL,  // changes the puzzle state (solve)
+  PRIO_TRANSFER, // core dump and trace fetches, which a host makes one page at a time and waits on
+  PRIO_COSMETIC  // LEDs, diagnostics and anything unknown
+};
+
+// Stages of a command's latency
+enum LatencyStage {
+  LAT_NETWORK,    // socket read to mqttCallback()
+  LAT_QUEUE,      // mqttCallback() to the handler starting
+  LAT_ACTUATION,  // handler starting to its first relay write
+  LAT_TOTAL,      // socket read to the first relay write
+  LATENCY_STAGES
+};
+
+// Counters kept by the command queue
+struct CommandStats {
+  unsigned long received;     // messages passed to enqueueCommand()
+  unsigned long processed;    // commands run by processCommands()
+  unsigned long droppedFull;  // dropped because the queue was full of equal or higher priority
+  unsigned long droppedRate;  // cosmetic commands dropped by the per-topic rate limit
+  unsigned long evicted;      // queued commands pushed out by a higher priority one
+  unsigned long unacked;      // of those three, dropped without even a "busy" ack
+  unsigned long overBudget;   // passes of loop() that left commands queued for lack of time
+  int highWater;              // most commands ever waiting at once
+  unsigned long pings;        // pings answered from the fast path
+};
+
+extern CommandStats commandStats;
+
+void enqueueCommand(const char* topic, const byte* message, unsigned int length, unsigned long receivedUs);
+void processCommands();
+void noteActuation();
+int commandCount();
+const char* commandName(int command);
+const LatencyHistogram& commandLatency(int command, LatencyStage stage);
+const char* latencyStageName(LatencyStage stage);
+void handleCommand(const byte* message, unsigned int length);
+const char* outcomeName(CommandOutcome outcome);
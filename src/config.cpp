@@ -0,0 +1,195 @@
+/*
+   Sterilizer puzzle - saved settings
+
+   Text settings are the buffers the network code reads (ssid, pass and
+   mqttServerIP in main.cpp); number settings reach their module through
+   get and apply functions.
+*/
+
+#include "config.h"
+#include "sterilizer.h"
+#include "sleep.h"
+#include <Preferences.h>
+#include <FastLED.h>
+
+enum SettingType {
+  SETTING_TEXT,
+  SETTING_NUMBER,
+};
+
+struct Setting {
+  const char* key;
+  SettingType type;
+  // Text: the buffer the value is used from
+  char* text;
+  size_t size;
+  bool secret;
+  // Number: the range, and how to read and change the value in use
+  long minimum;
+  long maximum;
+  long (*get)();
+  void (*apply)(long value, bool booting);
+};
+
+static long getBrightness() {
+  return LedBright;
+}
+
+static void applyBrightness(long value, bool booting) {
+  LedBright = value;
+  FastLED.setBrightness(LedBright);
+  // setup() shows the strip itself once it is ready
+  if (!booting) {
+    showLEDs();
+  }
+}
+
+static long getAutoSleep() {
+  return sleepAutoMinutes();
+}
+
+static void applyAutoSleep(long value, bool booting) {
+  sleepAutoAfter(value);
+}
+
+static const Setting settings[] = {
+  { "ssid",       SETTING_TEXT,   ssid,         SSID_SIZE, false, 0, 0,                 NULL,          NULL },
+  { "pass",       SETTING_TEXT,   pass,         PASS_SIZE, true,  0, 0,                 NULL,          NULL },
+  { "mqtt",       SETTING_TEXT,   mqttServerIP, HOST_SIZE, false, 0, 0,                 NULL,          NULL },
+  { "brightness", SETTING_NUMBER, NULL,         0,         false, 0, 255,               getBrightness, applyBrightness },
+  { "autosleep",  SETTING_NUMBER, NULL,         0,         false, 0, SLEEP_MAX_MINUTES, getAutoSleep,  applyAutoSleep },
+};
+static const int NUM_SETTINGS = sizeof(settings) / sizeof(settings[0]);
+
+static Preferences preferences;
+
+// Values held by configStage() until configCommitStaged(); empty when none
+static char staged[NUM_SETTINGS][CONFIG_VALUE_SIZE];
+
+static const Setting* findSetting(const char* key) {
+  for (int i = 0; i < NUM_SETTINGS; i++) {
+    if (strcmp(settings[i].key, key) == 0) {
+      return &settings[i];
+    }
+  }
+  return NULL;
+}
+
+void configSetup() {
+  // Fails harmlessly before anything has ever been saved
+  if (!preferences.begin(CONFIG_NAMESPACE, true)) {
+    return;
+  }
+  for (int i = 0; i < NUM_SETTINGS; i++) {
+    const Setting& setting = settings[i];
+    if (!preferences.isKey(setting.key)) {
+      continue;
+    }
+    if (setting.type == SETTING_TEXT) {
+      preferences.getString(setting.key, setting.text, setting.size);
+    }
+    else {
+      setting.apply(preferences.getLong(setting.key, 0), true);
+    }
+  }
+  preferences.end();
+}
+
+int configCount() {
+  return NUM_SETTINGS;
+}
+
+const char* configKey(int setting) {
+  return settings[setting].key;
+}
+
+bool configGet(const char* key, char* value, size_t size) {
+  const Setting* setting = findSetting(key);
+  if (setting == NULL) {
+    return false;
+  }
+  if (setting->type == SETTING_NUMBER) {
+    snprintf(value, size, "%ld", setting->get());
+  }
+  else {
+    snprintf(value, size, "%s", setting->secret ? "********" : setting->text);
+  }
+  return true;
+}
+
+// Checks a value against its setting; a number is returned through number
+static bool validValue(const Setting* setting, const char* value, long* number) {
+  if (setting->type == SETTING_TEXT) {
+    size_t length = strlen(value);
+    return length > 0 && length < setting->size;
+  }
+  char* end;
+  *number = strtol(value, &end, 10);
+  return end != value && *end == '\0' && *number >= setting->minimum && *number <= setting->maximum;
+}
+
+bool configSet(const char* key, const char* value) {
+  const Setting* setting = findSetting(key);
+  long number;
+  if (setting == NULL || !validValue(setting, value, &number)) {
+    return false;
+  }
+  preferences.begin(CONFIG_NAMESPACE, false);
+  if (setting->type == SETTING_TEXT) {
+    preferences.putString(key, value);
+    preferences.end();
+    return true;
+  }
+  preferences.putLong(key, number);
+  preferences.end();
+  setting->apply(number, false);
+  return true;
+}
+
+bool configStage(const char* key, const char* value) {
+  const Setting* setting = findSetting(key);
+  long number;
+  if (setting == NULL || setting->secret || strlen(value) >= CONFIG_VALUE_SIZE ||
+      !validValue(setting, value, &number)) {
+    return false;
+  }
+  strcpy(staged[setting - settings], value);
+  return true;
+}
+
+void configCommitStaged() {
+  for (int i = 0; i < NUM_SETTINGS; i++) {
+    if (staged[i][0] != '\0') {
+      configSet(settings[i].key, staged[i]);
+    }
+  }
+  configDiscardStaged();
+}
+
+void configDiscardStaged() {
+  for (int i = 0; i < NUM_SETTINGS; i++) {
+    staged[i][0] = '\0';
+  }
+}
+
+bool configClear(const char* key) {
+  if (findSetting(key) == NULL) {
+    return false;
+  }
+  preferences.begin(CONFIG_NAMESPACE, false);
+  preferences.remove(key);
+  preferences.end();
+  return true;
+}
+
+bool configPending(const char* key) {
+  const Setting* setting = findSetting(key);
+  if (setting == NULL || setting->type != SETTING_TEXT || !preferences.begin(CONFIG_NAMESPACE, true)) {
+    return false;
+  }
+  char saved[CONFIG_VALUE_SIZE];
+  bool pending = preferences.isKey(key) && preferences.getString(key, saved, sizeof(saved)) > 0 &&
+                 strcmp(saved, setting->text) != 0;
+  preferences.end();
+  return pending;
+}
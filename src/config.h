@@ -0,0 +1,54 @@
+/*
+   Sterilizer puzzle - saved settings
+
+   Settings that can be changed at the prop without a new build, kept in
+   the ESP32's NVS with Preferences. Each one starts from the compiled-in
+   value (arduino_secrets.h and main.cpp) and is replaced by the saved
+   value at boot:
+
+     ssid         WiFi network                  after a restart
+     pass         WiFi password, never shown    after a restart
+     mqtt         broker address                after a restart
+     brightness   LED brightness, 0-255         at once
+     autosleep    minutes idle before sleeping, at once
+                  0 for never (see sleep.h)
+
+   Only settings that have been saved replace their compiled-in values,
+   and they do at every boot; after a deep sleep, though, the prop comes
+   back at the brightness it went to sleep with. A changed network setting
+   is saved at once but used from the next restart, so a typo
+   cannot cut off a prop mid-game.
+
+   Settings are changed from the serial console (console.h), or in a batch
+   by a config upload (upload.h), which stages every value and saves them
+   only once the whole upload has checked out. The password is set from
+   the console only, so it can never be read or replaced over the network.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// Preferences namespace
+#define CONFIG_NAMESPACE "sterilizer"
+// Longest value that can be set, plus the terminator
+#define CONFIG_VALUE_SIZE 64
+
+// Call from setup() before sleepSetup(), which may need the network settings
+void configSetup();
+
+int configCount();
+const char* configKey(int setting);
+// Value in use, with the password hidden; false for an unknown key
+bool configGet(const char* key, char* value, size_t size);
+// Saves and applies a value; false for an unknown key or a value out of range
+bool configSet(const char* key, const char* value);
+// Holds a value to be saved by configCommitStaged(); false for an unknown
+// key, a value out of range or the password
+bool configStage(const char* key, const char* value);
+void configCommitStaged();
+void configDiscardStaged();
+// Forgets the saved value; the compiled-in one returns at the next restart
+bool configClear(const char* key);
+// True if the saved value differs from the one in use until a restart
+bool configPending(const char* key);
@@ -0,0 +1,297 @@
+/*
+   Sterilizer puzzle - serial console
+
+   Everything runs in loop(), so the line and output buffers need no
+   locking; only the receive callback runs elsewhere, and it just wakes
+   the loop.
+*/
+
+#include "console.h"
+#include "sterilizer.h"
+#include "commands.h"
+#include "config.h"
+#include "telemetry.h"
+#include "taskstats.h"
+#include "tickless.h"
+#include "link.h"
+#include "clocksync.h"
+#include <WiFi.h>
+#include <stdarg.h>
+
+// The line being typed; overlong lines are skipped up to their end
+static char line[CONSOLE_LINE_LENGTH + 1];
+static unsigned int lineLength = 0;
+static bool overlong = false;
+
+// Replies waiting for the UART
+static char output[CONSOLE_OUTPUT_SIZE];
+static unsigned int outputStart = 0;
+static unsigned int outputUsed = 0;
+// Bytes dropped since the buffer was last empty
+static unsigned long outputLost = 0;
+
+ConsoleStats consoleStats;
+
+static void consoleHelp(const char* args);
+static void consoleStatus(const char* args);
+static void consoleStatsDump(const char* args);
+static void consoleConfig(const char* args);
+static void consoleRestart(const char* args);
+
+struct ConsoleCommand {
+  const char* name;
+  void (*handler)(const char* args);
+  const char* help;
+};
+
+// Console commands, looked at before the shared command table
+static const ConsoleCommand consoleCommands[] = {
+  { "help",    consoleHelp,      "list the commands" },
+  { "status",  consoleStatus,    "puzzle, relays, switch, network, clock and load" },
+  { "stats",   consoleStatsDump, "the stats lines, printed here" },
+  { "config",  consoleConfig,    "[<key> [<value>|clear]] show or save settings" },
+  { "restart", consoleRestart,   "reboot, for the network settings" },
+};
+static const int NUM_CONSOLE_COMMANDS = sizeof(consoleCommands) / sizeof(consoleCommands[0]);
+
+
+// Output
+static void consoleWrite(const char* text, size_t length) {
+  size_t room = CONSOLE_OUTPUT_SIZE - outputUsed;
+  if (length > room) {
+    outputLost += length - room;
+    consoleStats.lost += length - room;
+    length = room;
+  }
+  for (size_t i = 0; i < length; i++) {
+    output[(outputStart + outputUsed + i) % CONSOLE_OUTPUT_SIZE] = text[i];
+  }
+  outputUsed += length;
+}
+
+static void consolePrintf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+static void consolePrintf(const char* format, ...) {
+  char text[160];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  if (length > 0) {
+    consoleWrite(text, (size_t)length < sizeof(text) ? length : sizeof(text) - 1);
+  }
+}
+
+// Hands the UART what its transmit FIFO has room for
+static void drainOutput() {
+  while (outputUsed > 0) {
+    int room = Serial.availableForWrite();
+    if (room <= 0) {
+      break;
+    }
+    // Up to the end of the ring at most; the rest goes round the loop again
+    size_t length = CONSOLE_OUTPUT_SIZE - outputStart;
+    if (length > outputUsed) {
+      length = outputUsed;
+    }
+    if (length > (size_t)room) {
+      length = room;
+    }
+    Serial.write((const uint8_t*)output + outputStart, length);
+    outputStart = (outputStart + length) % CONSOLE_OUTPUT_SIZE;
+    outputUsed -= length;
+  }
+  if (outputUsed == 0 && outputLost > 0) {
+    unsigned long lost = outputLost;
+    outputLost = 0;
+    consolePrintf("(%lu bytes of output lost)\n", lost);
+  }
+  if (outputUsed > 0) {
+    wakeWithin(CONSOLE_DRAIN_MS);
+  }
+}
+
+void consoleAck(const char* ack) {
+  consolePrintf("%s\n", ack);
+}
+
+
+// Console Commands
+static void consoleHelp(const char* args) {
+  for (int i = 0; i < NUM_CONSOLE_COMMANDS; i++) {
+    consolePrintf("  %-8s %s\n", consoleCommands[i].name, consoleCommands[i].help);
+  }
+  consolePrintf("and the MQTT commands:");
+  for (int command = 0; command < commandCount(); command++) {
+    consolePrintf(" %s", commandName(command));
+  }
+  consolePrintf("\n");
+}
+
+static void consoleStatus(const char* args) {
+  consolePrintf("puzzle %s, rotary %d, pump %d, flames %d, maglock %d\n", puzzleStateName(puzzle),
+                RotaryPin::read(), PumpPin::driven(), FlamesPin::driven(), MagLockPin::driven());
+  IPAddress address = WiFi.localIP();
+  consolePrintf("wifi %s %s rssi %d ip %d.%d.%d.%d, mqtt %s %s, link %s\n", wifiConnected ? "up" : "down", ssid,
+                (int)WiFi.RSSI(), address[0], address[1], address[2], address[3], mqttConnected ? "up" : "down",
+                mqttServerIP, linkProfileName(linkProfile()));
+  consolePrintf("uptime %lu s, loop passes %lu, commands %lu, brightness %d\n", millis() / 1000, idleStats.passes,
+                commandStats.processed, LedBright);
+  uint64_t nowMs = clockNowMs();
+  if (nowMs != 0) {
+    unsigned long dayMs = (unsigned long)(nowMs % 86400000);
+    consolePrintf("clock %02lu:%02lu:%02lu.%03lu UTC, drift %ld ppb, last error %ld us\n", dayMs / 3600000,
+                  dayMs / 60000 % 60, dayMs / 1000 % 60, dayMs % 1000, clockDriftPpb(), clockStats.errorUs);
+  }
+  else {
+    consolePrintf("clock not synchronized\n");
+  }
+#ifdef ESP32
+  consolePrintf("heap %lu free, %lu lowest\n", (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap());
+#endif
+}
+
+static void printStatsLine(const char* statsLine) {
+  consolePrintf("%s\n", statsLine);
+}
+
+static void consoleStatsDump(const char* args) {
+  setStatsSink(printStatsLine);
+  publishStats();
+  publishTaskStats();
+  setStatsSink(NULL);
+}
+
+static void printSetting(const char* key) {
+  char value[CONFIG_VALUE_SIZE];
+  configGet(key, value, sizeof(value));
+  consolePrintf("%s %s%s\n", key, value, configPending(key) ? " (changed; restart to use)" : "");
+}
+
+static void consoleConfig(const char* args) {
+  if (args[0] == '\0') {
+    for (int i = 0; i < configCount(); i++) {
+      printSetting(configKey(i));
+    }
+    return;
+  }
+
+  char key[CONSOLE_LINE_LENGTH + 1];
+  const char* value = strchr(args, ' ');
+  size_t keyLength = value != NULL ? (size_t)(value - args) : strlen(args);
+  memcpy(key, args, keyLength);
+  key[keyLength] = '\0';
+  char unused[CONFIG_VALUE_SIZE];
+  if (!configGet(key, unused, sizeof(unused))) {
+    consolePrintf("no setting %s\n", key);
+    return;
+  }
+  if (value == NULL) {
+    printSetting(key);
+    return;
+  }
+
+  value++;
+  if (strcmp(value, "clear") == 0) {
+    configClear(key);
+    consolePrintf("%s cleared; the built-in value returns at the next restart\n", key);
+  }
+  else if (configSet(key, value)) {
+    printSetting(key);
+  }
+  else {
+    consolePrintf("bad value for %s\n", key);
+  }
+}
+
+static void consoleRestart(const char* args) {
+#ifdef ESP32
+  Serial.println("Restarting");
+  Serial.flush();
+  ESP.restart();
+#else
+  consolePrintf("restart is not simulated\n");
+#endif
+}
+
+
+// Input
+static void runLine() {
+  while (lineLength > 0 && line[lineLength - 1] == ' ') {
+    lineLength--;
+  }
+  line[lineLength] = '\0';
+  consoleStats.lines++;
+  // Split off the first word to look for a console command
+  char* args = strchr(line, ' ');
+  size_t nameLength = args != NULL ? (size_t)(args - line) : lineLength;
+  for (int i = 0; i < NUM_CONSOLE_COMMANDS; i++) {
+    if (strlen(consoleCommands[i].name) == nameLength && strncasecmp(line, consoleCommands[i].name, nameLength) == 0) {
+      consoleStats.local++;
+      consoleCommands[i].handler(args != NULL ? args + 1 : "");
+      return;
+    }
+  }
+  // Anything else is an MQTT command; its acknowledgment comes back through consoleAck()
+  enqueueCommand(CONSOLE_SOURCE, (const byte*)line, lineLength, micros());
+}
+
+static void consoleReceived() {
+  wakeLoop(WAKE_SERIAL);
+}
+
+void consoleSetup() {
+  Serial.onReceive(consoleReceived);
+  consolePrintf("Console ready; type help\n");
+}
+
+void consoleLoop() {
+  unsigned long start = micros();
+  bool ran = false;
+  while (!ran && Serial.available() > 0) {
+    if (micros() - start >= CONSOLE_TICK_BUDGET_US) {
+      break;
+    }
+    int c = Serial.read();
+    if (c == '\r' || c == '\n') {
+      if (overlong) {
+        consoleStats.overlong++;
+        consolePrintf("line too long\n");
+      }
+      else if (lineLength > 0) {
+        runLine();
+        // One line a pass; the rest of the input waits for the next
+        ran = true;
+      }
+      lineLength = 0;
+      overlong = false;
+    }
+    else if (c == '\b' || c == 0x7F) {
+      if (lineLength > 0) {
+        lineLength--;
+      }
+    }
+    else if (c >= ' ' && c < 0x7F) {
+      // Leading spaces are dropped so that the first word is the command
+      if (c == ' ' && lineLength == 0) {
+        continue;
+      }
+      if (lineLength < CONSOLE_LINE_LENGTH) {
+        line[lineLength++] = c;
+      }
+      else {
+        overlong = true;
+      }
+    }
+  }
+  if (Serial.available() > 0) {
+    wakeWithin(0);
+  }
+  drainOutput();
+}
+
+void publishConsoleStats() {
+  char statsLine[120];
+  snprintf(statsLine, sizeof(statsLine), "console lines=%lu local=%lu overlong=%lu lost=%lu", consoleStats.lines,
+           consoleStats.local, consoleStats.overlong, consoleStats.lost);
+  publishStatsLine(statsLine);
+}
@@ -0,0 +1,64 @@
+/*
+   Sterilizer puzzle - serial console
+
+   A command line on the USB serial port, for a technician at the prop
+   with or without WiFi and the broker. A line typed there goes where an
+   MQTT message would: "solve id=7", "test relays", "brightness 40" and the
+   rest of the commands in commands.h are queued with the same priorities
+   and request ID cache, and acknowledged on the console as well as on
+   ToHost/Sterilizer. The console is not rate limited. It adds its own
+   commands:
+
+     help                     list the commands
+     status                   puzzle, relays, switch, network, clock and load
+     stats                    the stats lines, printed here instead of published
+     config                   every setting (see config.h)
+     config <key>             one setting
+     config <key> <value>     save and apply a setting
+     config <key> clear       forget a saved setting
+     restart                  reboot, for the network settings
+
+   consoleLoop() never waits on the UART. It takes the bytes that have
+   arrived, for at most CONSOLE_TICK_BUDGET_US a pass, builds lines across
+   passes and runs at most one line a pass. A reply goes into an output
+   buffer drained only as fast as the UART's transmit FIFO has room, so a
+   stats dump never holds up loop(); a reply that does not fit is cut
+   short and the console says how much was lost. Arriving bytes wake the
+   loop (WAKE_SERIAL).
+
+   The port runs at CONSOLE_BAUD, which is monitor_speed in platformio.ini.
+   The console does not echo; the monitor does (monitor_echo).
+   The stats line is "console lines= local= overlong= lost=".
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#define CONSOLE_BAUD 921600
+// Longest line; room for "config pass" and a full password
+#define CONSOLE_LINE_LENGTH 96
+// Time consoleLoop() may spend reading input in one pass of loop()
+#define CONSOLE_TICK_BUDGET_US 500
+// Room for replies waiting for the UART; a full stats dump fits
+#define CONSOLE_OUTPUT_SIZE 6144
+// Time for the transmit FIFO to drain at CONSOLE_BAUD
+#define CONSOLE_DRAIN_MS 2
+// Rate limit name of the console's commands, which has no limit
+#define CONSOLE_SOURCE "console"
+
+struct ConsoleStats {
+  unsigned long lines;      // lines run
+  unsigned long local;      // of which console commands
+  unsigned long overlong;   // lines too long to run
+  unsigned long lost;       // reply bytes that did not fit the output buffer
+};
+
+extern ConsoleStats consoleStats;
+
+// Call from setup() once Serial has begun
+void consoleSetup();
+void consoleLoop();
+// Shows an acknowledgment on the console
+void consoleAck(const char* ack);
+void publishConsoleStats();
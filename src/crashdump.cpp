@@ -0,0 +1,163 @@
+/*
+   Sterilizer puzzle - crash reports
+*/
+
+#include "crashdump.h"
+#include "sterilizer.h"
+#include "tickless.h"
+
+const char crashTopic[] = "ToHost/Sterilizer/crash";
+
+#ifdef ESP32
+
+#include <esp_core_dump.h>
+#include <esp_partition.h>
+#include <mbedtls/base64.h>
+
+#define CRASH_CONTEXT_MAGIC 0x53544552
+
+// Kept in RTC memory, which is not cleared by a panic reset
+struct CrashContext {
+  uint32_t magic;
+  unsigned long uptime;
+  int puzzleState;
+};
+RTC_NOINIT_ATTR static CrashContext crashContext;
+
+// What the previous run left behind, captured before crashContext is overwritten
+static esp_reset_reason_t bootReason;
+static bool previousContextValid = false;
+static CrashContext previousContext;
+static bool summaryPending = false;
+
+static unsigned long lastContextTime = 0;
+
+static const char* resetReasonName(esp_reset_reason_t reason) {
+  switch (reason) {
+    case ESP_RST_POWERON:   return "poweron";
+    case ESP_RST_EXT:       return "external";
+    case ESP_RST_SW:        return "software";
+    case ESP_RST_PANIC:     return "panic";
+    case ESP_RST_INT_WDT:   return "int_wdt";
+    case ESP_RST_TASK_WDT:  return "task_wdt";
+    case ESP_RST_WDT:       return "wdt";
+    case ESP_RST_DEEPSLEEP: return "deepsleep";
+    case ESP_RST_BROWNOUT:  return "brownout";
+    case ESP_RST_SDIO:      return "sdio";
+    default:                return "unknown";
+  }
+}
+
+static const esp_partition_t* coreDumpPartition() {
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_COREDUMP, NULL);
+}
+
+void crashDumpSetup() {
+  bootReason = esp_reset_reason();
+  previousContextValid = crashContext.magic == CRASH_CONTEXT_MAGIC;
+  previousContext = crashContext;
+
+  crashContext.magic = CRASH_CONTEXT_MAGIC;
+  crashContext.uptime = 0;
+  crashContext.puzzleState = puzzle;
+
+  size_t address;
+  size_t size;
+  bool haveDump = esp_core_dump_image_get(&address, &size) == ESP_OK;
+  // Report anything that was not a clean power-up, and any dump still waiting to be fetched
+  summaryPending = haveDump || (bootReason != ESP_RST_POWERON && bootReason != ESP_RST_SW &&
+                                bootReason != ESP_RST_DEEPSLEEP && bootReason != ESP_RST_EXT);
+}
+
+void crashDumpLoop() {
+  if (millis() - lastContextTime >= CRASH_CONTEXT_INTERVAL) {
+    lastContextTime = millis();
+    crashContext.uptime = millis();
+    crashContext.puzzleState = puzzle;
+  }
+  wakeWithin(CRASH_CONTEXT_INTERVAL - (millis() - lastContextTime));
+  if (summaryPending && MQTTclient.connected()) {
+    summaryPending = !publishCrashSummary();
+  }
+}
+
+bool publishCrashSummary() {
+  // Sized to fit PubSubClient's default 256 byte packet with the topic
+  char line[200];
+  int used = snprintf(line, sizeof(line), "crash reason=%s", resetReasonName(bootReason));
+  if (previousContextValid) {
+    used += snprintf(line + used, sizeof(line) - used, " uptime=%lu state=%s",
+                     previousContext.uptime, puzzleStateName(previousContext.puzzleState));
+  }
+
+  size_t address;
+  size_t size;
+  if (esp_core_dump_image_get(&address, &size) == ESP_OK) {
+    esp_core_dump_summary_t summary;
+    if (esp_core_dump_get_summary(&summary) == ESP_OK) {
+      used += snprintf(line + used, sizeof(line) - used, " task=%s pc=%08x cause=%u vaddr=%08x bt=",
+                       summary.exc_task, (unsigned int)summary.exc_pc,
+                       (unsigned int)summary.ex_info.exc_cause, (unsigned int)summary.ex_info.exc_vaddr);
+      for (unsigned int i = 0; i < summary.exc_bt_info.depth && i < CRASH_BACKTRACE_DEPTH && used < (int)sizeof(line); i++) {
+        used += snprintf(line + used, sizeof(line) - used, i == 0 ? "%08x" : ",%08x",
+                         (unsigned int)summary.exc_bt_info.bt[i]);
+      }
+    }
+    if (used < (int)sizeof(line)) {
+      snprintf(line + used, sizeof(line) - used, " size=%u", (unsigned int)size);
+    }
+  }
+  return MQTTclient.publish(crashTopic, line);
+}
+
+bool publishCoreDumpChunk(unsigned long offset) {
+  size_t address;
+  size_t size;
+  const esp_partition_t* partition = coreDumpPartition();
+  if (partition == NULL || esp_core_dump_image_get(&address, &size) != ESP_OK || offset >= size) {
+    return false;
+  }
+
+  uint8_t chunk[COREDUMP_CHUNK];
+  size_t length = size - offset < COREDUMP_CHUNK ? size - offset : COREDUMP_CHUNK;
+  if (esp_partition_read(partition, address - partition->address + offset, chunk, length) != ESP_OK) {
+    return false;
+  }
+
+  char line[24 + (COREDUMP_CHUNK + 2) / 3 * 4 + 1];
+  int used = snprintf(line, sizeof(line), "core %lu ", offset);
+  size_t encoded;
+  mbedtls_base64_encode((unsigned char*)line + used, sizeof(line) - used, &encoded, chunk, length);
+  return MQTTclient.publish(crashTopic, line);
+}
+
+bool eraseCoreDump() {
+  const esp_partition_t* partition = coreDumpPartition();
+  if (partition == NULL) {
+    return false;
+  }
+  return esp_partition_erase_range(partition, 0, partition->size) == ESP_OK;
+}
+
+#else
+
+// Only the ESP32 build has reset reasons and core dumps
+void crashDumpSetup() {
+}
+
+void crashDumpLoop() {
+}
+
+bool publishCrashSummary() {
+  return false;
+}
+
+bool publishCoreDumpChunk(unsigned long offset) {
+  return false;
+}
+
+bool eraseCoreDump() {
+  return false;
+}
+
+#endif
@@ -0,0 +1,36 @@
+/*
+   Sterilizer puzzle - crash reports
+
+   The ESP32 core writes a core dump to the "coredump" flash partition when
+   the firmware panics (the default Arduino partition table has one). On the
+   next boot a summary is published on ToHost/Sterilizer/crash once MQTT is
+   up:
+
+     crash reason=<reset reason> uptime=<ms> state=<PuzzleState>
+           task=<name> pc=<hex> cause=<n> vaddr=<hex> bt=<hex>,<hex>,... size=<bytes>
+
+   uptime and state come from RTC memory, which survives the reset. The
+   full dump is fetched with "coredump read <offset>", which replies with
+   "core <offset> <base64>" chunks, and decoded on the host by
+   tools/coredump_fetch.py. "coredump erase" clears it, "coredump info"
+   publishes the summary again.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// Bytes of core dump per "core" message
+#define COREDUMP_CHUNK 120
+// Backtrace frames included in the summary; the full backtrace is in the dump
+#define CRASH_BACKTRACE_DEPTH 8
+// How often the uptime kept in RTC memory is refreshed
+#define CRASH_CONTEXT_INTERVAL 1000
+
+extern const char crashTopic[];
+
+void crashDumpSetup();
+void crashDumpLoop();
+bool publishCrashSummary();
+bool publishCoreDumpChunk(unsigned long offset);
+bool eraseCoreDump();
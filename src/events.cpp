@@ -0,0 +1,152 @@
+/*
+   Sterilizer puzzle - internal event bus
+
+   The queue follows Dmitry Vyukov's bounded MPMC queue: each slot carries
+   a sequence number that says whether it is free for the producer at a
+   given position or holds an event for the consumer. Producers claim a
+   position with a compare-and-swap and publish the slot by storing its
+   sequence, so no producer ever waits for another.
+*/
+
+#include "events.h"
+#include "tickless.h"
+#include <atomic>
+
+typedef void (*EventHandler)(const Event& event);
+
+// Subscribers of each event type, in the order they are called
+static const EventHandler connectionSubscribers[] = { ledsOnConnection, networkOnConnection, linkOnConnection, httpOnConnection };
+static const EventHandler puzzleSubscribers[] = { ledsOnPuzzle, networkOnPuzzle, linkOnPuzzle, httpOnPuzzle };
+static const EventHandler commandSubscribers[] = { commandsOnCommand };
+
+struct SubscriberList {
+  const char* name;
+  const EventHandler* handlers;
+  int count;
+};
+
+#define SUBSCRIBERS(name, list) { name, list, sizeof(list) / sizeof(list[0]) }
+
+// Indexed by EventType
+static const SubscriberList subscribers[EVENT_TYPES] = {
+  SUBSCRIBERS("connection", connectionSubscribers),
+  SUBSCRIBERS("puzzle", puzzleSubscribers),
+  SUBSCRIBERS("command", commandSubscribers),
+};
+
+struct EventSlot {
+  std::atomic<unsigned long> sequence;
+  Event event;
+};
+
+static EventSlot slots[EVENT_QUEUE_SIZE];
+static std::atomic<unsigned long> enqueuePosition(0);
+static unsigned long dequeuePosition = 0;  // only eventLoop() takes events
+static std::atomic<unsigned long> droppedEvents(0);
+
+EventStats eventStats;
+
+static LatencyHistogram latencyHistograms[EVENT_TYPES][EVENT_STAGES];
+
+void eventBusSetup() {
+  for (unsigned long i = 0; i < EVENT_QUEUE_SIZE; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+bool postEvent(const Event& event) {
+  unsigned long position = enqueuePosition.load(std::memory_order_relaxed);
+  EventSlot* slot;
+  for (;;) {
+    slot = &slots[position & (EVENT_QUEUE_SIZE - 1)];
+    long difference = (long)(slot->sequence.load(std::memory_order_acquire) - position);
+    if (difference == 0) {
+      // The slot is free; claim it unless another producer got there first
+      if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    }
+    else if (difference < 0) {
+      // The consumer has not emptied this slot yet, so the queue is full
+      droppedEvents.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    else {
+      position = enqueuePosition.load(std::memory_order_relaxed);
+    }
+  }
+  slot->event = event;
+  slot->event.postedUs = micros();
+  slot->sequence.store(position + 1, std::memory_order_release);
+  wakeLoop(WAKE_EVENT);
+  return true;
+}
+
+void postConnection(bool wifi, bool mqtt) {
+  Event event;
+  event.type = EVT_CONNECTION;
+  event.connection.wifi = wifi;
+  event.connection.mqtt = mqtt;
+  postEvent(event);
+}
+
+void postPuzzleState(PuzzleState state, PuzzleState previous) {
+  Event event;
+  event.type = EVT_PUZZLE;
+  event.puzzle.state = state;
+  event.puzzle.previous = previous;
+  postEvent(event);
+}
+
+bool postCommand(const char* source, const char* line, unsigned int length, unsigned long receivedUs) {
+  Event event;
+  event.type = EVT_COMMAND;
+  event.command.source = source;
+  // One byte past the limit is kept so that the command queue can tell it was too long
+  event.command.length = length > MAX_COMMAND_LENGTH ? MAX_COMMAND_LENGTH + 1 : length;
+  memcpy(event.command.line, line, event.command.length);
+  event.command.receivedUs = receivedUs;
+  return postEvent(event);
+}
+
+void eventLoop() {
+  // Only the events already queued, so a subscriber that posts cannot keep this going
+  unsigned long end = enqueuePosition.load(std::memory_order_acquire);
+  int waiting = (int)(end - dequeuePosition);
+  if (waiting > eventStats.highWater) {
+    eventStats.highWater = waiting;
+  }
+  while (dequeuePosition != end) {
+    EventSlot& slot = slots[dequeuePosition & (EVENT_QUEUE_SIZE - 1)];
+    // A producer that claimed this slot may not have filled it yet
+    if (slot.sequence.load(std::memory_order_acquire) != dequeuePosition + 1) {
+      break;
+    }
+    Event event = slot.event;
+    slot.sequence.store(dequeuePosition + EVENT_QUEUE_SIZE, std::memory_order_release);
+    dequeuePosition++;
+
+    unsigned long startUs = micros();
+    const SubscriberList& list = subscribers[event.type];
+    for (int i = 0; i < list.count; i++) {
+      list.handlers[i](event);
+    }
+    recordLatency(latencyHistograms[event.type][EVT_STAGE_QUEUE], startUs - event.postedUs);
+    recordLatency(latencyHistograms[event.type][EVT_STAGE_HANDLE], micros() - startUs);
+    eventStats.delivered++;
+  }
+  eventStats.posted = enqueuePosition.load(std::memory_order_relaxed);
+  eventStats.dropped = droppedEvents.load(std::memory_order_relaxed);
+}
+
+const char* eventName(int type) {
+  return subscribers[type].name;
+}
+
+const LatencyHistogram& eventLatency(int type, EventStage stage) {
+  return latencyHistograms[type][stage];
+}
+
+const char* eventStageName(EventStage stage) {
+  return stage == EVT_STAGE_QUEUE ? "queue" : "handle";
+}
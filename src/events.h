@@ -0,0 +1,100 @@
+/*
+   Sterilizer puzzle - internal event bus
+
+   Subsystems tell each other what happened by posting typed events rather
+   than calling into each other or sharing globals: the network code posts
+   connection changes, the puzzle posts its state changes, and the LEDs and
+   the MQTT announcements react to them. Commands from outside loop(),
+   such as the web panel's, reach the command queue the same way.
+
+   Events go through a fixed-size lock-free queue (a bounded multi-producer
+   ring with a sequence number per slot), so they can be posted from any
+   task on either core, or from an ISR, without taking a lock. eventLoop()
+   delivers them from loop() to the subscribers listed for each event type
+   in the constant table in events.cpp. The time from posting to delivery,
+   and the time the subscribers took, are kept per event type and published
+   with the stats as "evt <event> <queue|handle> n=... max=... b<i>=...".
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "sterilizer.h"
+#include "latency.h"
+#include "commands.h"
+
+// Slots in the queue; a power of two
+#define EVENT_QUEUE_SIZE 32
+
+enum EventType {
+  EVT_CONNECTION,  // WiFi or MQTT connected or lost
+  EVT_PUZZLE,      // puzzle state changed
+  EVT_COMMAND,     // command line from another task, for the command queue
+  EVENT_TYPES
+};
+
+enum EventStage {
+  EVT_STAGE_QUEUE,   // post to delivery
+  EVT_STAGE_HANDLE,  // all subscribers of the event
+  EVENT_STAGES
+};
+
+struct ConnectionEvent {
+  bool wifi;
+  bool mqtt;
+};
+
+struct PuzzleEvent {
+  PuzzleState state;
+  PuzzleState previous;
+};
+
+struct CommandEvent {
+  const char* source;  // rate limited like an MQTT topic of this name
+  char line[MAX_COMMAND_LENGTH + 1];
+  unsigned int length;  // MAX_COMMAND_LENGTH + 1 when the line was cut short
+  unsigned long receivedUs;
+};
+
+struct Event {
+  EventType type;
+  unsigned long postedUs;
+  union {
+    ConnectionEvent connection;
+    PuzzleEvent puzzle;
+    CommandEvent command;
+  };
+};
+
+struct EventStats {
+  unsigned long posted;
+  unsigned long delivered;
+  unsigned long dropped;   // queue full
+  int highWater;
+};
+
+extern EventStats eventStats;
+
+void eventBusSetup();
+// Post from anywhere, including an ISR; false if the queue is full
+bool postEvent(const Event& event);
+void postConnection(bool wifi, bool mqtt);
+void postPuzzleState(PuzzleState state, PuzzleState previous);
+bool postCommand(const char* source, const char* line, unsigned int length, unsigned long receivedUs);
+// Delivers the events queued so far
+void eventLoop();
+
+const char* eventName(int type);
+const LatencyHistogram& eventLatency(int type, EventStage stage);
+const char* eventStageName(EventStage stage);
+
+// Subscribers, defined by the subsystems in main.cpp, link.cpp, http.cpp and commands.cpp
+void ledsOnConnection(const Event& event);
+void ledsOnPuzzle(const Event& event);
+void networkOnConnection(const Event& event);
+void networkOnPuzzle(const Event& event);
+void linkOnConnection(const Event& event);
+void linkOnPuzzle(const Event& event);
+void httpOnConnection(const Event& event);
+void httpOnPuzzle(const Event& event);
+void commandsOnCommand(const Event& event);
@@ -0,0 +1,107 @@
+/*
+   Sterilizer puzzle - compile-time GPIO
+
+   The fallback mask writer for builds without the ESP32 registers, and a
+   benchmark of the register writes against digitalWrite().
+*/
+
+#include "gpio.h"
+#include "sterilizer.h"
+#include "telemetry.h"
+
+// Writes per measurement
+#define GPIO_BENCH_ITERATIONS 1000
+
+#ifndef ESP32
+void gpioWriteMask(uint32_t mask0, uint32_t mask1, int level) {
+  for (int pin = 0; pin < 40; pin++) {
+    uint32_t mask = pin < 32 ? mask0 : mask1;
+    if (mask & (1UL << (pin & 31))) {
+      digitalWrite(pin, level);
+    }
+  }
+}
+#endif
+
+// Cycle counter on the ESP32, microseconds elsewhere
+static inline uint32_t benchClock() {
+#ifdef ESP32
+  return ESP.getCycleCount();
+#else
+  return micros();
+#endif
+}
+
+// Nanoseconds per iteration, with one decimal, as "123.4"
+static void formatNanoseconds(char* buffer, size_t size, uint32_t ticks) {
+#ifdef ESP32
+  unsigned long tenths = (unsigned long long)ticks * 10000 / ESP.getCpuFreqMHz() / GPIO_BENCH_ITERATIONS;
+#else
+  unsigned long tenths = (unsigned long long)ticks * 10000 / GPIO_BENCH_ITERATIONS;
+#endif
+  snprintf(buffer, size, "%lu.%lu", tenths / 10, tenths % 10);
+}
+
+void publishGpioBenchmark() {
+  // Every write repeats the level the relay already has, so nothing clicks
+  int pump = PumpPin::driven();
+  int flames = FlamesPin::driven();
+  int maglock = MagLockPin::driven();
+  uint32_t high0 = (pump ? PumpPin::mask0 : 0) | (flames ? FlamesPin::mask0 : 0) | (maglock ? MagLockPin::mask0 : 0);
+  uint32_t high1 = (pump ? PumpPin::mask1 : 0) | (flames ? FlamesPin::mask1 : 0) | (maglock ? MagLockPin::mask1 : 0);
+  uint32_t low0 = AllRelays::mask0 & ~high0;
+  uint32_t low1 = AllRelays::mask1 & ~high1;
+  volatile int sink = 0;
+
+  uint32_t start = benchClock();
+  for (int i = 0; i < GPIO_BENCH_ITERATIONS; i++) {
+    digitalWrite(Flames, flames);
+  }
+  uint32_t arduinoWrite = benchClock() - start;
+
+  start = benchClock();
+  for (int i = 0; i < GPIO_BENCH_ITERATIONS; i++) {
+    FlamesPin::write(flames);
+  }
+  uint32_t directWrite = benchClock() - start;
+
+  start = benchClock();
+  for (int i = 0; i < GPIO_BENCH_ITERATIONS; i++) {
+    digitalWrite(Pump, pump);
+    digitalWrite(Flames, flames);
+    digitalWrite(MagLock, maglock);
+  }
+  uint32_t arduinoRelays = benchClock() - start;
+
+  start = benchClock();
+  for (int i = 0; i < GPIO_BENCH_ITERATIONS; i++) {
+    gpioSwitchMasks(high0, high1, low0, low1);
+  }
+  uint32_t groupRelays = benchClock() - start;
+
+  start = benchClock();
+  for (int i = 0; i < GPIO_BENCH_ITERATIONS; i++) {
+    sink += digitalRead(Rotary);
+  }
+  uint32_t arduinoRead = benchClock() - start;
+
+  start = benchClock();
+  for (int i = 0; i < GPIO_BENCH_ITERATIONS; i++) {
+    sink += RotaryPin::read();
+  }
+  uint32_t directRead = benchClock() - start;
+
+  char results[6][16];
+  formatNanoseconds(results[0], sizeof(results[0]), arduinoWrite);
+  formatNanoseconds(results[1], sizeof(results[1]), directWrite);
+  formatNanoseconds(results[2], sizeof(results[2]), arduinoRelays);
+  formatNanoseconds(results[3], sizeof(results[3]), groupRelays);
+  formatNanoseconds(results[4], sizeof(results[4]), arduinoRead);
+  formatNanoseconds(results[5], sizeof(results[5]), directRead);
+
+  char line[192];
+  snprintf(line, sizeof(line),
+           "bench gpio ns digitalWrite=%s direct=%s relays_digitalWrite=%s relays_group=%s digitalRead=%s directRead=%s",
+           results[0], results[1], results[2], results[3], results[4], results[5]);
+  publishStatsLine(line);
+}
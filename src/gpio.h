@@ -0,0 +1,148 @@
+/*
+   Sterilizer puzzle - compile-time GPIO
+
+   GpioPin<N> is a pin whose number is fixed at compile time, so writing it
+   compiles to a single store to the ESP32's GPIO set or clear register
+   instead of a trip through digitalWrite()'s pin lookup. GpioGroup<...>
+   combines pins into register masks, and gpioSwitch<HighPins, LowPins>()
+   drives a whole group in one go with interrupts held off, so that the
+   flames, pump and maglock change together.
+
+   GPIO 0-31 and 32-39 live in separate registers, and setting and clearing
+   are separate registers too, so a switch is up to four stores a few
+   nanoseconds apart rather than one. Other builds (the simulator) fall
+   back to digitalWrite() and digitalRead().
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#ifdef ESP32
+#include <soc/gpio_struct.h>
+#endif
+
+#ifndef ESP32
+void gpioWriteMask(uint32_t mask0, uint32_t mask1, int level);
+#endif
+
+// Drives the pins in the high masks high and those in the low masks low.
+// Masks are bit n for GPIO n (mask0) or GPIO 32 + n (mask1).
+inline __attribute__((always_inline))
+void gpioSwitchMasks(uint32_t high0, uint32_t high1, uint32_t low0, uint32_t low1) {
+#ifdef ESP32
+  // No interrupt or task switch can land between the register writes
+  portDISABLE_INTERRUPTS();
+  if (high0 != 0) {
+    GPIO.out_w1ts = high0;
+  }
+  if (low0 != 0) {
+    GPIO.out_w1tc = low0;
+  }
+  if (high1 != 0) {
+    GPIO.out1_w1ts.val = high1;
+  }
+  if (low1 != 0) {
+    GPIO.out1_w1tc.val = low1;
+  }
+  portENABLE_INTERRUPTS();
+#else
+  gpioWriteMask(high0, high1, HIGH);
+  gpioWriteMask(low0, low1, LOW);
+#endif
+}
+
+template <uint8_t PIN>
+struct GpioPin {
+  static const uint8_t number = PIN;
+  static const uint32_t mask0 = PIN < 32 ? 1UL << (PIN & 31) : 0;
+  static const uint32_t mask1 = PIN < 32 ? 0 : 1UL << (PIN & 31);
+
+  static void output() {
+    static_assert(PIN < 34, "GPIO 34-39 are inputs only");
+    pinMode(PIN, OUTPUT);
+  }
+
+  static void inputPullup() {
+    pinMode(PIN, INPUT_PULLUP);
+  }
+
+  static inline __attribute__((always_inline)) void high() {
+    static_assert(PIN < 34, "GPIO 34-39 are inputs only");
+#ifdef ESP32
+    if (PIN < 32) {
+      GPIO.out_w1ts = mask0;
+    }
+    else {
+      GPIO.out1_w1ts.val = mask1;
+    }
+#else
+    digitalWrite(PIN, HIGH);
+#endif
+  }
+
+  static inline __attribute__((always_inline)) void low() {
+    static_assert(PIN < 34, "GPIO 34-39 are inputs only");
+#ifdef ESP32
+    if (PIN < 32) {
+      GPIO.out_w1tc = mask0;
+    }
+    else {
+      GPIO.out1_w1tc.val = mask1;
+    }
+#else
+    digitalWrite(PIN, LOW);
+#endif
+  }
+
+  static inline __attribute__((always_inline)) void write(int level) {
+    if (level == LOW) {
+      low();
+    }
+    else {
+      high();
+    }
+  }
+
+  // Level of an input pin
+  static inline __attribute__((always_inline)) int read() {
+#ifdef ESP32
+    return PIN < 32 ? (GPIO.in >> (PIN & 31)) & 1 : (GPIO.in1.val >> (PIN & 31)) & 1;
+#else
+    return digitalRead(PIN);
+#endif
+  }
+
+  // Level an output pin is being driven to
+  static inline __attribute__((always_inline)) int driven() {
+#ifdef ESP32
+    return PIN < 32 ? (GPIO.out >> (PIN & 31)) & 1 : (GPIO.out1.val >> (PIN & 31)) & 1;
+#else
+    return digitalRead(PIN);
+#endif
+  }
+};
+
+template <typename... PINS>
+struct GpioGroup;
+
+template <>
+struct GpioGroup<> {
+  static const uint32_t mask0 = 0;
+  static const uint32_t mask1 = 0;
+};
+
+template <typename FIRST, typename... REST>
+struct GpioGroup<FIRST, REST...> {
+  static const uint32_t mask0 = FIRST::mask0 | GpioGroup<REST...>::mask0;
+  static const uint32_t mask1 = FIRST::mask1 | GpioGroup<REST...>::mask1;
+};
+
+template <typename HIGH_PINS, typename LOW_PINS>
+inline __attribute__((always_inline)) void gpioSwitch() {
+  static_assert((HIGH_PINS::mask0 & LOW_PINS::mask0) == 0 && (HIGH_PINS::mask1 & LOW_PINS::mask1) == 0,
+                "a pin cannot be driven high and low at once");
+  gpioSwitchMasks(HIGH_PINS::mask0, HIGH_PINS::mask1, LOW_PINS::mask0, LOW_PINS::mask1);
+}
+
+// Publishes "bench gpio ..." with the cost of each way of driving the relays
+void publishGpioBenchmark();
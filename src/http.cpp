@@ -0,0 +1,376 @@
+/*
+   Sterilizer puzzle - HTTP status endpoint
+
+   The ESP32 build serves from a task on core 0, away from the loop task.
+   The native simulator has no tasks: its WebServer stand-in answers the
+   scenario's "http" requests from httpLoop(), and a request there can take
+   a fresh snapshot itself since it runs inside loop().
+*/
+
+#include "http.h"
+#include "sterilizer.h"
+#include "telemetry.h"
+#include "commands.h"
+#include "events.h"
+#include "tickless.h"
+#include "link.h"
+#include "web.h"
+#include <WiFi.h>
+#include <WebServer.h>
+#include <atomic>
+#include <stdarg.h>
+
+// Longest a request waits for loop() to replace a snapshot gone stale
+#define HTTP_FRESH_WAIT_MS 50
+// Also runs the web panel's WebSocket server
+#define HTTP_TASK_STACK 6144
+
+static WebServer server(HTTP_PORT);
+
+// One page, formatted by loop(); readers counts the requests sending it
+struct Snapshot {
+  char* text;
+  size_t length;
+  std::atomic<int> readers;
+};
+
+static char metricsText[2][HTTP_METRICS_SIZE];
+static char stateText[2][HTTP_STATE_SIZE];
+static Snapshot snapshots[HTTP_PAGES][2];
+// Index of the snapshot requests should send, and when it was taken
+static std::atomic<int> published[HTTP_PAGES];
+static std::atomic<unsigned long> snapshotMs[HTTP_PAGES];
+static std::atomic<unsigned long> stateVersion(0);
+
+static const char* const pageTypes[HTTP_PAGES] = { "text/plain; version=0.0.4", "application/json" };
+static const size_t pageSizes[HTTP_PAGES] = { HTTP_METRICS_SIZE, HTTP_STATE_SIZE };
+
+// Set by the server task, read by loop()
+static std::atomic<bool> everRequested(false);
+static std::atomic<unsigned long> lastRequestMs(0);
+static std::atomic<bool> refreshWanted(false);
+// The puzzle or the connection changed since the last snapshot
+static bool dirty = true;
+static unsigned long lastSnapshotMs = 0;
+
+HttpStats httpStats;
+
+
+// Page Formatting
+struct PageWriter {
+  char* text;
+  size_t size;
+  size_t used;
+  bool full;
+};
+
+static void emit(PageWriter& page, const char* format, ...) __attribute__((format(printf, 2, 3)));
+static void emit(PageWriter& page, const char* format, ...) {
+  if (page.full) {
+    return;
+  }
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(page.text + page.used, page.size - page.used, format, args);
+  va_end(args);
+  // A line that does not fit is left out whole, and so is everything after it, so the page still parses
+  if (length < 0 || (size_t)length >= page.size - page.used) {
+    page.text[page.used] = '\0';
+    page.full = true;
+    return;
+  }
+  page.used += length;
+}
+
+// Cumulative buckets at every third bucket bound of latency.h, 2^6 us up
+static void emitHistogram(PageWriter& page, const char* name, const char* labels, const LatencyHistogram& histogram) {
+  const char* separator = labels[0] != '\0' ? "," : "";
+  unsigned long cumulative = 0;
+  int bucket = 0;
+  for (int bound = 6; bound < LATENCY_BUCKETS - 1; bound += 3) {
+    // Bucket i holds durations below 2^i us
+    while (bucket <= bound) {
+      cumulative += histogram.counts[bucket++];
+    }
+    emit(page, "%s_bucket{%s%sle=\"%lu\"} %lu\n", name, labels, separator, 1UL << bound, cumulative);
+  }
+  unsigned long count = latencyCount(histogram);
+  emit(page, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, separator, count);
+  emit(page, "%s_count{%s} %lu\n", name, labels, count);
+}
+
+static void writeMetrics(PageWriter& page) {
+  emit(page, "# TYPE sterilizer_uptime_seconds gauge\nsterilizer_uptime_seconds %lu\n", millis() / 1000);
+  emit(page, "# TYPE sterilizer_loop_passes_total counter\nsterilizer_loop_passes_total %lu\n", idleStats.passes);
+  emit(page, "# TYPE sterilizer_loop_wakes_total counter\n");
+  emit(page, "sterilizer_loop_wakes_total{cause=\"timer\"} %lu\n", idleStats.timer);
+  emit(page, "sterilizer_loop_wakes_total{cause=\"gpio\"} %lu\n", idleStats.gpio);
+  emit(page, "sterilizer_loop_wakes_total{cause=\"network\"} %lu\n", idleStats.network);
+  emit(page, "sterilizer_loop_wakes_total{cause=\"wifi\"} %lu\n", idleStats.wifi);
+  emit(page, "sterilizer_loop_wakes_total{cause=\"event\"} %lu\n", idleStats.event);
+  emit(page, "sterilizer_loop_wakes_total{cause=\"serial\"} %lu\n", idleStats.serial);
+#ifdef ESP32
+  emit(page, "# TYPE sterilizer_heap_free_bytes gauge\nsterilizer_heap_free_bytes %lu\n", (unsigned long)ESP.getFreeHeap());
+  emit(page, "# TYPE sterilizer_heap_min_free_bytes gauge\nsterilizer_heap_min_free_bytes %lu\n", (unsigned long)ESP.getMinFreeHeap());
+#endif
+  emit(page, "# TYPE sterilizer_wifi_rssi_dbm gauge\nsterilizer_wifi_rssi_dbm %d\n", (int)WiFi.RSSI());
+
+  emit(page, "# TYPE sterilizer_connected gauge\n");
+  emit(page, "sterilizer_connected{link=\"wifi\"} %d\n", wifiConnected ? 1 : 0);
+  emit(page, "sterilizer_connected{link=\"mqtt\"} %d\n", mqttConnected ? 1 : 0);
+  // The first connect is the boot; every later one is a reconnect
+  emit(page, "# TYPE sterilizer_connects_total counter\n");
+  emit(page, "sterilizer_connects_total{link=\"wifi\"} %lu\n", wifiConnects);
+  emit(page, "sterilizer_connects_total{link=\"mqtt\"} %lu\n", mqttConnects);
+
+  emit(page, "# TYPE sterilizer_puzzle_state gauge\n");
+  for (int state = Initializing; state <= Resetting; state++) {
+    emit(page, "sterilizer_puzzle_state{state=\"%s\"} %d\n", puzzleStateName(state), puzzle == state ? 1 : 0);
+  }
+  emit(page, "# TYPE sterilizer_relay gauge\n");
+  emit(page, "sterilizer_relay{relay=\"pump\"} %d\n", PumpPin::driven());
+  emit(page, "sterilizer_relay{relay=\"flames\"} %d\n", FlamesPin::driven());
+  emit(page, "sterilizer_relay{relay=\"maglock\"} %d\n", MagLockPin::driven());
+  emit(page, "# TYPE sterilizer_rotary gauge\nsterilizer_rotary %d\n", RotaryPin::read());
+  emit(page, "# TYPE sterilizer_link_profile gauge\n");
+  for (int profile = 0; profile < LINK_PROFILES; profile++) {
+    emit(page, "sterilizer_link_profile{profile=\"%s\"} %d\n", linkProfileName((LinkProfile)profile),
+         linkProfile() == profile ? 1 : 0);
+  }
+
+  emit(page, "# TYPE sterilizer_commands_total counter\n");
+  emit(page, "sterilizer_commands_total{result=\"received\"} %lu\n", commandStats.received);
+  emit(page, "sterilizer_commands_total{result=\"processed\"} %lu\n", commandStats.processed);
+  emit(page, "sterilizer_commands_total{result=\"queue_full\"} %lu\n", commandStats.droppedFull);
+  emit(page, "sterilizer_commands_total{result=\"rate_limited\"} %lu\n", commandStats.droppedRate);
+  emit(page, "sterilizer_commands_total{result=\"evicted\"} %lu\n", commandStats.evicted);
+  emit(page, "sterilizer_commands_total{result=\"ping\"} %lu\n", commandStats.pings);
+  emit(page, "# TYPE sterilizer_command_latency_us histogram\n");
+  char labels[48];
+  for (int command = 0; command < commandCount(); command++) {
+    const LatencyHistogram& histogram = commandLatency(command, LAT_TOTAL);
+    if (latencyCount(histogram) == 0) {
+      continue;
+    }
+    snprintf(labels, sizeof(labels), "command=\"%s\"", commandName(command));
+    emitHistogram(page, "sterilizer_command_latency_us", labels, histogram);
+  }
+
+  emit(page, "# TYPE sterilizer_events_total counter\n");
+  emit(page, "sterilizer_events_total{result=\"posted\"} %lu\n", eventStats.posted);
+  emit(page, "sterilizer_events_total{result=\"delivered\"} %lu\n", eventStats.delivered);
+  emit(page, "sterilizer_events_total{result=\"dropped\"} %lu\n", eventStats.dropped);
+  emit(page, "# TYPE sterilizer_event_latency_us histogram\n");
+  for (int type = 0; type < EVENT_TYPES; type++) {
+    for (int stage = 0; stage < EVENT_STAGES; stage++) {
+      snprintf(labels, sizeof(labels), "event=\"%s\",stage=\"%s\"", eventName(type), eventStageName((EventStage)stage));
+      emitHistogram(page, "sterilizer_event_latency_us", labels, eventLatency(type, (EventStage)stage));
+    }
+  }
+
+  emit(page, "# TYPE sterilizer_http_requests_total counter\n");
+  emit(page, "sterilizer_http_requests_total{path=\"/metrics\"} %lu\n", httpStats.requests[HTTP_METRICS]);
+  emit(page, "sterilizer_http_requests_total{path=\"/state\"} %lu\n", httpStats.requests[HTTP_STATE]);
+  emit(page, "sterilizer_http_requests_total{path=\"other\"} %lu\n", httpStats.missing);
+  emit(page, "# TYPE sterilizer_web_clients gauge\nsterilizer_web_clients %d\n", webStats.clients);
+  emit(page, "# TYPE sterilizer_web_commands_total counter\nsterilizer_web_commands_total %lu\n", webStats.commands);
+  emit(page, "# TYPE sterilizer_http_serve_us histogram\n");
+  emitHistogram(page, "sterilizer_http_serve_us", "path=\"/metrics\"", httpStats.serve[HTTP_METRICS]);
+  emitHistogram(page, "sterilizer_http_serve_us", "path=\"/state\"", httpStats.serve[HTTP_STATE]);
+  emit(page, "# TYPE sterilizer_http_snapshot_us histogram\n");
+  emitHistogram(page, "sterilizer_http_snapshot_us", "path=\"/metrics\"", httpStats.snapshot[HTTP_METRICS]);
+  emitHistogram(page, "sterilizer_http_snapshot_us", "path=\"/state\"", httpStats.snapshot[HTTP_STATE]);
+}
+
+static void writeState(PageWriter& page) {
+  emit(page, "{\"device\":\"%s\",\"uptime\":%lu,\"state\":\"%s\",\"rotary\":%d,", deviceID, millis() / 1000,
+       puzzleStateName(puzzle), RotaryPin::read());
+  emit(page, "\"relays\":{\"pump\":%d,\"flames\":%d,\"maglock\":%d},", PumpPin::driven(), FlamesPin::driven(),
+       MagLockPin::driven());
+  emit(page, "\"wifi\":%s,\"mqtt\":%s,\"rssi\":%d,\"link\":\"%s\",\"brightness\":%d}\n",
+       wifiConnected ? "true" : "false", mqttConnected ? "true" : "false", (int)WiFi.RSSI(),
+       linkProfileName(linkProfile()), LedBright);
+}
+
+// Formats a page into the buffer no request is sending, then publishes it. False if both are busy.
+static bool takeSnapshot(HttpPage which) {
+  unsigned long start = micros();
+  int next = 1 - published[which].load();
+  Snapshot& snapshot = snapshots[which][next];
+  // A request that picked this buffer up before the last swap is still sending it
+  if (snapshot.readers.load() != 0) {
+    return false;
+  }
+  PageWriter page = { snapshot.text, pageSizes[which], 0, false };
+  if (which == HTTP_METRICS) {
+    writeMetrics(page);
+  }
+  else {
+    writeState(page);
+  }
+  if (page.full) {
+    httpStats.truncated++;
+  }
+  snapshot.length = page.used;
+  published[which].store(next);
+  snapshotMs[which].store(millis());
+  if (which == HTTP_STATE) {
+    stateVersion.fetch_add(1);
+  }
+  recordLatency(httpStats.snapshot[which], micros() - start);
+  return true;
+}
+
+
+// Request Handlers
+
+// The published snapshot, marked as being read
+static Snapshot& acquireSnapshot(HttpPage which) {
+  for (;;) {
+    int index = published[which].load();
+    Snapshot& snapshot = snapshots[which][index];
+    snapshot.readers.fetch_add(1);
+    // loop() may have swapped and started on this buffer before it saw the reader
+    if (published[which].load() == index) {
+      return snapshot;
+    }
+    snapshot.readers.fetch_sub(1);
+  }
+}
+
+static void serve(HttpPage which) {
+  unsigned long start = micros();
+  lastRequestMs.store(millis());
+  everRequested.store(true);
+  if (millis() - snapshotMs[which].load() > HTTP_SNAPSHOT_MS) {
+#ifdef ESP32
+    // After a quiet spell the snapshot is old; ask loop() for a new one and give it a moment
+    refreshWanted.store(true);
+    wakeLoop(WAKE_NETWORK);
+    unsigned long asked = millis();
+    while (millis() - snapshotMs[which].load() > HTTP_SNAPSHOT_MS && millis() - asked < HTTP_FRESH_WAIT_MS) {
+      delay(1);
+    }
+#else
+    takeSnapshot(which);
+#endif
+  }
+
+  Snapshot& snapshot = acquireSnapshot(which);
+  server.send_P(200, pageTypes[which], snapshot.text, snapshot.length);
+  snapshot.readers.fetch_sub(1);
+
+  httpStats.requests[which]++;
+  recordLatency(httpStats.serve[which], micros() - start);
+}
+
+static void serveMissing() {
+  if (webServeAsset(server)) {
+    return;
+  }
+  httpStats.missing++;
+  server.send(404, "text/plain", "not found\n");
+}
+
+#ifdef ESP32
+static void httpTask(void* parameter) {
+  server.begin();
+  for (;;) {
+    server.handleClient();
+    webServe();
+    vTaskDelay(pdMS_TO_TICKS(HTTP_POLL_MS));
+  }
+}
+#endif
+
+void httpSetup() {
+  for (int i = 0; i < 2; i++) {
+    snapshots[HTTP_METRICS][i].text = metricsText[i];
+    snapshots[HTTP_STATE][i].text = stateText[i];
+  }
+  takeSnapshot(HTTP_METRICS);
+  takeSnapshot(HTTP_STATE);
+
+  server.on("/metrics", []() { serve(HTTP_METRICS); });
+  server.on("/state", []() { serve(HTTP_STATE); });
+  server.onNotFound(serveMissing);
+  webSetup();
+#ifdef ESP32
+  // Core 0, with the WiFi stack, so a slow client never competes with the loop task
+  xTaskCreatePinnedToCore(httpTask, "http", HTTP_TASK_STACK, NULL, 1, NULL, 0);
+#else
+  server.begin();
+#endif
+}
+
+void httpLoop() {
+#ifndef ESP32
+  server.handleClient();
+#endif
+  bool watched = everRequested.load() && millis() - lastRequestMs.load() < HTTP_WATCHED_MS;
+  if (refreshWanted.exchange(false)) {
+    dirty = true;
+  }
+  if (dirty || (watched && millis() - lastSnapshotMs >= HTTP_SNAPSHOT_MS)) {
+    lastSnapshotMs = millis();
+    // Tried again shortly if a slow request is holding a buffer
+    dirty = !takeSnapshot(HTTP_METRICS);
+    dirty = !takeSnapshot(HTTP_STATE) || dirty;
+  }
+#ifndef ESP32
+  // After the snapshots, so that a panel is pushed the new state in the same pass
+  webServe();
+#endif
+  if (dirty) {
+    wakeWithin(TICKLESS_POLL_MS);
+  }
+  else if (watched) {
+    wakeWithin(HTTP_SNAPSHOT_MS - (millis() - lastSnapshotMs));
+  }
+}
+
+size_t httpCopyState(char* text, size_t size) {
+  Snapshot& snapshot = acquireSnapshot(HTTP_STATE);
+  size_t length = snapshot.length < size ? snapshot.length : size - 1;
+  memcpy(text, snapshot.text, length);
+  text[length] = '\0';
+  snapshot.readers.fetch_sub(1);
+  return length;
+}
+
+unsigned long httpStateVersion() {
+  return stateVersion.load();
+}
+
+void httpKeepFresh() {
+  lastRequestMs.store(millis());
+  everRequested.store(true);
+}
+
+void httpOnConnection(const Event& event) {
+  dirty = true;
+}
+
+void httpOnPuzzle(const Event& event) {
+  dirty = true;
+}
+
+void publishHttpStats() {
+  char line[200];
+  int used = snprintf(line, sizeof(line), "http metrics=%lu state=%lu missing=%lu truncated=%lu",
+                      httpStats.requests[HTTP_METRICS], httpStats.requests[HTTP_STATE], httpStats.missing,
+                      httpStats.truncated);
+  publishStatsLine(line);
+
+  static const char* const names[HTTP_PAGES] = { "metrics", "state" };
+  for (int which = 0; which < HTTP_PAGES; which++) {
+    if (latencyCount(httpStats.serve[which]) > 0) {
+      used = snprintf(line, sizeof(line), "http serve %s ", names[which]);
+      formatLatency(line + used, sizeof(line) - used, httpStats.serve[which]);
+      publishStatsLine(line);
+    }
+    used = snprintf(line, sizeof(line), "http snapshot %s ", names[which]);
+    formatLatency(line + used, sizeof(line) - used, httpStats.snapshot[which]);
+    publishStatsLine(line);
+  }
+}
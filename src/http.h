@@ -0,0 +1,79 @@
+/*
+   Sterilizer puzzle - HTTP status endpoint
+
+   A small HTTP server on port 80 for looking at the prop without an MQTT
+   client:
+
+     /metrics   Prometheus text format: uptime, loop passes and wakes,
+                heap, RSSI, connection state and reconnects, puzzle state,
+                relay and switch levels, link profile, command and event
+                counters and latency histograms, and the cost of this
+                server itself
+     /state     the same picture as a small JSON object
+
+   loop() owns every value on those pages, so it also writes them: it
+   formats each page into a preformatted snapshot buffer, at most every
+   HTTP_SNAPSHOT_MS and only while someone has asked for one in the last
+   HTTP_WATCHED_MS, or straight away when the puzzle or connection state
+   changes. The server runs in its own task and answers every request by
+   writing the latest snapshot to the socket as it stands (send_P(), no
+   copy into a String), so a slow or stalled client holds up that task and
+   never the puzzle. Each page has two snapshot buffers; loop() writes the
+   one no request is reading and then publishes it.
+
+   Latency histograms use the buckets of latency.h, exported at every third
+   power of two (64 us, 512 us, 4 ms, ...) to keep the page small; there is
+   no _sum, as the histograms do not keep one.
+
+   What a request costs is measured both ways and published with the stats
+   as "http metrics= state= missing= truncated=" and the histograms
+   "http serve <page> ..." and "http snapshot <page> ...": serve is the
+   time the server task spends on a request, snapshot the time loop()
+   spends formatting a page.
+
+   Any other path is offered to the web panel (web.h) as a file before
+   it gets a 404.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "latency.h"
+
+#define HTTP_PORT 80
+#define HTTP_SNAPSHOT_MS 1000
+#define HTTP_WATCHED_MS 60000
+// How often the server task looks for a connection
+#define HTTP_POLL_MS 20
+// About 8 KB once every command has latency samples
+#define HTTP_METRICS_SIZE 12288
+#define HTTP_STATE_SIZE 512
+
+enum HttpPage {
+  HTTP_METRICS,
+  HTTP_STATE,
+  HTTP_PAGES
+};
+
+struct HttpStats {
+  unsigned long requests[HTTP_PAGES];
+  unsigned long missing;     // requests for anything else
+  unsigned long truncated;   // snapshots that ran out of buffer
+  LatencyHistogram serve[HTTP_PAGES];
+  LatencyHistogram snapshot[HTTP_PAGES];
+};
+
+extern HttpStats httpStats;
+
+// Call from setup() once the network is up
+void httpSetup();
+void httpLoop();
+void publishHttpStats();
+
+// For the web panel (web.h), which shares the server and its task:
+// copies the latest /state snapshot into text and returns its length
+size_t httpCopyState(char* text, size_t size);
+// Counts the /state snapshots taken, so a new one can be noticed
+unsigned long httpStateVersion();
+// Keeps the snapshots fresh as though the pages were being scraped
+void httpKeepFresh();
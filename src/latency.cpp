@@ -0,0 +1,37 @@
+/*
+   Sterilizer puzzle - latency histograms
+*/
+
+#include "latency.h"
+
+void recordLatency(LatencyHistogram& histogram, unsigned long us) {
+  int bucket = 0;
+  while (bucket < LATENCY_BUCKETS - 1 && us >= (1UL << bucket)) {
+    bucket++;
+  }
+  // Saturate rather than wrap so a busy counter never looks idle
+  if (histogram.counts[bucket] < 0xFFFF) {
+    histogram.counts[bucket]++;
+  }
+  if (us > histogram.maxUs) {
+    histogram.maxUs = us;
+  }
+}
+
+unsigned long latencyCount(const LatencyHistogram& histogram) {
+  unsigned long count = 0;
+  for (int i = 0; i < LATENCY_BUCKETS; i++) {
+    count += histogram.counts[i];
+  }
+  return count;
+}
+
+int formatLatency(char* buffer, size_t size, const LatencyHistogram& histogram) {
+  int used = snprintf(buffer, size, "n=%lu max=%lu", latencyCount(histogram), histogram.maxUs);
+  for (int i = 0; i < LATENCY_BUCKETS && used < (int)size; i++) {
+    if (histogram.counts[i] != 0) {
+      used += snprintf(buffer + used, size - used, " b%d=%u", i, histogram.counts[i]);
+    }
+  }
+  return used;
+}
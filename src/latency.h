@@ -0,0 +1,23 @@
+/*
+   Sterilizer puzzle - latency histograms
+
+   Fixed-size histograms of durations in microseconds. Bucket i counts
+   durations below 2^i us (and at least 2^(i-1) us), so 24 buckets reach
+   about eight seconds; anything longer lands in the last bucket.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#define LATENCY_BUCKETS 24
+
+struct LatencyHistogram {
+  uint16_t counts[LATENCY_BUCKETS];
+  unsigned long maxUs;
+};
+
+void recordLatency(LatencyHistogram& histogram, unsigned long us);
+// Writes "n=<count> max=<us> b<i>=<count> ..." for the non-empty buckets
+int formatLatency(char* buffer, size_t size, const LatencyHistogram& histogram);
+unsigned long latencyCount(const LatencyHistogram& histogram);
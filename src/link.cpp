@@ -0,0 +1,152 @@
+/*
+   Sterilizer puzzle - WiFi link profiles
+
+   Applied with esp_wifi_set_ps(), the station listen interval and
+   esp_wifi_set_max_tx_power(). The native simulator keeps the switching
+   logic but has no radio to configure.
+*/
+
+#include "link.h"
+#include "sterilizer.h"
+#include "telemetry.h"
+#include "events.h"
+#ifdef ESP32
+#include <esp_wifi.h>
+#endif
+
+enum LinkPowerSave {
+  LINK_PS_NONE,
+  LINK_PS_MIN_MODEM,  // wake for every DTIM beacon
+  LINK_PS_MAX_MODEM,  // wake every listen interval
+};
+
+struct LinkSettings {
+  const char* name;
+  LinkPowerSave powerSave;
+  uint8_t listenInterval;  // beacons, used by LINK_PS_MAX_MODEM
+  int8_t txPower;          // 0.25 dBm units
+};
+
+// Indexed by LinkProfile
+static const LinkSettings linkSettings[LINK_PROFILES] = {
+  { "game",      LINK_PS_NONE,      1,  78 },  // 19.5 dBm
+  { "attract",   LINK_PS_MIN_MODEM, 3,  68 },  // 17 dBm
+  { "overnight", LINK_PS_MAX_MODEM, 10, 44 },  // 11 dBm
+};
+
+static LinkProfile currentProfile = LINK_GAME;
+static bool automaticProfile = true;
+static unsigned long lastActivity = 0;
+static unsigned long profileSince = 0;
+static unsigned long switchCount = 0;
+// Milliseconds spent in each profile, not counting the current stretch
+static unsigned long long profileTime[LINK_PROFILES];
+
+static void applyProfile(LinkProfile profile) {
+#ifdef ESP32
+  const LinkSettings& settings = linkSettings[profile];
+  switch (settings.powerSave) {
+    case LINK_PS_NONE:      esp_wifi_set_ps(WIFI_PS_NONE); break;
+    case LINK_PS_MIN_MODEM: esp_wifi_set_ps(WIFI_PS_MIN_MODEM); break;
+    case LINK_PS_MAX_MODEM: esp_wifi_set_ps(WIFI_PS_MAX_MODEM); break;
+  }
+  wifi_config_t config;
+  if (esp_wifi_get_config(WIFI_IF_STA, &config) == ESP_OK && config.sta.listen_interval != settings.listenInterval) {
+    config.sta.listen_interval = settings.listenInterval;
+    esp_wifi_set_config(WIFI_IF_STA, &config);
+  }
+  esp_wifi_set_max_tx_power(settings.txPower);
+#endif
+}
+
+static void switchProfile(LinkProfile profile) {
+  if (profile == currentProfile) {
+    return;
+  }
+  profileTime[currentProfile] += millis() - profileSince;
+  profileSince = millis();
+  currentProfile = profile;
+  switchCount++;
+  applyProfile(profile);
+#ifdef DEBUG
+  Serial.print("Link profile ");
+  Serial.println(linkSettings[profile].name);
+#endif
+}
+
+void linkSetup() {
+  lastActivity = millis();
+  profileSince = millis();
+  applyProfile(currentProfile);
+}
+
+void linkLoop() {
+  if (!automaticProfile) {
+    return;
+  }
+  unsigned long quiet = millis() - lastActivity;
+  if (puzzle == Solving || puzzle == Resetting || quiet < LINK_ATTRACT_AFTER_MS) {
+    switchProfile(LINK_GAME);
+  }
+  else if (quiet < LINK_OVERNIGHT_AFTER_MS) {
+    switchProfile(LINK_ATTRACT);
+  }
+  else {
+    switchProfile(LINK_OVERNIGHT);
+  }
+}
+
+void noteLinkActivity() {
+  lastActivity = millis();
+  if (automaticProfile) {
+    switchProfile(LINK_GAME);
+  }
+}
+
+unsigned long linkQuietMs() {
+  return millis() - lastActivity;
+}
+
+LinkProfile linkProfile() {
+  return currentProfile;
+}
+
+const char* linkProfileName(LinkProfile profile) {
+  return linkSettings[profile].name;
+}
+
+void linkOverride(LinkProfile profile, bool automatic) {
+  automaticProfile = automatic;
+  if (automatic) {
+    noteLinkActivity();
+  }
+  else {
+    switchProfile(profile);
+  }
+}
+
+void linkOnConnection(const Event& event) {
+  // The WiFi driver may have come back with its own defaults
+  if (event.connection.wifi) {
+    applyProfile(currentProfile);
+  }
+}
+
+void linkOnPuzzle(const Event& event) {
+  noteLinkActivity();
+}
+
+void publishLinkStats() {
+  unsigned long long spent[LINK_PROFILES];
+  for (int i = 0; i < LINK_PROFILES; i++) {
+    spent[i] = profileTime[i];
+  }
+  spent[currentProfile] += millis() - profileSince;
+
+  char line[128];
+  snprintf(line, sizeof(line), "link profile=%s auto=%d switches=%lu game=%lu attract=%lu overnight=%lu",
+           linkSettings[currentProfile].name, automaticProfile ? 1 : 0, switchCount,
+           (unsigned long)(spent[LINK_GAME] / 1000), (unsigned long)(spent[LINK_ATTRACT] / 1000),
+           (unsigned long)(spent[LINK_OVERNIGHT] / 1000));
+  publishStatsLine(line);
+}
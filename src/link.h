@@ -0,0 +1,52 @@
+/*
+   Sterilizer puzzle - WiFi link profiles
+
+   The ESP32 defaults to modem sleep, which saves power but can hold an
+   inbound MQTT message for up to a beacon interval or more. Three profiles
+   trade latency against power:
+
+     game       no modem sleep, full TX power; lowest command latency
+     attract    modem sleep waking every DTIM, slightly reduced TX power
+     overnight  deep modem sleep with a long listen interval, low TX power
+
+   The profile follows the game: a solve or reset command, or any change
+   of puzzle state, selects game; after LINK_ATTRACT_AFTER_MS
+   without either the link drops to attract, and after
+   LINK_OVERNIGHT_AFTER_MS to overnight. While a solve or reset sequence
+   runs it stays in game. The listen interval only takes effect at the
+   next association.
+
+     link game | attract | overnight    hold a profile
+     link auto                          back to automatic switching
+
+   Pongs carry "link=<profile>" so that tools/rtt_probe.py can measure the
+   round trip in each profile. Current draw has to be measured with a
+   meter; the stats line "link profile= auto= switches= game= attract=
+   overnight=" gives the seconds spent in each profile to weight it by.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#define LINK_ATTRACT_AFTER_MS (10UL * 60 * 1000)
+#define LINK_OVERNIGHT_AFTER_MS (2UL * 60 * 60 * 1000)
+
+enum LinkProfile {
+  LINK_GAME,
+  LINK_ATTRACT,
+  LINK_OVERNIGHT,
+  LINK_PROFILES
+};
+
+void linkSetup();
+void linkLoop();
+// Something happened that a player or game master did
+void noteLinkActivity();
+// Milliseconds since the last activity
+unsigned long linkQuietMs();
+LinkProfile linkProfile();
+const char* linkProfileName(LinkProfile profile);
+// Holds a profile, or returns to automatic switching with automatic set
+void linkOverride(LinkProfile profile, bool automatic);
+void publishLinkStats();
@@ -14,7 +14,23 @@
 
 #include <Arduino.h>
 #include "arduino_secrets.h"
-#include <PubSubClient.h>
+#include "sterilizer.h"
+#include "commands.h"
+#include "telemetry.h"
+#include "taskstats.h"
+#include "profiler.h"
+#include "crashdump.h"
+#include "trace.h"
+#include "script.h"
+#include "events.h"
+#include "tickless.h"
+#include "link.h"
+#include "sleep.h"
+#include "http.h"
+#include "config.h"
+#include "console.h"
+#include "upload.h"
+#include "clocksync.h"
 #include <SoftwareSerial.h>
 #include <WiFi.h>
 #include <FastLED.h>
@@ -23,44 +39,39 @@
 
 // Wifi connection data is in arduino_secrets.h
 ///////please enter your sensitive data in the Secret tab/arduino_secrets.h
-char ssid[] = SECRET_SSID;        // your network SSID (name)
-char pass[] = SECRET_PASS;    // your network password (use for WPA, or use as key for WEP)
+char ssid[SSID_SIZE] = SECRET_SSID;        // your network SSID (name)
+char pass[PASS_SIZE] = SECRET_PASS;    // your network password (use for WPA, or use as key for WEP)
 int status = WL_IDLE_STATUS;     // the WiFi radio's status
 
 
-// Create instances of the FastLED library, the Wifi client, and the MQTT client
-WiFiClient wifiClient;
-PubSubClient MQTTclient(wifiClient);
+// The MQTT client is MQTTclient, from the transport the build selects (transport.h)
 
 // DEFINES
-#define DEBUG
 #define NUM_LEDS 17
 
 CRGB leds[NUM_LEDS];
 
 // Function Declarations
-void onSolve();
-void onReset();
 void mqttCallback(char*, byte*, unsigned int);
 void mqttSetup();
 void mqttLoop();
 //void publish();
 void millisdelay(long);
 void allonehue (CRGB thehue);
+bool stripIs(CRGB hue);
 void fadeall();
 void looper (CRGB themainhue);
 void wifiSetup();
 void checkWiFi();
 void checkMQTT();
-void updateLEDs();
+void reportConnection();
+void setPuzzleState(PuzzleState state);
+template <typename RELAY> void setRelay(int level);
+template <typename HIGH_RELAYS, typename LOW_RELAYS> void setRelays();
 
 
 
 // CONSTANTS
-int Rotary = 27;
-const int Pump = 25;
-const int Flames = 33;
-const int MagLock = 26;
 int LedBright = 120;
 
 //WIFI Settings
@@ -68,7 +79,7 @@ int LedBright = 120;
 //const byte mac[] = { 0x84, 0xCC, 0xA8, 0x2F, 0xEF, 0xF8 };
 
 // IP address of the machine on the network running the MQTT broker
-const char* mqttServerIP = "10.1.10.55";
+char mqttServerIP[HOST_SIZE] = "10.1.10.55";
 
 // Unique name of this device, used as client ID to connect to MQTT server
 // and also topic name for messages published to this device
@@ -82,8 +93,10 @@ bool wifiTimedOut = false;
 bool mqttTimedOut = false;
 bool wifiConnected = false;
 bool mqttConnected = false;
+unsigned long wifiConnects = 0;
+unsigned long mqttConnects = 0;
 
-// Add these state variables to track the previous connection status
+// The connection status last posted on the event bus
 bool previousWifiStatus = false;
 bool previousMqttStatus = false;
 
@@ -91,6 +104,9 @@ bool previousMqttStatus = false;
 unsigned long lastWiFiAttempt = 0;
 unsigned long lastMQTTAttempt = 0;
 
+// micros() when MQTTclient.loop() last started
+unsigned long mqttReadTime = 0;
+
 // Global Variables
 long lastMsgTime = 0; // The time (from millis()) when the last MQTT message was received
 char msg[64]; // A buffer to hold messages to be sent or received
@@ -99,16 +115,22 @@ int pulseCount = 0; // Counter for number of heartbear pulses sent
 
 //int Solved = 0;
 
-enum PuzzleState{Initializing, Running, Solved};
 PuzzleState puzzle = Initializing;
 
 
 // WiFi and MQTT Functions
 void wifiSetup() {
   Serial.println("Connecting to WiFi...");
-  WiFi.begin(ssid, pass);
+  // Straight to the same access point after a sleep
+  bool fast = wifiBeginFast();
+  unsigned long start = millis();
+  // Polled often enough not to add to the time taken to wake from a sleep
   while (WiFi.status() != WL_CONNECTED) {
-    delay(500);
+    if (fast && millis() - start >= SLEEP_CHECK_JOIN_MS) {
+      fast = false;
+      wifiBeginScan();
+    }
+    delay(50);
     Serial.print(".");
   }
   Serial.println("\nWiFi connected");
@@ -124,6 +146,7 @@ void mqttSetup() {
     if (MQTTclient.connect(deviceID)) {
       Serial.println("Connected to MQTT broker");
       MQTTclient.subscribe(DeviceTopic);
+      scriptPost("connected");
     } else {
       Serial.print("MQTT connection failed, state=");
       Serial.println(MQTTclient.state());
@@ -132,24 +155,18 @@ void mqttSetup() {
   }
 }
 
-void updateLEDs()
+void reportConnection()
 {
   // Check if the current status has changed from the previous status
   if (wifiConnected != previousWifiStatus || mqttConnected != previousMqttStatus)
   {
-    // Update the LEDs based on the current connection status
-    if (!wifiConnected)
-    {
-      allonehue(CRGB::Purple); // Purple indicates no WiFi
+    if (wifiConnected && !previousWifiStatus) {
+      wifiConnects++;
     }
-    else if (!mqttConnected)
-    {
-      allonehue(CRGB::Blue); // Blue indicates WiFi is connected but MQTT is not
-    }
-    else
-    {
-      allonehue(CRGB::Red); // Red indicates both WiFi and MQTT are connected
+    if (mqttConnected && !previousMqttStatus) {
+      mqttConnects++;
     }
+    postConnection(wifiConnected, mqttConnected);
 
     // Update the previous status variables
     previousWifiStatus = wifiConnected;
@@ -157,6 +174,92 @@ void updateLEDs()
   }
 }
 
+const char* puzzleStateName(int state) {
+  switch (state) {
+    case Initializing: return "Initializing";
+    case Running:      return "Running";
+    case Solved:       return "Solved";
+    case Solving:      return "Solving";
+    case Resetting:    return "Resetting";
+    default:           return "?";
+  }
+}
+
+void setPuzzleState(PuzzleState state) {
+  PuzzleState previous = puzzle;
+  puzzle = state;
+  postPuzzleState(state, previous);
+}
+
+
+// Event Subscribers
+// Announcements that could not be published while MQTT was down, oldest first;
+// a solve and a reset in the same outage must both reach the host
+#define PENDING_ANNOUNCEMENTS 4
+const char* pendingAnnouncements[PENDING_ANNOUNCEMENTS];
+int pendingCount = 0;
+
+void ledsOnConnection(const Event& event) {
+  // Update the LEDs based on the current connection status
+  if (!event.connection.wifi)
+  {
+    allonehue(CRGB::Purple); // Purple indicates no WiFi
+  }
+  else if (!event.connection.mqtt)
+  {
+    allonehue(CRGB::Blue); // Blue indicates WiFi is connected but MQTT is not
+  }
+  else
+  {
+    allonehue(CRGB::Red); // Red indicates both WiFi and MQTT are connected
+  }
+}
+
+void ledsOnPuzzle(const Event& event) {
+  if (event.puzzle.state == Solved) {
+    allonehue( CRGB:: Green);
+  }
+}
+
+void flushAnnouncements() {
+  int sent = 0;
+  while (sent < pendingCount && MQTTclient.publish(hostTopic, pendingAnnouncements[sent])) {
+    sent++;
+  }
+  // Whatever a dropped connection stopped keeps its place for the next one
+  pendingCount -= sent;
+  memmove(pendingAnnouncements, pendingAnnouncements + sent, pendingCount * sizeof(pendingAnnouncements[0]));
+}
+
+void networkOnConnection(const Event& event) {
+  if (event.connection.mqtt) {
+    flushAnnouncements();
+  }
+}
+
+void networkOnPuzzle(const Event& event) {
+  const char* announcement = NULL;
+  if (event.puzzle.state == Solved) {
+    announcement = "Sterilizer puzzle has been solved!";
+  }
+  else if (event.puzzle.state == Running && event.puzzle.previous == Resetting) {
+    announcement = "Sterilizer has been reset!";
+  }
+  if (announcement == NULL) {
+    return;
+  }
+  // Publish a message to the MQTT broker, or as soon as it is back, in order
+  if (pendingCount == PENDING_ANNOUNCEMENTS) {
+    // Only a long string of solves and resets in one outage gets here; the oldest matters least
+    pendingCount--;
+    memmove(pendingAnnouncements, pendingAnnouncements + 1, pendingCount * sizeof(pendingAnnouncements[0]));
+  }
+  pendingAnnouncements[pendingCount++] = announcement;
+  if (MQTTclient.connected()) {
+    flushAnnouncements();
+  }
+}
+
 void mqttLoop() {
   if (!MQTTclient.connected()) {
     mqttConnected = false;
@@ -170,37 +273,21 @@ void mqttLoop() {
   } else {
     mqttConnected = true;
     mqttTimedOut = false;
+    mqttReadTime = micros();
     MQTTclient.loop();
+    if (MQTTclient.pending()) {
+      wakeWithin(0);
+    }
+    // Only the passes that did real work are worth a place in the trace
+    if (micros() - mqttReadTime >= TRACE_MIN_MQTT_LOOP_US) {
+      traceSpan(TRACE_MQTT_LOOP, mqttReadTime, micros());
+    }
   }
 }
 
 void mqttCallback(char* thisTopic, byte* message, unsigned int length) {
-  Serial.print("Message arrived [");
-  Serial.print(thisTopic);
-  Serial.print("] ");
-  Serial.println("Message: ");
-  
-  // Convert byte array to C-style string
-  char messageArrived[length + 1];
-  memcpy(messageArrived, message, length);
-  messageArrived[length] = '\0'; // Null-terminate the string
- 
-  for (unsigned int i = 0; i < length; i++) {
-    messageArrived[i] = tolower(messageArrived[i]);
-  }
-
-  // Act upon the message received
-  if (strcasecmp(messageArrived, "solve") == 0) {
-    onSolve();
-  }
-  else if (strcasecmp(messageArrived, "reset") == 0) {
-    onReset();
-  }
-  else {
-    Serial.print("Message Received: ");
-    Serial.println(messageArrived);
-    Serial.println(); 
-  }
+  // Runs inside MQTTclient.loop(), so only queue the command; loop() runs it
+  enqueueCommand(thisTopic, message, length, MQTTclient.receivedUs());
 }
 
 void checkWiFi() {
@@ -220,68 +307,99 @@ void checkWiFi() {
 }
 
 void setup() {
+  eventBusSetup();
+  crashDumpSetup();
+  taskStatsSetup();
+  configSetup();
+  // A wake that only looked for the host's wake message goes back to sleep in here
+  sleepSetup();
   FastLED.addLeds<WS2812B, 14, GRB>(leds, NUM_LEDS);
   FastLED.setBrightness(LedBright);
 
   //Initialize serial and wait for port to open:
-  Serial.begin(9600);
+  Serial.begin(CONSOLE_BAUD);
   while (!Serial) {
     ; // wait for serial port to connect. Needed for native USB port only
   }
+  consoleSetup();
 
   // Setup the WiFi and MQTT services
   wifiSetup();
-  delay(500); // Slow down the output
+  linkSetup();
+  if (!sleepResumed()) {
+    delay(500); // Slow down the output
+  }
   mqttSetup();
-  delay(500); // Slow down the output
+  httpSetup();
+  uploadSetup();
+  clockSetup();
+  if (!sleepResumed()) {
+    delay(500); // Slow down the output
+  }
 
-#ifdef DEBUG
-  // Initialize serial communications channel with the PC
-  Serial.begin(9600);
-#endif
 #ifdef DEBUG
   Serial.println("Sterilizer initializing");
-  delay(250); // Slow down the output
+  if (!sleepResumed()) {
+    delay(250); // Slow down the output
+  }
 #endif
 
   // Set the Rotary switch pin as input
-  pinMode(Rotary, INPUT_PULLUP);
+  RotaryPin::inputPullup();
 
   // Set the relay pins as output and ensure locks are magnetized and pump/flames are off
-  pinMode(Flames, OUTPUT);
-  pinMode(Pump, OUTPUT);
-  pinMode(MagLock, OUTPUT);
-
-  digitalWrite(Flames, LOW);
-  digitalWrite(Pump, LOW);
-  digitalWrite(MagLock, LOW);
-
-  looper( CRGB::Green);
-  millisdelay(500);
-  looper( CRGB::Blue);
-  millisdelay(500);
-  looper( CRGB::Red);
-  millisdelay(500);
+  FlamesPin::output();
+  PumpPin::output();
+  MagLockPin::output();
+
+  setRelays<NoRelays, AllRelays>();
+
+  // Waking from a deep sleep skips the light show; the morning check should not wait for it
+  if (!sleepResumed()) {
+    looper( CRGB::Green);
+    millisdelay(500);
+    looper( CRGB::Blue);
+    millisdelay(500);
+    looper( CRGB::Red);
+    millisdelay(500);
+
+    allonehue( CRGB::Red);                                        // LED turn all  red
+    delay(500);
+  }
 
-  allonehue( CRGB::Red);                                        // LED turn all  red
-  delay(500);
+  // From here on loop() sleeps whenever there is nothing to do
+  ticklessSetup();
 }
 
 void loop() {
   checkWiFi();
   mqttLoop();
-  updateLEDs();
+  consoleLoop();
+  processCommands();
+  reportConnection();
+  telemetryLoop();
+  clockLoop();
+  taskStatsLoop();
+  profilerLoop();
+  crashDumpLoop();
+  traceLoop();
+  linkLoop();
+  scriptLoop();
+  eventLoop();
+  httpLoop();
+  sleepLoop();
 
   // Switch action based on the current state of the puzzle
   switch(puzzle) {
     {
     case Initializing:
-    puzzle = Running;
+    setPuzzleState(Running);
     break;
     }
     case Running:
     {
-      if (digitalRead(Rotary) == LOW) {
+      // The switch that woke the prop from a sleep has to be turned back first
+      if (sleepSwitchArmed() && RotaryPin::read() == LOW) {
         onSolve();
         Serial.print(F("Sterilizer Solved!"));
       }
@@ -290,75 +408,249 @@ void loop() {
 
   case Solved: 
     {
-    // Trigger the Maglock
-    allonehue( CRGB:: Green);
-    digitalWrite(MagLock, HIGH);
-    digitalWrite(Pump, LOW);
-    digitalWrite(Flames, LOW);
+    // Trigger the Maglock and hold the strip green, writing (and tracing)
+    // only what a sleep or a command has since changed
+    if (!stripIs(CRGB::Green)) {
+      allonehue( CRGB:: Green);
+    }
+    if (MagLockPin::driven() != HIGH || PumpPin::driven() != LOW || FlamesPin::driven() != LOW) {
+      setRelays<GpioGroup<MagLockPin>, GpioGroup<PumpPin, FlamesPin> >();
+    }
     break; 
     }
+
+  case Solving:
+  case Resetting:
+    // scriptLoop() is running the sequence
+    break;
   }
+
+  ticklessWait();
 }
 
-void onSolve () {
-#ifdef DEBUG
-  Serial.println("Sterilizer has just been solved!");
-#endif
+// Puzzle Scripts
+// looper() without the delays, for use inside a script
+struct SweepScript : Script {
+  CRGB hue;
+  int i;
+
+  bool resume() {
+    SCRIPT_BEGIN();
+    // First slide the led in one direction
+    for (i = 0; i < NUM_LEDS; i++) {
+      leds[i] = hue;
+      showLEDs();
+      fadeall();
+      SCRIPT_SLEEP(50);
+    }
+    // Now go in the other direction
+    for (i = NUM_LEDS - 1; i >= 0; i--) {
+      leds[i] = hue;
+      showLEDs();
+      fadeall();
+      SCRIPT_SLEEP(50);
+    }
+    SCRIPT_END();
+  }
+};
+
+struct SolveScript : Script {
+  SweepScript sweep;
+  int x;
+
+  bool resume() {
+    SCRIPT_BEGIN();
+    traceBegin(TRACE_SOLVE);
+
+    // Trigger the relay for the flames
+    setRelay<FlamesPin>(HIGH);
+    // Wait 5 seconds
+    traceBegin(TRACE_SOLVE_FLAMES);
+    SCRIPT_SLEEP(5000);
+    traceEnd(TRACE_SOLVE_FLAMES);
+    // Trigger the relay for the pump
+    setRelay<PumpPin>(HIGH);
+    for (x = 0; x < 6; x++) {
+      traceBegin(TRACE_SOLVE_SWEEP, x);
+      sweep.hue = CRGB::Blue;
+      SCRIPT_CALL(sweep);
+      traceEnd(TRACE_SOLVE_SWEEP, x);
+    }
+    // Trigger the Maglock
+    setRelays<GpioGroup<MagLockPin>, GpioGroup<PumpPin, FlamesPin> >();
 
-  // Trigger the relay for the flames
-  digitalWrite(Flames, HIGH);
-  // Delay 5 seconds
-  delay(5000);
-  // Trigger the relay for the pump
-  digitalWrite(Pump, HIGH);
-  for (int x=0; x<6; x++)
-{
-  looper( CRGB::Blue );
-  //Serial.println("Blue Loop ");
-  //Serial.print(x);
-}
-  // Trigger the Maglock
-  allonehue( CRGB:: Green);
-  digitalWrite(MagLock, HIGH);
-  digitalWrite(Pump, LOW);
-  digitalWrite(Flames, LOW);
+    // Update the global puzzle state; the LEDs turn green and the host is told
+    setPuzzleState(Solved);
+    traceEnd(TRACE_SOLVE);
+    SCRIPT_END();
+  }
+
+  void cancelled() {
+    traceEnd(TRACE_SOLVE);
+  }
+};
+
+struct ResetScript : Script {
+  SweepScript sweep;
+
+  bool resume() {
+    SCRIPT_BEGIN();
+    traceBegin(TRACE_RESET);
+    // Lock the lock, turn off flames, and turn off pump
+    setRelays<NoRelays, AllRelays>();
+
+    sweep.hue = CRGB::Green;
+    SCRIPT_CALL(sweep);
+    SCRIPT_SLEEP(500);
+    sweep.hue = CRGB::Blue;
+    SCRIPT_CALL(sweep);
+    SCRIPT_SLEEP(500);
+    sweep.hue = CRGB::Red;
+    SCRIPT_CALL(sweep);
+    SCRIPT_SLEEP(500);
+
+    allonehue(CRGB::Red);                                        // LED turn all  red
+    SCRIPT_SLEEP(500);
+
+    // Update the globale puzzle state; the host is told
+    setPuzzleState(Running);
+    traceEnd(TRACE_RESET);
+    SCRIPT_END();
+  }
 
+  void cancelled() {
+    traceEnd(TRACE_RESET);
+  }
+};
+
+// Each relay on in turn, so the game master can hear it click
+struct RelayTestScript : Script {
+  bool resume() {
+    SCRIPT_BEGIN();
+    safeRelays();
+    setRelay<PumpPin>(HIGH);
+    SCRIPT_SLEEP(TEST_RELAY_MS);
+    setRelay<PumpPin>(LOW);
+    setRelay<FlamesPin>(HIGH);
+    SCRIPT_SLEEP(TEST_RELAY_MS);
+    setRelay<FlamesPin>(LOW);
+    setRelay<MagLockPin>(HIGH);
+    SCRIPT_SLEEP(TEST_RELAY_MS);
+    setRelay<MagLockPin>(LOW);
+    SCRIPT_END();
+  }
+};
+
+// Every pixel in each colour, to find dead pixels and channels
+struct LedTestScript : Script {
+  bool resume() {
+    SCRIPT_BEGIN();
+    allonehue(CRGB::Red);
+    SCRIPT_SLEEP(TEST_LED_MS);
+    allonehue(CRGB::Green);
+    SCRIPT_SLEEP(TEST_LED_MS);
+    allonehue(CRGB::Blue);
+    SCRIPT_SLEEP(TEST_LED_MS);
+    allonehue(CRGB::White);
+    SCRIPT_SLEEP(TEST_LED_MS);
+    // Back to the armed colour
+    allonehue(CRGB::Red);
+    SCRIPT_END();
+  }
+};
 
-  // Publish a message to the MQTT broker
-  MQTTclient.publish(hostTopic, "Sterilizer puzzle has been solved!");
+// The solve or reset sequence in progress
+Script* puzzleScript = NULL;
+// The relay or LED test in progress
+Script* testScript = NULL;
 
-  // Update the global puzzle state
-  puzzle = Solved;
+void onSolve () {
+#ifdef DEBUG
+  Serial.println("Sterilizer has just been solved!");
+#endif
+  // A solve during a reset takes over from it, and from a test
+  scriptCancel(puzzleScript);
+  scriptCancel(testScript);
+  setPuzzleState(Solving);
+  puzzleScript = scriptStart<SolveScript>();
 }
 
 void onReset() {
 #ifdef DEBUG
   Serial.println("Sterilizer has just been reset!");
 #endif
-  // Lock the lock, turn off flames, and turn off pump
-  digitalWrite(Pump, LOW);
-  digitalWrite(Flames, LOW);
-  digitalWrite(MagLock, LOW);
+  // A reset stops the solve sequence wherever it has got to, and any test
+  scriptCancel(puzzleScript);
+  scriptCancel(testScript);
+  setPuzzleState(Resetting);
+  puzzleScript = scriptStart<ResetScript>();
+}
+
+bool onRelayTest() {
+  // A second test starts over rather than running alongside
+  scriptCancel(testScript);
+  testScript = scriptStart<RelayTestScript>();
+  return testScript != NULL;
+}
 
+bool onLedTest() {
+  scriptCancel(testScript);
+  testScript = scriptStart<LedTestScript>();
+  return testScript != NULL;
+}
 
+bool onTestStop() {
+  // A finished test's frame may since have gone to a solve or reset sequence
+  if (testScript == NULL || testScript == puzzleScript || !scriptRunning(testScript)) {
+    testScript = NULL;
+    return false;
+  }
+  scriptCancel(testScript);
+  testScript = NULL;
+  safeRelays();
+  // Back to the armed colour, as the LED test ends
+  allonehue(CRGB::Red);
+  return true;
+}
 
-  looper( CRGB::Green);
-  millisdelay(500);
-  looper( CRGB::Blue);
-  millisdelay(500);
-  looper( CRGB::Red);
-  millisdelay(500);
+template <typename RELAY>
+void setRelay(int level) {
+  RELAY::write(level);
+  traceInstant(TRACE_RELAY, RELAY::number << 8 | level);
+  // Lets the command latency tracking see when a command reaches the hardware
+  noteActuation();
+}
 
+// Traces one relay of a group switched by setRelays()
+static int traceRelay(int pin, int level) {
+  traceInstant(TRACE_RELAY, pin << 8 | level);
+  return 0;
+}
 
-  allonehue(CRGB::Red);                                        // LED turn all  red
-  delay(500);
+template <typename... RELAYS>
+static void traceRelays(GpioGroup<RELAYS...>, int level) {
+  int traced[] = { 0, traceRelay(RELAYS::number, level)... };
+  (void)traced;
+  (void)level;
+}
 
+// Switches several relays at the same instant
+template <typename HIGH_RELAYS, typename LOW_RELAYS>
+void setRelays() {
+  gpioSwitch<HIGH_RELAYS, LOW_RELAYS>();
+  traceRelays(HIGH_RELAYS(), HIGH);
+  traceRelays(LOW_RELAYS(), LOW);
+  noteActuation();
+}
 
-  // Publish a message to the MQTT broker
-  MQTTclient.publish(hostTopic, "Sterilizer has been reset!");
+void safeRelays() {
+  setRelays<NoRelays, AllRelays>();
+}
 
-  // Update the globale puzzle state
-  puzzle = Running;
+void showLEDs() {
+  traceBegin(TRACE_LED_SHOW);
+  FastLED.show();
+  traceEnd(TRACE_LED_SHOW);
 }
 
 void looper ( CRGB themainhue ) {
@@ -366,14 +658,14 @@ void looper ( CRGB themainhue ) {
   // First slide the led in one direction
   for (int i = 0; i < NUM_LEDS ; i++) {
     leds[i] = themainhue;
-    FastLED.show();
+    showLEDs();
     fadeall();
     delay(50);
   }
   // Now go in the other direction
   for (int i = (NUM_LEDS) - 1; i >= 0; i--) {
     leds[i] = themainhue;
-    FastLED.show();
+    showLEDs();
     fadeall();
     delay(50);
   }
@@ -392,7 +684,20 @@ void allonehue ( CRGB thehue){
   {
     leds[i] = thehue;
   }
-  FastLED.show();
+  showLEDs();
+}
+
+bool stripIs(CRGB hue) {
+  for (int i = 0; i < NUM_LEDS; i++) {
+    if (leds[i] != hue) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void blankLEDs() {
+  allonehue(CRGB::Black);
 }
 
 void millisdelay(long intervaltime){
@@ -0,0 +1,112 @@
+/*
+   Sterilizer puzzle - sampling profiler
+*/
+
+#include "profiler.h"
+#include "sterilizer.h"
+#include "tickless.h"
+
+const char profileTopic[] = "ToHost/Sterilizer/profile";
+
+static uint32_t profileSamples[PROFILE_MAX_SAMPLES];
+static volatile unsigned int sampleCount = 0;
+static volatile unsigned long droppedSamples = 0;
+static unsigned long sampleRate = 0;
+
+// Progress of a dump in progress; -1 when not dumping
+static int dumpIndex = -1;
+static unsigned int dumpCount = 0;
+
+#ifdef ESP32
+
+#include <freertos/xtensa_context.h>
+
+static hw_timer_t* profileTimer = NULL;
+
+static void IRAM_ATTR onProfileTimer() {
+  // On its first interrupt level the FreeRTOS port stores the interrupted
+  // task's stack pointer in pxTopOfStack, the first field of its TCB, and
+  // the exception frame holding the interrupted PC sits at that address.
+  XtExcFrame* frame = *(XtExcFrame**)xTaskGetCurrentTaskHandle();
+  unsigned int count = sampleCount;
+  if (count < PROFILE_MAX_SAMPLES) {
+    profileSamples[count] = frame->pc;
+    sampleCount = count + 1;
+  }
+  else {
+    droppedSamples++;
+  }
+}
+
+bool profilerStart(unsigned long hz) {
+  if (hz == 0 || hz > PROFILE_MAX_HZ || dumpIndex >= 0) {
+    return false;
+  }
+  profilerStop();
+  sampleCount = 0;
+  droppedSamples = 0;
+  sampleRate = hz;
+
+  // Timer 1 at 1 MHz; allocated from loop() so the interrupt lands on loop()'s core
+  profileTimer = timerBegin(1, 80, true);
+  timerAttachInterrupt(profileTimer, onProfileTimer, true);
+  timerAlarmWrite(profileTimer, 1000000 / hz, true);
+  timerAlarmEnable(profileTimer);
+  return true;
+}
+
+void profilerStop() {
+  if (profileTimer == NULL) {
+    return;
+  }
+  timerAlarmDisable(profileTimer);
+  timerDetachInterrupt(profileTimer);
+  timerEnd(profileTimer);
+  profileTimer = NULL;
+}
+
+#else
+
+// Only the ESP32 build can sample the program counter
+bool profilerStart(unsigned long hz) {
+  return false;
+}
+
+void profilerStop() {
+}
+
+#endif
+
+bool profilerDump() {
+  if (dumpIndex >= 0) {
+    return false;
+  }
+  profilerStop();
+  dumpCount = sampleCount;
+  dumpIndex = 0;
+
+  char line[64];
+  snprintf(line, sizeof(line), "prof begin n=%u hz=%lu dropped=%lu", dumpCount, sampleRate, droppedSamples);
+  MQTTclient.publish(profileTopic, line);
+  return true;
+}
+
+void profilerLoop() {
+  if (dumpIndex < 0) {
+    return;
+  }
+  wakeWithin(0);
+  for (int message = 0; message < PROFILE_MESSAGES_PER_TICK; message++) {
+    if (dumpIndex >= (int)dumpCount) {
+      MQTTclient.publish(profileTopic, "prof end");
+      dumpIndex = -1;
+      return;
+    }
+    char line[16 + 9 * PROFILE_SAMPLES_PER_MESSAGE];
+    int used = snprintf(line, sizeof(line), "prof %d", dumpIndex);
+    for (int i = 0; i < PROFILE_SAMPLES_PER_MESSAGE && dumpIndex < (int)dumpCount; i++, dumpIndex++) {
+      used += snprintf(line + used, sizeof(line) - used, " %08lx", (unsigned long)profileSamples[dumpIndex]);
+    }
+    MQTTclient.publish(profileTopic, line);
+  }
+}
@@ -0,0 +1,36 @@
+/*
+   Sterilizer puzzle - sampling profiler
+
+   A hardware timer interrupts core 1, where loop() runs, and records the
+   program counter of whatever it interrupted. Controlled with the
+   "profile" command:
+
+     profile start [hz]   clear the buffer and sample at hz (default 100)
+     profile stop         stop sampling
+     profile dump         publish the samples on ToHost/Sterilizer/profile
+
+   The dump is "prof begin n=<samples> hz=<rate> dropped=<n>", then
+   "prof <index> <pc> <pc> ..." lines in hex, then "prof end". Sampling
+   stops by itself once the buffer is full. tools/profile_symbolize.py
+   turns a dump into a flat profile using the firmware's ELF file.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// Samples held in RAM, four bytes each
+#define PROFILE_MAX_SAMPLES 2048
+#define PROFILE_DEFAULT_HZ 100
+#define PROFILE_MAX_HZ 5000
+// Program counters per dump message
+#define PROFILE_SAMPLES_PER_MESSAGE 16
+// Dump messages published per pass of loop()
+#define PROFILE_MESSAGES_PER_TICK 4
+
+extern const char profileTopic[];
+
+bool profilerStart(unsigned long hz);
+void profilerStop();
+bool profilerDump();
+void profilerLoop();
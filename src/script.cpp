@@ -0,0 +1,146 @@
+/*
+   Sterilizer puzzle - non-blocking scripts
+
+   The frame pool and the scheduler that resumes scripts whose wait is over.
+*/
+
+#include "script.h"
+#include "sterilizer.h"
+#include "tickless.h"
+
+// Frame storage, aligned for any member a script may have
+static union {
+  uint8_t bytes[SCRIPT_FRAME_SIZE];
+  long double align;
+} framePool[SCRIPT_POOL_SLOTS];
+
+// The script living in each frame, or NULL while the frame is free
+static Script* scripts[SCRIPT_POOL_SLOTS];
+static bool frameTaken[SCRIPT_POOL_SLOTS];
+
+static int frameIndex(const Script* script) {
+  for (int i = 0; i < SCRIPT_POOL_SLOTS; i++) {
+    if (script != NULL && scripts[i] == script) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void releaseFrame(int index) {
+  scripts[index]->~Script();
+  scripts[index] = NULL;
+  frameTaken[index] = false;
+}
+
+void* scriptAllocate() {
+  for (int i = 0; i < SCRIPT_POOL_SLOTS; i++) {
+    if (!frameTaken[i]) {
+      frameTaken[i] = true;
+      return framePool[i].bytes;
+    }
+  }
+#ifdef DEBUG
+  Serial.println("Script pool full");
+#endif
+  return NULL;
+}
+
+bool scriptAdopt(Script* script) {
+  for (int i = 0; i < SCRIPT_POOL_SLOTS; i++) {
+    if ((void*)script == (void*)framePool[i].bytes) {
+      scripts[i] = script;
+      if (!script->resume()) {
+        releaseFrame(i);
+        return false;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+void scriptCancel(Script* script) {
+  int index = frameIndex(script);
+  if (index >= 0) {
+    script->cancelled();
+    releaseFrame(index);
+  }
+}
+
+bool scriptRunning(const Script* script) {
+  return frameIndex(script) >= 0;
+}
+
+// The innermost script a SCRIPT_CALL() chain is waiting in
+static Script* waitingScript(Script* script) {
+  while (script->wait == WAIT_CHILD) {
+    script = script->waitChild;
+  }
+  return script;
+}
+
+void scriptPost(const char* event) {
+  for (int i = 0; i < SCRIPT_POOL_SLOTS; i++) {
+    if (scripts[i] != NULL) {
+      Script* waiting = waitingScript(scripts[i]);
+      if (waiting->wait == WAIT_EVENT && strcmp(waiting->waitEvent, event) == 0) {
+        waiting->posted = true;
+      }
+    }
+  }
+}
+
+static bool waitOver(Script* script) {
+  Script* waiting = waitingScript(script);
+  bool done;
+  switch (waiting->wait) {
+    case WAIT_INPUT: done = digitalRead(waiting->waitPin) == waiting->waitLevel; break;
+    case WAIT_EVENT: done = waiting->posted; break;
+    case WAIT_TIME:  return millis() - waiting->waitStart >= waiting->waitMs;
+    default:         return true;
+  }
+  if (!done && waiting->waitMs != 0 && millis() - waiting->waitStart >= waiting->waitMs) {
+    waiting->timedOut = true;
+    done = true;
+  }
+  return done;
+}
+
+// Asks the tickless loop to run again when this script's wait could end
+static void scheduleWake(Script* script) {
+  Script* waiting = waitingScript(script);
+  unsigned long elapsed = millis() - waiting->waitStart;
+  unsigned long left = waiting->waitMs > elapsed ? waiting->waitMs - elapsed : 0;
+  switch (waiting->wait) {
+    case WAIT_TIME:
+      wakeWithin(left);
+      break;
+    case WAIT_INPUT:
+      // Inputs are polled; only the rotary switch has an interrupt
+      wakeWithin(waiting->waitMs != 0 && left < TICKLESS_POLL_MS ? left : TICKLESS_POLL_MS);
+      break;
+    case WAIT_EVENT:
+      // Posting the event runs the loop anyway
+      if (waiting->waitMs != 0) {
+        wakeWithin(left);
+      }
+      break;
+    default:
+      wakeWithin(0);
+      break;
+  }
+}
+
+void scriptLoop() {
+  for (int i = 0; i < SCRIPT_POOL_SLOTS; i++) {
+    if (scripts[i] != NULL && waitOver(scripts[i])) {
+      if (!scripts[i]->resume()) {
+        releaseFrame(i);
+      }
+    }
+    if (scripts[i] != NULL) {
+      scheduleWake(scripts[i]);
+    }
+  }
+}
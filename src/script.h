@@ -0,0 +1,141 @@
+/*
+   Sterilizer puzzle - non-blocking scripts
+
+   A script is a sequence such as the solve sequence written as straight
+   line code that waits without blocking loop(). C++20 coroutines are not
+   available with the ESP32 toolchain (GCC 8, gnu++11), so scripts are
+   stackless protothreads: resume() is a switch on the line it last
+   stopped at, and the await macros record that line and return.
+
+     struct Flash : Script {
+       bool resume() {
+         SCRIPT_BEGIN();
+         setRelay<FlamesPin>(HIGH);
+         SCRIPT_SLEEP(5000);
+         setRelay<FlamesPin>(LOW);
+         SCRIPT_END();
+       }
+     };
+     scriptStart<Flash>();
+
+   Local variables do not survive an await, so anything a script needs
+   afterwards must be a member. Only one await macro may go on a line, and
+   they cannot be used inside a switch statement of the script's own.
+
+   Awaitables:
+
+     SCRIPT_SLEEP(ms)                      wait ms milliseconds
+     SCRIPT_AWAIT_INPUT(pin, level, ms)    wait for digitalRead(pin) == level
+     SCRIPT_AWAIT_EVENT(name, ms)          wait for scriptPost(name)
+     SCRIPT_CALL(child)                    run a Script member to its end
+
+   A timeout of 0 waits forever; SCRIPT_TIMED_OUT() tells whether the last
+   wait ended by timing out. Events are posted for every command that
+   completes with "ok" (the command name) and when the MQTT connection is
+   made ("connected").
+
+   Started scripts live in a static pool of SCRIPT_POOL_SLOTS frames of
+   SCRIPT_FRAME_SIZE bytes each; nothing is taken from the heap. Scripts
+   are resumed by scriptLoop(), which loop() calls on every pass.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include <new>
+
+#define SCRIPT_POOL_SLOTS 4
+// Bytes in a frame; the largest script must fit
+#define SCRIPT_FRAME_SIZE 128
+// Lateness up to which a sleep is counted from the end of the one before
+#define SCRIPT_SLEEP_SLACK_MS 10
+
+enum ScriptWait {
+  WAIT_NONE,
+  WAIT_TIME,
+  WAIT_INPUT,
+  WAIT_EVENT,
+  WAIT_CHILD,
+};
+
+class Script {
+public:
+  Script() : line(0), wait(WAIT_NONE), timedOut(false), posted(false) {}
+  virtual ~Script() {}
+
+  // Runs the script up to its next await; false once it has finished
+  virtual bool resume() = 0;
+  // Called instead of finishing when scriptCancel() stops the script
+  virtual void cancelled() {}
+
+  // Resume point and what the script is waiting for, set by the macros
+  int line;
+  ScriptWait wait;
+  bool timedOut;
+  bool posted;
+  uint8_t waitPin;
+  uint8_t waitLevel;
+  unsigned long waitStart;
+  unsigned long waitMs;
+  const char* waitEvent;
+  Script* waitChild;
+
+  void await(ScriptWait kind, unsigned long ms) {
+    unsigned long now = millis();
+    // A sleep straight after another counts from where that one ended, so
+    // an animation of back-to-back sleeps does not drift with loop timing
+    if (kind == WAIT_TIME && wait == WAIT_TIME && now - (waitStart + waitMs) <= SCRIPT_SLEEP_SLACK_MS) {
+      now = waitStart + waitMs;
+    }
+    wait = kind;
+    waitStart = now;
+    waitMs = ms;
+    timedOut = false;
+    posted = false;
+  }
+};
+
+#define SCRIPT_BEGIN() switch (line) { case 0:
+
+#define SCRIPT_END() } return false
+
+#define SCRIPT_SLEEP(ms) \
+  do { await(WAIT_TIME, (ms)); line = __LINE__; return true; case __LINE__:; } while (0)
+
+#define SCRIPT_AWAIT_INPUT(pin, level, ms) \
+  do { waitPin = (pin); waitLevel = (level); await(WAIT_INPUT, (ms)); \
+       line = __LINE__; return true; case __LINE__:; } while (0)
+
+#define SCRIPT_AWAIT_EVENT(name, ms) \
+  do { waitEvent = (name); await(WAIT_EVENT, (ms)); line = __LINE__; return true; case __LINE__:; } while (0)
+
+#define SCRIPT_CALL(child) \
+  do { (child).line = 0; line = __LINE__; __attribute__((fallthrough)); case __LINE__: \
+       if ((child).resume()) { waitChild = &(child); await(WAIT_CHILD, 0); return true; } } while (0)
+
+#define SCRIPT_TIMED_OUT() (timedOut)
+
+// Frame storage for scriptStart(); NULL when the pool is full
+void* scriptAllocate();
+// Adds a constructed script to the ones scriptLoop() runs; false if it has already finished
+bool scriptAdopt(Script* script);
+
+// Starts a script and runs it up to its first await. Returns the script,
+// or NULL if it finished at once or the pool is full.
+template <typename SCRIPT, typename... ARGS>
+SCRIPT* scriptStart(ARGS... args) {
+  static_assert(sizeof(SCRIPT) <= SCRIPT_FRAME_SIZE, "script frame is bigger than SCRIPT_FRAME_SIZE");
+  void* frame = scriptAllocate();
+  if (frame == NULL) {
+    return NULL;
+  }
+  SCRIPT* script = new (frame) SCRIPT(args...);
+  return scriptAdopt(script) ? script : NULL;
+}
+
+// Stops a script started by scriptStart() without finishing it
+void scriptCancel(Script* script);
+bool scriptRunning(const Script* script);
+// Wakes the scripts waiting for this event
+void scriptPost(const char* event);
+void scriptLoop();
@@ -0,0 +1,383 @@
+/*
+   Sterilizer puzzle - overnight sleep
+
+   The ESP32 build sleeps with esp_light_sleep_start() or
+   esp_deep_sleep_start(), woken by the timer or an ext0 wake on the
+   rotary switch; a deep sleep carries on in sleepSetup() after the reset.
+   The native simulator has neither: both modes move the virtual clock on
+   until the timer runs out or the switch changes, and deep sleep returns
+   the way light sleep does instead of resetting.
+*/
+
+#include "sleep.h"
+#include "sterilizer.h"
+#include "telemetry.h"
+#include "events.h"
+#include "link.h"
+#include "tickless.h"
+#include <WiFi.h>
+#ifdef ESP32
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#include <driver/rtc_io.h>
+#include <sys/time.h>
+#else
+#include "sim.h"
+#endif
+
+const char wakeTopic[] = "ToDevice/Sterilizer/wake";
+
+enum SleepWake {
+  SLEEP_WAKE_NONE,
+  SLEEP_WAKE_TIMER,
+  SLEEP_WAKE_SWITCH,
+  SLEEP_WAKE_HOST,
+};
+
+#define SLEEP_MEMORY_MAGIC 0x534C5050
+
+// Kept in RTC memory through deep sleep; a power-up clears it
+struct SleepMemory {
+  uint32_t magic;
+  uint8_t mode;
+  uint8_t puzzleState;
+  uint8_t ledBright;
+  uint8_t channel;             // access point to rejoin without a scan, 0 for none
+  uint8_t bssid[6];
+  unsigned long remainingMs;   // of the for= timer
+  unsigned long checkMs;
+  unsigned long sliceMs;       // length of the sleep in progress
+  unsigned long long sleptAt;  // sleepClockMs() when the prop went to sleep
+};
+RTC_DATA_ATTR static SleepMemory memory;
+RTC_DATA_ATTR static unsigned long autoAfterMs = 0;
+RTC_DATA_ATTR static unsigned long sleepCount = 0;
+RTC_DATA_ATTR static unsigned long checkCount = 0;
+
+// Set by the sleep command, acted on by sleepLoop()
+static bool requested = false;
+static SleepMode requestedMode = SLEEP_DEEP;
+static unsigned long requestedMs = 0;
+static unsigned long requestedCheckMs = 0;
+
+static bool resumed = false;
+static bool announcePending = false;
+static SleepWake lastWake = SLEEP_WAKE_NONE;
+static unsigned long wokeAt = 0;  // millis() at the wake
+static unsigned long lastSleptS = 0;
+static unsigned long lastReadyMs = 0;
+static bool wakeRequested = false;
+// The rotary switch is also the solve input; one turned to wake the prop
+// must be seen back off before it can solve the puzzle
+static bool switchHeld = false;
+
+static const char* wakeName(SleepWake wake) {
+  switch (wake) {
+    case SLEEP_WAKE_NONE:   return "none";
+    case SLEEP_WAKE_TIMER:  return "timer";
+    case SLEEP_WAKE_SWITCH: return "switch";
+    case SLEEP_WAKE_HOST:   return "host";
+  }
+  return "?";
+}
+
+#ifdef ESP32
+
+// Milliseconds on the RTC clock, which keeps running through both kinds of sleep
+static unsigned long long sleepClockMs() {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (unsigned long long)now.tv_sec * 1000 + now.tv_usec / 1000;
+}
+
+// Sleeps for up to ms. Deep sleep does not return; it resets into sleepSetup().
+static SleepWake sleepFor(unsigned long ms) {
+  memory.sliceMs = ms;
+  int level = RotaryPin::read();
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+  esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+  // ext0 watches the switch from the RTC domain, which stays powered for the pull-up
+  esp_sleep_enable_ext0_wakeup((gpio_num_t)Rotary, level == HIGH ? 0 : 1);
+  esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
+  rtc_gpio_pullup_en((gpio_num_t)Rotary);
+  rtc_gpio_pulldown_dis((gpio_num_t)Rotary);
+
+  if (memory.mode == SLEEP_DEEP) {
+    // Outputs float in deep sleep unless their pads are held
+    gpio_hold_en((gpio_num_t)Pump);
+    gpio_hold_en((gpio_num_t)Flames);
+    gpio_hold_en((gpio_num_t)MagLock);
+    gpio_deep_sleep_hold_en();
+    esp_deep_sleep_start();
+  }
+
+  esp_light_sleep_start();
+  SleepWake wake = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0 ? SLEEP_WAKE_SWITCH : SLEEP_WAKE_TIMER;
+  // Hand the switch back to the digital GPIO for reads and the tickless interrupt
+  rtc_gpio_deinit((gpio_num_t)Rotary);
+  RotaryPin::inputPullup();
+  return wake;
+}
+
+#else
+
+static unsigned long long sleepClockMs() {
+  return simNow() / 1000;
+}
+
+static SleepWake sleepFor(unsigned long ms) {
+  memory.sliceMs = ms;
+  int level = RotaryPin::read();
+  uint64_t until = simNow() + (uint64_t)ms * 1000;
+  while (simNow() < until) {
+    simSleep(until - simNow());
+    if (RotaryPin::read() != level) {
+      return SLEEP_WAKE_SWITCH;
+    }
+  }
+  return SLEEP_WAKE_TIMER;
+}
+
+#endif
+
+static void radioOff() {
+  MQTTclient.disconnect();
+  WiFi.disconnect(true);
+}
+
+bool wifiBeginFast() {
+  if (memory.magic == SLEEP_MEMORY_MAGIC && memory.channel != 0) {
+    WiFi.begin(ssid, pass, memory.channel, memory.bssid);
+    return true;
+  }
+  WiFi.begin(ssid, pass);
+  return false;
+}
+
+void wifiBeginScan() {
+  // The access point may have been replaced or moved channel while the prop slept
+  memory.channel = 0;
+  WiFi.disconnect();
+  WiFi.begin(ssid, pass);
+}
+
+static void wakeMessage(char* topic, byte* message, unsigned int length) {
+  // An empty retained message is the host clearing its request
+  if (strcmp(topic, wakeTopic) == 0 && length > 0) {
+    wakeRequested = true;
+  }
+}
+
+// Joins WiFi and the broker just long enough to see a retained wake message
+static bool hostWantsWake() {
+  checkCount++;
+  wakeRequested = false;
+  wifiBeginFast();
+  unsigned long start = millis();
+  while (WiFi.status() != WL_CONNECTED && millis() - start < SLEEP_CHECK_JOIN_MS) {
+    delay(10);
+  }
+  if (WiFi.status() != WL_CONNECTED) {
+    // The access point may have moved; scan from now on
+    memory.channel = 0;
+  }
+  else {
+    // mqttSetup() puts the command callback back once the prop is awake
+    MQTTclient.setServer(mqttServerIP, 1883);
+    MQTTclient.setCallback(wakeMessage);
+    if (MQTTclient.connect(deviceID) && MQTTclient.subscribe(wakeTopic)) {
+      start = millis();
+      while (!wakeRequested && millis() - start < SLEEP_CHECK_WINDOW_MS) {
+        MQTTclient.loop();
+        delay(10);
+      }
+      // Else the backend keeps the topic and hears its own clear of it once awake
+      MQTTclient.unsubscribe(wakeTopic);
+    }
+  }
+  radioOff();
+  return wakeRequested;
+}
+
+// Whether the slice that just ended ends the sleep, and why
+static SleepWake sliceEnded(SleepWake wake) {
+  if (wake != SLEEP_WAKE_TIMER) {
+    return wake;
+  }
+  memory.remainingMs -= memory.sliceMs;
+  if (memory.remainingMs == 0) {
+    return SLEEP_WAKE_TIMER;
+  }
+  return hostWantsWake() ? SLEEP_WAKE_HOST : SLEEP_WAKE_NONE;
+}
+
+// Sleeps a slice at a time, waking between slices to look for the host's message
+static SleepWake sleepUntilWoken() {
+  SleepWake wake = SLEEP_WAKE_NONE;
+  while (wake == SLEEP_WAKE_NONE) {
+    unsigned long slice = memory.remainingMs;
+    if (memory.checkMs > 0 && memory.checkMs < slice) {
+      slice = memory.checkMs;
+    }
+    wake = sliceEnded(sleepFor(slice));
+  }
+  return wake;
+}
+
+static void noteWake(SleepWake wake) {
+  lastWake = wake;
+  switchHeld = true;
+  lastSleptS = (sleepClockMs() - memory.sleptAt) / 1000;
+  announcePending = true;
+}
+
+static void enterSleep() {
+  requested = false;
+  sleepCount++;
+
+  // Nothing live while nobody is watching: no relay or LED test to pick up
+  // again after a light sleep, pump and flames off, lock engaged, strip dark
+  onTestStop();
+  safeRelays();
+  blankLEDs();
+
+  char line[80];
+  snprintf(line, sizeof(line), "Sterilizer sleeping mode=%s for=%lu check=%lu",
+           sleepModeName(requestedMode), requestedMs / 60000, requestedCheckMs / 60000);
+  MQTTclient.publish(hostTopic, line);
+#ifdef DEBUG
+  Serial.println(line);
+#endif
+
+  memory.magic = SLEEP_MEMORY_MAGIC;
+  memory.mode = requestedMode;
+  memory.puzzleState = puzzle;
+  memory.ledBright = LedBright;
+  memory.channel = 0;
+  uint8_t* bssid = WiFi.BSSID();
+  if (WiFi.status() == WL_CONNECTED && bssid != NULL) {
+    memory.channel = WiFi.channel();
+    memcpy(memory.bssid, bssid, sizeof(memory.bssid));
+  }
+  memory.remainingMs = requestedMs;
+  memory.checkMs = requestedCheckMs;
+  memory.sleptAt = sleepClockMs();
+  radioOff();
+
+  SleepWake wake = sleepUntilWoken();
+
+  // Only light sleep gets here; RAM, the strip's colours and the puzzle state are as they were
+  noteWake(wake);
+  wokeAt = millis();
+  wifiSetup();
+  mqttSetup();
+  // The LEDs light again and the link profile is re-applied
+  postConnection(true, true);
+  noteLinkActivity();
+}
+
+void sleepSetup() {
+#ifdef ESP32
+  if (esp_reset_reason() != ESP_RST_DEEPSLEEP || memory.magic != SLEEP_MEMORY_MAGIC) {
+    return;
+  }
+  SleepWake wake = sliceEnded(esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0 ? SLEEP_WAKE_SWITCH : SLEEP_WAKE_TIMER);
+  if (wake == SLEEP_WAKE_NONE) {
+    // Only a check, with nobody asking for the prop: back to sleep, leaving the strip and relays alone
+    wake = sleepUntilWoken();
+  }
+
+  resumed = true;
+  noteWake(wake);
+  // Ready is measured from the reset
+  wokeAt = 0;
+  puzzle = (PuzzleState)memory.puzzleState;
+  LedBright = memory.ledBright;
+
+  // Take the relays back from the pad hold at the levels they were held at
+  FlamesPin::output();
+  PumpPin::output();
+  MagLockPin::output();
+  gpioSwitch<NoRelays, AllRelays>();
+  gpio_hold_dis((gpio_num_t)Pump);
+  gpio_hold_dis((gpio_num_t)Flames);
+  gpio_hold_dis((gpio_num_t)MagLock);
+  gpio_deep_sleep_hold_dis();
+  rtc_gpio_deinit((gpio_num_t)Rotary);
+#endif
+}
+
+void sleepLoop() {
+  if (announcePending && MQTTclient.connected()) {
+    announcePending = false;
+    lastReadyMs = millis() - wokeAt;
+    char line[96];
+    snprintf(line, sizeof(line), "Sterilizer awake cause=%s slept=%lu ready=%lu",
+             wakeName(lastWake), lastSleptS, lastReadyMs);
+    MQTTclient.publish(hostTopic, line);
+    // Whatever woke the prop, a wake request left behind would cut the next sleep short
+    MQTTclient.publish(wakeTopic, "", true);
+  }
+
+  // Only once the game is over: a game the host says nothing in looks just as quiet while Running
+  if (!requested && autoAfterMs > 0 && puzzle == Solved) {
+    unsigned long quiet = linkQuietMs();
+    if (quiet >= autoAfterMs) {
+      sleepRequest(SLEEP_DEEP, SLEEP_DEFAULT_MINUTES, SLEEP_CHECK_MINUTES);
+    }
+    else {
+      wakeWithin(autoAfterMs - quiet);
+    }
+  }
+
+  if (requested) {
+    // A solve or reset that came in behind the sleep command wins
+    if (puzzle == Solving || puzzle == Resetting) {
+      requested = false;
+      return;
+    }
+    enterSleep();
+  }
+}
+
+bool sleepResumed() {
+  return resumed;
+}
+
+bool sleepSwitchArmed() {
+  if (switchHeld && RotaryPin::read() == HIGH) {
+    switchHeld = false;
+  }
+  return !switchHeld;
+}
+
+bool sleepRequest(SleepMode mode, unsigned long minutes, unsigned long checkMinutes) {
+  if (minutes == 0 || minutes > SLEEP_MAX_MINUTES || checkMinutes > minutes) {
+    return false;
+  }
+  requested = true;
+  requestedMode = mode;
+  requestedMs = minutes * 60000;
+  requestedCheckMs = checkMinutes * 60000;
+  wakeWithin(0);
+  return true;
+}
+
+unsigned long sleepAutoMinutes() {
+  return autoAfterMs / 60000;
+}
+
+void sleepAutoAfter(unsigned long minutes) {
+  autoAfterMs = minutes * 60000;
+}
+
+const char* sleepModeName(SleepMode mode) {
+  return mode == SLEEP_LIGHT ? "light" : "deep";
+}
+
+void publishSleepStats() {
+  char line[128];
+  snprintf(line, sizeof(line), "sleep sleeps=%lu checks=%lu auto=%lu last=%s slept=%lu ready=%lu",
+           sleepCount, checkCount, autoAfterMs / 60000, wakeName(lastWake), lastSleptS, lastReadyMs);
+  publishStatsLine(line);
+}
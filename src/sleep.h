@@ -0,0 +1,75 @@
+/*
+   Sterilizer puzzle - overnight sleep
+
+   Between closing and opening the prop does not need to sit at full power
+   with WiFi up and the strip lit. Going to sleep stops any relay or LED
+   test, safes the relays (pump and flames off, lock engaged), blanks the
+   strip, says so on ToHost/Sterilizer, drops WiFi and puts the ESP32 into
+   light or deep sleep until one of:
+
+     the timer         for=<minutes> has passed
+     the switch        the rotary switch changes (ext0 wake on GPIO 27);
+                       as it is also the solve input, it does not solve
+                       the puzzle until it has been turned back off
+     the host          a retained message on ToDevice/Sterilizer/wake,
+                       looked for every check=<minutes> by joining WiFi
+                       and the broker for a moment; 0 never looks
+
+   Light sleep keeps RAM and returns to where it left off. Deep sleep
+   draws far less but wakes through a reset; the puzzle state, brightness
+   and sleep settings ride through it in RTC memory, the relay pins are
+   held at their safe levels, and setup() skips its start-up animation and
+   rejoins the same access point without a scan. A wake that is only a
+   host check goes straight back to sleep from setup() without touching
+   the strip or the relays.
+
+     sleep [light|deep] [for=<minutes>] [check=<minutes>]
+     sleep auto <minutes> | off       sleep (deep, defaults) after that
+                                      long solved without game activity;
+                                      a running game never sleeps by itself
+
+   Once back on MQTT the prop announces
+   "Sterilizer awake cause=<timer|switch|host> slept=<s> ready=<ms>",
+   where ready is the time from the wake to the broker connection, and
+   clears the retained wake message. The stats line is
+   "sleep sleeps= checks= auto=<minutes> last=<cause> slept=<s> ready=<ms>".
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#define SLEEP_DEFAULT_MINUTES (10 * 60)
+#define SLEEP_MAX_MINUTES (24 * 60)
+#define SLEEP_CHECK_MINUTES 15
+// How long joining the remembered access point may take, for a host check
+// or a wake, and then how long a check waits for the retained message
+#define SLEEP_CHECK_JOIN_MS 5000
+#define SLEEP_CHECK_WINDOW_MS 500
+
+enum SleepMode {
+  SLEEP_LIGHT,
+  SLEEP_DEEP,
+};
+
+// Call from setup() before the LEDs and network start; may go back to sleep and not return
+void sleepSetup();
+void sleepLoop();
+// True when setup() is running after a deep sleep rather than a power-up
+bool sleepResumed();
+// False from a wake until the rotary switch has been seen off (HIGH), so
+// that turning it to wake the prop does not also solve the puzzle
+bool sleepSwitchArmed();
+// Starts joining the access point, skipping the scan when one is remembered
+// from before a sleep; true if it did. A join that has not finished within
+// SLEEP_CHECK_JOIN_MS goes over to wifiBeginScan().
+bool wifiBeginFast();
+// Forgets the remembered access point and starts joining with a scan
+void wifiBeginScan();
+// Sleeps at the next sleepLoop(), after the command has been acknowledged
+bool sleepRequest(SleepMode mode, unsigned long minutes, unsigned long checkMinutes);
+// Sleep after this long without activity, or never with 0
+void sleepAutoAfter(unsigned long minutes);
+unsigned long sleepAutoMinutes();
+const char* sleepModeName(SleepMode mode);
+void publishSleepStats();
@@ -0,0 +1,75 @@
+/*
+   Sterilizer puzzle - shared declarations
+
+   State and functions owned by main.cpp that the other modules of the
+   sketch need to reach.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "gpio.h"
+#include "transport.h"
+
+// DEFINES
+#define DEBUG
+
+enum PuzzleState{Initializing, Running, Solved, Solving, Resetting};
+
+// How long "test relays" keeps each relay on, and "test leds" each colour
+#define TEST_RELAY_MS 1000
+#define TEST_LED_MS 500
+
+// Buffers of the network settings, which config.cpp can replace at boot
+#define SSID_SIZE 33
+#define PASS_SIZE 64
+#define HOST_SIZE 40
+
+// Pins
+const int Rotary = 27;
+const int Pump = 25;
+const int Flames = 33;
+const int MagLock = 26;
+
+typedef GpioPin<Rotary> RotaryPin;
+typedef GpioPin<Pump> PumpPin;
+typedef GpioPin<Flames> FlamesPin;
+typedef GpioPin<MagLock> MagLockPin;
+typedef GpioGroup<PumpPin, FlamesPin, MagLockPin> AllRelays;
+typedef GpioGroup<> NoRelays;
+
+// Globals defined in main.cpp
+extern PuzzleState puzzle;
+extern const char DeviceTopic[];
+extern const char hostTopic[];
+extern int LedBright;
+extern bool wifiConnected;
+extern bool mqttConnected;
+// Times each link has come up, the first at boot
+extern unsigned long wifiConnects;
+extern unsigned long mqttConnects;
+extern char ssid[];
+extern char pass[];
+extern char mqttServerIP[];
+extern const char* deviceID;
+
+const char* puzzleStateName(int state);
+
+// Puzzle actions defined in main.cpp; all start a sequence and return at once
+void onSolve();
+void onReset();
+// False if the test could not be started
+bool onRelayTest();
+bool onLedTest();
+// Stops a relay or LED test with the relays made safe; false if none was running
+bool onTestStop();
+
+// Hardware helpers defined in main.cpp
+void showLEDs();
+void blankLEDs();
+// Pump and flames off, lock engaged
+void safeRelays();
+
+// Network setup defined in main.cpp; both block until connected
+void wifiSetup();
+void mqttSetup();
@@ -0,0 +1,202 @@
+/*
+   Sterilizer puzzle - FreeRTOS task statistics
+*/
+
+#include "taskstats.h"
+#include "sterilizer.h"
+#include "tickless.h"
+#include "telemetry.h"
+
+static unsigned long lastTaskStatsTime = 0;
+
+#ifdef ESP32
+
+#include <esp_freertos_hooks.h>
+
+struct TaskSample {
+  TaskHandle_t task;
+  char name[configMAX_TASK_NAME_LEN];
+  int core;                 // core it was last seen on
+  bool bothCores;           // seen running on both cores
+  unsigned long ticks;
+};
+
+// Written by the tick hooks of both cores, read by taskStatsLoop()
+static portMUX_TYPE sampleLock = portMUX_INITIALIZER_UNLOCKED;
+static TaskSample samples[MAX_TRACKED_TASKS];
+static unsigned long coreTicks[portNUM_PROCESSORS];
+static unsigned long idleTicks[portNUM_PROCESSORS];
+static unsigned long untracked = 0;
+
+static void IRAM_ATTR sampleTask(int core) {
+  TaskHandle_t current = xTaskGetCurrentTaskHandleForCPU(core);
+
+  portENTER_CRITICAL_ISR(&sampleLock);
+  coreTicks[core]++;
+  if (current == xTaskGetIdleTaskHandleForCPU(core)) {
+    idleTicks[core]++;
+  }
+  int slot = -1;
+  for (int i = 0; i < MAX_TRACKED_TASKS; i++) {
+    if (samples[i].task == current) {
+      slot = i;
+      break;
+    }
+    if (samples[i].task == NULL) {
+      // First time this task has been seen; copy its name while it surely exists
+      slot = i;
+      samples[i].task = current;
+      strncpy(samples[i].name, pcTaskGetTaskName(current), configMAX_TASK_NAME_LEN - 1);
+      samples[i].core = core;
+      break;
+    }
+  }
+  if (slot < 0) {
+    untracked++;
+  }
+  else {
+    if (samples[slot].core != core) {
+      samples[slot].bothCores = true;
+    }
+    samples[slot].core = core;
+    samples[slot].ticks++;
+  }
+  portEXIT_CRITICAL_ISR(&sampleLock);
+}
+
+static void IRAM_ATTR sampleCore0() {
+  sampleTask(0);
+}
+
+static void IRAM_ATTR sampleCore1() {
+  sampleTask(1);
+}
+
+void taskStatsSetup() {
+  esp_register_freertos_tick_hook_for_cpu(sampleCore0, 0);
+#if portNUM_PROCESSORS > 1
+  esp_register_freertos_tick_hook_for_cpu(sampleCore1, 1);
+#endif
+}
+
+// Percentage with one decimal, as "12.3"
+static void formatPercent(char* buffer, size_t size, unsigned long part, unsigned long whole) {
+  unsigned long tenths = whole == 0 ? 0 : (part * 1000ULL + whole / 2) / whole;
+  snprintf(buffer, size, "%lu.%lu", tenths / 10, tenths % 10);
+}
+
+// A task that has since been deleted must not be touched. The idle tasks
+// never are; any other is still there if its name still finds it.
+static bool taskAlive(TaskHandle_t task, const char* name) {
+  for (int core = 0; core < portNUM_PROCESSORS; core++) {
+    if (task == xTaskGetIdleTaskHandleForCPU(core)) {
+      return true;
+    }
+  }
+  return xTaskGetHandle(name) == task;
+}
+
+// Frees the slots of deleted tasks for new ones. The last slot in use is
+// moved into the freed one, as the tick hook stops looking at the first
+// empty slot.
+static void forgetTasks(const TaskHandle_t* tasks, int count) {
+  portENTER_CRITICAL(&sampleLock);
+  for (int t = 0; t < count; t++) {
+    int slot = -1;
+    int last = -1;
+    for (int i = 0; i < MAX_TRACKED_TASKS && samples[i].task != NULL; i++) {
+      if (samples[i].task == tasks[t]) {
+        slot = i;
+      }
+      last = i;
+    }
+    if (slot < 0) {
+      continue;
+    }
+    samples[slot] = samples[last];
+    memset(&samples[last], 0, sizeof(samples[last]));
+  }
+  portEXIT_CRITICAL(&sampleLock);
+}
+
+void publishTaskStats() {
+  // Take a copy and restart the counts so each message covers one interval
+  TaskSample snapshot[MAX_TRACKED_TASKS];
+  unsigned long ticks[portNUM_PROCESSORS];
+  unsigned long idle[portNUM_PROCESSORS];
+  unsigned long missed;
+  portENTER_CRITICAL(&sampleLock);
+  memcpy(snapshot, samples, sizeof(samples));
+  memcpy(ticks, coreTicks, sizeof(coreTicks));
+  memcpy(idle, idleTicks, sizeof(idleTicks));
+  missed = untracked;
+  for (int i = 0; i < MAX_TRACKED_TASKS; i++) {
+    samples[i].ticks = 0;
+  }
+  memset(coreTicks, 0, sizeof(coreTicks));
+  memset(idleTicks, 0, sizeof(idleTicks));
+  untracked = 0;
+  portEXIT_CRITICAL(&sampleLock);
+
+  char line[128];
+  char idle0[8];
+  char idle1[8] = "-";
+  formatPercent(idle0, sizeof(idle0), idle[0], ticks[0]);
+#if portNUM_PROCESSORS > 1
+  formatPercent(idle1, sizeof(idle1), idle[1], ticks[1]);
+#endif
+  snprintf(line, sizeof(line), "cpu idle0=%s idle1=%s ticks=%lu untracked=%lu",
+           idle0, idle1, ticks[0], missed);
+  publishStatsLine(line);
+
+  TaskHandle_t gone[MAX_TRACKED_TASKS];
+  int goneCount = 0;
+  for (int i = 0; i < MAX_TRACKED_TASKS && snapshot[i].task != NULL; i++) {
+    TaskSample& sample = snapshot[i];
+    // Use the handle the tick hook saw, as both idle tasks are called IDLE
+    TaskHandle_t task = sample.task;
+    if (!taskAlive(task, sample.name)) {
+      gone[goneCount++] = task;
+      continue;
+    }
+    // A task that moves between cores is a share of both cores' ticks
+    unsigned long whole = ticks[sample.core];
+#if portNUM_PROCESSORS > 1
+    if (sample.bothCores) {
+      whole = ticks[0] + ticks[1];
+    }
+#endif
+    char cpu[8];
+    formatPercent(cpu, sizeof(cpu), sample.ticks, whole);
+    char core[4] = "-";
+    if (!sample.bothCores) {
+      snprintf(core, sizeof(core), "%d", sample.core);
+    }
+    snprintf(line, sizeof(line), "task %s core=%s cpu=%s stack=%u",
+             sample.name, core, cpu, (unsigned int)uxTaskGetStackHighWaterMark(task));
+    publishStatsLine(line);
+  }
+  forgetTasks(gone, goneCount);
+}
+
+#else
+
+// Only the ESP32 build has FreeRTOS tasks to report on
+void taskStatsSetup() {
+}
+
+void publishTaskStats() {
+}
+
+#endif
+
+void taskStatsLoop() {
+  if (millis() - lastTaskStatsTime < TASK_STATS_INTERVAL) {
+    wakeWithin(TASK_STATS_INTERVAL - (millis() - lastTaskStatsTime));
+    return;
+  }
+  lastTaskStatsTime = millis();
+  if (MQTTclient.connected()) {
+    publishTaskStats();
+  }
+}
@@ -0,0 +1,29 @@
+/*
+   Sterilizer puzzle - FreeRTOS task statistics
+
+   The FreeRTOS tick interrupt (1 kHz on each core) samples which task is
+   running, which gives the CPU share of every task, including each core's
+   idle task, without needing the run-time stats option of the prebuilt
+   Arduino core. Every TASK_STATS_INTERVAL the shares and the stack
+   high-water marks (smallest free stack ever seen, in bytes) are published
+   on the stats topic:
+
+     cpu idle0=<%> idle1=<%> ticks=<samples per core>
+     task <name> core=<0|1|-> cpu=<%> stack=<bytes>
+
+   A task seen on both cores (core=-) is given as a share of both cores'
+   ticks. Deleted tasks drop out and free their slot for new ones.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// Time between task statistics messages
+#define TASK_STATS_INTERVAL 10000
+// Most tasks tracked; the ESP32 Arduino core runs about a dozen
+#define MAX_TRACKED_TASKS 20
+
+void taskStatsSetup();
+void taskStatsLoop();
+void publishTaskStats();
@@ -0,0 +1,103 @@
+/*
+   Sterilizer puzzle - telemetry
+
+   Publishes the counters kept by the other modules on the stats topic.
+*/
+
+#include "telemetry.h"
+#include "sterilizer.h"
+#include "commands.h"
+#include "events.h"
+#include "tickless.h"
+#include "link.h"
+#include "sleep.h"
+#include "http.h"
+#include "web.h"
+#include "console.h"
+#include "upload.h"
+#include "clocksync.h"
+
+const char statsTopic[] = "ToHost/Sterilizer/stats";
+
+static unsigned long lastStatsTime = 0;
+static StatsSink statsSink = NULL;
+
+void publishStatsLine(const char* line) {
+  if (statsSink != NULL) {
+    statsSink(line);
+    return;
+  }
+  // Stamped with the synchronized time, so that lines from different props line up
+  char stamped[STATS_LINE_SIZE];
+  strncpy(stamped, line, sizeof(stamped) - 1);
+  stamped[sizeof(stamped) - 1] = '\0';
+  clockStamp(stamped, sizeof(stamped));
+  MQTTclient.publish(statsTopic, stamped);
+}
+
+void setStatsSink(StatsSink sink) {
+  statsSink = sink;
+}
+
+void publishStats() {
+  char line[160];
+
+  snprintf(line, sizeof(line), "cmd rx=%lu run=%lu full=%lu rate=%lu evict=%lu unacked=%lu late=%lu hw=%d ping=%lu",
+           commandStats.received, commandStats.processed, commandStats.droppedFull,
+           commandStats.droppedRate, commandStats.evicted, commandStats.unacked, commandStats.overBudget,
+           commandStats.highWater, commandStats.pings);
+  publishStatsLine(line);
+
+  // One line per command and latency stage that has seen any samples
+  for (int command = 0; command < commandCount(); command++) {
+    for (int stage = 0; stage < LATENCY_STAGES; stage++) {
+      const LatencyHistogram& histogram = commandLatency(command, (LatencyStage)stage);
+      if (latencyCount(histogram) == 0) {
+        continue;
+      }
+      int used = snprintf(line, sizeof(line), "lat %s %s ", commandName(command), latencyStageName((LatencyStage)stage));
+      formatLatency(line + used, sizeof(line) - used, histogram);
+      publishStatsLine(line);
+    }
+  }
+
+  publishLinkStats();
+  publishSleepStats();
+  publishHttpStats();
+  publishWebStats();
+  publishConsoleStats();
+  publishUploadStats();
+  publishTransportStats();
+  publishClockStats();
+
+  snprintf(line, sizeof(line), "idle passes=%lu idle=%lu%% timer=%lu gpio=%lu net=%lu wifi=%lu event=%lu serial=%lu",
+           idleStats.passes, idlePercent(), idleStats.timer, idleStats.gpio, idleStats.network,
+           idleStats.wifi, idleStats.event, idleStats.serial);
+  publishStatsLine(line);
+
+  snprintf(line, sizeof(line), "evt posted=%lu delivered=%lu dropped=%lu hw=%d",
+           eventStats.posted, eventStats.delivered, eventStats.dropped, eventStats.highWater);
+  publishStatsLine(line);
+  for (int type = 0; type < EVENT_TYPES; type++) {
+    for (int stage = 0; stage < EVENT_STAGES; stage++) {
+      const LatencyHistogram& histogram = eventLatency(type, (EventStage)stage);
+      if (latencyCount(histogram) == 0) {
+        continue;
+      }
+      int used = snprintf(line, sizeof(line), "evt %s %s ", eventName(type), eventStageName((EventStage)stage));
+      formatLatency(line + used, sizeof(line) - used, histogram);
+      publishStatsLine(line);
+    }
+  }
+}
+
+void telemetryLoop() {
+  if (millis() - lastStatsTime < STATS_INTERVAL) {
+    wakeWithin(STATS_INTERVAL - (millis() - lastStatsTime));
+    return;
+  }
+  lastStatsTime = millis();
+  if (MQTTclient.connected()) {
+    publishStats();
+  }
+}
@@ -0,0 +1,30 @@
+/*
+   Sterilizer puzzle - telemetry
+
+   Counters and measurements are published as compact "key=value" lines on
+   ToHost/Sterilizer/stats every STATS_INTERVAL, and on demand with the
+   "stats" command. Each line starts with the name of the section it covers.
+   Every module publishes its lines through publishStatsLine(), so that the
+   serial console can take a dump of them instead. Once the clock is
+   synchronized (clocksync.h) each published line ends with " at=<Unix ms>".
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// Time between periodic stats messages
+#define STATS_INTERVAL 60000
+// Longest stats line once stamped with the time
+#define STATS_LINE_SIZE 224
+
+extern const char statsTopic[];
+
+typedef void (*StatsSink)(const char* line);
+
+// Publishes one line on the stats topic, or hands it to the sink if one is set
+void publishStatsLine(const char* line);
+// Sends stats lines to sink instead of MQTT until called again with NULL
+void setStatsSink(StatsSink sink);
+void publishStats();
+void telemetryLoop();
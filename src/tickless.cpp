@@ -0,0 +1,219 @@
+/*
+   Sterilizer puzzle - tickless main loop
+
+   The loop task waits with xTaskNotifyWait(), the wake cause carried in the
+   notification bits. In the native simulator the wait moves the virtual
+   clock forward to the deadline, stopping early when a scenario action
+   wakes the loop.
+*/
+
+#include "tickless.h"
+#include "sterilizer.h"
+#include <atomic>
+#ifdef ESP32
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include <esp_vfs_eventfd.h>
+#include <unistd.h>
+#else
+#include "sim.h"
+#endif
+
+IdleStats idleStats;
+
+// Earliest time the loop asked to run again, relative to the start of the pass
+static unsigned long passStart = 0;
+static unsigned long wakeAfterMs = TICKLESS_MAX_IDLE_MS;
+
+#ifdef ESP32
+static TaskHandle_t loopTask = NULL;
+static TaskHandle_t watcherTask = NULL;
+// Written when the transport connects, so that the watcher stops waiting on the old socket
+static int socketChangedFd = -1;
+
+static void IRAM_ATTR rotaryChanged() {
+  wakeLoopFromISR(WAKE_GPIO);
+}
+
+static void wifiEvent(WiFiEvent_t event) {
+  wakeLoop(WAKE_WIFI);
+}
+
+#ifndef MQTT_TRANSPORT_ESP_MQTT
+// Wakes the loop when the MQTT socket has data, then waits until the loop has gone idle again
+static void socketWatcher(void* parameter) {
+  for (;;) {
+    int fd = MQTTclient.socket();
+    if (fd < 0) {
+      vTaskDelay(pdMS_TO_TICKS(TICKLESS_SOCKET_RETRY_MS));
+      continue;
+    }
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(fd, &readable);
+    if (socketChangedFd >= 0) {
+      FD_SET(socketChangedFd, &readable);
+    }
+    struct timeval timeout = { 1, 0 };
+    int ready = select((fd > socketChangedFd ? fd : socketChangedFd) + 1, &readable, NULL, NULL, &timeout);
+    if (ready > 0 && socketChangedFd >= 0 && FD_ISSET(socketChangedFd, &readable)) {
+      // Look again at whatever socket the transport has now
+      uint64_t count;
+      read(socketChangedFd, &count, sizeof(count));
+    }
+    else if (ready > 0) {
+      ulTaskNotifyTake(pdTRUE, 0);
+      wakeLoop(WAKE_NETWORK);
+      // The data stays readable until the loop has read it
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    else if (ready < 0) {
+      // The socket was closed under us; wait for the next connection
+      vTaskDelay(pdMS_TO_TICKS(TICKLESS_SOCKET_RETRY_MS));
+    }
+  }
+}
+
+#endif
+
+void ticklessSetup() {
+  loopTask = xTaskGetCurrentTaskHandle();
+  attachInterrupt(digitalPinToInterrupt(Rotary), rotaryChanged, CHANGE);
+  WiFi.onEvent(wifiEvent);
+#ifndef MQTT_TRANSPORT_ESP_MQTT
+  esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+  esp_vfs_eventfd_register(&config);
+  socketChangedFd = eventfd(0, 0);
+  // esp-mqtt's own task wakes the loop
+  xTaskCreatePinnedToCore(socketWatcher, "sockwatch", 2048, NULL, 1, &watcherTask, xPortGetCoreID());
+#endif
+  idleStats.sinceUs = micros();
+}
+
+void ticklessSocketChanged() {
+  if (socketChangedFd >= 0) {
+    uint64_t one = 1;
+    write(socketChangedFd, &one, sizeof(one));
+  }
+}
+
+void wakeLoop(WakeCause cause) {
+  if (xPortInIsrContext()) {
+    wakeLoopFromISR(cause);
+  }
+  else if (loopTask != NULL) {
+    xTaskNotify(loopTask, cause, eSetBits);
+  }
+}
+
+void IRAM_ATTR wakeLoopFromISR(WakeCause cause) {
+  if (loopTask == NULL) {
+    return;
+  }
+  BaseType_t woken = pdFALSE;
+  xTaskNotifyFromISR(loopTask, cause, eSetBits, &woken);
+  if (woken) {
+    portYIELD_FROM_ISR();
+  }
+}
+
+// Blocks for up to ms; returns the wake causes, or 0 on timeout
+static uint32_t waitForWake(unsigned long ms) {
+  // Let the watcher look at the socket again now that the loop has read it
+  if (watcherTask != NULL) {
+    xTaskNotifyGive(watcherTask);
+  }
+  uint32_t causes = 0;
+  if (xTaskNotifyWait(0, 0xFFFFFFFF, &causes, pdMS_TO_TICKS(ms)) != pdTRUE) {
+    return 0;
+  }
+  return causes;
+}
+
+#else
+
+static std::atomic<uint32_t> pendingCauses(0);
+
+static void rotaryChanged() {
+  wakeLoopFromISR(WAKE_GPIO);
+}
+
+void ticklessSetup() {
+  attachInterrupt(digitalPinToInterrupt(Rotary), rotaryChanged, CHANGE);
+  // The fake broker and WiFi stand in for the socket watcher and WiFi events
+  simSetWakeHandler([](int source) {
+    wakeLoop(source == SIM_WAKE_NETWORK ? WAKE_NETWORK : WAKE_WIFI);
+  });
+  idleStats.sinceUs = micros();
+}
+
+void ticklessSocketChanged() {
+}
+
+void wakeLoop(WakeCause cause) {
+  pendingCauses.fetch_or(cause);
+  simWake();
+}
+
+void wakeLoopFromISR(WakeCause cause) {
+  wakeLoop(cause);
+}
+
+static uint32_t waitForWake(unsigned long ms) {
+  if (pendingCauses.load() == 0) {
+    simSleep((uint64_t)ms * 1000);
+  }
+  return pendingCauses.exchange(0);
+}
+
+#endif
+
+void wakeWithin(unsigned long ms) {
+  unsigned long due = millis() - passStart + ms;
+  if (due < wakeAfterMs) {
+    wakeAfterMs = due;
+  }
+}
+
+void ticklessWait() {
+  unsigned long elapsed = millis() - passStart;
+  unsigned long timeout = wakeAfterMs > elapsed ? wakeAfterMs - elapsed : 0;
+  idleStats.passes++;
+
+  uint32_t causes = 0;
+  if (timeout > 0) {
+    unsigned long sleptFrom = micros();
+    causes = waitForWake(timeout);
+    idleStats.idleUs += micros() - sleptFrom;
+    if (causes == 0) {
+      idleStats.timer++;
+    }
+  }
+  if (causes & WAKE_GPIO) {
+    idleStats.gpio++;
+  }
+  if (causes & WAKE_NETWORK) {
+    idleStats.network++;
+  }
+  if (causes & WAKE_WIFI) {
+    idleStats.wifi++;
+  }
+  if (causes & WAKE_EVENT) {
+    idleStats.event++;
+  }
+  if (causes & WAKE_SERIAL) {
+    idleStats.serial++;
+  }
+
+  passStart = millis();
+  wakeAfterMs = TICKLESS_MAX_IDLE_MS;
+}
+
+unsigned long idlePercent() {
+  unsigned long now = micros();
+  unsigned long period = now - idleStats.sinceUs;
+  unsigned long percent = period > 0 ? (unsigned long)((unsigned long long)idleStats.idleUs * 100 / period) : 0;
+  idleStats.idleUs = 0;
+  idleStats.sinceUs = now;
+  return percent > 100 ? 100 : percent;
+}
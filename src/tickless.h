@@ -0,0 +1,73 @@
+/*
+   Sterilizer puzzle - tickless main loop
+
+   Instead of spinning, loop() ends in ticklessWait(), which blocks the loop
+   task on its FreeRTOS task notification until something wakes it or the
+   earliest deadline asked for with wakeWithin() comes round. Wakers:
+
+     WAKE_GPIO      the rotary switch changing (pin interrupt)
+     WAKE_NETWORK   data arriving on the MQTT socket (a watcher task
+                    blocked in select(), moved to the new socket by
+                    ticklessSocketChanged() on a reconnect), or from
+                    esp-mqtt's task (transport.h)
+     WAKE_WIFI      WiFi connecting or dropping (WiFi.onEvent)
+     WAKE_EVENT     an event posted on the event bus, from any task or ISR
+     WAKE_SERIAL    bytes arriving for the serial console (Serial.onReceive)
+     WAKE_TIMER     the deadline passing
+
+   Modules that have work pending call wakeWithin(0); modules with a timer
+   call wakeWithin() with the time left. The loop never sleeps longer than
+   TICKLESS_MAX_IDLE_MS, which keeps PubSubClient's keepalive and the crash
+   context fresh.
+
+   The counters are published with the stats as
+   "idle passes= idle=<percent> timer= gpio= net= wifi= event= serial=".
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+// Longest the loop sleeps without a wake
+#define TICKLESS_MAX_IDLE_MS 1000
+// Poll interval for waits nothing can wake, such as a script waiting on an input without an interrupt
+#define TICKLESS_POLL_MS 10
+// Time the socket watcher waits before looking again when there is no connection
+#define TICKLESS_SOCKET_RETRY_MS 100
+
+enum WakeCause {
+  WAKE_TIMER   = 1 << 0,
+  WAKE_GPIO    = 1 << 1,
+  WAKE_NETWORK = 1 << 2,
+  WAKE_WIFI    = 1 << 3,
+  WAKE_EVENT   = 1 << 4,
+  WAKE_SERIAL  = 1 << 5,
+};
+
+struct IdleStats {
+  unsigned long passes;
+  unsigned long idleUs;
+  unsigned long sinceUs;  // micros() at the start of the period idleUs covers
+  unsigned long timer;
+  unsigned long gpio;
+  unsigned long network;
+  unsigned long wifi;
+  unsigned long event;
+  unsigned long serial;
+};
+
+extern IdleStats idleStats;
+
+// Call from setup(); attaches the wakers
+void ticklessSetup();
+// The loop must run again within ms
+void wakeWithin(unsigned long ms);
+// Wakes the loop from another task, or from an ISR
+void wakeLoop(WakeCause cause);
+void wakeLoopFromISR(WakeCause cause);
+// The transport has a new socket; the watcher stops waiting on the old one
+void ticklessSocketChanged();
+// Last thing in loop(): sleeps until woken or the next deadline
+void ticklessWait();
+// Percentage of the time since the last call spent asleep, then starts a new period
+unsigned long idlePercent();
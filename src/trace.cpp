@@ -0,0 +1,203 @@
+/*
+   Sterilizer puzzle - event tracing
+*/
+
+#include "trace.h"
+#include "sterilizer.h"
+#include "tickless.h"
+#include "clocksync.h"
+#include <mbedtls/base64.h>
+
+const char traceTopic[] = "ToHost/Sterilizer/trace";
+
+static const char* const traceEventNames[TRACE_EVENT_COUNT] = {
+  "solve",
+  "flames",
+  "sweep",
+  "reset",
+  "led show",
+  "mqtt loop",
+  "relay",
+  "command",
+};
+
+static TraceRecord traceBuffer[TRACE_BUFFER_EVENTS];
+static unsigned int traceNext = 0;     // slot the next record goes in
+static unsigned int traceCount = 0;    // records held, up to TRACE_BUFFER_EVENTS
+static bool traceEnabled = true;
+static bool traceFrozen = false;       // held still while a dump is read
+
+// Progress of a dump over MQTT; -1 when not dumping
+static long dumpOffset = -1;
+
+// The clock when the dump was started, so its times can be put on the host's
+static uint32_t anchorLocal = 0;
+static uint64_t anchorSynced = 0;
+static int32_t anchorDrift = 0;
+
+static void traceRecordAt(unsigned long time, uint8_t kind, TraceEvent event, uint16_t arg) {
+  if (!traceEnabled || traceFrozen) {
+    return;
+  }
+  TraceRecord& record = traceBuffer[traceNext];
+  record.time = time;
+  record.kind = kind;
+  record.event = event;
+  record.arg = arg;
+  traceNext = (traceNext + 1) % TRACE_BUFFER_EVENTS;
+  if (traceCount < TRACE_BUFFER_EVENTS) {
+    traceCount++;
+  }
+}
+
+static void traceRecord(uint8_t kind, TraceEvent event, uint16_t arg) {
+  traceRecordAt(micros(), kind, event, arg);
+}
+
+void traceBegin(TraceEvent event, uint16_t arg) {
+  traceRecord('B', event, arg);
+}
+
+void traceEnd(TraceEvent event, uint16_t arg) {
+  traceRecord('E', event, arg);
+}
+
+void traceInstant(TraceEvent event, uint16_t arg) {
+  traceRecord('I', event, arg);
+}
+
+void traceSpan(TraceEvent event, unsigned long startUs, unsigned long endUs) {
+  traceRecordAt(startUs, 'B', event, 0);
+  traceRecordAt(endUs, 'E', event, 0);
+}
+
+void traceEnable(bool enable) {
+  traceEnabled = enable;
+}
+
+void traceClear() {
+  traceNext = 0;
+  traceCount = 0;
+}
+
+
+// Dump Serialization
+
+static size_t traceHeaderSize() {
+  size_t size = 4 + 2 + 2;
+  for (int i = 0; i < TRACE_EVENT_COUNT; i++) {
+    size += strlen(traceEventNames[i]) + 1;
+  }
+  return size + TRACE_ANCHOR_SIZE + 4;
+}
+
+size_t traceDumpSize() {
+  return traceHeaderSize() + traceCount * 8;
+}
+
+// Byte at a given offset of the dump
+static uint8_t traceDumpByte(size_t offset) {
+  if (offset < 4) {
+    return "STRC"[offset];
+  }
+  offset -= 4;
+  if (offset < 2) {
+    return (TRACE_FORMAT_VERSION >> (8 * offset)) & 0xFF;
+  }
+  offset -= 2;
+  if (offset < 2) {
+    return (TRACE_EVENT_COUNT >> (8 * offset)) & 0xFF;
+  }
+  offset -= 2;
+  for (int i = 0; i < TRACE_EVENT_COUNT; i++) {
+    size_t length = strlen(traceEventNames[i]) + 1;
+    if (offset < length) {
+      return traceEventNames[i][offset];
+    }
+    offset -= length;
+  }
+  if (offset < 4) {
+    return (anchorLocal >> (8 * offset)) & 0xFF;
+  }
+  offset -= 4;
+  if (offset < 8) {
+    return (anchorSynced >> (8 * offset)) & 0xFF;
+  }
+  offset -= 8;
+  if (offset < 4) {
+    return ((uint32_t)anchorDrift >> (8 * offset)) & 0xFF;
+  }
+  offset -= 4;
+  if (offset < 4) {
+    return (traceCount >> (8 * offset)) & 0xFF;
+  }
+  offset -= 4;
+
+  // Records oldest first
+  unsigned int oldest = (traceNext + TRACE_BUFFER_EVENTS - traceCount) % TRACE_BUFFER_EVENTS;
+  const TraceRecord& record = traceBuffer[(oldest + offset / 8) % TRACE_BUFFER_EVENTS];
+  switch (offset % 8) {
+    case 0:  return record.time & 0xFF;
+    case 1:  return (record.time >> 8) & 0xFF;
+    case 2:  return (record.time >> 16) & 0xFF;
+    case 3:  return (record.time >> 24) & 0xFF;
+    case 4:  return record.kind;
+    case 5:  return record.event;
+    case 6:  return record.arg & 0xFF;
+    default: return (record.arg >> 8) & 0xFF;
+  }
+}
+
+size_t traceDumpRead(size_t offset, uint8_t* buffer, size_t length) {
+  if (offset == 0) {
+    anchorLocal = micros();
+    anchorSynced = clockSyncedUs(anchorLocal);
+    anchorDrift = clockDriftPpb();
+  }
+  size_t size = traceDumpSize();
+  size_t count = 0;
+  while (count < length && offset + count < size) {
+    buffer[count] = traceDumpByte(offset + count);
+    count++;
+  }
+  return count;
+}
+
+
+// Dump over MQTT
+
+bool traceDump() {
+  if (dumpOffset >= 0) {
+    return false;
+  }
+  traceFrozen = true;
+  dumpOffset = 0;
+
+  char line[40];
+  snprintf(line, sizeof(line), "trace begin size=%u", (unsigned int)traceDumpSize());
+  MQTTclient.publish(traceTopic, line);
+  return true;
+}
+
+void traceLoop() {
+  if (dumpOffset < 0) {
+    return;
+  }
+  wakeWithin(0);
+  for (int message = 0; message < TRACE_MESSAGES_PER_TICK; message++) {
+    uint8_t chunk[TRACE_CHUNK];
+    size_t length = traceDumpRead(dumpOffset, chunk, sizeof(chunk));
+    if (length == 0) {
+      MQTTclient.publish(traceTopic, "trace end");
+      dumpOffset = -1;
+      traceFrozen = false;
+      return;
+    }
+    char line[24 + (TRACE_CHUNK + 2) / 3 * 4 + 1];
+    int used = snprintf(line, sizeof(line), "trace %ld ", dumpOffset);
+    size_t encoded;
+    mbedtls_base64_encode((unsigned char*)line + used, sizeof(line) - used, &encoded, chunk, length);
+    MQTTclient.publish(traceTopic, line);
+    dumpOffset += length;
+  }
+}
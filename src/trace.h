@@ -0,0 +1,81 @@
+/*
+   Sterilizer puzzle - event tracing
+
+   Begin, end and instant events are recorded with their micros() time in a
+   fixed ring buffer of TRACE_BUFFER_EVENTS records, so the most recent few
+   seconds of the solve sequence, LED frames, MQTT servicing and relay
+   writes can be lined up on one timeline.
+
+   The dump format is the same on the device and in the native simulator:
+
+     "STRC", uint16 version, uint16 name count, the event names as
+     NUL-terminated strings, the clock anchor, uint32 record count, then
+     the records, each uint32 time (us), uint8 kind ('B', 'E' or 'I'),
+     uint8 event, uint16 arg
+
+   all little-endian. The clock anchor is the clock when the dump was
+   started: uint32 micros(), uint64 the synchronized time of that micros()
+   in Unix microseconds (0 if the clock is not synchronized) and int32 the
+   drift in ppb (clocksync.h), so that record times can be put on the
+   host's clock and traces from several props lined up. Over MQTT the "trace" command controls it:
+
+     trace on | off | clear
+     trace dump    publish the dump on ToHost/Sterilizer/trace as
+                   "trace begin size=<bytes>", "trace <offset> <base64>"...,
+                   "trace end"
+
+   tools/trace2chrome.py converts a dump to Chrome trace JSON, which
+   chrome://tracing and ui.perfetto.dev can open.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+
+#define TRACE_BUFFER_EVENTS 1024
+#define TRACE_FORMAT_VERSION 2
+// micros(), synchronized time and drift, after the event names
+#define TRACE_ANCHOR_SIZE 16
+// MQTT servicing shorter than this is not traced, or it would fill the buffer
+#define TRACE_MIN_MQTT_LOOP_US 200
+// Bytes of dump per "trace" message
+#define TRACE_CHUNK 120
+// Dump messages published per pass of loop()
+#define TRACE_MESSAGES_PER_TICK 4
+
+// Traced events; keep traceEventNames in trace.cpp in the same order
+enum TraceEvent {
+  TRACE_SOLVE,        // onSolve()
+  TRACE_SOLVE_FLAMES, // flames on, waiting before the pump
+  TRACE_SOLVE_SWEEP,  // one blue sweep, arg = sweep number
+  TRACE_RESET,        // onReset()
+  TRACE_LED_SHOW,     // FastLED.show()
+  TRACE_MQTT_LOOP,    // MQTTclient.loop()
+  TRACE_RELAY,        // relay write, arg = pin << 8 | level
+  TRACE_COMMAND,      // a queued command running, arg = command table index
+  TRACE_EVENT_COUNT
+};
+
+struct TraceRecord {
+  uint32_t time;
+  uint8_t kind;
+  uint8_t event;
+  uint16_t arg;
+};
+
+extern const char traceTopic[];
+
+void traceBegin(TraceEvent event, uint16_t arg = 0);
+void traceEnd(TraceEvent event, uint16_t arg = 0);
+void traceInstant(TraceEvent event, uint16_t arg = 0);
+// Records a begin/end pair for a span that has already finished
+void traceSpan(TraceEvent event, unsigned long startUs, unsigned long endUs);
+void traceEnable(bool enable);
+void traceClear();
+
+// Serialized dump of the buffer. Recording pauses while a dump is taken.
+size_t traceDumpSize();
+size_t traceDumpRead(size_t offset, uint8_t* buffer, size_t length);
+
+bool traceDump();
+void traceLoop();
@@ -0,0 +1,23 @@
+/*
+   Sterilizer puzzle - MQTT transport
+
+   What the backends share: the counters and their stats line.
+*/
+
+#include "transport.h"
+#include "telemetry.h"
+
+TransportStats transportStats;
+
+void publishTransportStats() {
+  char line[160];
+  snprintf(line, sizeof(line), "transport name=%s rx=%lu tx=%lu fail=%lu acked=%lu dropped=%lu connects=%lu",
+           MQTTclient.name(), transportStats.received, transportStats.published, transportStats.failed,
+           transportStats.acked, transportStats.dropped, transportStats.connects);
+  publishStatsLine(line);
+  if (latencyCount(transportStats.publish) > 0) {
+    int used = snprintf(line, sizeof(line), "transport publish ");
+    formatLatency(line + used, sizeof(line) - used, transportStats.publish);
+    publishStatsLine(line);
+  }
+}
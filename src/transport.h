@@ -0,0 +1,99 @@
+/*
+   Sterilizer puzzle - MQTT transport
+
+   Everything the sketch says or hears over MQTT goes through MQTTclient,
+   an MqttTransport. Two backends implement it; the build picks one:
+
+     pubsub    PubSubClient (transport_pubsub.cpp), the default. Pumped
+               from loop(): MQTTclient.loop() reads at most one packet
+               from the socket and publish() writes to it before
+               returning. QoS 0 out, QoS 0 or 1 in.
+     esp-mqtt  ESP-IDF's MQTT client (transport_espmqtt.cpp), built with
+               -DMQTT_TRANSPORT_ESP_MQTT ([env:nodemcu-32s-espmqtt]). Runs
+               in its own task and reconnects by itself. publish() only
+               puts the message in the client's outbox, which the task
+               sends and, at QoS 1 or 2, resends until the broker
+               acknowledges it, across reconnects. Received messages wait
+               in a ring of MQTT_RX_SLOTS for loop().
+
+   Either way the message callback runs inside MQTTclient.loop(), in the
+   loop task, so the command code never sees another task. receivedUs()
+   is when the message being delivered was read off the network, for the
+   commands' latency stages. The native simulator builds the PubSubClient
+   backend against its stand-in.
+
+   The stats line is
+   "transport name= rx= tx= fail= acked= dropped= connects="
+   with the histogram "transport publish ..." of the time publish() takes,
+   which is the time loop() is held up by each message sent.
+   tools/rtt_probe.py compares the backends: pongs carry mqtt=<name>.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "latency.h"
+
+// QoS of the esp-mqtt backend's publishes and subscriptions
+#ifndef MQTT_QOS
+#define MQTT_QOS 1
+#endif
+// esp-mqtt: received messages that can wait for loop(), and the largest one
+#define MQTT_RX_SLOTS 8
+#define MQTT_RX_TOPIC 48
+#define MQTT_RX_PAYLOAD 256
+// esp-mqtt: topics resubscribed after a reconnect, until unsubscribed
+#define MQTT_MAX_SUBSCRIPTIONS 4
+// esp-mqtt: longest connect() waits for the client's task to connect
+#define MQTT_CONNECT_WAIT_MS 5000
+
+struct TransportStats {
+  unsigned long received;
+  unsigned long published;
+  unsigned long failed;    // publishes refused
+  unsigned long acked;     // QoS 1 and 2 publishes the broker acknowledged
+  unsigned long dropped;   // received messages too big or with no room to wait
+  unsigned long connects;
+  LatencyHistogram publish;
+};
+
+extern TransportStats transportStats;
+
+class MqttTransport {
+public:
+  typedef void (*Callback)(char* topic, byte* payload, unsigned int length);
+
+  virtual ~MqttTransport() {}
+
+  virtual const char* name() = 0;
+  virtual void setServer(const char* host, uint16_t port) = 0;
+  virtual void setCallback(Callback callback) = 0;
+  // Blocks until connected or given up; false on failure, with state() saying why
+  virtual bool connect(const char* clientId) = 0;
+  virtual void disconnect() = 0;
+  virtual bool connected() = 0;
+  virtual bool subscribe(const char* topic) = 0;
+  // Also forgets a topic the backend would subscribe to again after reconnecting
+  virtual bool unsubscribe(const char* topic) = 0;
+  virtual bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) = 0;
+  // Delivers received messages to the callback
+  virtual bool loop() = 0;
+  // True if more messages are waiting for loop()
+  virtual bool pending() = 0;
+  virtual unsigned long receivedUs() = 0;
+  // PubSubClient's state codes; 0 when connected
+  virtual int state() = 0;
+  // The socket to watch for incoming data, or -1 when the backend wakes the loop itself
+  virtual int socket() = 0;
+
+  bool publish(const char* topic, const char* payload, bool retained = false) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), retained);
+  }
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length) {
+    return publish(topic, payload, length, false);
+  }
+};
+
+extern MqttTransport& MQTTclient;
+
+void publishTransportStats();
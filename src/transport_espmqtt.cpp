@@ -0,0 +1,275 @@
+/*
+   Sterilizer puzzle - MQTT transport over ESP-IDF's esp-mqtt
+
+   The client runs in its own task; onEvent() is called there. Received
+   messages cross to the loop task through a single-producer
+   single-consumer ring, as the web panel's acknowledgments do the other
+   way, and the task wakes the loop (WAKE_NETWORK) for each. Written
+   against the IDF 4.4 configuration the Arduino core 2.x ships.
+*/
+
+#if defined(ESP32) && defined(MQTT_TRANSPORT_ESP_MQTT)
+
+#include "transport.h"
+#include "tickless.h"
+#include "sterilizer.h"
+#include <mqtt_client.h>
+#include <freertos/semphr.h>
+#include <atomic>
+
+#define MQTT_TASK_STACK 4096
+#define MQTT_RECONNECT_MS 2000
+#define MQTT_KEEPALIVE_S 15
+
+// PubSubClient's codes, for state()
+#define STATE_CONNECTED 0
+#define STATE_DISCONNECTED -1
+#define STATE_CONNECT_FAILED -2
+
+// Guards the subscription list, which the loop task changes and the client's task reads on a reconnect
+static portMUX_TYPE subscriptionLock = portMUX_INITIALIZER_UNLOCKED;
+
+struct ReceivedMessage {
+  char topic[MQTT_RX_TOPIC];
+  uint8_t payload[MQTT_RX_PAYLOAD];
+  unsigned int length;
+  unsigned long receivedUs;
+};
+
+class EspMqttTransport : public MqttTransport {
+public:
+  EspMqttTransport() : client(NULL), started(false), port(1883), userCallback(NULL), isConnected(false),
+                       lastState(STATE_DISCONNECTED), connectedSignal(NULL), subscriptions(0), head(0), tail(0),
+                       deliveringUs(0) {
+    host[0] = '\0';
+  }
+
+  using MqttTransport::publish;
+
+  const char* name() {
+    return "esp-mqtt";
+  }
+  void setServer(const char* host, uint16_t port) {
+    strncpy(this->host, host, HOST_SIZE - 1);
+    this->host[HOST_SIZE - 1] = '\0';
+    this->port = port;
+  }
+  void setCallback(Callback callback) {
+    userCallback = callback;
+  }
+
+  bool connect(const char* clientId) {
+    if (client == NULL) {
+      connectedSignal = xSemaphoreCreateBinary();
+      snprintf(uri, sizeof(uri), "mqtt://%s:%u", host, port);
+      esp_mqtt_client_config_t config = {};
+      config.uri = uri;
+      config.client_id = clientId;
+      config.keepalive = MQTT_KEEPALIVE_S;
+      config.reconnect_timeout_ms = MQTT_RECONNECT_MS;
+      config.task_stack = MQTT_TASK_STACK;
+      config.buffer_size = MQTT_RX_PAYLOAD + MQTT_RX_TOPIC + 8;
+      client = esp_mqtt_client_init(&config);
+      if (client == NULL) {
+        lastState = STATE_CONNECT_FAILED;
+        return false;
+      }
+      esp_mqtt_client_register_event(client, MQTT_EVENT_ANY, onEvent, this);
+    }
+    if (!started) {
+      xSemaphoreTake(connectedSignal, 0);
+      if (esp_mqtt_client_start(client) != ESP_OK) {
+        lastState = STATE_CONNECT_FAILED;
+        return false;
+      }
+      started = true;
+    }
+    // The task connects, and reconnects, by itself; wait as PubSubClient's connect() would
+    if (!isConnected) {
+      xSemaphoreTake(connectedSignal, pdMS_TO_TICKS(MQTT_CONNECT_WAIT_MS));
+    }
+    return isConnected;
+  }
+
+  void disconnect() {
+    if (started) {
+      esp_mqtt_client_stop(client);
+      started = false;
+    }
+    isConnected = false;
+    lastState = STATE_DISCONNECTED;
+  }
+
+  bool connected() {
+    return isConnected;
+  }
+
+  bool subscribe(const char* topic) {
+    // Remembered, so that the task can subscribe again after reconnecting
+    bool known = false;
+    portENTER_CRITICAL(&subscriptionLock);
+    for (int i = 0; i < subscriptions; i++) {
+      known = known || strcmp(subscribed[i], topic) == 0;
+    }
+    bool full = !known && subscriptions == MQTT_MAX_SUBSCRIPTIONS;
+    if (!known && !full) {
+      strncpy(subscribed[subscriptions], topic, MQTT_RX_TOPIC - 1);
+      subscribed[subscriptions][MQTT_RX_TOPIC - 1] = '\0';
+      subscriptions++;
+    }
+    portEXIT_CRITICAL(&subscriptionLock);
+    if (full) {
+      return false;
+    }
+    return isConnected && esp_mqtt_client_subscribe(client, topic, MQTT_QOS) >= 0;
+  }
+
+  bool unsubscribe(const char* topic) {
+    // A temporary subscription, such as sleep.cpp's wake topic, must not come back on the next connect
+    portENTER_CRITICAL(&subscriptionLock);
+    for (int i = 0; i < subscriptions; i++) {
+      if (strcmp(subscribed[i], topic) == 0) {
+        subscriptions--;
+        memmove(subscribed[i], subscribed[subscriptions], MQTT_RX_TOPIC);
+        break;
+      }
+    }
+    portEXIT_CRITICAL(&subscriptionLock);
+    return isConnected && esp_mqtt_client_unsubscribe(client, topic) >= 0;
+  }
+
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    // At QoS 0 there is nothing to resend, so nothing is kept while offline
+    if (client == NULL || (MQTT_QOS == 0 && !isConnected)) {
+      transportStats.failed++;
+      return false;
+    }
+    unsigned long start = micros();
+    // Into the outbox for the task to send; loop() never waits on the socket
+    int id = esp_mqtt_client_enqueue(client, topic, (const char*)payload, length, MQTT_QOS, retained, true);
+    recordLatency(transportStats.publish, micros() - start);
+    if (id < 0) {
+      transportStats.failed++;
+      return false;
+    }
+    transportStats.published++;
+    return true;
+  }
+
+  bool loop() {
+    // Everything waiting, each message delivered from its slot
+    unsigned int at = tail.load(std::memory_order_relaxed);
+    while (at != head.load(std::memory_order_acquire)) {
+      ReceivedMessage& message = ring[at % MQTT_RX_SLOTS];
+      deliveringUs = message.receivedUs;
+      if (userCallback != NULL) {
+        userCallback(message.topic, message.payload, message.length);
+      }
+      at++;
+      tail.store(at, std::memory_order_release);
+    }
+    return isConnected;
+  }
+
+  bool pending() {
+    return tail.load(std::memory_order_relaxed) != head.load(std::memory_order_acquire);
+  }
+  unsigned long receivedUs() {
+    return deliveringUs;
+  }
+  int state() {
+    return isConnected ? STATE_CONNECTED : lastState;
+  }
+  int socket() {
+    return -1;
+  }
+
+private:
+  // The client's task
+  static void onEvent(void* handlerArgs, esp_event_base_t base, int32_t id, void* data) {
+    EspMqttTransport* self = (EspMqttTransport*)handlerArgs;
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)data;
+    switch ((esp_mqtt_event_id_t)id) {
+      case MQTT_EVENT_CONNECTED:
+        self->resubscribe();
+        self->isConnected = true;
+        transportStats.connects++;
+        xSemaphoreGive(self->connectedSignal);
+        wakeLoop(WAKE_NETWORK);
+        break;
+      case MQTT_EVENT_DISCONNECTED:
+        self->isConnected = false;
+        self->lastState = STATE_DISCONNECTED;
+        wakeLoop(WAKE_NETWORK);
+        break;
+      case MQTT_EVENT_ERROR:
+        self->lastState = STATE_CONNECT_FAILED;
+        break;
+      case MQTT_EVENT_PUBLISHED:
+        transportStats.acked++;
+        break;
+      case MQTT_EVENT_DATA:
+        self->received(event);
+        break;
+      default:
+        break;
+    }
+  }
+
+  void resubscribe() {
+    // A copy, as the loop task may change the list meanwhile; esp-mqtt is not called with the lock held
+    char topics[MQTT_MAX_SUBSCRIPTIONS][MQTT_RX_TOPIC];
+    portENTER_CRITICAL(&subscriptionLock);
+    int count = subscriptions;
+    memcpy(topics, subscribed, sizeof(topics));
+    portEXIT_CRITICAL(&subscriptionLock);
+    for (int i = 0; i < count; i++) {
+      esp_mqtt_client_subscribe(client, topics[i], MQTT_QOS);
+    }
+  }
+
+  void received(esp_mqtt_event_handle_t event) {
+    unsigned long now = micros();
+    // A message bigger than the client's buffer comes in pieces; like PubSubClient, drop it
+    if (event->current_data_offset != 0) {
+      return;
+    }
+    unsigned int at = head.load(std::memory_order_relaxed);
+    if (event->total_data_len != event->data_len || event->data_len > MQTT_RX_PAYLOAD ||
+        event->topic_len >= MQTT_RX_TOPIC || at - tail.load(std::memory_order_acquire) >= MQTT_RX_SLOTS) {
+      transportStats.dropped++;
+      return;
+    }
+    ReceivedMessage& message = ring[at % MQTT_RX_SLOTS];
+    memcpy(message.topic, event->topic, event->topic_len);
+    message.topic[event->topic_len] = '\0';
+    memcpy(message.payload, event->data, event->data_len);
+    message.length = event->data_len;
+    message.receivedUs = now;
+    head.store(at + 1, std::memory_order_release);
+    transportStats.received++;
+    wakeLoop(WAKE_NETWORK);
+  }
+
+  esp_mqtt_client_handle_t client;
+  bool started;
+  char host[HOST_SIZE];
+  uint16_t port;
+  char uri[HOST_SIZE + 16];
+  Callback userCallback;
+  volatile bool isConnected;
+  volatile int lastState;
+  SemaphoreHandle_t connectedSignal;
+  char subscribed[MQTT_MAX_SUBSCRIPTIONS][MQTT_RX_TOPIC];
+  int subscriptions;
+  // Only the client's task moves head and only the loop task tail
+  ReceivedMessage ring[MQTT_RX_SLOTS];
+  std::atomic<unsigned int> head;
+  std::atomic<unsigned int> tail;
+  unsigned long deliveringUs;
+};
+
+static EspMqttTransport espMqttTransport;
+MqttTransport& MQTTclient = espMqttTransport;
+
+#endif
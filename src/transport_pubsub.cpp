@@ -0,0 +1,103 @@
+/*
+   Sterilizer puzzle - MQTT transport over PubSubClient
+
+   The default backend. Everything happens in the calling task: loop()
+   reads the socket, publish() writes it.
+*/
+
+#ifndef MQTT_TRANSPORT_ESP_MQTT
+
+#include "transport.h"
+#include "tickless.h"
+#include <WiFi.h>
+#include <PubSubClient.h>
+
+class PubSubTransport : public MqttTransport {
+public:
+  PubSubTransport() : client(wifiClient), readUs(0) {}
+
+  using MqttTransport::publish;
+
+  const char* name() {
+    return "pubsub";
+  }
+  void setServer(const char* host, uint16_t port) {
+    client.setServer(host, port);
+  }
+  void setCallback(Callback callback) {
+    userCallback = callback;
+    client.setCallback(received);
+  }
+  bool connect(const char* clientId) {
+    if (!client.connect(clientId)) {
+      return false;
+    }
+    transportStats.connects++;
+    ticklessSocketChanged();
+    return true;
+  }
+  void disconnect() {
+    client.disconnect();
+  }
+  bool connected() {
+    return client.connected();
+  }
+  bool subscribe(const char* topic) {
+    return client.subscribe(topic);
+  }
+  bool unsubscribe(const char* topic) {
+    return client.unsubscribe(topic);
+  }
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    unsigned long start = micros();
+    bool sent = client.publish(topic, payload, length, retained);
+    recordLatency(transportStats.publish, micros() - start);
+    if (sent) {
+      transportStats.published++;
+    }
+    else {
+      transportStats.failed++;
+    }
+    return sent;
+  }
+  bool loop() {
+    // Any message handled by this loop() is read off the socket now
+    readUs = micros();
+    return client.loop();
+  }
+  bool pending() {
+    // PubSubClient reads one packet per call; the socket watcher cannot see what is already buffered
+    return wifiClient.available() > 0;
+  }
+  unsigned long receivedUs() {
+    return readUs;
+  }
+  int state() {
+    return client.state();
+  }
+  int socket() {
+#ifdef ESP32
+    return wifiClient.fd();
+#else
+    return -1;
+#endif
+  }
+
+private:
+  static void received(char* topic, uint8_t* payload, unsigned int length) {
+    transportStats.received++;
+    userCallback(topic, payload, length);
+  }
+
+  static Callback userCallback;
+  WiFiClient wifiClient;
+  PubSubClient client;
+  unsigned long readUs;
+};
+
+MqttTransport::Callback PubSubTransport::userCallback = NULL;
+
+static PubSubTransport pubSubTransport;
+MqttTransport& MQTTclient = pubSubTransport;
+
+#endif
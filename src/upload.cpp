@@ -0,0 +1,427 @@
+/*
+   Sterilizer puzzle - chunked uploads
+
+   Runs inside mqttCallback(), on PubSubClient's buffer. Every chunk is
+   written or parsed before anything is published, as publishing reuses
+   that buffer.
+*/
+
+#include "upload.h"
+#include "sterilizer.h"
+#include "config.h"
+#include "telemetry.h"
+#include <LittleFS.h>
+#include <stdarg.h>
+
+// A config line: a key and a value that fits a setting
+#define UPLOAD_LINE_LENGTH (CONFIG_VALUE_SIZE + 16)
+// Longest "upload ..." message, without the "upload "
+#define UPLOAD_COMMAND_LENGTH (UPLOAD_MAX_PATH + 40)
+
+struct UploadSession {
+  bool active;
+  bool config;
+  char target[UPLOAD_MAX_PATH + 1];
+  unsigned long size;
+  uint32_t crc;             // as announced
+  uint32_t runningCrc;      // of the bytes written so far
+  unsigned long received;
+  unsigned long next;       // sequence number wanted next
+  unsigned long sentBack;   // last place the host was sent back to, so that a gap is reported once
+  unsigned long chunks;
+  unsigned long resent;
+  unsigned long resumes;
+  unsigned long startMs;
+  unsigned long heapLow;
+  File file;
+  // Config: the line being parsed
+  char line[UPLOAD_LINE_LENGTH + 1];
+  unsigned int lineLength;
+};
+
+static UploadSession session;
+static bool filesMounted = false;
+
+UploadStats uploadStats;
+
+
+// CRC-32 (IEEE, as zlib), a nibble at a time
+static const uint32_t crcNibbles[16] = {
+  0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+  0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+static uint32_t updateCrc(uint32_t crc, const byte* data, unsigned int length) {
+  crc = ~crc;
+  for (unsigned int i = 0; i < length; i++) {
+    crc = crcNibbles[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+    crc = crcNibbles[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+  }
+  return ~crc;
+}
+
+
+// Replies
+static void reply(const char* format, ...) __attribute__((format(printf, 1, 2)));
+static void reply(const char* format, ...) {
+  char text[160];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  MQTTclient.publish(hostTopic, text);
+}
+
+// A resend asks the host to go back; a plain next= only confirms progress
+static void replyNext(bool resend) {
+  if (resend) {
+    session.sentBack = session.next;
+  }
+  reply(resend ? "upload resend=%lu" : "upload next=%lu", session.next);
+}
+
+static void partPath(char* path, size_t size) {
+  snprintf(path, size, "%s.part", session.target);
+}
+
+// Ends the session, throwing away whatever it wrote
+static void discardSession() {
+  if (session.config) {
+    configDiscardStaged();
+  }
+  else {
+    session.file.close();
+    char path[UPLOAD_MAX_PATH + 6];
+    partPath(path, sizeof(path));
+    LittleFS.remove(path);
+  }
+  session.active = false;
+}
+
+static void failUpload(const char* target, const char* reason) {
+  uploadStats.failed++;
+  reply("upload failed %s %s", target, reason);
+}
+
+static void failSession(const char* reason) {
+  char target[UPLOAD_MAX_PATH + 1];
+  strcpy(target, session.target);
+  discardSession();
+  failUpload(target, reason);
+}
+
+
+// Destinations
+static bool validTarget(const char* target) {
+  if (strcmp(target, "config") == 0) {
+    return true;
+  }
+  size_t length = strlen(target);
+  if (target[0] != '/' || length < 2 || length > UPLOAD_MAX_PATH || strstr(target, "..") != NULL ||
+      target[length - 1] == '/') {
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    if (target[i] <= ' ' || target[i] >= 0x7F) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Stages one "<setting> <value>" line; blank lines and # comments are skipped
+static bool stageConfigLine() {
+  char* text = session.line;
+  text[session.lineLength] = '\0';
+  session.lineLength = 0;
+  while (*text == ' ') {
+    text++;
+  }
+  size_t length = strlen(text);
+  while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\r')) {
+    text[--length] = '\0';
+  }
+  if (text[0] == '\0' || text[0] == '#') {
+    return true;
+  }
+  char* value = strchr(text, ' ');
+  if (value == NULL) {
+    return false;
+  }
+  *value++ = '\0';
+  return configStage(text, value);
+}
+
+static bool parseConfig(const byte* data, unsigned int length) {
+  for (unsigned int i = 0; i < length; i++) {
+    if (data[i] == '\n') {
+      if (!stageConfigLine()) {
+        return false;
+      }
+    }
+    else if (session.lineLength < UPLOAD_LINE_LENGTH) {
+      session.line[session.lineLength++] = data[i];
+    }
+    else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool writeFile(const byte* data, unsigned int length) {
+  unsigned long start = micros();
+  size_t written = session.file.write(data, length);
+  recordLatency(uploadStats.write, micros() - start);
+  return written == length;
+}
+
+static void finishUpload() {
+  if (session.runningCrc != session.crc) {
+    failSession("crc");
+    return;
+  }
+  if (session.config) {
+    // The last line need not end in a newline
+    if (session.lineLength > 0 && !stageConfigLine()) {
+      failSession("config");
+      return;
+    }
+    configCommitStaged();
+  }
+  else {
+    session.file.close();
+    char path[UPLOAD_MAX_PATH + 6];
+    partPath(path, sizeof(path));
+    if (LittleFS.exists(session.target)) {
+      LittleFS.remove(session.target);
+    }
+    if (!LittleFS.rename(path, session.target)) {
+      failSession("rename");
+      return;
+    }
+  }
+  session.active = false;
+  uploadStats.done++;
+
+  unsigned long ms = millis() - session.startMs;
+  unsigned long rate = session.size * 1000UL / (ms > 0 ? ms : 1);
+#ifdef ESP32
+  reply("upload done %s bytes=%lu chunks=%lu resent=%lu resumes=%lu ms=%lu rate=%lu ram=%u heap=%lu", session.target,
+        session.size, session.chunks, session.resent, session.resumes, ms, rate, (unsigned)sizeof(session),
+        session.heapLow);
+#else
+  reply("upload done %s bytes=%lu chunks=%lu resent=%lu resumes=%lu ms=%lu rate=%lu ram=%u", session.target,
+        session.size, session.chunks, session.resent, session.resumes, ms, rate, (unsigned)sizeof(session));
+#endif
+}
+
+
+// Messages
+static void beginUpload(const char* args) {
+  char words[UPLOAD_COMMAND_LENGTH + 1];
+  strcpy(words, args);
+  const char* target = strtok(words, " ");
+  const char* sizeText = strtok(NULL, " ");
+  const char* crcText = strtok(NULL, " ");
+  if (target == NULL || sizeText == NULL || crcText == NULL || strtok(NULL, " ") != NULL) {
+    failUpload(target != NULL ? target : "-", "invalid");
+    return;
+  }
+  char* end;
+  unsigned long size = strtoul(sizeText, &end, 10);
+  if (end == sizeText || *end != '\0') {
+    failUpload(target, "invalid");
+    return;
+  }
+  uint32_t crc = strtoul(crcText, &end, 16);
+  if (end == crcText || *end != '\0') {
+    failUpload(target, "invalid");
+    return;
+  }
+  if (!validTarget(target)) {
+    failUpload(target, "target");
+    return;
+  }
+
+  // The same upload again is a host coming back after losing the connection
+  if (session.active && strcmp(session.target, target) == 0 && session.size == size && session.crc == crc) {
+    session.resumes++;
+    uploadStats.resumed++;
+    session.sentBack = session.next;
+    reply("upload ready %s next=%lu chunk=%d", session.target, session.next, UPLOAD_CHUNK_SIZE);
+    return;
+  }
+  // Anything else replaces the upload under way
+  if (session.active) {
+    discardSession();
+  }
+
+  bool config = strcmp(target, "config") == 0;
+  if (size == 0 || (config && size > UPLOAD_CONFIG_SIZE)) {
+    failUpload(target, "size");
+    return;
+  }
+  strcpy(session.target, target);
+  session.config = config;
+  if (!config) {
+    if (!filesMounted) {
+      failUpload(target, "nofs");
+      return;
+    }
+    char path[UPLOAD_MAX_PATH + 6];
+    partPath(path, sizeof(path));
+    session.file = LittleFS.open(path, "w");
+    if (!session.file) {
+      failUpload(target, "open");
+      return;
+    }
+  }
+  else {
+    configDiscardStaged();
+    session.lineLength = 0;
+  }
+  session.active = true;
+  session.size = size;
+  session.crc = crc;
+  session.runningCrc = 0;
+  session.received = 0;
+  session.next = 0;
+  session.sentBack = 0;
+  session.chunks = 0;
+  session.resent = 0;
+  session.resumes = 0;
+  session.startMs = millis();
+#ifdef ESP32
+  session.heapLow = ESP.getFreeHeap();
+#endif
+  uploadStats.started++;
+  reply("upload ready %s next=0 chunk=%d", session.target, UPLOAD_CHUNK_SIZE);
+}
+
+static void receiveChunk(const byte* message, unsigned int length) {
+  // "chunk <seq> <data>"
+  unsigned int position = 6;
+  unsigned long seq = 0;
+  while (position < length && isdigit(message[position])) {
+    seq = seq * 10 + (message[position] - '0');
+    position++;
+  }
+  if (position == 6 || position >= length || message[position] != ' ') {
+    if (session.active) {
+      failSession("invalid");
+    }
+    else {
+      failUpload("-", "invalid");
+    }
+    return;
+  }
+  const byte* data = message + position + 1;
+  unsigned int dataLength = length - position - 1;
+
+  if (!session.active) {
+    reply("upload idle");
+    return;
+  }
+  if (seq != session.next) {
+    session.resent++;
+    uploadStats.resent++;
+    if (session.sentBack != session.next) {
+      replyNext(true);
+    }
+    return;
+  }
+  // Every chunk but the last is full, so that a chunk's place follows from its number
+  unsigned long left = session.size - session.received;
+  if (dataLength == 0 || dataLength > left || (dataLength < left && dataLength != UPLOAD_CHUNK_SIZE)) {
+    failSession("size");
+    return;
+  }
+
+  bool stored = session.config ? parseConfig(data, dataLength) : writeFile(data, dataLength);
+  if (!stored) {
+    failSession(session.config ? "config" : "write");
+    return;
+  }
+  session.runningCrc = updateCrc(session.runningCrc, data, dataLength);
+  session.received += dataLength;
+  session.next++;
+  session.chunks++;
+  uploadStats.chunks++;
+  uploadStats.bytes += dataLength;
+#ifdef ESP32
+  unsigned long heap = ESP.getFreeHeap();
+  if (heap < session.heapLow) {
+    session.heapLow = heap;
+  }
+#endif
+
+  if (session.received == session.size) {
+    finishUpload();
+  }
+  else if (session.next % UPLOAD_ACK_EVERY == 0) {
+    replyNext(false);
+  }
+}
+
+bool uploadMessage(const byte* message, unsigned int length) {
+  if (length >= 6 && memcmp(message, "chunk ", 6) == 0) {
+    receiveChunk(message, length);
+    return true;
+  }
+  if (length < 7 || memcmp(message, "upload ", 7) != 0) {
+    return false;
+  }
+
+  char args[UPLOAD_COMMAND_LENGTH + 1];
+  unsigned int argsLength = length - 7;
+  if (argsLength > UPLOAD_COMMAND_LENGTH) {
+    failUpload("-", "invalid");
+    return true;
+  }
+  memcpy(args, message + 7, argsLength);
+  args[argsLength] = '\0';
+
+  if (strncmp(args, "begin ", 6) == 0) {
+    beginUpload(args + 6);
+  }
+  else if (strcmp(args, "status") == 0) {
+    if (session.active) {
+      session.sentBack = session.next;
+      reply("upload ready %s next=%lu chunk=%d", session.target, session.next, UPLOAD_CHUNK_SIZE);
+    }
+    else {
+      reply("upload idle");
+    }
+  }
+  else if (strcmp(args, "abort") == 0) {
+    if (session.active) {
+      failSession("aborted");
+    }
+    else {
+      reply("upload idle");
+    }
+  }
+  else {
+    failUpload("-", "invalid");
+  }
+  return true;
+}
+
+void uploadSetup() {
+  // Already mounted for the web panel when there is a partition; this only checks
+  filesMounted = LittleFS.begin(false);
+}
+
+void publishUploadStats() {
+  char line[160];
+  snprintf(line, sizeof(line), "upload started=%lu done=%lu failed=%lu resumed=%lu chunks=%lu bytes=%lu resent=%lu",
+           uploadStats.started, uploadStats.done, uploadStats.failed, uploadStats.resumed, uploadStats.chunks,
+           uploadStats.bytes, uploadStats.resent);
+  publishStatsLine(line);
+  if (latencyCount(uploadStats.write) > 0) {
+    int used = snprintf(line, sizeof(line), "upload write ");
+    formatLatency(line + used, sizeof(line) - used, uploadStats.write);
+    publishStatsLine(line);
+  }
+}
@@ -0,0 +1,80 @@
+/*
+   Sterilizer puzzle - chunked uploads
+
+   PubSubClient only delivers a message that fits its buffer whole, so
+   anything larger than about 230 bytes sent to ToDevice/Sterilizer is
+   dropped without a word, and a bigger buffer is heap held for good. A
+   file or a batch of settings is sent instead as numbered chunks that
+   each fit the buffer, written to their destination as they arrive:
+
+     upload begin <target> <bytes> <crc32>   start an upload, or resume the
+                                             one with the same target, size
+                                             and CRC (hex, as zlib.crc32)
+     chunk <seq> <data>                      UPLOAD_CHUNK_SIZE raw bytes
+                                             after the space; the last one
+                                             may be shorter
+     upload status                           where the upload is
+     upload abort                            give it up
+
+   A target is a LittleFS path ("/index.html.gz"), written to <path>.part
+   and renamed over the old file once the CRC matches, or "config": lines
+   of "<setting> <value>" (see config.h), each checked as it arrives and
+   all saved together once the CRC matches. A config upload cannot set
+   the WiFi password.
+
+   Answers go to ToHost/Sterilizer:
+
+     upload ready <target> next=<seq> chunk=<bytes>
+     upload next=<seq>                  every UPLOAD_ACK_EVERY chunks
+     upload resend=<seq>                once for a chunk out of order
+     upload done <target> bytes= chunks= resent= resumes= ms= rate=<bytes/s>
+                ram=<bytes> heap=<lowest free bytes, ESP32 only>
+     upload failed <target> <reason>   invalid, target, size, nofs, open,
+                                        write, config, crc, rename, aborted
+     upload idle                        no upload under way
+
+   Chunks are only taken in order, so a host can keep a window of chunks
+   in flight and go back to resend= when told; one that was out of order
+   is dropped. An upload outlives a dropped connection: after reconnecting
+   the host sends the same "upload begin" and carries on from next=. It
+   does not outlive a restart. The upload holds ram= bytes for as long as
+   it runs, whatever its size; heap= shows what the file system took.
+
+   The stats line is
+   "upload started= done= failed= resumed= chunks= bytes= resent="
+   with the histogram "upload write ..." of the time to write a chunk.
+   tools/mqtt_upload.py sends files this way.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "latency.h"
+
+// Data bytes per chunk; with the topic and "chunk <seq> " a chunk fits
+// PubSubClient's default 256-byte buffer
+#define UPLOAD_CHUNK_SIZE 192
+#define UPLOAD_ACK_EVERY 8
+// Longest target path, with room left for ".part"
+#define UPLOAD_MAX_PATH 26
+// Largest config upload
+#define UPLOAD_CONFIG_SIZE 1024
+
+struct UploadStats {
+  unsigned long started;
+  unsigned long done;
+  unsigned long failed;
+  unsigned long resumed;   // begins that picked up an upload under way
+  unsigned long chunks;    // chunks written
+  unsigned long bytes;
+  unsigned long resent;    // chunks out of order or already written
+  LatencyHistogram write;
+};
+
+extern UploadStats uploadStats;
+
+// Call from setup()
+void uploadSetup();
+// Handles an upload message; false for any other message
+bool uploadMessage(const byte* message, unsigned int length);
+void publishUploadStats();
@@ -0,0 +1,179 @@
+/*
+   Sterilizer puzzle - web control panel
+
+   Everything here but webPushAck() runs on the HTTP server's task (from
+   httpLoop() in the native simulator). Acknowledgments cross from loop()
+   through a single-producer single-consumer ring; state comes from the
+   /state snapshots of http.cpp, and commands go the other way on the
+   event bus.
+*/
+
+#include "web.h"
+#include "http.h"
+#include "sterilizer.h"
+#include "telemetry.h"
+#include "events.h"
+#include <WebServer.h>
+#include <WebSocketsServer.h>
+#include <LittleFS.h>
+#include <atomic>
+
+static WebSocketsServer sockets(WEB_SOCKET_PORT);
+static bool filesMounted = false;
+
+// Acknowledgments from loop(); only loop() moves ackHead and only the server task ackTail
+static char ackRing[WEB_ACK_SLOTS][WEB_ACK_LENGTH];
+static std::atomic<unsigned int> ackHead(0);
+static std::atomic<unsigned int> ackTail(0);
+
+// The /state snapshot last pushed, and the buffer pushes are copied into
+static unsigned long pushedVersion = 0;
+static char stateText[HTTP_STATE_SIZE];
+
+WebStats webStats;
+
+struct ContentType {
+  const char* extension;
+  const char* type;
+};
+
+static const ContentType contentTypes[] = {
+  { ".html", "text/html" },
+  { ".js",   "application/javascript" },
+  { ".css",  "text/css" },
+  { ".svg",  "image/svg+xml" },
+  { ".ico",  "image/x-icon" },
+  { ".json", "application/json" },
+};
+static const int NUM_CONTENT_TYPES = sizeof(contentTypes) / sizeof(contentTypes[0]);
+
+
+// Files
+static const char* contentType(const char* path) {
+  size_t length = strlen(path);
+  for (int i = 0; i < NUM_CONTENT_TYPES; i++) {
+    size_t extension = strlen(contentTypes[i].extension);
+    if (length > extension && strcmp(path + length - extension, contentTypes[i].extension) == 0) {
+      return contentTypes[i].type;
+    }
+  }
+  return NULL;
+}
+
+bool webServeAsset(WebServer& server) {
+  unsigned long start = micros();
+  auto uri = server.uri();
+  const char* name = strcmp(uri.c_str(), "/") == 0 ? "/index.html" : uri.c_str();
+  const char* type = contentType(name);
+  if (!filesMounted || type == NULL || strlen(name) > WEB_MAX_PATH) {
+    return false;
+  }
+
+  // Only the compressed copy is stored; streamFile() adds the Content-Encoding for a .gz name
+  char path[WEB_MAX_PATH + 4];
+  snprintf(path, sizeof(path), "%s.gz", name);
+  if (!LittleFS.exists(path)) {
+    webStats.missing++;
+    return false;
+  }
+  File file = LittleFS.open(path, "r");
+  if (!file) {
+    webStats.missing++;
+    return false;
+  }
+  size_t sent = server.streamFile(file, type);
+  file.close();
+
+  webStats.assets++;
+  webStats.assetBytes += sent;
+  recordLatency(webStats.asset, micros() - start);
+  return true;
+}
+
+
+// WebSocket
+static void pushState(int client) {
+  size_t length = httpCopyState(stateText, sizeof(stateText));
+  if (client < 0) {
+    sockets.broadcastTXT(stateText, length);
+  }
+  else {
+    sockets.sendTXT(client, stateText, length);
+  }
+  webStats.pushes++;
+}
+
+static void onSocketEvent(uint8_t client, WStype_t type, uint8_t* payload, size_t length) {
+  if (type == WStype_CONNECTED) {
+    webStats.sockets++;
+    // A new panel starts from the current state rather than a blank page
+    pushState(client);
+  }
+  else if (type == WStype_TEXT) {
+    webStats.commands++;
+    if (!postCommand(WEB_SOURCE, (const char*)payload, length, micros())) {
+      webStats.dropped++;
+    }
+  }
+}
+
+void webSetup() {
+  filesMounted = LittleFS.begin(false);
+  if (!filesMounted) {
+    Serial.println("No LittleFS partition; the web panel needs pio run -t uploadfs");
+  }
+  sockets.onEvent(onSocketEvent);
+  sockets.begin();
+}
+
+void webServe() {
+  sockets.loop();
+  webStats.clients = sockets.connectedClients();
+  if (webStats.clients > 0) {
+    httpKeepFresh();
+    unsigned long version = httpStateVersion();
+    if (version != pushedVersion) {
+      pushedVersion = version;
+      pushState(-1);
+    }
+  }
+  else {
+    // The first panel to open is sent the state when it connects
+    pushedVersion = httpStateVersion();
+  }
+
+  // Drained even with no panel open, so a panel opened later does not get old news
+  unsigned int tail = ackTail.load(std::memory_order_relaxed);
+  while (tail != ackHead.load(std::memory_order_acquire)) {
+    if (webStats.clients > 0) {
+      sockets.broadcastTXT(ackRing[tail % WEB_ACK_SLOTS]);
+    }
+    tail++;
+    ackTail.store(tail, std::memory_order_release);
+  }
+}
+
+void webPushAck(const char* ack) {
+  unsigned int head = ackHead.load(std::memory_order_relaxed);
+  if (head - ackTail.load(std::memory_order_acquire) >= WEB_ACK_SLOTS) {
+    webStats.lostAcks++;
+    return;
+  }
+  strncpy(ackRing[head % WEB_ACK_SLOTS], ack, WEB_ACK_LENGTH - 1);
+  ackRing[head % WEB_ACK_SLOTS][WEB_ACK_LENGTH - 1] = '\0';
+  ackHead.store(head + 1, std::memory_order_release);
+}
+
+void publishWebStats() {
+  char line[200];
+  int used = snprintf(line, sizeof(line), "web assets=%lu bytes=%lu missing=%lu clients=%d sockets=%lu commands=%lu "
+                      "dropped=%lu pushes=%lu lost=%lu", webStats.assets, webStats.assetBytes, webStats.missing,
+                      webStats.clients, webStats.sockets, webStats.commands, webStats.dropped, webStats.pushes,
+                      webStats.lostAcks);
+  publishStatsLine(line);
+  if (latencyCount(webStats.asset) > 0) {
+    used = snprintf(line, sizeof(line), "web asset ");
+    formatLatency(line + used, sizeof(line) - used, webStats.asset);
+    publishStatsLine(line);
+  }
+}
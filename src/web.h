@@ -0,0 +1,73 @@
+/*
+   Sterilizer puzzle - web control panel
+
+   A page for running the prop from a phone or laptop when the host
+   software is down: solve, reset, relay test, LED test and the live
+   state. It sits beside the MQTT path, on the server of http.h:
+
+     GET /                 the panel, from the LittleFS partition
+     ws://<prop>:81/       the prop pushes state and acknowledgments; the
+                           panel sends commands
+
+   The panel's files live in web/. web/gzip_assets.py gzips them into
+   data/ before every build of the ESP32 image, and "pio run -t uploadfs"
+   writes data/ to the LittleFS partition. A request for /<name> is
+   answered with /<name>.gz and "Content-Encoding: gzip", streamed from
+   flash by WebServer::streamFile() a socket buffer at a time, never read
+   into RAM whole. index.html carries its own styles and script, so
+   opening the panel is one request.
+
+   Commands from the panel are WebSocket text frames in the MQTT syntax,
+   for example "solve id=w3". The server task hands them to loop() over
+   the event bus, and they take the same queue, priorities and request ID
+   cache as the host's, rate limited as their own topic. Every
+   acknowledgment, the host's commands' too, is pushed to the panel as the
+   same "ack ..." text, and every new /state snapshot as its JSON. While a
+   panel is open loop() keeps the snapshots fresh as for a scrape, so the
+   relays can be watched through a relay test.
+
+   The stats line is
+   "web assets= bytes= missing= clients= sockets= commands= dropped= pushes= lost="
+   with the histogram "web asset ..." of the time to stream a file.
+*/
+
+#pragma once
+
+#include <Arduino.h>
+#include "latency.h"
+
+#define WEB_SOCKET_PORT 81
+// Rate limit name of the panel's commands
+#define WEB_SOURCE "web"
+// Acknowledgments that can wait for the server task
+#define WEB_ACK_SLOTS 8
+#define WEB_ACK_LENGTH 112
+// Longest file name served
+#define WEB_MAX_PATH 32
+
+struct WebStats {
+  unsigned long assets;      // files streamed
+  unsigned long assetBytes;
+  unsigned long missing;     // requests for files that are not there
+  int clients;               // panels open now
+  unsigned long sockets;     // panels opened
+  unsigned long commands;    // frames received
+  unsigned long dropped;     // frames the event bus had no room for
+  unsigned long pushes;      // state snapshots pushed
+  unsigned long lostAcks;    // acknowledgments that found the ring full
+  LatencyHistogram asset;
+};
+
+extern WebStats webStats;
+
+class WebServer;
+
+// Call from httpSetup(), before the server starts
+void webSetup();
+// Call from the server's task: runs the WebSocket server and pushes what is new
+void webServe();
+// Streams the file the request names; false if there is none
+bool webServeAsset(WebServer& server);
+// Queues an acknowledgment for the panels; call from loop()
+void webPushAck(const char* ack);
+void publishWebStats();
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+"""
+Fetch and decode a Sterilizer core dump
+
+Reads the core dump the firmware left in its "coredump" flash partition
+over MQTT, one "coredump read <offset>" request at a time, and saves it
+as a raw core file. Unless --no-decode is given the file is then decoded
+against the firmware's ELF file with espcoredump.py (part of ESP-IDF and
+of PlatformIO's espressif32 tool packages).
+
+Usage:
+  coredump_fetch.py --elf .pio/build/nodemcu-32s/firmware.elf [--broker 10.1.10.55] [--erase]
+
+Requires paho-mqtt (pip install paho-mqtt).
+"""
+
+import argparse
+import base64
+import queue
+import re
+import subprocess
+import sys
+import time
+
+import paho.mqtt.client as mqtt
+
+DEVICE_TOPIC = "ToDevice/Sterilizer"
+CRASH_TOPIC = "ToHost/Sterilizer/crash"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--elf", help="firmware.elf of the build that crashed")
+    parser.add_argument("--broker", default="10.1.10.55")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--output", default="sterilizer.core", help="where to save the raw dump")
+    parser.add_argument("--espcoredump", default="espcoredump.py")
+    parser.add_argument("--retries", type=int, default=5, help="attempts per chunk")
+    parser.add_argument("--timeout", type=float, default=2.0, help="seconds to wait for each chunk")
+    parser.add_argument("--erase", action="store_true", help="erase the dump on the device once saved")
+    parser.add_argument("--no-decode", action="store_true")
+    args = parser.parse_args()
+
+    replies = queue.Queue()
+
+    def on_message(client, userdata, message):
+        replies.put(message.payload.decode(errors="replace"))
+
+    client = mqtt.Client(client_id="CoreDumpFetch")
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.subscribe(CRASH_TOPIC)
+    client.loop_start()
+    time.sleep(0.5)
+
+    # The summary says how big the dump is
+    client.publish(DEVICE_TOPIC, "coredump info")
+    size = None
+    deadline = time.monotonic() + 5
+    while size is None and time.monotonic() < deadline:
+        try:
+            line = replies.get(timeout=0.5)
+        except queue.Empty:
+            continue
+        if line.startswith("crash "):
+            print(line)
+            match = re.search(r"\bsize=(\d+)", line)
+            if not match:
+                sys.exit("the device has no core dump")
+            size = int(match.group(1))
+    if size is None:
+        sys.exit("no reply to coredump info")
+
+    dump = bytearray()
+    started = time.monotonic()
+    while len(dump) < size:
+        offset = len(dump)
+        for attempt in range(args.retries):
+            client.publish(DEVICE_TOPIC, "coredump read %d" % offset)
+            chunk = None
+            deadline = time.monotonic() + args.timeout
+            while chunk is None and time.monotonic() < deadline:
+                try:
+                    words = replies.get(timeout=0.2).split()
+                except queue.Empty:
+                    continue
+                if len(words) == 3 and words[0] == "core" and int(words[1]) == offset:
+                    chunk = base64.b64decode(words[2])
+            if chunk:
+                break
+        else:
+            sys.exit("no reply for offset %d" % offset)
+        dump += chunk
+        print("\r%d / %d bytes" % (len(dump), size), end="", flush=True)
+    print(" in %.1f s" % (time.monotonic() - started))
+
+    with open(args.output, "wb") as output:
+        output.write(dump)
+    print("saved %s" % args.output)
+
+    if args.erase:
+        client.publish(DEVICE_TOPIC, "coredump erase")
+        time.sleep(0.5)
+    client.loop_stop()
+
+    if not args.no_decode:
+        if not args.elf:
+            sys.exit("give --elf to decode the dump")
+        subprocess.run([args.espcoredump, "info_corefile", "--core-format", "raw",
+                        "--core", args.output, args.elf], check=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""
+Compare two simulator event logs
+
+Checks that a new firmware build produces the same relay, LED and publish
+events as a baseline when both replay the same scenario, and that it
+reacts at least as quickly. Each output event's latency is its time since
+the host message, input change or marker it followed. Prints the first
+point where the sequences differ, then the latency change for each kind
+of event. Exits 1 if the sequences differ or any event got slower by more
+than --tolerance ms.
+
+Usage:
+  program --quiet game.txt > baseline.log     (old build)
+  program --quiet game.txt > candidate.log    (new build)
+  event_diff.py baseline.log candidate.log
+
+Use --ignore to leave out events that are expected to differ, for example
+--ignore "pub ToHost/Sterilizer/stats".
+"""
+
+import argparse
+import collections
+import sys
+
+
+def read_log(path, ignore):
+    """Return [(event text, latency ms)] for the output events in a log."""
+    events = []
+    since = 0.0
+    with open(path) as log:
+        for line in log:
+            time_ms, _, event = line.rstrip("\n").partition(" ")
+            try:
+                at = float(time_ms)
+            except ValueError:
+                continue
+            if event.startswith(("host ", "input ", "mark ")):
+                since = at
+                continue
+            if any(event.startswith(prefix) for prefix in ignore):
+                continue
+            events.append((event, at - since))
+    return events
+
+
+def kind(event):
+    """Group events by what they are rather than their exact values."""
+    words = event.split()
+    if words[0] == "pub":
+        return " ".join(words[:2])
+    if words[0] == "gpio":
+        return " ".join(words[:3])
+    return words[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    parser.add_argument("--tolerance", type=float, default=1.0, help="ms an event may get slower")
+    parser.add_argument("--ignore", action="append", default=[], help="event prefix to leave out")
+    args = parser.parse_args()
+
+    baseline = read_log(args.baseline, args.ignore)
+    candidate = read_log(args.candidate, args.ignore)
+    failed = False
+
+    for index, (old, new) in enumerate(zip(baseline, candidate)):
+        if old[0] != new[0]:
+            print("sequences differ at event %d:" % index)
+            print("  baseline:  %s" % old[0])
+            print("  candidate: %s" % new[0])
+            failed = True
+            break
+    else:
+        if len(baseline) != len(candidate):
+            shorter, longer = (baseline, candidate) if len(baseline) < len(candidate) else (candidate, baseline)
+            print("sequences differ in length (%d vs %d), first extra event: %s" %
+                  (len(baseline), len(candidate), longer[len(shorter)][0]))
+            failed = True
+        else:
+            print("same %d events" % len(baseline))
+
+    # Latency only means something where the events line up
+    deltas = collections.defaultdict(list)
+    for old, new in zip(baseline, candidate):
+        if old[0] != new[0]:
+            break
+        deltas[kind(old[0])].append((old[1], new[1]))
+
+    print("%-40s %6s %12s %12s %10s" % ("event", "count", "baseline ms", "candidate ms", "worst +ms"))
+    for name in sorted(deltas):
+        pairs = deltas[name]
+        old_mean = sum(old for old, _ in pairs) / len(pairs)
+        new_mean = sum(new for _, new in pairs) / len(pairs)
+        worst = max(new - old for old, new in pairs)
+        flag = ""
+        if worst > args.tolerance:
+            flag = "  SLOWER"
+            failed = True
+        print("%-40s %6d %12.3f %12.3f %10.3f%s" % (name, len(pairs), old_mean, new_mean, worst, flag))
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
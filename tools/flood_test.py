@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""
+Sterilizer command flood test
+
+Floods ToDevice/Sterilizer with cosmetic commands while sending "reset"
+probes with request IDs, and reports how long the probe acknowledgments
+take to come back. Since reset is a safety command it jumps the device's
+command queue, so the probe latency shows how responsive the puzzle stays
+under the flood. The device's command counters are printed at the end.
+
+Usage: flood_test.py [--broker 10.1.10.55] [--rate 200] [--seconds 10]
+
+Resetting a Running puzzle is a no-op, so run this with the puzzle armed.
+Requires paho-mqtt (pip install paho-mqtt).
+"""
+
+import argparse
+import statistics
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+DEVICE_TOPIC = "ToDevice/Sterilizer"
+HOST_TOPIC = "ToHost/Sterilizer"
+STATS_TOPIC = "ToHost/Sterilizer/stats"
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("--broker", default="10.1.10.55")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--rate", type=float, default=200, help="flood messages per second")
+    parser.add_argument("--seconds", type=float, default=10, help="length of the flood")
+    parser.add_argument("--probe-interval", type=float, default=0.25, help="seconds between reset probes")
+    parser.add_argument("--flood", default="brightness 120", help="payload used for the flood")
+    args = parser.parse_args()
+
+    sent = {}
+    latencies = []
+    stats = []
+    lock = threading.Lock()
+
+    def on_message(client, userdata, message):
+        payload = message.payload.decode(errors="replace")
+        now = time.monotonic()
+        if message.topic == STATS_TOPIC:
+            stats.append(payload)
+            return
+        words = payload.split()
+        if len(words) >= 4 and words[0] == "ack" and words[1].startswith("flood"):
+            with lock:
+                start = sent.pop(words[1], None)
+            if start is not None:
+                latencies.append(now - start)
+
+    client = mqtt.Client(client_id="SterilizerFloodTest")
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.subscribe([(HOST_TOPIC, 0), (STATS_TOPIC, 0)])
+    client.loop_start()
+
+    flood_count = 0
+    probe_count = 0
+    start = time.monotonic()
+    next_probe = start
+    while time.monotonic() - start < args.seconds:
+        now = time.monotonic()
+        if now >= next_probe:
+            request_id = "flood%d" % probe_count
+            with lock:
+                sent[request_id] = now
+            client.publish(DEVICE_TOPIC, "reset id=%s" % request_id)
+            probe_count += 1
+            next_probe += args.probe_interval
+        client.publish(DEVICE_TOPIC, args.flood)
+        flood_count += 1
+        time.sleep(max(0.0, start + flood_count / args.rate - time.monotonic()))
+
+    # Give the device time to drain its queue before asking for its counters
+    time.sleep(2)
+    client.publish(DEVICE_TOPIC, "stats")
+    time.sleep(1)
+    client.loop_stop()
+
+    print("flood: %d messages at %.0f/s, %d probes" % (flood_count, args.rate, probe_count))
+    if latencies:
+        ms = [1000 * latency for latency in latencies]
+        print("probe ack latency ms: min %.1f  median %.1f  p95 %.1f  max %.1f" %
+              (min(ms), statistics.median(ms), percentile(ms, 0.95), max(ms)))
+    print("probes lost: %d" % len(sent))
+    for line in stats:
+        print("device: " + line)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""
+Benchmark the prop's HTTP status endpoint
+
+Fetches /metrics and /state from a prop a number of times, one request
+at a time, and reports the time each took from the host's side. Then it
+prints what the prop measured for itself on the last /metrics page:
+
+- sterilizer_http_serve_us is the time the server task spent on each
+  request.
+- sterilizer_http_snapshot_us is the time loop() spent formatting each
+  page.
+
+The snapshot time is all a scrape costs the puzzle.
+
+Usage: http_bench.py [--count 100] [--interval 0.1] 10.1.10.80
+
+Needs only the Python standard library.
+"""
+
+import argparse
+import time
+import urllib.request
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def fetch(url, timeout):
+    started = time.monotonic()
+    with urllib.request.urlopen(url, timeout=timeout) as response:
+        body = response.read()
+    return (time.monotonic() - started) * 1000, body
+
+
+def report(path, times, sizes, failures):
+    print("%s: %d ok, %d failed" % (path, len(times), failures))
+    if times:
+        print("  ms      min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f" %
+              (min(times), percentile(times, 0.5), percentile(times, 0.9), percentile(times, 0.99), max(times)))
+        print("  bytes   %d..%d" % (min(sizes), max(sizes)))
+
+
+def device_histograms(metrics):
+    """Print the prop's own serve and snapshot histograms from a /metrics page."""
+    for line in metrics.decode(errors="replace").splitlines():
+        if line.startswith(("sterilizer_http_serve_us", "sterilizer_http_snapshot_us")):
+            print("  " + line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("host", help="the prop's address")
+    parser.add_argument("--count", type=int, default=100, help="requests per page")
+    parser.add_argument("--interval", type=float, default=0.1, help="seconds between requests")
+    parser.add_argument("--timeout", type=float, default=5.0)
+    args = parser.parse_args()
+
+    last_metrics = b""
+    for path in ("/metrics", "/state"):
+        times = []
+        sizes = []
+        failures = 0
+        for _ in range(args.count):
+            try:
+                elapsed, body = fetch("http://%s%s" % (args.host, path), args.timeout)
+            except OSError:
+                failures += 1
+                continue
+            times.append(elapsed)
+            sizes.append(len(body))
+            if path == "/metrics":
+                last_metrics = body
+            time.sleep(args.interval)
+        report(path, times, sizes, failures)
+
+    if last_metrics:
+        print("measured on the prop:")
+        device_histograms(last_metrics)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""
+Capture live MQTT traffic as a simulator scenario
+
+Taps the broker during a real game and writes every command sent to the
+props as a timed "publish" line of a simulator scenario (see
+sim/scenario.h), so the game can be replayed against a new firmware
+build. What the props sent back is kept as comments for reference. The
+capture ends with Ctrl-C and an "end" line one second after the last
+message.
+
+Usage: mqtt_capture.py [--broker 10.1.10.55] [--output game.txt] [topic filters...]
+
+Topic filters default to ToDevice/Sterilizer and ToHost/Sterilizer/#.
+Requires paho-mqtt (pip install paho-mqtt).
+"""
+
+import argparse
+import datetime
+import sys
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("filters", nargs="*", default=["ToDevice/Sterilizer", "ToHost/Sterilizer/#"])
+    parser.add_argument("--broker", default="10.1.10.55")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--output", default="-", help="scenario file to write (default stdout)")
+    parser.add_argument("--offset", type=float, default=10000,
+                        help="ms added to every time, leaving the replayed device time to boot")
+    args = parser.parse_args()
+
+    output = sys.stdout if args.output == "-" else open(args.output, "w")
+    lock = threading.Lock()
+    started = time.monotonic()
+    last = [0.0]
+
+    output.write("# Captured from %s on %s\n" % (args.broker, datetime.datetime.now().isoformat(timespec="seconds")))
+    output.write("# Filters: %s\n" % " ".join(args.filters))
+
+    def on_message(client, userdata, message):
+        at = args.offset + (time.monotonic() - started) * 1000
+        payload = message.payload.decode(errors="replace").replace("\n", " ")
+        with lock:
+            last[0] = at
+            if message.topic.startswith("ToDevice/"):
+                verb = "retain" if message.retain else "publish"
+                output.write("%.1f %s %s %s\n" % (at, verb, message.topic, payload))
+            else:
+                output.write("# %.1f device %s %s\n" % (at, message.topic, payload))
+            output.flush()
+
+    client = mqtt.Client(client_id="SterilizerCapture")
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.subscribe([(topic_filter, 0) for topic_filter in args.filters])
+    print("capturing, Ctrl-C to stop", file=sys.stderr)
+    try:
+        client.loop_forever()
+    except KeyboardInterrupt:
+        pass
+    with lock:
+        output.write("%.1f end\n" % (last[0] + 1000))
+    if output is not sys.stdout:
+        output.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""
+Upload a file or a batch of settings to a Sterilizer over MQTT
+
+Sends the file in numbered chunks with "upload begin" and "chunk <seq>"
+(see src/upload.h), keeping --window chunks in flight and going back when
+the prop asks for a resend. If the connection drops the upload is picked
+up where the prop left off once the client reconnects. The target is a
+LittleFS path, for example /index.html.gz, or "config" for a file of
+"<setting> <value>" lines (see src/config.h).
+
+Prints the prop's own figures for the upload (time, rate, RAM and the
+lowest free heap) and the rate seen from the host.
+
+Usage:
+  mqtt_upload.py [--broker 10.1.10.55] [--window 16] /index.html.gz data/index.html.gz
+  mqtt_upload.py config settings.txt
+
+Requires paho-mqtt (pip install paho-mqtt).
+"""
+
+import argparse
+import queue
+import re
+import sys
+import time
+import zlib
+
+import paho.mqtt.client as mqtt
+
+DEVICE_TOPIC = "ToDevice/Sterilizer"
+HOST_TOPIC = "ToHost/Sterilizer"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("target", help='LittleFS path on the prop, or "config"')
+    parser.add_argument("file", help="file to send")
+    parser.add_argument("--broker", default="10.1.10.55")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--window", type=int, default=16, help="chunks in flight")
+    parser.add_argument("--timeout", type=float, default=3.0, help="seconds without progress before asking where it is")
+    parser.add_argument("--retries", type=int, default=5, help="timeouts in a row before giving up")
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as source:
+        data = source.read()
+    if not data:
+        sys.exit("nothing to send")
+    begin = "upload begin %s %d %08x" % (args.target, len(data), zlib.crc32(data))
+
+    replies = queue.Queue()
+
+    def on_connect(client, userdata, flags, rc):
+        client.subscribe(HOST_TOPIC)
+        # Also how an upload is resumed after the connection dropped
+        client.publish(DEVICE_TOPIC, begin)
+
+    def on_message(client, userdata, message):
+        text = message.payload.decode(errors="replace")
+        if text.startswith("upload "):
+            replies.put(text)
+
+    client = mqtt.Client(client_id="SterilizerUpload")
+    client.on_connect = on_connect
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.loop_start()
+
+    chunk_size = None
+    chunks = 0
+    acked = 0           # chunks the prop has confirmed
+    position = 0        # next chunk to send
+    sent = 0
+    timeouts = 0
+    started = time.monotonic()
+    while True:
+        # Keep the window full
+        while chunk_size is not None and position < chunks and position < acked + args.window:
+            piece = data[position * chunk_size:(position + 1) * chunk_size]
+            client.publish(DEVICE_TOPIC, b"chunk %d " % position + piece)
+            position += 1
+            sent += 1
+
+        try:
+            line = replies.get(timeout=args.timeout)
+        except queue.Empty:
+            timeouts += 1
+            if timeouts > args.retries:
+                sys.exit("no answer from the prop")
+            client.publish(DEVICE_TOPIC, "upload status" if chunk_size else begin)
+            continue
+        timeouts = 0
+
+        words = line.split()
+        fields = dict(word.split("=", 1) for word in words if "=" in word)
+        if words[1] == "ready":
+            chunk_size = int(fields["chunk"])
+            chunks = (len(data) + chunk_size - 1) // chunk_size
+            acked = position = int(fields["next"])
+        elif words[1].startswith("next="):
+            acked = max(acked, int(fields["next"]))
+        elif words[1].startswith("resend="):
+            acked = position = int(fields["resend"])
+        elif words[1] == "done":
+            break
+        elif words[1] == "failed":
+            sys.exit(line)
+        elif words[1] == "idle":
+            # The prop restarted, or the upload was replaced; start again
+            client.publish(DEVICE_TOPIC, begin)
+            chunk_size = None
+        if chunks:
+            print("\r%d / %d chunks" % (acked, chunks), end="", flush=True)
+
+    seconds = time.monotonic() - started
+    client.loop_stop()
+    print("\r%s" % line)
+    print("host: %d bytes in %.2f s, %.0f bytes/s, %d chunks sent for %d" %
+          (len(data), seconds, len(data) / seconds, sent, chunks))
+    match = re.search(r"\bheap=(\d+)", line)
+    if match:
+        print("prop: lowest free heap %s bytes during the upload" % match.group(1))
+
+
+if __name__ == "__main__":
+    main()
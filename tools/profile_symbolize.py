@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+"""
+Flat profile from a Sterilizer sampling profiler dump
+
+Reads the "prof ..." lines published on ToHost/Sterilizer/profile, looks
+each sampled program counter up in the firmware's ELF file with
+xtensa-esp32-elf-addr2line, and prints the functions that were running
+most often.
+
+The dump can be read from a file holding the message payloads, one per
+line (for example captured with mosquitto_sub -t ToHost/Sterilizer/profile),
+or fetched directly from the device with --broker, which sends
+"profile dump" and collects the reply.
+
+Usage:
+  profile_symbolize.py --elf .pio/build/nodemcu-32s/firmware.elf dump.txt
+  profile_symbolize.py --elf .pio/build/nodemcu-32s/firmware.elf --broker 10.1.10.55
+"""
+
+import argparse
+import collections
+import subprocess
+import sys
+import time
+
+DEVICE_TOPIC = "ToDevice/Sterilizer"
+PROFILE_TOPIC = "ToHost/Sterilizer/profile"
+
+
+def fetch_dump(broker, port, timeout):
+    import paho.mqtt.client as mqtt
+
+    lines = []
+    done = []
+
+    def on_message(client, userdata, message):
+        line = message.payload.decode(errors="replace")
+        lines.append(line)
+        if line == "prof end":
+            done.append(True)
+
+    client = mqtt.Client(client_id="ProfileSymbolizer")
+    client.on_message = on_message
+    client.connect(broker, port)
+    client.subscribe(PROFILE_TOPIC)
+    client.loop_start()
+    time.sleep(0.5)
+    client.publish(DEVICE_TOPIC, "profile dump")
+    deadline = time.monotonic() + timeout
+    while not done and time.monotonic() < deadline:
+        time.sleep(0.1)
+    client.loop_stop()
+    if not done:
+        sys.exit("timed out waiting for the end of the dump")
+    return lines
+
+
+def parse_dump(lines):
+    """Return (header fields, list of PCs) from the dump lines."""
+    header = {}
+    samples = {}
+    for line in lines:
+        words = line.split()
+        if len(words) < 2 or words[0] != "prof":
+            continue
+        if words[1] == "begin":
+            header = dict(word.split("=", 1) for word in words[2:] if "=" in word)
+        elif words[1] != "end":
+            index = int(words[1])
+            for offset, pc in enumerate(words[2:]):
+                samples[index + offset] = int(pc, 16)
+    expected = int(header.get("n", len(samples)))
+    if len(samples) != expected:
+        print("warning: %d of %d samples received" % (len(samples), expected), file=sys.stderr)
+    return header, [samples[index] for index in sorted(samples)]
+
+
+def symbolize(addr2line, elf, pcs):
+    """Map each distinct PC to (function, file:line)."""
+    unique = sorted(set(pcs))
+    output = subprocess.run([addr2line, "-f", "-C", "-e", elf] + ["0x%08x" % pc for pc in unique],
+                            check=True, capture_output=True, text=True).stdout.splitlines()
+    symbols = {}
+    for pc, function, location in zip(unique, output[0::2], output[1::2]):
+        symbols[pc] = (function, location)
+    return symbols
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("dump", nargs="?", help="file with the dump messages, one per line")
+    parser.add_argument("--elf", required=True, help="firmware.elf of the build that produced the dump")
+    parser.add_argument("--addr2line", default="xtensa-esp32-elf-addr2line")
+    parser.add_argument("--broker", help="fetch the dump from the device through this broker")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--timeout", type=float, default=60)
+    parser.add_argument("--lines", action="store_true", help="also list the hottest source lines")
+    parser.add_argument("--top", type=int, default=30)
+    args = parser.parse_args()
+
+    if args.broker:
+        lines = fetch_dump(args.broker, args.port, args.timeout)
+    elif args.dump:
+        with open(args.dump) as dump:
+            lines = dump.read().splitlines()
+    else:
+        parser.error("give a dump file or --broker")
+
+    header, pcs = parse_dump(lines)
+    if not pcs:
+        sys.exit("no samples in the dump")
+    symbols = symbolize(args.addr2line, args.elf, pcs)
+
+    functions = collections.Counter(symbols[pc][0] for pc in pcs)
+    total = len(pcs)
+    print("%d samples at %s Hz, %s dropped" % (total, header.get("hz", "?"), header.get("dropped", "?")))
+    print("%8s %7s  %s" % ("samples", "self%", "function"))
+    for function, count in functions.most_common(args.top):
+        print("%8d %6.1f%%  %s" % (count, 100.0 * count / total, function))
+
+    if args.lines:
+        print()
+        locations = collections.Counter(symbols[pc][1] for pc in pcs)
+        for location, count in locations.most_common(args.top):
+            print("%8d %6.1f%%  %s" % (count, 100.0 * count / total, location))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""
+Round trip time probe for MQTT props
+
+Sends "ping <token>" to ToDevice/<prop> for each prop named on the command
+line and times the "pong" that comes back on ToHost/<prop>, giving the
+host -> broker -> prop -> broker -> host latency seen by the game. The
+pong also carries the prop's micros() at receive, dispatch and publish,
+which splits each round trip into time spent on the prop and time spent
+on the network and broker, the WiFi link profile the prop was in and
+the MQTT transport it was built with (src/transport.h). Results are
+reported per prop, link profile and transport, with the rate replies came
+back at; with --interval 0 the probes go out back to back and that rate
+is the throughput of the round trip.
+
+With --command the probes are that command instead, sent as
+"<command> id=<n>" and timed to its "ack <n>", so they take the command
+queue as the game's commands do. Pick one that is a no-op in the prop's
+state ("reset" while it is armed) or harmless, and mind the rate limit of
+5 cosmetic commands a second. Run the same probe against a build of each
+transport to compare them.
+
+With --profiles the probes are repeated with each prop held in each of
+the named link profiles ("link <profile>"), then returned to "link auto";
+read a current meter during each round to pair latency with power.
+
+Usage: rtt_probe.py [--broker 10.1.10.55] [--count 200] [--interval 0.05]
+                    [--profiles game,attract,overnight] [--command reset]
+                    Sterilizer [OtherProp ...]
+
+Requires paho-mqtt (pip install paho-mqtt).
+"""
+
+import argparse
+import collections
+import random
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+# Upper bounds (ms) of the histogram buckets; the last bucket is open ended
+BUCKETS_MS = [1, 2, 5, 10, 20, 50, 100, 200, 500, 1000]
+
+
+def percentile(values, fraction):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(fraction * len(ordered)))]
+
+
+def parse_ack(payload):
+    """Return the request ID of an acknowledgment, or None."""
+    words = payload.split()
+    if len(words) < 4 or words[0] != "ack":
+        return None
+    return words[1]
+
+
+def parse_pong(payload):
+    """Return (token, {field: int or str}) for a pong message, or None."""
+    words = payload.split()
+    if len(words) < 2 or words[0] != "pong":
+        return None
+    fields = {}
+    for word in words[2:]:
+        key, _, value = word.partition("=")
+        fields[key] = int(value) if value.isdigit() else value
+    return words[1], fields
+
+
+def report(name, rtts, on_device, lost, span):
+    print("%s: %d replies, %d lost" % (name, len(rtts), lost))
+    if not rtts:
+        return
+    if span:
+        print("  rate     %.1f replies/s over %.2f s" % (len(rtts) / span, span))
+    print("  rtt ms   min %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f" %
+          (min(rtts), percentile(rtts, 0.5), percentile(rtts, 0.9), percentile(rtts, 0.99), max(rtts)))
+    if on_device:
+        print("  on prop  p50 %.3f  p99 %.3f  (receive to publish)" %
+              (percentile(on_device, 0.5), percentile(on_device, 0.99)))
+    lower = 0
+    for upper in BUCKETS_MS + [None]:
+        count = sum(1 for rtt in rtts if rtt >= lower and (upper is None or rtt < upper))
+        label = "%4d+ ms" % lower if upper is None else "%4d-%d ms" % (lower, upper)
+        print("  %-12s %5d %s" % (label, count, "#" * (60 * count // len(rtts))))
+        lower = upper
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("props", nargs="+", help="prop names, as used in ToDevice/<prop>")
+    parser.add_argument("--broker", default="10.1.10.55")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--count", type=int, default=200, help="probes per prop")
+    parser.add_argument("--interval", type=float, default=0.05, help="seconds between probes")
+    parser.add_argument("--timeout", type=float, default=2.0, help="seconds to wait for late replies")
+    parser.add_argument("--profiles", help="comma-separated link profiles to hold the props in, one round each")
+    parser.add_argument("--settle", type=float, default=2.0, help="seconds to wait after switching profile")
+    parser.add_argument("--command", help="time this command's acknowledgment instead of a ping")
+    args = parser.parse_args()
+
+    pending = {}
+    # Keyed by (prop, link profile, transport); a command's ack carries neither, so the last pong's are used
+    rtts = collections.defaultdict(list)
+    on_device = collections.defaultdict(list)
+    first_sent = {}
+    last_received = {}
+    seen = {}
+    lock = threading.Lock()
+
+    def on_message(client, userdata, message):
+        received = time.monotonic_ns()
+        payload = message.payload.decode(errors="replace")
+        pong = parse_pong(payload)
+        if pong is not None:
+            token, fields = pong
+        else:
+            token, fields = parse_ack(payload), None
+        if token is None:
+            return
+        with lock:
+            entry = pending.pop(token, None)
+        if entry is None:
+            return
+        prop, sent = entry
+        with lock:
+            if fields is not None:
+                seen[prop] = (str(fields.get("link", "-")), str(fields.get("mqtt", "-")))
+            key = (prop,) + seen.get(prop, ("-", "-"))
+            rtts[key].append((received - sent) / 1e6)
+            first_sent.setdefault(key, sent)
+            last_received[key] = received
+            if fields and isinstance(fields.get("rx"), int) and isinstance(fields.get("tx"), int):
+                on_device[key].append(((fields["tx"] - fields["rx"]) & 0xFFFFFFFF) / 1e3)
+
+    client = mqtt.Client(client_id="RttProbe")
+    client.on_message = on_message
+    client.connect(args.broker, args.port)
+    client.subscribe([("ToHost/%s" % prop, 0) for prop in args.props])
+    client.loop_start()
+    time.sleep(0.5)
+
+    if args.command:
+        # One ping each first, to learn the link profile and transport the acks are filed under
+        for prop in args.props:
+            with lock:
+                pending["learn"] = (prop, time.monotonic_ns())
+            client.publish("ToDevice/%s" % prop, "ping learn")
+            time.sleep(args.settle)
+        with lock:
+            rtts.clear()
+            on_device.clear()
+            first_sent.clear()
+            last_received.clear()
+
+    run = "%04x" % random.randrange(0x10000)
+    probes = 0
+    rounds = args.profiles.split(",") if args.profiles else [None]
+    for profile in rounds:
+        if profile is not None:
+            print("holding %s in link profile %s" % (", ".join(args.props), profile))
+            for prop in args.props:
+                client.publish("ToDevice/%s" % prop, "link %s" % profile)
+            time.sleep(args.settle)
+        for sequence in range(args.count):
+            for prop in args.props:
+                sent = time.monotonic_ns()
+                # Request IDs are at most 16 characters, and must not repeat or the prop answers "dup"
+                probes += 1
+                token = "%s-%d" % (run, probes) if args.command else "%d" % sent
+                with lock:
+                    pending[token] = (prop, sent)
+                if args.command:
+                    client.publish("ToDevice/%s" % prop, "%s id=%s" % (args.command, token))
+                else:
+                    client.publish("ToDevice/%s" % prop, "ping %s" % token)
+            time.sleep(args.interval)
+        time.sleep(args.timeout)
+
+    if args.profiles:
+        for prop in args.props:
+            client.publish("ToDevice/%s" % prop, "link auto")
+    client.loop_stop()
+
+    for prop in args.props:
+        lost = sum(1 for owner, _ in pending.values() if owner == prop)
+        keys = sorted(key for key in rtts if key[0] == prop)
+        if not keys:
+            report(prop, [], [], lost, 0)
+        for key in keys:
+            span = (last_received[key] - first_sent[key]) / 1e9
+            report("%s link=%s mqtt=%s" % key, rtts[key], on_device[key], lost, span)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""
+Convert a Sterilizer trace dump to Chrome trace JSON
+
+Accepts the binary dump written by the native simulator, the "trace ..."
+messages published on ToHost/Sterilizer/trace saved one per line (for
+example with mosquitto_sub -t ToHost/Sterilizer/trace), or fetches a dump
+straight from the device with --broker. The output opens in
+chrome://tracing and https://ui.perfetto.dev.
+
+Dumps from props whose clocks were synchronized with the host (format
+version 2, src/clocksync.h) are put on the host's clock, so several
+props' dumps given together line up on one timeline, one process each.
+Other dumps keep the prop's own micros().
+
+Usage:
+  trace2chrome.py trace.bin -o trace.json
+  trace2chrome.py sterilizer.txt cabinet.txt -o room.json
+  trace2chrome.py --broker 10.1.10.55 -o trace.json
+"""
+
+import argparse
+import base64
+import json
+import struct
+import sys
+import time
+
+DEVICE_TOPIC = "ToDevice/Sterilizer"
+TRACE_TOPIC = "ToHost/Sterilizer/trace"
+
+# Thread lanes in the viewer, by event name
+LANES = {"solve": 1, "flames": 1, "sweep": 1, "reset": 1, "command": 1,
+         "led show": 2, "mqtt loop": 3, "relay": 4}
+LANE_NAMES = {1: "puzzle", 2: "leds", 3: "network", 4: "relays"}
+
+
+def fetch_dump(broker, port, timeout):
+    import paho.mqtt.client as mqtt
+
+    lines = []
+    done = []
+
+    def on_message(client, userdata, message):
+        line = message.payload.decode(errors="replace")
+        lines.append(line)
+        if line == "trace end":
+            done.append(True)
+
+    client = mqtt.Client(client_id="TraceFetch")
+    client.on_message = on_message
+    client.connect(broker, port)
+    client.subscribe(TRACE_TOPIC)
+    client.loop_start()
+    time.sleep(0.5)
+    client.publish(DEVICE_TOPIC, "trace dump")
+    deadline = time.monotonic() + timeout
+    while not done and time.monotonic() < deadline:
+        time.sleep(0.1)
+    client.loop_stop()
+    if not done:
+        sys.exit("timed out waiting for the end of the dump")
+    return lines
+
+
+def join_messages(lines):
+    """Reassemble the binary dump from "trace <offset> <base64>" messages."""
+    chunks = {}
+    for line in lines:
+        words = line.split()
+        if len(words) == 3 and words[0] == "trace" and words[1].isdigit():
+            chunks[int(words[1])] = base64.b64decode(words[2])
+    dump = bytearray()
+    for offset in sorted(chunks):
+        if offset != len(dump):
+            sys.exit("dump is missing bytes at offset %d" % len(dump))
+        dump += chunks[offset]
+    return bytes(dump)
+
+
+def parse_dump(dump):
+    """Return (event names, [(time, kind, event, arg)], clock anchor) from a binary dump.
+
+    The anchor is (micros(), Unix microseconds, drift in ppb), or None when
+    the prop's clock was not synchronized.
+    """
+    if dump[:4] != b"STRC":
+        sys.exit("not a Sterilizer trace dump")
+    version, name_count = struct.unpack_from("<HH", dump, 4)
+    if version not in (1, 2):
+        sys.exit("unsupported trace format version %d" % version)
+    offset = 8
+    names = []
+    for _ in range(name_count):
+        end = dump.index(b"\0", offset)
+        names.append(dump[offset:end].decode())
+        offset = end + 1
+    anchor = None
+    if version >= 2:
+        anchor = struct.unpack_from("<IQi", dump, offset)
+        offset += 16
+        if anchor[1] == 0:
+            anchor = None
+    (count,) = struct.unpack_from("<I", dump, offset)
+    offset += 4
+    records = [struct.unpack_from("<IBBH", dump, offset + 8 * i) for i in range(count)]
+    return names, records, anchor
+
+
+def to_chrome(names, records, anchor=None, pid=1, process=None):
+    events = []
+    if process:
+        events.append({"name": "process_name", "ph": "M", "pid": pid, "args": {"name": process}})
+    for lane, name in LANE_NAMES.items():
+        events.append({"name": "thread_name", "ph": "M", "pid": pid, "tid": lane, "args": {"name": name}})
+
+    # micros() wraps every 71 minutes; records are oldest first, so unwrap as we go.
+    # On the host's clock, a record is timed from the anchor, correcting for the drift.
+    base = 0
+    previous = None
+    for time_us, kind, event, arg in records:
+        if anchor is not None:
+            local_us, synced_us, drift_ppb = anchor
+            since = (time_us - local_us + (1 << 31)) % (1 << 32) - (1 << 31)
+            ts = synced_us + since + round(since * drift_ppb / 1e9)
+        else:
+            if previous is not None and time_us < previous:
+                base += 1 << 32
+            previous = time_us
+            ts = base + time_us
+        name = names[event] if event < len(names) else "event %d" % event
+        entry = {"name": name, "pid": pid, "tid": LANES.get(name, 5), "ts": ts}
+        if kind == ord("I"):
+            entry["ph"] = "i"
+            entry["s"] = "t"
+        else:
+            entry["ph"] = chr(kind)
+        if name == "relay":
+            entry["args"] = {"pin": arg >> 8, "level": arg & 0xFF}
+        elif arg:
+            entry["args"] = {"arg": arg}
+        events.append(entry)
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    parser.add_argument("dump", nargs="*", help="binary dumps, or saved trace messages one per line")
+    parser.add_argument("-o", "--output", default="-", help="JSON file to write (default stdout)")
+    parser.add_argument("--broker", help="fetch the dump from the device through this broker")
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--timeout", type=float, default=60)
+    args = parser.parse_args()
+
+    dumps = []
+    if args.broker:
+        dumps.append(("Sterilizer", join_messages(fetch_dump(args.broker, args.port, args.timeout))))
+    elif args.dump:
+        for path in args.dump:
+            with open(path, "rb") as source:
+                dump = source.read()
+            if not dump.startswith(b"STRC"):
+                dump = join_messages(dump.decode(errors="replace").splitlines())
+            dumps.append((path, dump))
+    else:
+        parser.error("give a dump file or --broker")
+
+    trace = {"traceEvents": [], "displayTimeUnit": "ms"}
+    total = 0
+    for pid, (process, dump) in enumerate(dumps, 1):
+        names, records, anchor = parse_dump(dump)
+        if anchor is None and len(dumps) > 1:
+            print("%s: clock not synchronized, its times will not line up" % process, file=sys.stderr)
+        trace["traceEvents"] += to_chrome(names, records, anchor, pid, process if len(dumps) > 1 else None)["traceEvents"]
+        total += len(records)
+    if args.output == "-":
+        json.dump(trace, sys.stdout)
+    else:
+        with open(args.output, "w") as output:
+            json.dump(trace, output)
+        print("%d events written to %s" % (total, args.output), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,44 @@
+"""
+Gzips the web panel's files from web/ into data/ for the LittleFS image
+
+PlatformIO runs this before every build of [env:nodemcu-32s]; only files
+that changed are compressed again. "pio run -t uploadfs" then writes data/
+to the prop. Run it by hand for the simulator, which serves data/ from its
+working directory:
+
+    python3 web/gzip_assets.py
+
+Needs only the Python standard library.
+"""
+
+import gzip
+import os
+
+EXTENSIONS = (".html", ".js", ".css", ".svg", ".ico", ".json")
+
+
+def compress(web_dir, data_dir):
+    os.makedirs(data_dir, exist_ok=True)
+    for name in sorted(os.listdir(web_dir)):
+        if not name.endswith(EXTENSIONS):
+            continue
+        source = os.path.join(web_dir, name)
+        target = os.path.join(data_dir, name + ".gz")
+        if os.path.exists(target) and os.path.getmtime(target) >= os.path.getmtime(source):
+            continue
+        with open(source, "rb") as f:
+            data = f.read()
+        # No timestamp in the header, so an unchanged file makes the same image
+        with open(target, "wb") as f:
+            f.write(gzip.compress(data, compresslevel=9, mtime=0))
+        print("web: %s %d -> %d bytes" % (name, len(data), os.path.getsize(target)))
+
+
+try:
+    # As a PlatformIO extra script, where __file__ is not set
+    Import("env")
+    project_dir = env["PROJECT_DIR"]
+except NameError:
+    project_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+compress(os.path.join(project_dir, "web"), os.path.join(project_dir, "data"))